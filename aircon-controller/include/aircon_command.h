@@ -0,0 +1,76 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stdint.h>
+
+// Hardware-independent half of the aircon node: the requested state and
+// its parsing, change detection against the last transmitted state, slider
+// burst coalescing and command ordering. main.cpp maps the state onto the
+// Mitsubishi IR protocol.
+
+enum AirconMode : uint8_t {
+  AIRCON_MODE_AUTO,
+  AIRCON_MODE_COOL,
+  AIRCON_MODE_DRY,
+  AIRCON_MODE_HEAT,
+  AIRCON_MODE_FAN,
+};
+
+#define AIRCON_MIN_TEMP 16
+#define AIRCON_MAX_TEMP 31
+// Fan speeds are 1-AIRCON_MAX_FAN_SPEED, or AIRCON_FAN_AUTO.
+#define AIRCON_FAN_AUTO 0
+#define AIRCON_MAX_FAN_SPEED 5
+
+struct AirconState {
+  bool power;
+  uint8_t mode;
+  uint8_t temperature;
+  uint8_t fan;
+  bool swing;
+};
+
+const char* modeToString(uint8_t mode);
+bool parseMode(const char* name, uint8_t& mode);
+bool parsePower(JsonVariantConst value, bool& power);
+
+// Equal as far as the unit is concerned: settings changed while it is off
+// are applied with the next ON.
+bool sameAirconState(const AirconState& a, const AirconState& b);
+
+// Accepts the legacy "ON"/"OFF" string or an object with any of power,
+// mode, temperature, fan ("auto" or 1-5) and swing. Returns whether any
+// field was understood.
+bool applyAirconMessage(JsonVariantConst message, AirconState& state);
+
+// Slider drags arrive as a burst of commands; a burst is due once it has
+// been quiet for `windowMs`, or `maxDelayMs` after it started at the latest.
+struct CommandCoalescer {
+  unsigned long windowMs;
+  unsigned long maxDelayMs;
+  bool pending;
+  unsigned long firstAt;
+  unsigned long lastAt;
+
+  void note(unsigned long now);
+  bool due(unsigned long now) const;
+};
+
+enum CommandVerdict : uint8_t {
+  COMMAND_ACCEPTED,
+  COMMAND_STALE,     // outside the freshness window, or no timestamp
+  COMMAND_REPLAYED,  // not newer than the last accepted command
+};
+
+// Last accepted command, ordered by (timestamp, seq). Retained messages and
+// QoS 1 redeliveries replay an already-seen key and are dropped.
+struct CommandOrder {
+  int64_t timeMs;
+  uint32_t seq;
+};
+
+// Accepts a command stamped `timeMs` within `thresholdSeconds` of `nowMs`
+// and newer than `last`, which it then advances. `timeMs` is 0 for a
+// missing or unparseable timestamp.
+CommandVerdict checkCommand(CommandOrder& last, int64_t timeMs, uint32_t seq,
+                            int64_t nowMs, int thresholdSeconds);
@@ -0,0 +1,139 @@
+#include "aircon_command.h"
+
+#include <string.h>
+
+namespace {
+struct NamedValue {
+  const char* name;
+  uint8_t value;
+};
+
+const NamedValue AIRCON_MODES[] = {
+  {"auto", AIRCON_MODE_AUTO},
+  {"cool", AIRCON_MODE_COOL},
+  {"dry", AIRCON_MODE_DRY},
+  {"heat", AIRCON_MODE_HEAT},
+  {"fan", AIRCON_MODE_FAN},
+};
+
+int clampInt(int value, int low, int high) {
+  return value < low ? low : (value > high ? high : value);
+}
+}  // namespace
+
+const char* modeToString(uint8_t mode) {
+  for (const NamedValue& entry : AIRCON_MODES) {
+    if (entry.value == mode) {
+      return entry.name;
+    }
+  }
+  return "unknown";
+}
+
+bool parseMode(const char* name, uint8_t& mode) {
+  if (!name) {
+    return false;
+  }
+  for (const NamedValue& entry : AIRCON_MODES) {
+    if (strcmp(entry.name, name) == 0) {
+      mode = entry.value;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool parsePower(JsonVariantConst value, bool& power) {
+  if (value.is<bool>()) {
+    power = value.as<bool>();
+    return true;
+  }
+  const char* text = value.as<const char*>();
+  if (!text) {
+    return false;
+  }
+  if (strcmp(text, "ON") == 0) {
+    power = true;
+    return true;
+  }
+  if (strcmp(text, "OFF") == 0) {
+    power = false;
+    return true;
+  }
+  return false;
+}
+
+bool sameAirconState(const AirconState& a, const AirconState& b) {
+  if (a.power != b.power) {
+    return false;
+  }
+  if (!a.power) {
+    return true;
+  }
+  return a.mode == b.mode && a.temperature == b.temperature &&
+         a.fan == b.fan && a.swing == b.swing;
+}
+
+bool applyAirconMessage(JsonVariantConst message, AirconState& state) {
+  if (message.is<const char*>()) {
+    return parsePower(message, state.power);
+  }
+  if (!message.is<JsonObjectConst>()) {
+    return false;
+  }
+
+  bool changed = false;
+  if (!message["power"].isNull()) {
+    changed |= parsePower(message["power"], state.power);
+  }
+  if (!message["mode"].isNull()) {
+    changed |= parseMode(message["mode"].as<const char*>(), state.mode);
+  }
+  if (message["temperature"].is<int>()) {
+    state.temperature = clampInt(message["temperature"].as<int>(),
+                                 AIRCON_MIN_TEMP, AIRCON_MAX_TEMP);
+    changed = true;
+  }
+  if (message["fan"].is<int>()) {
+    state.fan = clampInt(message["fan"].as<int>(), 1, AIRCON_MAX_FAN_SPEED);
+    changed = true;
+  } else if (message["fan"].is<const char*>() &&
+             strcmp(message["fan"].as<const char*>(), "auto") == 0) {
+    state.fan = AIRCON_FAN_AUTO;
+    changed = true;
+  }
+  if (message["swing"].is<bool>()) {
+    state.swing = message["swing"].as<bool>();
+    changed = true;
+  }
+  return changed;
+}
+
+void CommandCoalescer::note(unsigned long now) {
+  if (!pending) {
+    pending = true;
+    firstAt = now;
+  }
+  lastAt = now;
+}
+
+bool CommandCoalescer::due(unsigned long now) const {
+  return pending &&
+         (now - lastAt >= windowMs || now - firstAt >= maxDelayMs);
+}
+
+CommandVerdict checkCommand(CommandOrder& last, int64_t timeMs, uint32_t seq,
+                            int64_t nowMs, int thresholdSeconds) {
+  const int64_t skewMs = nowMs - timeMs;
+  if (timeMs == 0 || skewMs > thresholdSeconds * 1000LL ||
+      skewMs < -thresholdSeconds * 1000LL) {
+    return COMMAND_STALE;
+  }
+  const bool newer = timeMs != last.timeMs ? timeMs > last.timeMs
+                                           : seq > last.seq;
+  if (!newer) {
+    return COMMAND_REPLAYED;
+  }
+  last = {timeMs, seq};
+  return COMMAND_ACCEPTED;
+}
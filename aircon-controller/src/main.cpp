@@ -6,7 +6,16 @@
 #include <IRremoteESP8266.h>
 #include <IRsend.h>
 #include <ir_Mitsubishi.h>
+#include <arena_allocator.h>
+#include <connectivity.h>
+#include <device_log.h>
+#include <device_time.h>
+#include <json_publish.h>
+#include <mqtt_topics.h>
+#include <ota_update.h>
 #include <secrets.h>
+#include <time.h>
+#include "aircon_command.h"
 
 const char* ssid = WIFI_SSID;
 const char* password = WIFI_PASSWORD;
@@ -15,11 +24,54 @@ const char* mqtt_server = MQTT_SERVER;
 const int mqtt_port = MQTT_PORT;
 const char* mqtt_user = MQTT_USERNAME;
 const char* mqtt_pass = MQTT_PASSWORD;
+#ifdef MQTT_CA_CERT
+const char* mqtt_ca_cert = MQTT_CA_CERT;
+#else
+const char* mqtt_ca_cert = nullptr;
+#endif
+#ifdef OTA_CA_CERT
+const char* ota_ca_cert = OTA_CA_CERT;
+#else
+const char* ota_ca_cert = mqtt_ca_cert;
+#endif
+#if MQTT_LAN_FAILOVER
+const char* mqtt_lan_ca_cert = MQTT_LAN_CA_CERT;
+const char* mqtt_lan_user = MQTT_LAN_USERNAME;
+const char* mqtt_lan_pass = MQTT_LAN_PASSWORD;
+#endif
 
 char deviceId[32];
 const int componentIndex = 1;
 const char* topic_type_control = "control";
+const char* topic_type_status = "status";
+// Device-level, on component index 0
+const char* topic_type_ota = "ota";
 char mqtt_topic[64];
+char status_topic[64];
+char ota_topic[64];
+char ota_state_topic[64];
+
+const unsigned long IR_COALESCE_WINDOW_MS = 400;
+const unsigned long IR_COALESCE_MAX_DELAY_MS = 1500;
+
+AirconState requested_state = {false, AIRCON_MODE_COOL, 24, AIRCON_FAN_AUTO, false};
+AirconState sent_state = requested_state;
+// The unit's real state is unknown after boot, so the first command always
+// transmits.
+bool has_sent_state = false;
+CommandCoalescer command_coalescer = {IR_COALESCE_WINDOW_MS, IR_COALESCE_MAX_DELAY_MS};
+unsigned long ir_frames_sent = 0;
+
+const int message_timestamp_threshold = 5;
+CommandOrder last_command = {0, 0};
+unsigned long commands_handled = 0;
+unsigned long commands_dropped = 0;
+
+// Commands are parsed into a static arena so the callback never touches the
+// heap.
+alignas(max_align_t) uint8_t command_arena_buffer[3072];
+ArenaAllocator command_arena(command_arena_buffer, sizeof(command_arena_buffer));
+JsonDocument command_doc(&command_arena);
 
 WiFiClientSecure wifiClient;
 PubSubClient client(wifiClient);
@@ -27,62 +79,143 @@ PubSubClient client(wifiClient);
 const uint16_t kIrLedPin = 4;
 IRMitsubishiAC ac(kIrLedPin);
 
-void connectWiFi() {
-  WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(1000);
+void publishAirconStatus();
+
+void reconnectMQTT() {
+  connectMQTT(client, {deviceId, mqtt_user, mqtt_pass, true});
+  client.subscribe(mqtt_topic);
+  client.subscribe(ota_topic);
+  otaPublishRunning(client, ota_state_topic);
+  if (has_sent_state) {
+    publishAirconStatus();
+  }
+}
+
+// Fan speeds go to the unit unchanged.
+static_assert(AIRCON_FAN_AUTO == kMitsubishiAcFanAuto, "fan auto mismatch");
+
+uint8_t mitsubishiMode(uint8_t mode) {
+  switch (mode) {
+    case AIRCON_MODE_AUTO: return kMitsubishiAcAuto;
+    case AIRCON_MODE_DRY: return kMitsubishiAcDry;
+    case AIRCON_MODE_HEAT: return kMitsubishiAcHeat;
+    case AIRCON_MODE_FAN: return kMitsubishiAcFan;
+    default: return kMitsubishiAcCool;
   }
 }
 
-void connectMQTT() {
-  while (!client.connected()) {
-    if (client.connect(deviceId, mqtt_user, mqtt_pass)) {
-      snprintf(mqtt_topic, sizeof(mqtt_topic), "%s/%d/%s", deviceId, componentIndex, topic_type_control);
-      client.subscribe(mqtt_topic);
-    } else {
-      delay(1000);
-    }
+void publishAirconStatus() {
+  JsonDocument doc;
+  doc["type"] = topic_type_status;
+  JsonObject message = doc["message"].to<JsonObject>();
+  message["power"] = sent_state.power ? "ON" : "OFF";
+  message["mode"] = modeToString(sent_state.mode);
+  message["temperature"] = sent_state.temperature;
+  if (sent_state.fan == AIRCON_FAN_AUTO) {
+    message["fan"] = "auto";
+  } else {
+    message["fan"] = sent_state.fan;
   }
+  message["swing"] = sent_state.swing;
+  message["irFramesSent"] = ir_frames_sent;
+  message["commandsHandled"] = commands_handled;
+  message["commandsDropped"] = commands_dropped;
+
+  publishJson(client, status_topic, doc, true);
 }
 
-void sendAirconCommand(const char* cmd) {
-  ac.setFan(kMitsubishiAcFanAuto);
-  ac.setMode(kMitsubishiAcCool);
-  ac.setTemp(24);
-  if (String(cmd) == "ON") {
-    ac.on();
-  } else if (String(cmd) == "OFF") {
-    ac.off();
+void sendAirconCommand() {
+  command_coalescer.pending = false;
+  if (has_sent_state && sameAirconState(requested_state, sent_state)) {
+    return;
   }
+
+  ac.setMode(mitsubishiMode(requested_state.mode));
+  ac.setTemp(requested_state.temperature);
+  ac.setFan(requested_state.fan);
+  ac.setVane(requested_state.swing ? kMitsubishiAcVaneAutoMove
+                                   : kMitsubishiAcVaneAuto);
+  ac.setPower(requested_state.power);
   ac.send();
+
+  sent_state = requested_state;
+  has_sent_state = true;
+  ir_frames_sent++;
+  publishAirconStatus();
+}
+
+void flushPendingAirconCommand() {
+  if (command_coalescer.due(millis())) {
+    sendAirconCommand();
+  }
 }
 
 void callback(char* topic, byte* payload, unsigned int length) {
-  String message;
-  for (unsigned int i = 0; i < length; i++) message += (char)payload[i];
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, message);
+  command_doc.clear();
+  command_arena.reset();
+  DeserializationError error = deserializeJson(command_doc, payload, length);
   if (error) {
+    LOG_WARN("deserializeJson() failed: %s", error.c_str());
+    commands_dropped++;
+    return;
+  }
+
+  if (strcmp(topic, ota_topic) == 0) {
+    otaHandleMessage(client, ota_state_topic, command_doc["message"],
+                     ota_ca_cert);
     return;
   }
-  const char* cmd = doc["message"];
-  sendAirconCommand(cmd);
+
+  int64_t messageTimeMs = parseISOTimeToEpochMs(command_doc["timestamp"]);
+  uint32_t seq = command_doc["seq"] | 0u;
+  if (checkCommand(last_command, messageTimeMs, seq, currentEpochMs(),
+                   message_timestamp_threshold) != COMMAND_ACCEPTED) {
+    commands_dropped++;
+    return;
+  }
+
+  if (!applyAirconMessage(command_doc["message"], requested_state)) {
+    commands_dropped++;
+    return;
+  }
+  commands_handled++;
+  command_coalescer.note(millis());
 }
 
 void setup() {
   Serial.begin(115200);
+  logBegin();
   uint64_t chipId = ESP.getEfuseMac();
   snprintf(deviceId, sizeof(deviceId), "esp32-aircon-%04X", (uint16_t)(chipId & 0xFFFF));
-  wifiClient.setInsecure();
-  connectWiFi();
+  buildTopic(mqtt_topic, sizeof(mqtt_topic), deviceId, componentIndex, topic_type_control);
+  buildTopic(status_topic, sizeof(status_topic), deviceId, componentIndex, topic_type_status);
+  buildTopic(ota_topic, sizeof(ota_topic), deviceId, 0, topic_type_ota);
+  buildTopic(ota_state_topic, sizeof(ota_state_topic), deviceId, 0, topic_type_ota, "state");
+  configureTls(wifiClient, mqtt_ca_cert);
+  connectWiFi(ssid, password);
+  syncTime();
   client.setServer(mqtt_server, mqtt_port);
   client.setCallback(callback);
+  // Room for ota requests, which carry a URL and two SHA-256 digests.
+  client.setBufferSize(MQTT_PACKET_BUFFER_SIZE);
+#if MQTT_LAN_FAILOVER
+  mqttFailoverBegin(client, wifiClient, mqtt_server, mqtt_port,
+                    {mqtt_lan_ca_cert, mqtt_lan_user, mqtt_lan_pass});
+  mqttDiscoverLanBroker();
+#endif
   ac.begin();
 }
 
 void loop() {
+  if (WiFi.status() != WL_CONNECTED) {
+    connectWiFi(ssid, password);
+  }
   if (!client.connected()) {
-    connectMQTT();
+    reconnectMQTT();
   }
   client.loop();
+#if MQTT_LAN_FAILOVER
+  mqttFailbackDue();
+#endif
+  flushPendingAirconCommand();
 }
@@ -0,0 +1,137 @@
+#include <unity.h>
+
+#include <ArduinoJson.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "aircon_command.h"
+
+const int THRESHOLD_SECONDS = 5;
+const int64_t NOW_MS = 1767225600000LL;  // 2026-01-01T00:00:00Z
+
+CommandOrder last;
+
+void setUp() {
+  last = {0, 0};
+}
+
+void tearDown() {}
+
+void test_fresh_command_is_accepted() {
+  TEST_ASSERT_EQUAL(COMMAND_ACCEPTED,
+                    checkCommand(last, NOW_MS - 200, 0, NOW_MS, THRESHOLD_SECONDS));
+  TEST_ASSERT_EQUAL(NOW_MS - 200, last.timeMs);
+}
+
+void test_stale_and_future_commands_are_dropped() {
+  TEST_ASSERT_EQUAL(COMMAND_STALE,
+                    checkCommand(last, NOW_MS - 5001, 0, NOW_MS, THRESHOLD_SECONDS));
+  TEST_ASSERT_EQUAL(COMMAND_STALE,
+                    checkCommand(last, NOW_MS + 5001, 0, NOW_MS, THRESHOLD_SECONDS));
+  TEST_ASSERT_EQUAL(COMMAND_ACCEPTED,
+                    checkCommand(last, NOW_MS - 5000, 0, NOW_MS, THRESHOLD_SECONDS));
+}
+
+void test_missing_timestamp_is_dropped() {
+  TEST_ASSERT_EQUAL(COMMAND_STALE,
+                    checkCommand(last, 0, 1, NOW_MS, THRESHOLD_SECONDS));
+  TEST_ASSERT_EQUAL(0, last.timeMs);
+}
+
+void test_unsynced_clock_drops_everything() {
+  // currentEpochMs() is 0 until NTP or the RTC provides a time.
+  TEST_ASSERT_EQUAL(COMMAND_STALE,
+                    checkCommand(last, NOW_MS, 1, 0, THRESHOLD_SECONDS));
+}
+
+void test_redelivery_is_dropped() {
+  TEST_ASSERT_EQUAL(COMMAND_ACCEPTED,
+                    checkCommand(last, NOW_MS, 7, NOW_MS, THRESHOLD_SECONDS));
+  TEST_ASSERT_EQUAL(COMMAND_REPLAYED,
+                    checkCommand(last, NOW_MS, 7, NOW_MS + 100, THRESHOLD_SECONDS));
+}
+
+void test_seq_orders_commands_in_the_same_millisecond() {
+  TEST_ASSERT_EQUAL(COMMAND_ACCEPTED,
+                    checkCommand(last, NOW_MS, 1, NOW_MS, THRESHOLD_SECONDS));
+  TEST_ASSERT_EQUAL(COMMAND_ACCEPTED,
+                    checkCommand(last, NOW_MS, 2, NOW_MS, THRESHOLD_SECONDS));
+  TEST_ASSERT_EQUAL(COMMAND_REPLAYED,
+                    checkCommand(last, NOW_MS, 1, NOW_MS, THRESHOLD_SECONDS));
+}
+
+void test_older_command_is_dropped_even_with_higher_seq() {
+  checkCommand(last, NOW_MS, 1, NOW_MS, THRESHOLD_SECONDS);
+  TEST_ASSERT_EQUAL(COMMAND_REPLAYED,
+                    checkCommand(last, NOW_MS - 1, 99, NOW_MS, THRESHOLD_SECONDS));
+  TEST_ASSERT_EQUAL(NOW_MS, last.timeMs);
+  TEST_ASSERT_EQUAL(1, last.seq);
+}
+
+double secondsSince(const struct timespec& start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// A reconnect replays the retained command, then QoS 1 redelivers a backlog
+// in which every command arrives several times. Each message goes through
+// the callback's parse, order check and apply; only the distinct ones in
+// order may reach the state.
+void test_replay_flood() {
+  const int DISTINCT = 2000;
+  const int COPIES = 10;
+  AirconState state = {false, AIRCON_MODE_COOL, 24, AIRCON_FAN_AUTO, false};
+  unsigned long handled = 0;
+  unsigned long dropped = 0;
+  JsonDocument doc;
+  char payload[96];
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int copy = 0; copy < COPIES; copy++) {
+    for (int i = 0; i < DISTINCT; i++) {
+      // Four commands per millisecond, told apart by seq, ending 1.5 s
+      // before the device clock.
+      const int64_t sentAt = NOW_MS - 2000 + i / 4;
+      snprintf(payload, sizeof(payload),
+               "{\"message\":{\"temperature\":%d},\"seq\":%d}",
+               AIRCON_MIN_TEMP + i % 16, i % 4 + 1);
+      if (deserializeJson(doc, payload)) {
+        dropped++;
+        continue;
+      }
+      uint32_t seq = doc["seq"] | 0u;
+      if (checkCommand(last, sentAt, seq, NOW_MS, THRESHOLD_SECONDS) !=
+              COMMAND_ACCEPTED ||
+          !applyAirconMessage(doc["message"], state)) {
+        dropped++;
+        continue;
+      }
+      handled++;
+    }
+  }
+  const double seconds = secondsSince(start);
+
+  char report[128];
+  snprintf(report, sizeof(report),
+           "%lu handled, %lu dropped, %.0f commands/s", handled, dropped,
+           (handled + dropped) / seconds);
+  TEST_MESSAGE(report);
+  TEST_ASSERT_EQUAL(DISTINCT, handled);
+  TEST_ASSERT_EQUAL(DISTINCT * (COPIES - 1), dropped);
+  TEST_ASSERT_EQUAL(AIRCON_MIN_TEMP + (DISTINCT - 1) % 16, state.temperature);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_fresh_command_is_accepted);
+  RUN_TEST(test_stale_and_future_commands_are_dropped);
+  RUN_TEST(test_missing_timestamp_is_dropped);
+  RUN_TEST(test_unsynced_clock_drops_everything);
+  RUN_TEST(test_redelivery_is_dropped);
+  RUN_TEST(test_seq_orders_commands_in_the_same_millisecond);
+  RUN_TEST(test_older_command_is_dropped_even_with_higher_seq);
+  RUN_TEST(test_replay_flood);
+  return UNITY_END();
+}
@@ -0,0 +1,183 @@
+#include <unity.h>
+
+#include <ArduinoJson.h>
+
+#include "aircon_command.h"
+
+// Stands in for IRMitsubishiAC: counts the frames that would reach the LED
+// and keeps the last one.
+struct FakeIrSend {
+  unsigned long frames;
+  AirconState last;
+
+  void send(const AirconState& state) {
+    frames++;
+    last = state;
+  }
+};
+
+const unsigned long WINDOW_MS = 400;
+const unsigned long MAX_DELAY_MS = 1500;
+
+FakeIrSend ir;
+AirconState requested;
+AirconState sent;
+bool has_sent_state;
+CommandCoalescer coalescer;
+
+// The main.cpp command path: apply, coalesce, transmit on a real change.
+bool receive(const char* json, unsigned long now) {
+  JsonDocument doc;
+  TEST_ASSERT_FALSE(deserializeJson(doc, json));
+  if (!applyAirconMessage(doc.as<JsonVariantConst>(), requested)) {
+    return false;
+  }
+  coalescer.note(now);
+  return true;
+}
+
+void flush(unsigned long now) {
+  if (!coalescer.due(now)) {
+    return;
+  }
+  coalescer.pending = false;
+  if (has_sent_state && sameAirconState(requested, sent)) {
+    return;
+  }
+  ir.send(requested);
+  sent = requested;
+  has_sent_state = true;
+}
+
+void setUp() {
+  ir = {};
+  requested = {false, AIRCON_MODE_COOL, 24, AIRCON_FAN_AUTO, false};
+  sent = requested;
+  has_sent_state = false;
+  coalescer = {WINDOW_MS, MAX_DELAY_MS};
+}
+
+void tearDown() {}
+
+void test_first_command_always_transmits() {
+  // The unit's state is unknown after boot, even if it matches the default.
+  TEST_ASSERT_TRUE(receive("\"OFF\"", 0));
+  flush(WINDOW_MS);
+  TEST_ASSERT_EQUAL(1, ir.frames);
+}
+
+void test_repeated_state_sends_one_frame() {
+  for (unsigned long i = 0; i < 5; i++) {
+    unsigned long now = i * 10000;
+    receive("{\"power\":\"ON\",\"mode\":\"cool\",\"temperature\":22}", now);
+    flush(now + WINDOW_MS);
+  }
+  TEST_ASSERT_EQUAL(1, ir.frames);
+  TEST_ASSERT_EQUAL(22, ir.last.temperature);
+}
+
+void test_each_field_change_transmits() {
+  receive("{\"power\":true}", 0);
+  flush(WINDOW_MS);
+  const char* changes[] = {
+    "{\"mode\":\"heat\"}",
+    "{\"temperature\":27}",
+    "{\"fan\":3}",
+    "{\"swing\":true}",
+    "{\"fan\":\"auto\"}",
+  };
+  unsigned long now = 10000;
+  for (const char* change : changes) {
+    receive(change, now);
+    flush(now + WINDOW_MS);
+    now += 10000;
+  }
+  TEST_ASSERT_EQUAL(6, ir.frames);
+  TEST_ASSERT_EQUAL(AIRCON_MODE_HEAT, ir.last.mode);
+  TEST_ASSERT_EQUAL(27, ir.last.temperature);
+  TEST_ASSERT_EQUAL(AIRCON_FAN_AUTO, ir.last.fan);
+  TEST_ASSERT_TRUE(ir.last.swing);
+}
+
+void test_settings_while_off_wait_for_on() {
+  receive("\"OFF\"", 0);
+  flush(WINDOW_MS);
+  receive("{\"temperature\":19,\"mode\":\"dry\"}", 10000);
+  flush(10000 + WINDOW_MS);
+  TEST_ASSERT_EQUAL(1, ir.frames);
+
+  receive("\"ON\"", 20000);
+  flush(20000 + WINDOW_MS);
+  TEST_ASSERT_EQUAL(2, ir.frames);
+  TEST_ASSERT_EQUAL(19, ir.last.temperature);
+  TEST_ASSERT_EQUAL(AIRCON_MODE_DRY, ir.last.mode);
+}
+
+void test_slider_burst_coalesces() {
+  receive("{\"power\":\"ON\"}", 0);
+  flush(WINDOW_MS);
+  TEST_ASSERT_EQUAL(1, ir.frames);
+
+  // 16-31 °C dragged across in 150 ms steps, flushed as often as loop() runs.
+  unsigned long now = 10000;
+  for (int temperature = AIRCON_MIN_TEMP; temperature <= AIRCON_MAX_TEMP;
+       temperature++) {
+    char json[32];
+    snprintf(json, sizeof(json), "{\"temperature\":%d}", temperature);
+    receive(json, now);
+    flush(now);
+    now += 150;
+  }
+  flush(now + WINDOW_MS);
+
+  // 16 steps over 2.4 s: one frame at the max delay, one at the end.
+  TEST_ASSERT_EQUAL(3, ir.frames);
+  TEST_ASSERT_EQUAL(AIRCON_MAX_TEMP, ir.last.temperature);
+}
+
+void test_burst_ending_on_sent_state_sends_nothing() {
+  receive("{\"power\":\"ON\",\"temperature\":24}", 0);
+  flush(WINDOW_MS);
+  receive("{\"temperature\":25}", 10000);
+  receive("{\"temperature\":24}", 10100);
+  flush(10100 + WINDOW_MS);
+  TEST_ASSERT_EQUAL(1, ir.frames);
+}
+
+void test_values_are_clamped() {
+  receive("{\"power\":\"ON\",\"temperature\":40,\"fan\":9}", 0);
+  flush(WINDOW_MS);
+  TEST_ASSERT_EQUAL(AIRCON_MAX_TEMP, ir.last.temperature);
+  TEST_ASSERT_EQUAL(AIRCON_MAX_FAN_SPEED, ir.last.fan);
+}
+
+void test_unknown_message_is_rejected() {
+  TEST_ASSERT_FALSE(receive("{\"mode\":\"turbo\"}", 0));
+  TEST_ASSERT_FALSE(receive("\"MAYBE\"", 0));
+  TEST_ASSERT_FALSE(receive("42", 0));
+  flush(WINDOW_MS);
+  TEST_ASSERT_EQUAL(0, ir.frames);
+}
+
+void test_mode_names_round_trip() {
+  const char* names[] = {"auto", "cool", "dry", "heat", "fan"};
+  for (const char* name : names) {
+    uint8_t mode;
+    TEST_ASSERT_TRUE(parseMode(name, mode));
+    TEST_ASSERT_EQUAL_STRING(name, modeToString(mode));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_first_command_always_transmits);
+  RUN_TEST(test_repeated_state_sends_one_frame);
+  RUN_TEST(test_each_field_change_transmits);
+  RUN_TEST(test_settings_while_off_wait_for_on);
+  RUN_TEST(test_slider_burst_coalesces);
+  RUN_TEST(test_burst_ending_on_sent_state_sends_nothing);
+  RUN_TEST(test_values_are_clamped);
+  RUN_TEST(test_unknown_message_is_rejected);
+  RUN_TEST(test_mode_names_round_trip);
+  return UNITY_END();
+}
@@ -0,0 +1,110 @@
+// Generates src/valveConfigSchema.ts from the CONFIG_FIELDS table in
+// controller/include/valve_config.h, so the UI and the mock controller use
+// the firmware's field names and limits.
+//
+//   npm run gen:config
+import fs from "node:fs";
+import path from "node:path";
+import { fileURLToPath } from "node:url";
+
+const here = path.dirname(fileURLToPath(import.meta.url));
+const headerPath = path.resolve(
+  here,
+  "../../controller/include/valve_config.h"
+);
+const outputPath = path.resolve(here, "../src/valveConfigSchema.ts");
+
+const TYPES = {
+  CONFIG_ULONG: "ulong",
+  CONFIG_FLOAT: "float",
+  CONFIG_CONTROL_MODE: "controlMode",
+};
+
+const ROW =
+  /^\s*\{"(\w+)", (nullptr|"\w+"), (CONFIG_\w+), (VALVE|CONTROLLER)_FIELD\(\w+\), ([^,]+), ([^,]+), ([^,]+), ([^}]+)\},\s*$/;
+
+function literal(token) {
+  const value = token.trim();
+  if (value.startsWith("CONTROL_MODE_")) {
+    return JSON.stringify(value.slice("CONTROL_MODE_".length).toLowerCase());
+  }
+  const number = Number(value.replace(/f$/, ""));
+  if (!Number.isFinite(number)) {
+    throw new Error(`Cannot translate ${value}`);
+  }
+  return String(number);
+}
+
+// Mode names in declaration order, so the options span min..max.
+function parseControlModes(source) {
+  const body = source.match(/enum ControlMode[^{]*\{([^}]*)\}/);
+  if (!body) {
+    throw new Error(`enum ControlMode not found in ${headerPath}`);
+  }
+  return [...body[1].matchAll(/CONTROL_MODE_\w+/g)].map(([name]) =>
+    literal(name)
+  );
+}
+
+function parseFields(source) {
+  const start = source.indexOf("CONFIG_FIELDS[] = {");
+  const end = source.indexOf("};", start);
+  if (start < 0 || end < 0) {
+    throw new Error(`CONFIG_FIELDS not found in ${headerPath}`);
+  }
+  return source
+    .slice(start, end)
+    .split("\n")
+    .map((line) => line.match(ROW))
+    .filter(Boolean)
+    .map(([, name, alias, type, scope, min, max, def, flags]) => ({
+      name,
+      alias: alias === "nullptr" ? null : JSON.parse(alias),
+      type: TYPES[type],
+      scope: scope.toLowerCase(),
+      min: literal(min),
+      max: literal(max),
+      default: literal(def),
+      rejectOutOfRange: flags.includes("CONFIG_REJECT_OUT_OF_RANGE"),
+    }));
+}
+
+function render(fields, controlModes) {
+  const lines = [
+    "// Generated from controller/include/valve_config.h by",
+    "// scripts/generateConfigSchema.js. Do not edit; run `npm run gen:config`.",
+    "",
+    "export const VALVE_CONFIG_FIELDS = {",
+  ];
+  for (const field of fields) {
+    const entries = [`type: "${field.type}"`, `scope: "${field.scope}"`];
+    if (field.alias) entries.push(`alias: "${field.alias}"`);
+    if (field.type === "controlMode") {
+      const first = controlModes.indexOf(field.min);
+      const last = controlModes.indexOf(field.max);
+      entries.push(`options: [${controlModes.slice(first, last + 1).join(", ")}]`);
+    } else {
+      entries.push(`min: ${field.min}`, `max: ${field.max}`);
+      entries.push(`rejectOutOfRange: ${field.rejectOutOfRange}`);
+    }
+    entries.push(`default: ${field.default}`);
+    lines.push(`  ${field.name}: { ${entries.join(", ")} },`);
+  }
+  lines.push("} as const;", "");
+  lines.push(
+    "export type ValveConfigFieldName = keyof typeof VALVE_CONFIG_FIELDS;",
+    "",
+    "export const NUMERIC_VALVE_CONFIG_FIELDS = [",
+    ...fields
+      .filter((field) => field.type !== "controlMode")
+      .map((field) => `  "${field.name}",`),
+    "] as const;",
+    ""
+  );
+  return lines.join("\n");
+}
+
+const source = fs.readFileSync(headerPath, "utf8");
+const fields = parseFields(source);
+fs.writeFileSync(outputPath, render(fields, parseControlModes(source)));
+console.log(`Wrote ${fields.length} fields to ${path.relative(process.cwd(), outputPath)}`);
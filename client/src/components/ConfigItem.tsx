@@ -18,16 +18,24 @@ import {
   HEARTBEAT_INTERVAL_MAX,
   DEFAULT_TARGET_WEIGHT_CHANGE,
   MIN_TARGET_WEIGHT_CHANGE,
+  MAX_TARGET_WEIGHT_CHANGE,
   MIN_HIGH_DURATION_MS,
   MAX_HIGH_DURATION_MS,
   DEFAULT_TOLERANCE_WEIGHT,
   MIN_TOLERANCE_WEIGHT,
+  MAX_TOLERANCE_WEIGHT,
   DEFAULT_TOLERANCE_DURATION_MS,
   MIN_TOLERANCE_DURATION_MS,
   MAX_TOLERANCE_DURATION_MS,
   DEFAULT_SENSOR_READ_INTERVAL_MS,
   MIN_SENSOR_READ_INTERVAL_MS,
   MAX_SENSOR_READ_INTERVAL_MS,
+  DEFAULT_TARGET_VOLUME,
+  MIN_TARGET_VOLUME,
+  MAX_TARGET_VOLUME,
+  DEFAULT_PULSES_PER_LITER,
+  MIN_PULSES_PER_LITER,
+  MAX_PULSES_PER_LITER,
 } from "@/constants";
 import { Button } from "./ui/button";
 import { FormEvent } from "react";
@@ -72,6 +80,12 @@ export default function ConfigItem(props: {
   const [sensorReadIntervalMs, setSensorReadIntervalMs] = useState<number>(
     DEFAULT_SENSOR_READ_INTERVAL_MS
   );
+  const [targetVolumeInput, setTargetVolumeInput] = useState<string>(
+    DEFAULT_TARGET_VOLUME.toString()
+  );
+  const [pulsesPerLiterInput, setPulsesPerLiterInput] = useState<string>(
+    DEFAULT_PULSES_PER_LITER.toString()
+  );
   const [heartbeatIntervalDuration, setHeartbeatIntervalDuration] =
     useState<number>(5);
   const [errors, setErrors] = useState<Record<string, string>>({});
@@ -145,6 +159,12 @@ export default function ConfigItem(props: {
           if (typeof payload.message.sensorReadIntervalMs === "number") {
             setSensorReadIntervalMs(payload.message.sensorReadIntervalMs);
           }
+          if (typeof payload.message.targetVolume === "number") {
+            setTargetVolumeInput(payload.message.targetVolume.toString());
+          }
+          if (typeof payload.message.pulsesPerLiter === "number") {
+            setPulsesPerLiterInput(payload.message.pulsesPerLiter.toString());
+          }
           if (typeof payload.message.heartbeatInterval === "number") {
             setHeartbeatIntervalDuration(payload.message.heartbeatInterval);
           }
@@ -210,6 +230,8 @@ export default function ConfigItem(props: {
       nextToleranceWeight: number,
       nextToleranceDurationMs: number,
       nextSensorReadIntervalMs: number,
+      nextTargetVolume: number,
+      nextPulsesPerLiter: number,
       nextHeartbeatInterval: number
     ) => {
       const message: MqttConfigMessage = {
@@ -221,6 +243,8 @@ export default function ConfigItem(props: {
           toleranceWeight: nextToleranceWeight,
           toleranceDurationMs: nextToleranceDurationMs,
           sensorReadIntervalMs: nextSensorReadIntervalMs,
+          targetVolume: nextTargetVolume,
+          pulsesPerLiter: nextPulsesPerLiter,
           heartbeatInterval: nextHeartbeatInterval,
         },
         timestamp: new Date().toISOString(),
@@ -241,6 +265,8 @@ export default function ConfigItem(props: {
       nextErrors.targetWeightChange = "Target weight change must be a valid number.";
     } else if (targetWeightParsed < MIN_TARGET_WEIGHT_CHANGE) {
       nextErrors.targetWeightChange = `Target weight change must be at least ${MIN_TARGET_WEIGHT_CHANGE}.`;
+    } else if (targetWeightParsed > MAX_TARGET_WEIGHT_CHANGE) {
+      nextErrors.targetWeightChange = `Target weight change must be at most ${MAX_TARGET_WEIGHT_CHANGE}.`;
     }
 
     const toleranceWeightParsed = Number(toleranceWeightInput);
@@ -248,6 +274,8 @@ export default function ConfigItem(props: {
       nextErrors.toleranceWeight = "Tolerance weight must be a valid number.";
     } else if (toleranceWeightParsed < MIN_TOLERANCE_WEIGHT) {
       nextErrors.toleranceWeight = `Tolerance weight must be at least ${MIN_TOLERANCE_WEIGHT}.`;
+    } else if (toleranceWeightParsed > MAX_TOLERANCE_WEIGHT) {
+      nextErrors.toleranceWeight = `Tolerance weight must be at most ${MAX_TOLERANCE_WEIGHT}.`;
     }
 
     const toleranceDurationSeconds = Number(toleranceDurationInput);
@@ -276,6 +304,24 @@ export default function ConfigItem(props: {
       }.`;
     }
 
+    const targetVolumeParsed = Number(targetVolumeInput);
+    if (!Number.isFinite(targetVolumeParsed)) {
+      nextErrors.targetVolume = "Target volume must be a valid number.";
+    } else if (targetVolumeParsed < MIN_TARGET_VOLUME) {
+      nextErrors.targetVolume = `Target volume must be at least ${MIN_TARGET_VOLUME}.`;
+    } else if (targetVolumeParsed > MAX_TARGET_VOLUME) {
+      nextErrors.targetVolume = `Target volume must be at most ${MAX_TARGET_VOLUME}.`;
+    }
+
+    const pulsesPerLiterParsed = Number(pulsesPerLiterInput);
+    if (!Number.isFinite(pulsesPerLiterParsed)) {
+      nextErrors.pulsesPerLiter = "Pulses per liter must be a valid number.";
+    } else if (pulsesPerLiterParsed < MIN_PULSES_PER_LITER) {
+      nextErrors.pulsesPerLiter = `Pulses per liter must be at least ${MIN_PULSES_PER_LITER}.`;
+    } else if (pulsesPerLiterParsed > MAX_PULSES_PER_LITER) {
+      nextErrors.pulsesPerLiter = `Pulses per liter must be at most ${MAX_PULSES_PER_LITER}.`;
+    }
+
     if (Object.keys(nextErrors).length > 0) {
       setErrors(nextErrors);
       return;
@@ -304,12 +350,20 @@ export default function ConfigItem(props: {
       resolvedTolerance,
       resolvedToleranceDuration,
       clampedSensorInterval,
+      targetVolumeParsed,
+      pulsesPerLiterParsed,
       heartbeatIntervalDuration
     );
 
     toast.success(topicConfig, {
       description:
-        controlMode === enumControlMode.TIME
+        controlMode === enumControlMode.FLOW
+          ? `Flow config updated (target ${targetVolumeParsed.toFixed(
+              2
+            )}L, ${pulsesPerLiterParsed} pulses/L, no-flow timeout ${(
+              resolvedToleranceDuration / 1000
+            ).toFixed(1)}s)`
+          : controlMode === enumControlMode.TIME
           ? `Timer config updated (${(resolvedHighDuration / 1000).toFixed(
               1
             )}s duration, ${(clampedSensorInterval / 1000).toFixed(
@@ -328,7 +382,9 @@ export default function ConfigItem(props: {
     heartbeatIntervalDuration,
     highDurationInput,
     publishConfigSnapshot,
+    pulsesPerLiterInput,
     sensorReadIntervalMs,
+    targetVolumeInput,
     targetWeightChangeInput,
     toleranceDurationInput,
     toleranceWeightInput,
@@ -411,7 +467,7 @@ export default function ConfigItem(props: {
         <div className="flex flex-col items-start justify-center gap-2 w-full">
           <ConfigLabel
             label="Valve control mode"
-            tooltip="Choose whether this valve stops based on target weight change or a fixed open duration."
+            tooltip="Choose whether this valve stops based on target weight change, a fixed open duration or a metered volume."
           />
           <div className="flex w-full gap-2">
             <Button
@@ -430,6 +486,14 @@ export default function ConfigItem(props: {
             >
               Time
             </Button>
+            <Button
+              type="button"
+              variant={controlMode === enumControlMode.FLOW ? "default" : "outline"}
+              className="flex-1"
+              onClick={() => setControlMode(enumControlMode.FLOW)}
+            >
+              Flow
+            </Button>
           </div>
         </div>
 
@@ -441,6 +505,7 @@ export default function ConfigItem(props: {
               tooltip="Target increase in measured weight before the valve closes automatically."
               type="number"
               min={MIN_TARGET_WEIGHT_CHANGE}
+              max={MAX_TARGET_WEIGHT_CHANGE}
               step={0.1}
               value={targetWeightChangeInput}
               onChange={(event) => setTargetWeightChangeInput(event.target.value)}
@@ -453,6 +518,7 @@ export default function ConfigItem(props: {
               tooltip="Minimum weight change expected within the tolerance duration while the valve is open."
               type="number"
               min={MIN_TOLERANCE_WEIGHT}
+              max={MAX_TOLERANCE_WEIGHT}
               step={0.1}
               value={toleranceWeightInput}
               onChange={(event) => setToleranceWeightInput(event.target.value)}
@@ -472,6 +538,47 @@ export default function ConfigItem(props: {
               error={errors.toleranceDurationMs}
             />
           </div>
+        ) : controlMode === enumControlMode.FLOW ? (
+          <div className="flex flex-col gap-3 w-full pb-3">
+            <ConfigInputField
+              id={`${topicItem}-target-volume`}
+              label="Target volume (liters)"
+              tooltip="Volume counted by the flow meter before the valve closes automatically."
+              type="number"
+              min={MIN_TARGET_VOLUME}
+              max={MAX_TARGET_VOLUME}
+              step={0.05}
+              value={targetVolumeInput}
+              onChange={(event) => setTargetVolumeInput(event.target.value)}
+              error={errors.targetVolume}
+            />
+
+            <ConfigInputField
+              id={`${topicItem}-pulses-per-liter`}
+              label="Pulses per liter"
+              tooltip="Calibration of the flow meter, from its datasheet or a measured fill."
+              type="number"
+              min={MIN_PULSES_PER_LITER}
+              max={MAX_PULSES_PER_LITER}
+              step={1}
+              value={pulsesPerLiterInput}
+              onChange={(event) => setPulsesPerLiterInput(event.target.value)}
+              error={errors.pulsesPerLiter}
+            />
+
+            <ConfigInputField
+              id={`${topicItem}-no-flow-duration`}
+              label="No-flow timeout (seconds)"
+              tooltip="How long the valve may stay open without a single pulse before it closes."
+              type="number"
+              min={MIN_TOLERANCE_DURATION_MS / 1000}
+              max={MAX_TOLERANCE_DURATION_MS / 1000}
+              step={0.5}
+              value={toleranceDurationInput}
+              onChange={(event) => setToleranceDurationInput(event.target.value)}
+              error={errors.toleranceDurationMs}
+            />
+          </div>
         ) : (
           <div className="w-full pb-3">
             <ConfigInputField
@@ -19,6 +19,7 @@ import { ControlClient } from "@/lib/control-client";
 import {
   DEFAULT_HIGH_DURATION_MS,
   DEFAULT_TARGET_WEIGHT_CHANGE,
+  DEFAULT_TARGET_VOLUME,
 } from "@/constants";
 import {
   Dialog,
@@ -90,6 +91,11 @@ export default function ControlItem(props: {
   const [targetWeightChange, setTargetWeightChange] = useState<number>(
     DEFAULT_TARGET_WEIGHT_CHANGE
   );
+  const [targetVolume, setTargetVolume] = useState<number>(
+    DEFAULT_TARGET_VOLUME
+  );
+  const [volume, setVolume] = useState<number | null>(null);
+  const [flowRate, setFlowRate] = useState<number | null>(null);
   const [heartbeatInterval, setHeartbeatInterval] = useState<number>(5);
   const [isDialogOpen, setIsDialogOpen] = useState(false);
   const [configLoadState, setConfigLoadState] =
@@ -106,11 +112,18 @@ export default function ControlItem(props: {
               typeof message.controlMode === "string"
             ) {
               setControlMode(
-                message.controlMode === enumControlMode.TIME
-                  ? enumControlMode.TIME
+                message.controlMode === enumControlMode.TIME ||
+                  message.controlMode === enumControlMode.FLOW
+                  ? message.controlMode
                   : enumControlMode.WEIGHT
               );
             }
+            if (typeof message.volume === "number") {
+              setVolume(message.volume);
+            }
+            if (typeof message.flowRate === "number") {
+              setFlowRate(message.flowRate);
+            }
             setCurrentWeight(message.weight);
             setWeightChange(message.weightChange);
             setProgressValue(
@@ -164,6 +177,15 @@ export default function ControlItem(props: {
                 setProgressUnit("g");
               }
             }
+            if (typeof payload.message.targetVolume === "number") {
+              setTargetVolume(payload.message.targetVolume);
+              if (
+                (payload.message.controlMode ?? controlMode) === enumControlMode.FLOW
+              ) {
+                setProgressTarget(payload.message.targetVolume);
+                setProgressUnit("L");
+              }
+            }
             if (typeof payload.message.heartbeatInterval === "number") {
               setHeartbeatInterval(payload.message.heartbeatInterval);
             }
@@ -203,6 +225,7 @@ export default function ControlItem(props: {
         type: enumMqttTopicType.CONTROL,
         message: checked ? enumSwitchStatus.HIGH : enumSwitchStatus.LOW,
         timestamp: new Date().toISOString(),
+        commandId: crypto.randomUUID(),
       };
       client?.publish(topicControl, JSON.stringify(message), {
         retain: true,
@@ -268,23 +291,44 @@ export default function ControlItem(props: {
     [highDuration]
   );
 
+  const formattedVolume: string = useMemo(
+    () => (volume === null ? "Unknown" : `${volume.toFixed(2)} L`),
+    [volume]
+  );
+
+  const formattedFlowRate: string = useMemo(
+    () => (flowRate === null ? "Unknown" : `${flowRate.toFixed(2)} L/min`),
+    [flowRate]
+  );
+
   const progressDisplay: string = useMemo(() => {
     const fallbackTarget =
       controlMode === enumControlMode.TIME
         ? highDuration / 1000
-        : targetWeightChange;
+        : controlMode === enumControlMode.FLOW
+          ? targetVolume
+          : targetWeightChange;
     const resolvedTarget = progressTarget ?? fallbackTarget;
     const resolvedUnit =
-      progressUnit || (controlMode === enumControlMode.TIME ? "s" : "g");
-    const currentText = progressValue === null ? "-" : progressValue.toFixed(1);
+      progressUnit ||
+      (controlMode === enumControlMode.TIME
+        ? "s"
+        : controlMode === enumControlMode.FLOW
+          ? "L"
+          : "g");
+    // Liters need the extra digit; a 0.25 L target would show as 0.3.
+    const digits = resolvedUnit === "L" ? 2 : 1;
+    const currentText =
+      progressValue === null ? "-" : progressValue.toFixed(digits);
 
-    return `${currentText}/${resolvedTarget.toFixed(1)} ${resolvedUnit}`;
+    return `${currentText}/${resolvedTarget.toFixed(digits)} ${resolvedUnit}`;
   }, [
     controlMode,
     highDuration,
     progressTarget,
     progressUnit,
     progressValue,
+    targetVolume,
     targetWeightChange,
   ]);
 
@@ -298,6 +342,7 @@ export default function ControlItem(props: {
   );
 
   const showWeightInfo = controlMode === enumControlMode.WEIGHT;
+  const showFlowInfo = controlMode === enumControlMode.FLOW;
   const defaultAccordionValue = showConfigControls ? ["config"] : ["system-info"];
 
   return (
@@ -402,6 +447,18 @@ export default function ControlItem(props: {
                         <div className="text-left">{formattedHealthWeight}</div>
                       </>
                     ) : null}
+                    {showFlowInfo ? (
+                      <>
+                        <div className="text-right after:content-[':']">
+                          Volume
+                        </div>
+                        <div className="text-left">{formattedVolume}</div>
+                        <div className="text-right after:content-[':']">
+                          Flow rate
+                        </div>
+                        <div className="text-left">{formattedFlowRate}</div>
+                      </>
+                    ) : null}
                   </div>
                 </AccordionContent>
               </AccordionItem>
@@ -1,24 +1,55 @@
 import { topicList, enumMqttTopicType } from "./types";
+import { VALVE_CONFIG_FIELDS } from "./valveConfigSchema";
 
 export const USE_MOCK_IRRIGATION_DATA =
   import.meta.env.VITE_USE_MOCK_IRRIGATION_DATA === "true";
 
-export const HEARTBEAT_INTERVAL_MIN = 0.1; //minutes
-export const HEARTBEAT_INTERVAL_MAX = 20;
-
-export const DEFAULT_TARGET_WEIGHT_CHANGE = 100;
-export const MIN_TARGET_WEIGHT_CHANGE = 50;
-export const DEFAULT_HIGH_DURATION_MS = 3000;
-export const MIN_HIGH_DURATION_MS = 1000;
-export const MAX_HIGH_DURATION_MS = 60000;
-export const DEFAULT_TOLERANCE_WEIGHT = 10;
-export const MIN_TOLERANCE_WEIGHT = 0;
-export const DEFAULT_TOLERANCE_DURATION_MS = 5000;
-export const MIN_TOLERANCE_DURATION_MS = 100;
-export const MAX_TOLERANCE_DURATION_MS = 6000;
-export const DEFAULT_SENSOR_READ_INTERVAL_MS = 500;
-export const MIN_SENSOR_READ_INTERVAL_MS = 100;
-export const MAX_SENSOR_READ_INTERVAL_MS = 1000;
+// Status and health through the backend's downsampling relay instead of
+// straight from the broker; see server/liveRelay.js.
+export const USE_LIVE_RELAY = import.meta.env.VITE_USE_LIVE_RELAY === "true";
+export const LIVE_RELAY_RATE_HZ = 2;
+
+// Valve config limits come from the controller firmware's field table.
+const {
+  heartbeatInterval,
+  highDuration,
+  targetWeightChange,
+  toleranceWeight,
+  toleranceDurationMs,
+  sensorReadIntervalMs,
+  targetVolume,
+  pulsesPerLiter,
+  maxOpenDurationMs,
+  tempCoefficient,
+} = VALVE_CONFIG_FIELDS;
+
+export const HEARTBEAT_INTERVAL_MIN = heartbeatInterval.min; //minutes
+export const HEARTBEAT_INTERVAL_MAX = heartbeatInterval.max;
+export const DEFAULT_HEARTBEAT_INTERVAL = heartbeatInterval.default;
+
+export const DEFAULT_TARGET_WEIGHT_CHANGE = targetWeightChange.default;
+export const MIN_TARGET_WEIGHT_CHANGE = targetWeightChange.min;
+export const MAX_TARGET_WEIGHT_CHANGE = targetWeightChange.max;
+export const DEFAULT_HIGH_DURATION_MS = highDuration.default;
+export const MIN_HIGH_DURATION_MS = highDuration.min;
+export const MAX_HIGH_DURATION_MS = highDuration.max;
+export const DEFAULT_TOLERANCE_WEIGHT = toleranceWeight.default;
+export const MIN_TOLERANCE_WEIGHT = toleranceWeight.min;
+export const MAX_TOLERANCE_WEIGHT = toleranceWeight.max;
+export const DEFAULT_TOLERANCE_DURATION_MS = toleranceDurationMs.default;
+export const MIN_TOLERANCE_DURATION_MS = toleranceDurationMs.min;
+export const MAX_TOLERANCE_DURATION_MS = toleranceDurationMs.max;
+export const DEFAULT_SENSOR_READ_INTERVAL_MS = sensorReadIntervalMs.default;
+export const MIN_SENSOR_READ_INTERVAL_MS = sensorReadIntervalMs.min;
+export const MAX_SENSOR_READ_INTERVAL_MS = sensorReadIntervalMs.max;
+export const DEFAULT_TARGET_VOLUME = targetVolume.default;
+export const MIN_TARGET_VOLUME = targetVolume.min;
+export const MAX_TARGET_VOLUME = targetVolume.max;
+export const DEFAULT_PULSES_PER_LITER = pulsesPerLiter.default;
+export const MIN_PULSES_PER_LITER = pulsesPerLiter.min;
+export const MAX_PULSES_PER_LITER = pulsesPerLiter.max;
+export const DEFAULT_MAX_OPEN_DURATION_MS = maxOpenDurationMs.default;
+export const DEFAULT_TEMP_COEFFICIENT = tempCoefficient.default;
 export const DEFAULT_TEMPERATURE_SENSOR_HEARTBEAT_INTERVAL_SECONDS = 60;
 export const MIN_TEMPERATURE_SENSOR_HEARTBEAT_INTERVAL_SECONDS = 1;
 export const MAX_TEMPERATURE_SENSOR_HEARTBEAT_INTERVAL_SECONDS = 6000;
@@ -1,25 +1,23 @@
 import mqtt from "mqtt";
 import {
   CONTROLLER_DEVICE_ID_TO_TOPIC,
+  DEFAULT_HEARTBEAT_INTERVAL,
   DEFAULT_HIGH_DURATION_MS,
   DEFAULT_TEMPERATURE_SENSOR_HEARTBEAT_INTERVAL_SECONDS,
   DEFAULT_TARGET_WEIGHT_CHANGE,
+  DEFAULT_TARGET_VOLUME,
+  DEFAULT_PULSES_PER_LITER,
+  DEFAULT_MAX_OPEN_DURATION_MS,
+  DEFAULT_TEMP_COEFFICIENT,
   DEFAULT_TOLERANCE_DURATION_MS,
   DEFAULT_TOLERANCE_WEIGHT,
   DEFAULT_SENSOR_READ_INTERVAL_MS,
-  HEARTBEAT_INTERVAL_MAX,
-  HEARTBEAT_INTERVAL_MIN,
-  MAX_HIGH_DURATION_MS,
-  MAX_TOLERANCE_DURATION_MS,
-  MAX_SENSOR_READ_INTERVAL_MS,
+  LIVE_RELAY_RATE_HZ,
   MAX_TEMPERATURE_SENSOR_HEARTBEAT_INTERVAL_SECONDS,
-  MIN_HIGH_DURATION_MS,
-  MIN_TARGET_WEIGHT_CHANGE,
-  MIN_TOLERANCE_DURATION_MS,
   MIN_TOLERANCE_WEIGHT,
-  MIN_SENSOR_READ_INTERVAL_MS,
   MIN_TEMPERATURE_SENSOR_HEARTBEAT_INTERVAL_SECONDS,
   TEMPERATURE_HUMIDITY_DEVICE_ID_TO_TOPIC,
+  USE_LIVE_RELAY,
   USE_MOCK_IRRIGATION_DATA,
 } from "@/constants";
 import {
@@ -33,6 +31,17 @@ import {
   ValveState,
 } from "@/types";
 import { getArrayOfTopicItems } from "@/utils";
+import {
+  NUMERIC_VALVE_CONFIG_FIELDS,
+  VALVE_CONFIG_FIELDS,
+} from "@/valveConfigSchema";
+
+type NumericConfigField = {
+  alias?: string;
+  min: number;
+  max: number;
+  rejectOutOfRange: boolean;
+};
 
 type ControlEventMap = {
   connect: () => void;
@@ -74,13 +83,19 @@ type MockValveState = {
   toleranceWeight: number;
   toleranceDurationMs: number;
   sensorReadIntervalMs: number;
+  targetVolume: number;
+  pulsesPerLiter: number;
+  maxOpenDurationMs: number;
   heartbeatInterval: number;
+  tempCoefficient: number;
   currentWeight: number;
   startWeight: number;
   lastWeight: number;
   activatedAt: number | null;
   lastWeightReadAt: number | null;
   toleranceSatisfied: boolean;
+  flowPulses: number;
+  flowRate: number;
   closeTimer: number | null;
   weightTimer: number | null;
   progressTimer: number | null;
@@ -95,8 +110,12 @@ type MockSensorState = {
   heartbeatTimer: number | null;
 };
 
-const HEARTBEAT_DEFAULT_MINUTES = 5;
 const MOCK_WEIGHT_START = 1250;
+// Same rate as the controller's esp32dev-flowsim build; at the default
+// 450 pulses/L that is 10 L/min.
+const MOCK_FLOW_PULSE_HZ = 75;
+// The controller drops control messages with a longer commandId.
+const MAX_COMMAND_ID_LENGTH = 36;
 let mockClientSingleton: ControlClient | null = null;
 
 export function createControlClient(): ControlClient {
@@ -107,10 +126,117 @@ export function createControlClient(): ControlClient {
     return mockClientSingleton;
   }
 
-  return mqtt.connect(import.meta.env.VITE_MQTT_CLUSTER_URL, {
+  const broker = mqtt.connect(import.meta.env.VITE_MQTT_CLUSTER_URL, {
     username: import.meta.env.VITE_MQTT_USERNAME,
     password: import.meta.env.VITE_MQTT_PASSWORD,
   }) as unknown as ControlClient;
+  return USE_LIVE_RELAY ? new RelayControlClient(broker) : broker;
+}
+
+const RELAYED_TOPIC_TYPES: string[] = [
+  enumMqttTopicType.STATUS,
+  enumMqttTopicType.HEALTH,
+];
+
+// Status and health topics come from the backend relay at
+// LIVE_RELAY_RATE_HZ per topic; commands, config and acks still go through
+// the broker, so they are not delayed.
+class RelayControlClient implements ControlClient {
+  private handlers: {
+    [K in EventName]: Set<EventHandler<K>>;
+  } = {
+    connect: new Set(),
+    reconnect: new Set(),
+    close: new Set(),
+    message: new Set(),
+  };
+  private relayTopics = new Set<string>();
+  private source: EventSource | null = null;
+  private reopenQueued = false;
+  private broker: ControlClient;
+
+  constructor(broker: ControlClient) {
+    this.broker = broker;
+    broker.on("connect", () => this.emit("connect"));
+    broker.on("reconnect", () => this.emit("reconnect"));
+    broker.on("close", () => this.emit("close"));
+    broker.on("message", (topic, payload) =>
+      this.emit("message", topic, payload)
+    );
+  }
+
+  get connected() {
+    return this.broker.connected;
+  }
+
+  publish(
+    topic: string,
+    message: string,
+    options?: { retain?: boolean },
+    callback?: PublishCallback
+  ) {
+    this.broker.publish(topic, message, options, callback);
+  }
+
+  subscribe(
+    topic: string,
+    options?: { qos?: number },
+    callback?: SubscribeCallback
+  ) {
+    const type = topic.split("/").pop() ?? "";
+    if (!RELAYED_TOPIC_TYPES.includes(type)) {
+      this.broker.subscribe(topic, options, callback);
+      return;
+    }
+    if (!this.relayTopics.has(topic)) {
+      this.relayTopics.add(topic);
+      this.queueReopen();
+    }
+    callback?.();
+  }
+
+  on<T extends EventName>(event: T, handler: EventHandler<T>) {
+    this.handlers[event].add(handler as never);
+  }
+
+  removeListener<T extends EventName>(event: T, handler: EventHandler<T>) {
+    this.handlers[event].delete(handler as never);
+  }
+
+  // Components subscribe one topic at a time while mounting; the stream is
+  // reopened once for all of them. The relay replays the last message of
+  // each topic, so nothing is missed across a reopen.
+  private queueReopen() {
+    if (this.reopenQueued) return;
+    this.reopenQueued = true;
+    queueMicrotask(() => {
+      this.reopenQueued = false;
+      this.source?.close();
+      const params = new URLSearchParams({
+        topics: [...this.relayTopics].join(","),
+        rateHz: String(LIVE_RELAY_RATE_HZ),
+      });
+      this.source = new EventSource(
+        `${import.meta.env.VITE_BACKEND_URL}/live?${params}`,
+        { withCredentials: true }
+      );
+      this.source.onmessage = (event: MessageEvent<string>) => {
+        const split = event.data.indexOf("\n");
+        if (split < 0) return;
+        this.emit(
+          "message",
+          event.data.slice(0, split),
+          event.data.slice(split + 1)
+        );
+      };
+    });
+  }
+
+  private emit<T extends EventName>(event: T, ...args: Parameters<ControlEventMap[T]>) {
+    this.handlers[event].forEach((handler) => {
+      (handler as (...params: Parameters<ControlEventMap[T]>) => void)(...args);
+    });
+  }
 }
 
 class MockControlClient implements ControlClient {
@@ -139,13 +265,19 @@ class MockControlClient implements ControlClient {
         toleranceWeight: DEFAULT_TOLERANCE_WEIGHT,
         toleranceDurationMs: DEFAULT_TOLERANCE_DURATION_MS,
         sensorReadIntervalMs: DEFAULT_SENSOR_READ_INTERVAL_MS,
-        heartbeatInterval: HEARTBEAT_DEFAULT_MINUTES,
+        targetVolume: DEFAULT_TARGET_VOLUME,
+        pulsesPerLiter: DEFAULT_PULSES_PER_LITER,
+        maxOpenDurationMs: DEFAULT_MAX_OPEN_DURATION_MS,
+        heartbeatInterval: DEFAULT_HEARTBEAT_INTERVAL,
+        tempCoefficient: DEFAULT_TEMP_COEFFICIENT,
         currentWeight: MOCK_WEIGHT_START - index * 75,
         startWeight: MOCK_WEIGHT_START - index * 75,
         lastWeight: MOCK_WEIGHT_START - index * 75,
         activatedAt: null,
         lastWeightReadAt: null,
         toleranceSatisfied: false,
+        flowPulses: 0,
+        flowRate: 0,
         closeTimer: null,
         weightTimer: null,
         progressTimer: null,
@@ -247,12 +379,30 @@ class MockControlClient implements ControlClient {
     const valve = this.valves.get(topicItem);
     if (!valve) return;
 
+    const { commandId } = payload;
+    if (commandId && commandId.length > MAX_COMMAND_ID_LENGTH) return;
+    const wasActive = valve.active;
     if (payload.message === "HIGH") {
-      this.activateValve(topicItem, valve);
-      return;
+      if (!wasActive) this.activateValve(topicItem, valve, commandId);
+    } else {
+      this.deactivateValve(topicItem, valve, "manual", commandId);
     }
 
-    this.deactivateValve(topicItem, valve, "manual");
+    if (commandId) {
+      this.emitMessage(
+        `${topic}/ack`,
+        JSON.stringify({
+          type: "ack",
+          message: {
+            commandId,
+            command: payload.message,
+            result: wasActive === valve.active ? "unchanged" : "applied",
+            state: valve.active ? "HIGH" : "LOW",
+          },
+          timestamp: new Date().toISOString(),
+        })
+      );
+    }
   }
 
   private handleConfig(topic: string, payload: MqttConfigMessage) {
@@ -288,46 +438,18 @@ class MockControlClient implements ControlClient {
     if (config.controlMode) {
       valve.controlMode = config.controlMode;
     }
-    if (typeof config.highDuration === "number") {
-      valve.highDuration = clamp(
-        config.highDuration,
-        MIN_HIGH_DURATION_MS,
-        MAX_HIGH_DURATION_MS
-      );
-    }
-    if (typeof config.targetWeightChange === "number") {
-      valve.targetWeightChange = Math.max(
-        config.targetWeightChange,
-        MIN_TARGET_WEIGHT_CHANGE
-      );
-    }
-    if (typeof config.toleranceWeight === "number") {
-      valve.toleranceWeight = Math.max(
-        config.toleranceWeight,
-        MIN_TOLERANCE_WEIGHT
-      );
-    }
-    if (typeof config.toleranceDurationMs === "number") {
-      valve.toleranceDurationMs = clamp(
-        config.toleranceDurationMs,
-        MIN_TOLERANCE_DURATION_MS,
-        MAX_TOLERANCE_DURATION_MS
-      );
-    }
-    if (typeof config.sensorReadIntervalMs === "number") {
-      valve.sensorReadIntervalMs = clamp(
-        config.sensorReadIntervalMs,
-        MIN_SENSOR_READ_INTERVAL_MS,
-        MAX_SENSOR_READ_INTERVAL_MS
-      );
-    }
-    if (typeof config.heartbeatInterval === "number") {
-      valve.heartbeatInterval = clamp(
-        config.heartbeatInterval,
-        HEARTBEAT_INTERVAL_MIN,
-        HEARTBEAT_INTERVAL_MAX
-      );
-      this.scheduleHeartbeat(topicItem);
+    // Same names, aliases and limits as configApply() on the controller.
+    for (const name of NUMERIC_VALVE_CONFIG_FIELDS) {
+      const field: NumericConfigField = VALVE_CONFIG_FIELDS[name];
+      const received: unknown =
+        config[name] ?? (field.alias ? Reflect.get(config, field.alias) : undefined);
+      if (typeof received !== "number") continue;
+      const outOfRange = received < field.min || received > field.max;
+      if (outOfRange && field.rejectOutOfRange) continue;
+      valve[name] = clamp(received, field.min, field.max);
+      if (name === "heartbeatInterval") {
+        this.scheduleHeartbeat(topicItem);
+      }
     }
 
     this.publishConfig(topicItem);
@@ -352,7 +474,11 @@ class MockControlClient implements ControlClient {
     this.publishHealth(topicItem);
   }
 
-  private activateValve(topicItem: string, valve: MockValveState) {
+  private activateValve(
+    topicItem: string,
+    valve: MockValveState,
+    commandId?: string
+  ) {
     this.clearValveTimers(valve);
     valve.active = true;
     valve.activatedAt = Date.now();
@@ -361,7 +487,7 @@ class MockControlClient implements ControlClient {
     valve.lastWeight = valve.currentWeight;
     valve.toleranceSatisfied = valve.toleranceWeight <= MIN_TOLERANCE_WEIGHT;
 
-    this.publishStatus(topicItem, valve, "HIGH");
+    this.publishStatus(topicItem, valve, "HIGH", undefined, commandId);
 
     if (valve.controlMode === enumControlMode.TIME) {
       valve.progressTimer = window.setInterval(() => {
@@ -374,6 +500,32 @@ class MockControlClient implements ControlClient {
       return;
     }
 
+    valve.closeTimer = window.setTimeout(() => {
+      this.deactivateValve(topicItem, valve, "max_duration");
+    }, valve.maxOpenDurationMs);
+
+    if (valve.controlMode === enumControlMode.FLOW) {
+      valve.flowPulses = 0;
+      valve.flowRate = 0;
+      const targetPulses = Math.round(valve.targetVolume * valve.pulsesPerLiter);
+      let lastTickAt = Date.now();
+      valve.progressTimer = window.setInterval(() => {
+        if (!valve.active) return;
+        const now = Date.now();
+        const pulses = Math.round(((now - lastTickAt) / 1000) * MOCK_FLOW_PULSE_HZ);
+        lastTickAt = now;
+        // The controller closes on the target pulse itself, never past it.
+        valve.flowPulses = Math.min(targetPulses, valve.flowPulses + pulses);
+        valve.flowRate = (MOCK_FLOW_PULSE_HZ * 60) / valve.pulsesPerLiter;
+        if (valve.flowPulses >= targetPulses) {
+          this.deactivateValve(topicItem, valve, "target_reached");
+          return;
+        }
+        this.publishStatus(topicItem, valve, "HIGH");
+      }, valve.sensorReadIntervalMs);
+      return;
+    }
+
     valve.weightTimer = window.setInterval(() => {
       if (!valve.active) return;
 
@@ -407,13 +559,14 @@ class MockControlClient implements ControlClient {
   private deactivateValve(
     topicItem: string,
     valve: MockValveState,
-    reason: string
+    reason: string,
+    commandId?: string
   ) {
     if (!valve.active) return;
 
     valve.active = false;
     this.clearValveTimers(valve);
-    this.publishStatus(topicItem, valve, "LOW", reason);
+    this.publishStatus(topicItem, valve, "LOW", reason, commandId);
     valve.activatedAt = null;
     valve.lastWeightReadAt = null;
     valve.toleranceSatisfied = false;
@@ -498,17 +651,13 @@ class MockControlClient implements ControlClient {
     const valve = this.valves.get(topicItem);
     if (valve) {
       const topic = `${topicItem}/${enumMqttTopicType.CONFIG}`;
+      const config: ValveControlConfig = { controlMode: valve.controlMode };
+      for (const name of NUMERIC_VALVE_CONFIG_FIELDS) {
+        config[name] = valve[name];
+      }
       const message: MqttConfigMessage = {
         type: enumMqttTopicType.CONFIG,
-        message: {
-          controlMode: valve.controlMode,
-          highDuration: valve.highDuration,
-          targetWeightChange: valve.targetWeightChange,
-          toleranceWeight: valve.toleranceWeight,
-          toleranceDurationMs: valve.toleranceDurationMs,
-          sensorReadIntervalMs: valve.sensorReadIntervalMs,
-          heartbeatInterval: valve.heartbeatInterval,
-        },
+        message: config,
         timestamp: new Date().toISOString(),
       };
       this.emitMessage(topic, JSON.stringify(message));
@@ -573,7 +722,8 @@ class MockControlClient implements ControlClient {
     topicItem: string,
     valve?: MockValveState,
     state?: ValveState,
-    reason?: string
+    reason?: string,
+    commandId?: string
   ) {
     if (!valve) {
       const sensor = this.sensors.get(topicItem);
@@ -595,15 +745,21 @@ class MockControlClient implements ControlClient {
     const topic = `${topicItem}/${enumMqttTopicType.STATUS}`;
     const weightChange = valve.startWeight - valve.lastWeight;
     const isTimeMode = valve.controlMode === enumControlMode.TIME;
+    const isFlowMode = valve.controlMode === enumControlMode.FLOW;
+    const volume = valve.flowPulses / valve.pulsesPerLiter;
     const progressValue = isTimeMode
       ? Math.min(
           valve.highDuration / 1000,
           valve.activatedAt === null ? 0 : (Date.now() - valve.activatedAt) / 1000
         )
-      : weightChange;
+      : isFlowMode
+        ? volume
+        : weightChange;
     const targetValue = isTimeMode
       ? valve.highDuration / 1000
-      : valve.targetWeightChange;
+      : isFlowMode
+        ? valve.targetVolume
+        : valve.targetWeightChange;
     const message = {
       type: enumMqttTopicType.STATUS,
       message: {
@@ -612,9 +768,11 @@ class MockControlClient implements ControlClient {
         weightChange,
         progressValue,
         targetValue,
-        progressUnit: isTimeMode ? "s" : "g",
+        progressUnit: isTimeMode ? "s" : isFlowMode ? "L" : "g",
         controlMode: valve.controlMode,
+        ...(isFlowMode ? { volume, flowRate: valve.flowRate } : {}),
         ...(reason ? { reason } : {}),
+        ...(commandId ? { commandId } : {}),
       },
       timestamp: new Date().toISOString(),
     };
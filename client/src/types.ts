@@ -24,6 +24,7 @@ export enum enumMqttTopicType {
 export enum enumControlMode {
   WEIGHT = "weight",
   TIME = "time",
+  FLOW = "flow",
 }
 
 export const getMqttTopicId = (
@@ -52,7 +53,12 @@ export interface ValveStatusPayload {
   targetValue?: number;
   progressUnit?: string;
   controlMode?: enumControlMode;
+  // Flow mode: liters since the valve opened, and liters per minute.
+  volume?: number;
+  flowRate?: number;
   reason?: string;
+  // Echoed from the control message that caused this transition.
+  commandId?: string;
 }
 
 export interface SensorStatusPayload {
@@ -89,6 +95,8 @@ export interface MqttHealthMessage extends MqttMessage<mqttHealthMessage> {
 
 export interface MqttControlMessage extends MqttMessage<string> {
   type: enumMqttTopicType.CONTROL;
+  // Answered on `<topic>/ack` and echoed in the resulting status.
+  commandId?: string;
 }
 
 export type MqttMessageAny =
@@ -105,6 +113,10 @@ export interface ValveControlConfig {
   toleranceWeight?: number;
   toleranceDurationMs?: number;
   sensorReadIntervalMs?: number;
+  targetVolume?: number;
+  pulsesPerLiter?: number;
+  maxOpenDurationMs?: number;
+  tempCoefficient?: number;
 }
 
 export interface SensorReaderConfig {
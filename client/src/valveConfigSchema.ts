@@ -0,0 +1,31 @@
+// Generated from controller/include/valve_config.h by
+// scripts/generateConfigSchema.js. Do not edit; run `npm run gen:config`.
+
+export const VALVE_CONFIG_FIELDS = {
+  controlMode: { type: "controlMode", scope: "valve", options: ["weight", "time", "flow"], default: "time" },
+  highDuration: { type: "ulong", scope: "valve", min: 1000, max: 600000, rejectOutOfRange: false, default: 3000 },
+  targetWeightChange: { type: "float", scope: "valve", alias: "targetWeightIncrease", min: 50, max: 20000, rejectOutOfRange: true, default: 100 },
+  toleranceWeight: { type: "float", scope: "valve", min: 0, max: 2000, rejectOutOfRange: true, default: 10 },
+  toleranceDurationMs: { type: "ulong", scope: "valve", min: 1000, max: 600000, rejectOutOfRange: false, default: 5000 },
+  sensorReadIntervalMs: { type: "ulong", scope: "valve", min: 100, max: 1000, rejectOutOfRange: false, default: 500 },
+  targetVolume: { type: "float", scope: "valve", min: 0.05, max: 10000, rejectOutOfRange: true, default: 1 },
+  pulsesPerLiter: { type: "float", scope: "valve", min: 1, max: 10000, rejectOutOfRange: false, default: 450 },
+  maxOpenDurationMs: { type: "ulong", scope: "valve", min: 10000, max: 14400000, rejectOutOfRange: false, default: 3600000 },
+  heartbeatInterval: { type: "float", scope: "controller", min: 0.1, max: 20, rejectOutOfRange: false, default: 5 },
+  tempCoefficient: { type: "float", scope: "controller", min: -50, max: 50, rejectOutOfRange: true, default: 0 },
+} as const;
+
+export type ValveConfigFieldName = keyof typeof VALVE_CONFIG_FIELDS;
+
+export const NUMERIC_VALVE_CONFIG_FIELDS = [
+  "highDuration",
+  "targetWeightChange",
+  "toleranceWeight",
+  "toleranceDurationMs",
+  "sensorReadIntervalMs",
+  "targetVolume",
+  "pulsesPerLiter",
+  "maxOpenDurationMs",
+  "heartbeatInterval",
+  "tempCoefficient",
+] as const;
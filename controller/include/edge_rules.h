@@ -0,0 +1,68 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Local rules linking other nodes' readings to this controller, e.g. "skip
+// watering above 90 % humidity" or "turn the aircon on above 28 °C", without
+// a browser in the loop. Rules arrive as JSON and are compiled into a fixed
+// table (persisted in NVS); evaluating a message is a topic lookup plus an
+// integer compare per rule.
+
+#define EDGE_MAX_RULES 8
+#define EDGE_MAX_TOPICS 4
+#define EDGE_TOPIC_LENGTH 64
+#define EDGE_PAYLOAD_LENGTH 48
+// Largest rules message the controller receives: a full table with
+// EDGE_TOPIC_LENGTH - 1 character topics and full payloads, as compact JSON
+// in its envelope. The controller's MQTT buffer and inbound document are
+// sized from it.
+#define EDGE_RULES_MAX_MESSAGE 3072
+
+enum EdgeField : uint8_t {
+  EDGE_FIELD_TEMPERATURE,
+  EDGE_FIELD_HUMIDITY,
+};
+
+enum EdgeCompare : uint8_t {
+  EDGE_ABOVE,
+  EDGE_BELOW,
+};
+
+enum EdgeAction : uint8_t {
+  EDGE_OPEN_VALVE,     // open once when the condition starts to hold
+  EDGE_INHIBIT_VALVE,  // skip scheduled and rule-driven openings while it holds
+  EDGE_PUBLISH,        // publish onTrue / onFalse to a target topic
+};
+
+struct EdgeRule {
+  uint8_t source;  // slot in the source topic table
+  EdgeField field;
+  EdgeCompare compare;
+  EdgeAction action;
+  int16_t thresholdCenti;  // hundredths of °C or %RH
+  int16_t hysteresisCenti;
+  uint8_t valve;   // valve index for valve actions
+  uint8_t target;  // slot in the target topic table for EDGE_PUBLISH
+  char onTrue[EDGE_PAYLOAD_LENGTH];  // serialized JSON message, or empty
+  char onFalse[EDGE_PAYLOAD_LENGTH];
+};
+
+// Called when a rule's condition starts (holds) or stops holding.
+typedef void (*EdgeRuleHandler)(const EdgeRule& rule, const char* targetTopic,
+                                bool holds);
+
+void edgeRulesBegin();
+// Replaces the table from a JSON rule list and persists it. Returns the
+// number of rules compiled; invalid entries are skipped.
+size_t edgeRulesCompile(JsonArrayConst list, size_t valveCount);
+size_t edgeRulesCount();
+size_t edgeRulesSourceCount();
+const char* edgeRulesSource(size_t slot);
+
+// Returns false if the topic is not a rule source.
+bool edgeRulesEvaluate(const char* topic, JsonVariantConst message,
+                       EdgeRuleHandler handler);
+bool edgeRulesInhibit(uint8_t valve);
+unsigned long edgeRulesMaxEvalUs();
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+
+// Hall-effect flow sensors counted by the PCNT peripheral, one unit per
+// channel, so pulses cost no CPU time. A run can be armed with a target:
+// the interrupt for the pulse that reaches it drives the valve pin low
+// itself, instead of leaving that to the next loop() pass.
+//
+// The hardware counter is 16 bits; it wraps at FLOW_PCNT_LIMIT and the
+// interrupt extends it, so a run can count up to 2^32 pulses.
+
+#define FLOW_MAX_CHANNELS 4
+
+void flowMeterBegin(const uint8_t* pulsePins, uint8_t channelCount);
+uint8_t flowMeterChannelCount();
+
+// Zeroes the channel and arms it to set `valvePin` low after
+// `targetPulses` pulses; 0 only counts.
+void flowMeterStart(uint8_t channel, uint32_t targetPulses, uint8_t valvePin);
+// Disarms the target; counting continues.
+void flowMeterStop(uint8_t channel);
+// Pulses since flowMeterStart().
+uint32_t flowMeterPulses(uint8_t channel);
+// True once after the interrupt closed the valve at the target.
+bool flowMeterTargetReached(uint8_t channel);
+
+// Bench builds: square wave of `hz` on the channel's own pulse pin, which
+// the PCNT unit counts like a sensor. Pins 34-39 are input-only and cannot
+// be used for this.
+void flowMeterSimulatePulses(uint8_t channel, uint32_t hz);
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// On-device watering schedule, driven by the NTP-synced clock so valves
+// keep running when the broker or web app is unreachable. Pending fire
+// times are kept in a table sorted by time; a tick only compares the head
+// against the clock.
+
+#define SCHEDULE_MAX_VALVES 8
+#define SCHEDULE_MAX_RULES_PER_VALVE 4
+#define SCHEDULE_EVERY_DAY 0x7F
+
+enum ScheduleKind : uint8_t {
+  SCHEDULE_DAILY,     // once at minuteOfDay
+  SCHEDULE_INTERVAL,  // every intervalMinutes from minuteOfDay until the
+                      // next day's start
+};
+
+struct ScheduleRule {
+  ScheduleKind kind;
+  uint8_t weekdays;  // bit 0 is Sunday, as in tm_wday
+  uint16_t minuteOfDay;  // local time
+  uint16_t intervalMinutes;
+};
+
+// First fire time strictly after `after`, or 0 if the rule never fires.
+time_t nextScheduleFire(const ScheduleRule& rule, time_t after);
+
+// Restores the rules for `valveCount` valves from NVS.
+void scheduleBegin(size_t valveCount);
+// Replaces a valve's rules and persists them. An empty list clears them.
+bool scheduleSetRules(size_t valve, const ScheduleRule* rules, size_t count);
+size_t scheduleGetRules(size_t valve, ScheduleRule* rules);
+// Next pending fire for a valve, or 0 if none (or the clock is not set).
+time_t scheduleNextFire(size_t valve);
+// Index of a valve due at `now`, or -1. Each call consumes one firing, so
+// call until it returns -1.
+int scheduleDue(time_t now);
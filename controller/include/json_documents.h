@@ -0,0 +1,18 @@
+#pragma once
+
+#include <arena_allocator.h>
+
+#include "edge_rules.h"
+
+// Incoming commands and outgoing publishes each reuse one static document,
+// so steady-state operation does not touch the heap. They are separate
+// because handling a command publishes state while the command is in use.
+// The inbound one has room to parse the largest rules message; the
+// outbound one holds any message publishJson() can send.
+//
+// Sizes are for the ESP32. ArduinoJson slots and allocator headers are
+// twice as big on a 64-bit host, so native builds get twice the room.
+constexpr size_t JSON_ARENA_SCALE = sizeof(void*) / 4;
+using InboundJsonDocument =
+    ArenaJsonDocument<JSON_ARENA_SCALE * 2 * EDGE_RULES_MAX_MESSAGE>;
+using OutboundJsonDocument = ArenaJsonDocument<JSON_ARENA_SCALE * 2048>;
@@ -6,4 +6,32 @@
 #define MQTT_SERVER "1234567890.s2.eu.hivemq.cloud";
 #define MQTT_PORT 8883;
 #define MQTT_USERNAME "mqtt-username";
-#define MQTT_PASSWORD "mqtt-password";
\ No newline at end of file
+#define MQTT_PASSWORD "mqtt-password";
+
+// Optional: PEM of the broker's root CA (HiveMQ Cloud uses Let's Encrypt's
+// ISRG Root X1). When defined the broker certificate is verified instead of
+// connecting with setInsecure().
+// #define MQTT_CA_CERT \
+//   "-----BEGIN CERTIFICATE-----\n" \
+//   "...\n" \
+//   "-----END CERTIFICATE-----\n";
+
+// Optional: PEM of the root CA of the server OTA images are downloaded
+// from. Defaults to MQTT_CA_CERT; the image's SHA-256 is checked either way.
+// #define OTA_CA_CERT \
+//   "-----BEGIN CERTIFICATE-----\n" \
+//   "...\n" \
+//   "-----END CERTIFICATE-----\n";
+
+// Optional: fail over to a broker on the LAN advertised over mDNS as
+// _mqtt._tcp while MQTT_SERVER is unreachable, and fail back once it
+// answers again. The LAN session is TLS, verified against MQTT_LAN_CA_CERT,
+// with its own credentials. Use a private CA that signs only the LAN
+// broker: it is reached by IP, so its host name is not checked.
+// #define MQTT_LAN_FAILOVER 1
+// #define MQTT_LAN_USERNAME "lan-mqtt-username";
+// #define MQTT_LAN_PASSWORD "lan-mqtt-password";
+// #define MQTT_LAN_CA_CERT \
+//   "-----BEGIN CERTIFICATE-----\n" \
+//   "...\n" \
+//   "-----END CERTIFICATE-----\n";
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Ring capture of the controller's inputs, so field problems such as an
+// early tolerance_timeout or a stale-message reject can be replayed from
+// what the controller actually saw. Every record starts with a uint8 kind
+// and the uint32 millis() it was taken at; the oldest records are dropped
+// whole as the ring fills. Multi-byte fields are little-endian.
+//
+//   TRACE_CLOCK        int64 epoch ms, 0 before NTP sync
+//   TRACE_WEIGHT       uint8 scale channel, int32 tared, corrected counts as
+//                      the control loop used
+//   TRACE_TEMPERATURE  float °C from the scale's AHT10
+//   TRACE_MQTT         uint8 topic length, uint16 payload length, topic,
+//                      payload (cut at TRACE_MAX_PAYLOAD bytes)
+
+#ifndef TRACE_BUFFER_BYTES
+#define TRACE_BUFFER_BYTES 16384
+#endif
+#define TRACE_MAX_PAYLOAD 384
+
+enum TraceKind : uint8_t {
+  TRACE_CLOCK = 1,
+  TRACE_WEIGHT = 2,
+  TRACE_TEMPERATURE = 3,
+  TRACE_MQTT = 4,
+};
+
+void traceSetEnabled(bool enabled);
+bool traceEnabled();
+void traceClear();
+
+void traceClock(int64_t epochMs);
+void traceWeight(uint8_t channel, int32_t counts);
+void traceTemperature(float celsius);
+void traceMqtt(const char* topic, const uint8_t* payload, size_t length);
+
+// Bytes held and records overwritten since the last clear.
+size_t traceSize();
+uint32_t traceDropped();
+// Copies up to `size` bytes of the record stream, oldest first, starting
+// `offset` bytes in. Returns the number of bytes copied.
+size_t traceRead(size_t offset, uint8_t* buffer, size_t size);
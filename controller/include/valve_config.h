@@ -0,0 +1,132 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Settings carried on <deviceId>/<valve>/config. CONFIG_FIELDS is the one
+// list of them: it drives parsing, publishing and the defaults, and
+// client/src/valveConfigSchema.ts is generated from it
+// (`npm run gen:config` in client/) so the UI and the mock controller use
+// the same names and limits.
+
+enum ControlMode {
+  CONTROL_MODE_WEIGHT,
+  CONTROL_MODE_TIME,
+  CONTROL_MODE_FLOW,
+};
+
+struct ValveConfig {
+  uint8_t pin;
+  uint8_t scale;  // HX711 channel under this valve's reservoir
+  uint8_t flowMeter;  // flow sensor channel on this valve's line
+  bool active;
+  unsigned long startTime;
+  unsigned long lastWeightReadTime;
+  unsigned long lastProgressPublishTime;
+  int32_t startCounts;
+  int32_t lastCounts;
+  ControlMode controlMode;
+  unsigned long highDurationMs;
+  float targetWeightChange;
+  float toleranceWeight;
+  unsigned long toleranceDurationMs;
+  unsigned long sensorReadIntervalMs;
+  float targetVolume;
+  float pulsesPerLiter;
+  // Weight and flow modes close after this long even short of the target.
+  unsigned long maxOpenDurationMs;
+  bool toleranceSatisfied;
+  // targetWeightChange and toleranceWeight in counts, see
+  // refreshWeightThresholds().
+  int32_t targetCounts;
+  int32_t toleranceCounts;
+  // Flow mode: pulses at the last progress sample, the last time the count
+  // moved, and the rate between the last two samples.
+  uint32_t lastFlowPulses;
+  unsigned long lastFlowPulseTime;
+  float flowRateLpm;
+};
+
+// Controller-wide settings, accepted and published on every valve's topic.
+struct ControllerConfig {
+  float healthIntervalMin;
+  float tempCoefficient;  // grams per degree, see weight_sensor.h
+};
+
+enum ConfigFieldType : uint8_t {
+  CONFIG_ULONG,
+  CONFIG_FLOAT,
+  CONFIG_CONTROL_MODE,
+};
+
+enum ConfigFieldScope : uint8_t {
+  CONFIG_SCOPE_VALVE,
+  CONFIG_SCOPE_CONTROLLER,
+};
+
+// Out-of-range values are clamped unless CONFIG_REJECT_OUT_OF_RANGE is set,
+// in which case the update is ignored.
+enum ConfigFieldFlags : uint8_t {
+  CONFIG_REJECT_OUT_OF_RANGE = 1 << 0,
+  // The valve's count thresholds must be recomputed after a change.
+  CONFIG_WEIGHT_THRESHOLD = 1 << 1,
+  // Ignored while the valve is open: the open and close paths branch on it,
+  // so a change mid-run would arm one mode's stop and check another's.
+  CONFIG_FIXED_WHILE_ACTIVE = 1 << 2,
+  // Lives in the weight sensor, which persists it; hand it over after a
+  // change.
+  CONFIG_TEMP_COEFFICIENT = 1 << 3,
+};
+
+struct ConfigField {
+  const char* name;
+  const char* alias;  // older name still accepted on input, or nullptr
+  ConfigFieldType type;
+  ConfigFieldScope scope;
+  uint16_t offset;  // into ValveConfig or ControllerConfig
+  float min;
+  float max;
+  float defaultValue;
+  uint8_t flags;
+};
+
+#define VALVE_FIELD(member) CONFIG_SCOPE_VALVE, offsetof(ValveConfig, member)
+#define CONTROLLER_FIELD(member) \
+  CONFIG_SCOPE_CONTROLLER, offsetof(ControllerConfig, member)
+
+// One row per field; the TypeScript generator parses these rows, so keep
+// each on one line. Durations are in ms, weights in grams, volumes in
+// liters, the heartbeat interval in minutes and the temperature
+// coefficient in grams per degree.
+constexpr ConfigField CONFIG_FIELDS[] = {
+  // name, alias, type, scope+offset, min, max, default, flags
+  {"controlMode", nullptr, CONFIG_CONTROL_MODE, VALVE_FIELD(controlMode), CONTROL_MODE_WEIGHT, CONTROL_MODE_FLOW, CONTROL_MODE_TIME, CONFIG_FIXED_WHILE_ACTIVE},
+  {"highDuration", nullptr, CONFIG_ULONG, VALVE_FIELD(highDurationMs), 1000, 600000, 3000, 0},
+  {"targetWeightChange", "targetWeightIncrease", CONFIG_FLOAT, VALVE_FIELD(targetWeightChange), 50, 20000, 100, CONFIG_REJECT_OUT_OF_RANGE | CONFIG_WEIGHT_THRESHOLD},
+  {"toleranceWeight", nullptr, CONFIG_FLOAT, VALVE_FIELD(toleranceWeight), 0, 2000, 10, CONFIG_REJECT_OUT_OF_RANGE | CONFIG_WEIGHT_THRESHOLD},
+  {"toleranceDurationMs", nullptr, CONFIG_ULONG, VALVE_FIELD(toleranceDurationMs), 1000, 600000, 5000, 0},
+  {"sensorReadIntervalMs", nullptr, CONFIG_ULONG, VALVE_FIELD(sensorReadIntervalMs), 100, 1000, 500, 0},
+  {"targetVolume", nullptr, CONFIG_FLOAT, VALVE_FIELD(targetVolume), 0.05f, 10000, 1, CONFIG_REJECT_OUT_OF_RANGE},
+  {"pulsesPerLiter", nullptr, CONFIG_FLOAT, VALVE_FIELD(pulsesPerLiter), 1, 10000, 450, 0},
+  {"maxOpenDurationMs", nullptr, CONFIG_ULONG, VALVE_FIELD(maxOpenDurationMs), 10000, 14400000, 3600000, 0},
+  {"heartbeatInterval", nullptr, CONFIG_FLOAT, CONTROLLER_FIELD(healthIntervalMin), 0.1f, 20, 5, 0},
+  {"tempCoefficient", nullptr, CONFIG_FLOAT, CONTROLLER_FIELD(tempCoefficient), -50, 50, 0, CONFIG_REJECT_OUT_OF_RANGE | CONFIG_TEMP_COEFFICIENT},
+};
+
+constexpr size_t CONFIG_FIELD_COUNT =
+    sizeof(CONFIG_FIELDS) / sizeof(CONFIG_FIELDS[0]);
+
+const char* controlModeToString(ControlMode mode);
+ControlMode parseControlMode(const char* mode);
+
+void configApplyDefaults(ValveConfig& valve, ControllerConfig& controller);
+
+// Applies every known field of `message` in one pass over its members and
+// returns the ConfigFieldFlags of the fields it applied. Unknown
+// members are left for the caller.
+uint8_t configApply(JsonObjectConst message, int valveId, ValveConfig& valve,
+                    ControllerConfig& controller);
+
+void configPublish(JsonObject message, const ValveConfig& valve,
+                   const ControllerConfig& controller);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "valve_config.h"
+
+// Flow-mode decisions for an open valve, apart from the GPIO and MQTT code
+// so they run on the host. The pulse count comes from flowMeterPulses();
+// the target itself is enforced by the flow meter's interrupt.
+
+// Pulses for targetVolume, to arm flowMeterStart() with.
+uint32_t valveFlowTargetPulses(const ValveConfig& valve);
+
+// Starts a cycle as the valve opens.
+void valveFlowStart(ValveConfig& valve, unsigned long now);
+
+// Liters for a pulse count.
+float valveFlowVolume(const ValveConfig& valve, uint32_t pulses);
+
+// Takes a progress sample: the rate since the previous sample, and the
+// time the count last moved.
+void valveFlowSample(ValveConfig& valve, uint32_t pulses, unsigned long now);
+
+// The status reason to close the valve with, or nullptr to keep it open.
+// `targetReached` is flowMeterTargetReached(), which has already driven
+// the pin low.
+const char* valveFlowCheck(const ValveConfig& valve, bool targetReached,
+                           unsigned long now);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "valve_config.h"
+
+// Weight-mode decisions for an open valve, apart from the GPIO and MQTT
+// code so they run on the host. Counts keep the sign of the scale's
+// calibration: on a load cell wired the other way round counts fall as
+// weight is added, and the thresholds are negative to match. Every
+// comparison therefore goes by the threshold's sign, never by `>=`.
+
+// targetWeightChange and toleranceWeight in counts of the valve's scale.
+void refreshWeightThresholds(ValveConfig& valve);
+
+// Starts a cycle from a reading taken as the valve opens.
+void valveWeightStart(ValveConfig& valve, int32_t counts, unsigned long now);
+
+// Weight change since the valve opened, corrected for the scale's idle
+// drift rate (counts per minute, Q8). 0 outside weight mode.
+int32_t valveWeightChange(const ValveConfig& valve,
+                          int32_t driftCountsPerMinQ8, unsigned long now);
+
+// The status reason to close the valve with, or nullptr to keep it open.
+// `sampled` is true when valve.lastCounts was just read; the target is
+// only compared against fresh readings.
+const char* valveWeightCheck(ValveConfig& valve, int32_t changeCounts,
+                             bool sampled, unsigned long now);
+
+// Idle drift tracking: while no valve on a scale is open the scale is
+// sampled periodically. Readings within the zero band pull the zero point
+// towards them, and slow changes between stable samples feed a drift-rate
+// estimate that valveWeightChange() compensates for.
+struct ScaleTracking {
+  int32_t zeroTrackingBandCounts;
+  int32_t driftStableBandCounts;
+  int32_t lastIdleCounts;
+  bool hasIdleSample;
+  int32_t driftCountsPerMinQ8;
+  int32_t zeroTrackedCounts;
+};
+
+// Recomputes the bands in counts of `channel` and starts over from the
+// next sample; the drift estimate is kept.
+void scaleTrackingRefresh(ScaleTracking& tracking, uint8_t channel);
+
+// One idle reading of `channel`, `elapsedMs` after the previous one. May
+// move the channel's zero point through weightSensorAdjustTare().
+void scaleTrackingSample(ScaleTracking& tracking, uint8_t channel,
+                         int32_t counts, unsigned long elapsedMs);
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fixed-point HX711 path. Readings stay as signed 24-bit counts relative to
+// an integer tare offset, and the calibration is held as counts per gram in
+// Q16.16. Callers convert thresholds to counts when config is applied so the
+// control loop only compares integers; grams are produced for publishing.
+//
+// Several HX711s can share one SCK line. Every conversion clocks all of
+// them at once and samples their DOUT lines in the same bit loop, so N
+// scales take as long to read as one. Each channel has its own tare,
+// calibration and temperature reference; the temperature coefficient is
+// shared, as there is one temperature sensor.
+
+#define WEIGHT_MAX_CHANNELS 4
+
+struct WeightCalibration {
+  int32_t tareOffset;  // raw counts with nothing on the scale
+  int32_t countsPerGramQ16;
+};
+
+struct CalibrationPoint {
+  int32_t raw;  // untared average
+  float grams;
+};
+
+// Pins 0-39; pins 34-39 are input-only and fine for DOUT.
+void weightSensorBegin(const uint8_t* dataPins, uint8_t channelCount,
+                       uint8_t clockPin);
+uint8_t weightSensorChannelCount();
+void weightSensorSetScale(uint8_t channel, float countsPerGram);
+// Averages `samples` conversions and uses the result as the zero point of
+// each channel whose bit is set in `channelMask`.
+void weightSensorTare(uint32_t channelMask, uint8_t samples);
+// Tared and temperature-corrected readings of every channel, each averaged
+// over `samples` conversions. Returns false if a scale did not become
+// ready; `counts` is then left unchanged.
+bool readWeightCounts(uint8_t samples, int32_t* counts);
+// Untared readings, for capturing calibration points.
+bool readWeightRaw(uint8_t samples, int32_t* raw);
+// Duration of the last readWeightCounts()/readWeightRaw() in microseconds,
+// including the wait for the scales to become ready.
+uint32_t weightSensorLastReadUs();
+
+int32_t gramsToWeightCounts(uint8_t channel, float grams);
+// Rounded to the nearest milligram.
+float weightCountsToGrams(uint8_t channel, int32_t counts);
+
+WeightCalibration weightSensorCalibration(uint8_t channel);
+void weightSensorApplyCalibration(uint8_t channel,
+                                  const WeightCalibration& calibration);
+
+// Least-squares line raw = tareOffset + countsPerGram * grams through the
+// points. Needs two or more distinct weights; maxResidualGrams receives the
+// largest distance of a point from the fitted line.
+bool fitWeightCalibration(const CalibrationPoint* points, size_t count,
+                          WeightCalibration& calibration,
+                          float& maxResidualGrams);
+
+// Moves a channel's zero point by `counts`, for idle zero tracking.
+void weightSensorAdjustTare(uint8_t channel, int32_t counts);
+
+// Temperature compensation: readings are corrected by
+// coefficient * (temperature - reference), where the reference is the
+// temperature when the channel's zero point was last set. Off while the
+// coefficient is 0 or no temperature has been reported.
+void weightSensorSetTemperature(float celsius);
+void weightSensorSetTemperatureCoefficient(float gramsPerDegree);
+float weightSensorTemperatureCoefficient();
+
+// Calibration persisted in NVS per channel, so boot needs neither a tare
+// nor a reflash. Load returns false when nothing has been saved for the
+// channel.
+bool weightSensorLoadCalibration(uint8_t channel);
+bool weightSensorSaveCalibration(uint8_t channel);
+void weightSensorClearCalibration(uint8_t channel);
@@ -0,0 +1,268 @@
+#include "edge_rules.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <device_log.h>
+#include <math.h>
+#include <string.h>
+
+namespace {
+constexpr const char* PREFS_NAMESPACE = "rules";
+constexpr const char* PREFS_TABLE_KEY = "table";
+// A silent source (sensor offline) stops inhibiting after this long.
+constexpr unsigned long SOURCE_TIMEOUT_MS = 15UL * 60UL * 1000UL;
+
+struct EdgeRuleTable {
+  uint8_t ruleCount;
+  uint8_t sourceCount;
+  uint8_t targetCount;
+  char sources[EDGE_MAX_TOPICS][EDGE_TOPIC_LENGTH];
+  char targets[EDGE_MAX_TOPICS][EDGE_TOPIC_LENGTH];
+  EdgeRule rules[EDGE_MAX_RULES];
+};
+
+EdgeRuleTable table;
+bool holding[EDGE_MAX_RULES];
+unsigned long sourceUpdatedAt[EDGE_MAX_TOPICS];
+unsigned long maxEvalUs = 0;
+
+int findTopic(const char topics[][EDGE_TOPIC_LENGTH], uint8_t count,
+              const char* topic) {
+  for (uint8_t i = 0; i < count; i++) {
+    if (strcmp(topics[i], topic) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Returns the slot for the topic, adding it if there is room.
+int internTopic(char topics[][EDGE_TOPIC_LENGTH], uint8_t& count,
+                const char* topic) {
+  if (!topic || strlen(topic) >= EDGE_TOPIC_LENGTH) {
+    return -1;
+  }
+  int slot = findTopic(topics, count, topic);
+  if (slot < 0 && count < EDGE_MAX_TOPICS) {
+    strcpy(topics[count], topic);
+    slot = count++;
+  }
+  return slot;
+}
+
+// Hundredths, saturated: a reading past the range still compares on the
+// right side of every threshold.
+int16_t toCenti(float value) {
+  const float centi = value * 100.0f;
+  if (centi >= INT16_MAX) {
+    return INT16_MAX;
+  }
+  if (centi <= INT16_MIN) {
+    return INT16_MIN;
+  }
+  return static_cast<int16_t>(lroundf(centi));
+}
+
+// Thresholds and bands have to be exact in hundredths.
+bool parseCenti(JsonVariantConst value, int16_t& centi) {
+  if (!value.is<float>()) {
+    return false;
+  }
+  const float number = value.as<float>();
+  if (!(fabsf(number) <= INT16_MAX / 100.0f)) {
+    return false;
+  }
+  centi = toCenti(number);
+  return true;
+}
+
+bool serializePayload(JsonVariantConst value, char* out) {
+  out[0] = '\0';
+  if (value.isNull()) {
+    return true;
+  }
+  size_t length = serializeJson(value, out, EDGE_PAYLOAD_LENGTH);
+  return length > 0 && length < EDGE_PAYLOAD_LENGTH - 1;
+}
+
+bool compileRule(JsonObjectConst entry, size_t valveCount, EdgeRuleTable& out,
+                 EdgeRule& rule) {
+  memset(&rule, 0, sizeof(rule));
+
+  const char* field = entry["field"] | "";
+  if (strcmp(field, "temperature") == 0) {
+    rule.field = EDGE_FIELD_TEMPERATURE;
+  } else if (strcmp(field, "humidity") == 0) {
+    rule.field = EDGE_FIELD_HUMIDITY;
+  } else {
+    return false;
+  }
+
+  if (entry["above"].is<float>()) {
+    rule.compare = EDGE_ABOVE;
+    if (!parseCenti(entry["above"], rule.thresholdCenti)) {
+      return false;
+    }
+  } else if (entry["below"].is<float>()) {
+    rule.compare = EDGE_BELOW;
+    if (!parseCenti(entry["below"], rule.thresholdCenti)) {
+      return false;
+    }
+  } else {
+    return false;
+  }
+  if (!entry["hysteresis"].isNull() &&
+      !parseCenti(entry["hysteresis"], rule.hysteresisCenti)) {
+    return false;
+  }
+
+  if (entry["openValve"].is<int>() || entry["inhibitValve"].is<int>()) {
+    rule.action = entry["openValve"].is<int>() ? EDGE_OPEN_VALVE
+                                               : EDGE_INHIBIT_VALVE;
+    int valveId = entry["openValve"].is<int>() ? entry["openValve"].as<int>()
+                                               : entry["inhibitValve"].as<int>();
+    if (valveId < 1 || valveId > static_cast<int>(valveCount)) {
+      return false;
+    }
+    rule.valve = valveId - 1;
+  } else if (entry["publish"].is<const char*>()) {
+    rule.action = EDGE_PUBLISH;
+    int target = internTopic(out.targets, out.targetCount, entry["publish"]);
+    if (target < 0 || !serializePayload(entry["onTrue"], rule.onTrue) ||
+        !serializePayload(entry["onFalse"], rule.onFalse)) {
+      return false;
+    }
+    rule.target = target;
+  } else {
+    return false;
+  }
+
+  int source = internTopic(out.sources, out.sourceCount, entry["source"]);
+  if (source < 0) {
+    return false;
+  }
+  rule.source = source;
+  return true;
+}
+
+bool ruleHolds(const EdgeRule& rule, bool wasHolding, int16_t value) {
+  // Once holding, the condition has to clear the hysteresis band to release.
+  const int16_t band = wasHolding ? rule.hysteresisCenti : 0;
+  return rule.compare == EDGE_ABOVE ? value > rule.thresholdCenti - band
+                                    : value < rule.thresholdCenti + band;
+}
+
+void resetState() {
+  memset(holding, 0, sizeof(holding));
+  memset(sourceUpdatedAt, 0, sizeof(sourceUpdatedAt));
+}
+}  // namespace
+
+void edgeRulesBegin() {
+  memset(&table, 0, sizeof(table));
+  resetState();
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, true)) {
+    return;
+  }
+  if (prefs.getBytes(PREFS_TABLE_KEY, &table, sizeof(table)) != sizeof(table)) {
+    memset(&table, 0, sizeof(table));
+  }
+  prefs.end();
+}
+
+size_t edgeRulesCompile(JsonArrayConst list, size_t valveCount) {
+  EdgeRuleTable compiled;
+  memset(&compiled, 0, sizeof(compiled));
+  for (JsonObjectConst entry : list) {
+    if (compiled.ruleCount == EDGE_MAX_RULES) {
+      LOG_WARN("⚠️ Only the first %d edge rules are kept", EDGE_MAX_RULES);
+      break;
+    }
+    if (compileRule(entry, valveCount, compiled,
+                    compiled.rules[compiled.ruleCount])) {
+      compiled.ruleCount++;
+    } else {
+      LOG_WARN("⚠️ Ignoring invalid edge rule %u",
+               (unsigned)compiled.ruleCount);
+    }
+  }
+
+  // Retained rule messages are redelivered on every reconnect; keep the
+  // current state and skip the flash write when nothing changed.
+  if (memcmp(&compiled, &table, sizeof(table)) == 0) {
+    return table.ruleCount;
+  }
+  table = compiled;
+  resetState();
+
+  Preferences prefs;
+  if (prefs.begin(PREFS_NAMESPACE, false)) {
+    prefs.putBytes(PREFS_TABLE_KEY, &table, sizeof(table));
+    prefs.end();
+  }
+  return table.ruleCount;
+}
+
+size_t edgeRulesCount() {
+  return table.ruleCount;
+}
+
+size_t edgeRulesSourceCount() {
+  return table.sourceCount;
+}
+
+const char* edgeRulesSource(size_t slot) {
+  return slot < table.sourceCount ? table.sources[slot] : nullptr;
+}
+
+bool edgeRulesEvaluate(const char* topic, JsonVariantConst message,
+                       EdgeRuleHandler handler) {
+  const int source = findTopic(table.sources, table.sourceCount, topic);
+  if (source < 0) {
+    return false;
+  }
+  const unsigned long startedAt = micros();
+  sourceUpdatedAt[source] = millis();
+
+  const bool hasValue[] = {message["temperature"].is<float>(),
+                           message["humidity"].is<float>()};
+  const int16_t values[] = {toCenti(message["temperature"] | 0.0f),
+                            toCenti(message["humidity"] | 0.0f)};
+
+  for (uint8_t i = 0; i < table.ruleCount; i++) {
+    const EdgeRule& rule = table.rules[i];
+    if (rule.source != source || !hasValue[rule.field]) {
+      continue;
+    }
+    const bool holds = ruleHolds(rule, holding[i], values[rule.field]);
+    if (holds != holding[i]) {
+      holding[i] = holds;
+      handler(rule, rule.action == EDGE_PUBLISH ? table.targets[rule.target]
+                                                : nullptr,
+              holds);
+    }
+  }
+
+  const unsigned long evalUs = micros() - startedAt;
+  if (evalUs > maxEvalUs) {
+    maxEvalUs = evalUs;
+  }
+  return true;
+}
+
+bool edgeRulesInhibit(uint8_t valve) {
+  const unsigned long now = millis();
+  for (uint8_t i = 0; i < table.ruleCount; i++) {
+    const EdgeRule& rule = table.rules[i];
+    if (rule.action == EDGE_INHIBIT_VALVE && rule.valve == valve &&
+        holding[i] && now - sourceUpdatedAt[rule.source] < SOURCE_TIMEOUT_MS) {
+      return true;
+    }
+  }
+  return false;
+}
+
+unsigned long edgeRulesMaxEvalUs() {
+  return maxEvalUs;
+}
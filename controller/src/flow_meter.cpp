@@ -0,0 +1,182 @@
+#include "flow_meter.h"
+
+#include <Arduino.h>
+#include <driver/gpio.h>
+#include <driver/pcnt.h>
+#include <freertos/FreeRTOS.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+
+#include <device_log.h>
+
+namespace {
+constexpr int16_t FLOW_PCNT_LIMIT = 30000;
+// Pulses shorter than this many 80 MHz APB cycles (12.5 us) are noise.
+constexpr uint16_t GLITCH_FILTER_CYCLES = 1000;
+constexpr uint8_t SIMULATOR_LEDC_CHANNEL = 0;
+
+struct Channel {
+  pcnt_unit_t unit;
+  uint8_t pulsePin;
+  // Written by the interrupt.
+  volatile uint32_t wraps;
+  volatile bool armed;
+  volatile bool reached;
+  uint32_t targetWraps;
+  int16_t targetRemainder;
+  uint8_t valvePin;
+};
+
+Channel channels[FLOW_MAX_CHANNELS];
+uint8_t channelCount = 0;
+portMUX_TYPE flowMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Register write rather than digitalWrite(), which is not in IRAM.
+void IRAM_ATTR setPinLowFromIsr(uint8_t pin) {
+  if (pin < 32) {
+    REG_WRITE(GPIO_OUT_W1TC_REG, 1UL << pin);
+  } else {
+    REG_WRITE(GPIO_OUT1_W1TC_REG, 1UL << (pin - 32));
+  }
+}
+
+void IRAM_ATTR onPcntEvent(void* arg) {
+  Channel& channel = channels[reinterpret_cast<uintptr_t>(arg)];
+  uint32_t status = 0;
+  pcnt_get_event_status(channel.unit, &status);
+
+  portENTER_CRITICAL_ISR(&flowMux);
+  // The counter restarts from 0 at the limit.
+  if (status & PCNT_EVT_H_LIM) {
+    channel.wraps = channel.wraps + 1;
+  }
+  // Threshold 0 fires on every wrap; only the last one counts. A target
+  // that is a whole number of wraps is reached at the limit itself.
+  const bool atTarget =
+      channel.wraps == channel.targetWraps &&
+      (channel.targetRemainder == 0 ? (status & PCNT_EVT_H_LIM) != 0
+                                    : (status & PCNT_EVT_THRES_0) != 0);
+  if (channel.armed && atTarget) {
+    setPinLowFromIsr(channel.valvePin);
+    channel.armed = false;
+    channel.reached = true;
+  }
+  portEXIT_CRITICAL_ISR(&flowMux);
+}
+}  // namespace
+
+void flowMeterBegin(const uint8_t* pulsePins, uint8_t count) {
+  channelCount = count > FLOW_MAX_CHANNELS ? FLOW_MAX_CHANNELS : count;
+  if (channelCount == 0) {
+    return;
+  }
+  pcnt_isr_service_install(0);
+  for (uint8_t i = 0; i < channelCount; i++) {
+    Channel& channel = channels[i];
+    channel.unit = static_cast<pcnt_unit_t>(PCNT_UNIT_0 + i);
+    channel.pulsePin = pulsePins[i];
+
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = pulsePins[i];
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.channel = PCNT_CHANNEL_0;
+    config.unit = channel.unit;
+    config.pos_mode = PCNT_COUNT_INC;
+    config.neg_mode = PCNT_COUNT_DIS;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.counter_h_lim = FLOW_PCNT_LIMIT;
+    config.counter_l_lim = -FLOW_PCNT_LIMIT;
+    pcnt_unit_config(&config);
+
+    pcnt_set_filter_value(channel.unit, GLITCH_FILTER_CYCLES);
+    pcnt_filter_enable(channel.unit);
+    pcnt_event_enable(channel.unit, PCNT_EVT_H_LIM);
+    pcnt_isr_handler_add(channel.unit, onPcntEvent,
+                         reinterpret_cast<void*>(static_cast<uintptr_t>(i)));
+    pcnt_counter_pause(channel.unit);
+    pcnt_counter_clear(channel.unit);
+    pcnt_counter_resume(channel.unit);
+  }
+  LOG_INFO("✅ %u flow meter(s) counting", (unsigned)channelCount);
+}
+
+uint8_t flowMeterChannelCount() {
+  return channelCount;
+}
+
+void flowMeterStart(uint8_t channel, uint32_t targetPulses, uint8_t valvePin) {
+  if (channel >= channelCount) {
+    return;
+  }
+  Channel& c = channels[channel];
+  pcnt_counter_pause(c.unit);
+
+  portENTER_CRITICAL(&flowMux);
+  c.wraps = 0;
+  c.targetWraps = targetPulses / FLOW_PCNT_LIMIT;
+  c.targetRemainder = static_cast<int16_t>(targetPulses % FLOW_PCNT_LIMIT);
+  c.valvePin = valvePin;
+  c.reached = false;
+  c.armed = targetPulses > 0;
+  portEXIT_CRITICAL(&flowMux);
+
+  if (targetPulses > 0 && c.targetRemainder != 0) {
+    pcnt_set_event_value(c.unit, PCNT_EVT_THRES_0, c.targetRemainder);
+    pcnt_event_enable(c.unit, PCNT_EVT_THRES_0);
+  } else {
+    pcnt_event_disable(c.unit, PCNT_EVT_THRES_0);
+  }
+  // Also latches the new threshold.
+  pcnt_counter_clear(c.unit);
+  pcnt_counter_resume(c.unit);
+}
+
+void flowMeterStop(uint8_t channel) {
+  if (channel >= channelCount) {
+    return;
+  }
+  portENTER_CRITICAL(&flowMux);
+  channels[channel].armed = false;
+  portEXIT_CRITICAL(&flowMux);
+}
+
+uint32_t flowMeterPulses(uint8_t channel) {
+  if (channel >= channelCount) {
+    return 0;
+  }
+  const Channel& c = channels[channel];
+  uint32_t wraps;
+  int16_t count;
+  // Retry if a wrap was counted between the two reads.
+  do {
+    wraps = c.wraps;
+    pcnt_get_counter_value(c.unit, &count);
+  } while (wraps != c.wraps);
+  return wraps * FLOW_PCNT_LIMIT + static_cast<uint32_t>(count);
+}
+
+bool flowMeterTargetReached(uint8_t channel) {
+  if (channel >= channelCount) {
+    return false;
+  }
+  portENTER_CRITICAL(&flowMux);
+  const bool reached = channels[channel].reached;
+  channels[channel].reached = false;
+  portEXIT_CRITICAL(&flowMux);
+  return reached;
+}
+
+void flowMeterSimulatePulses(uint8_t channel, uint32_t hz) {
+  if (channel >= channelCount) {
+    return;
+  }
+  const uint8_t pin = channels[channel].pulsePin;
+  ledcSetup(SIMULATOR_LEDC_CHANNEL, hz, 8);
+  ledcAttachPin(pin, SIMULATOR_LEDC_CHANNEL);
+  ledcWrite(SIMULATOR_LEDC_CHANNEL, 128);
+  // Output and input at once, so the PCNT unit still sees the pin.
+  gpio_set_direction(static_cast<gpio_num_t>(pin), GPIO_MODE_INPUT_OUTPUT);
+  LOG_WARN("Flow meter %u fed by a simulated %lu Hz pulse train",
+           (unsigned)channel, (unsigned long)hz);
+}
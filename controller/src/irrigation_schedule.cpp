@@ -0,0 +1,199 @@
+#include "irrigation_schedule.h"
+
+#include <Preferences.h>
+#include <string.h>
+
+namespace {
+constexpr const char* PREFS_NAMESPACE = "schedule";
+constexpr time_t SECONDS_PER_DAY = 24 * 60 * 60;
+// Anything earlier means NTP has not synced yet.
+constexpr time_t MIN_VALID_EPOCH = 1451606400;  // 2016-01-01
+
+struct PendingFire {
+  time_t at;
+  uint8_t valve;
+  uint8_t rule;
+};
+
+ScheduleRule rules[SCHEDULE_MAX_VALVES][SCHEDULE_MAX_RULES_PER_VALVE];
+uint8_t ruleCounts[SCHEDULE_MAX_VALVES];
+size_t valves = 0;
+
+PendingFire pending[SCHEDULE_MAX_VALVES * SCHEDULE_MAX_RULES_PER_VALVE];
+size_t pendingCount = 0;
+bool pendingBuilt = false;
+
+// Insertion into the sorted table; it holds at most a few dozen entries.
+void insertPending(const PendingFire& fire) {
+  size_t position = pendingCount;
+  while (position > 0 && pending[position - 1].at > fire.at) {
+    pending[position] = pending[position - 1];
+    position--;
+  }
+  pending[position] = fire;
+  pendingCount++;
+}
+
+void removePendingForValve(size_t valve) {
+  size_t kept = 0;
+  for (size_t i = 0; i < pendingCount; i++) {
+    if (pending[i].valve != valve) {
+      pending[kept++] = pending[i];
+    }
+  }
+  pendingCount = kept;
+}
+
+void schedulePending(size_t valve, size_t rule, time_t after) {
+  const time_t at = nextScheduleFire(rules[valve][rule], after);
+  if (at != 0) {
+    insertPending({at, static_cast<uint8_t>(valve), static_cast<uint8_t>(rule)});
+  }
+}
+
+void buildPending(time_t now) {
+  pendingCount = 0;
+  for (size_t valve = 0; valve < valves; valve++) {
+    for (size_t rule = 0; rule < ruleCounts[valve]; rule++) {
+      schedulePending(valve, rule, now);
+    }
+  }
+  pendingBuilt = true;
+}
+
+void prefsKey(size_t valve, char* key, size_t size) {
+  snprintf(key, size, "v%u", static_cast<unsigned>(valve));
+}
+}  // namespace
+
+time_t nextScheduleFire(const ScheduleRule& rule, time_t after) {
+  const time_t period = rule.kind == SCHEDULE_INTERVAL
+                            ? static_cast<time_t>(rule.intervalMinutes) * 60
+                            : SECONDS_PER_DAY;
+  if (period <= 0 || (rule.weekdays & SCHEDULE_EVERY_DAY) == 0) {
+    return 0;
+  }
+
+  // Yesterday's window can still be running past midnight.
+  time_t best = 0;
+  for (int dayOffset = -1; dayOffset <= 7; dayOffset++) {
+    struct tm day;
+    localtime_r(&after, &day);
+    day.tm_mday += dayOffset;
+    // Through mktime rather than midnight plus minutes, so the start stays
+    // at the same wall-clock time on DST change days.
+    day.tm_hour = rule.minuteOfDay / 60;
+    day.tm_min = rule.minuteOfDay % 60;
+    day.tm_sec = 0;
+    day.tm_isdst = -1;
+    const time_t anchor = mktime(&day);  // also normalizes tm_wday
+    if ((rule.weekdays & (1 << day.tm_wday)) == 0) {
+      continue;
+    }
+
+    time_t candidate = anchor;
+    if (after >= anchor) {
+      candidate = anchor + ((after - anchor) / period + 1) * period;
+    }
+    if (candidate - anchor < SECONDS_PER_DAY &&
+        (best == 0 || candidate < best)) {
+      best = candidate;
+    }
+    if (best != 0 && dayOffset >= 0) {
+      break;
+    }
+  }
+  return best;
+}
+
+void scheduleBegin(size_t valveCount) {
+  valves = valveCount < SCHEDULE_MAX_VALVES ? valveCount : SCHEDULE_MAX_VALVES;
+  memset(ruleCounts, 0, sizeof(ruleCounts));
+
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, true)) {
+    return;
+  }
+  char key[8];
+  for (size_t valve = 0; valve < valves; valve++) {
+    prefsKey(valve, key, sizeof(key));
+    const size_t length = prefs.getBytes(key, rules[valve], sizeof(rules[valve]));
+    ruleCounts[valve] = length / sizeof(ScheduleRule);
+  }
+  prefs.end();
+  pendingBuilt = false;
+}
+
+bool scheduleSetRules(size_t valve, const ScheduleRule* newRules, size_t count) {
+  if (valve >= valves || count > SCHEDULE_MAX_RULES_PER_VALVE) {
+    return false;
+  }
+  // Retained schedule messages are redelivered on every reconnect; skip the
+  // flash write when nothing changed.
+  if (count == ruleCounts[valve] &&
+      memcmp(rules[valve], newRules, count * sizeof(ScheduleRule)) == 0) {
+    return true;
+  }
+  memcpy(rules[valve], newRules, count * sizeof(ScheduleRule));
+  ruleCounts[valve] = count;
+
+  if (pendingBuilt) {
+    removePendingForValve(valve);
+    const time_t now = time(nullptr);
+    for (size_t rule = 0; rule < count; rule++) {
+      schedulePending(valve, rule, now);
+    }
+  }
+
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, false)) {
+    return false;
+  }
+  char key[8];
+  prefsKey(valve, key, sizeof(key));
+  bool saved;
+  if (count == 0) {
+    saved = prefs.remove(key) || !prefs.isKey(key);
+  } else {
+    saved = prefs.putBytes(key, rules[valve], count * sizeof(ScheduleRule)) > 0;
+  }
+  prefs.end();
+  return saved;
+}
+
+size_t scheduleGetRules(size_t valve, ScheduleRule* out) {
+  if (valve >= valves) {
+    return 0;
+  }
+  memcpy(out, rules[valve], ruleCounts[valve] * sizeof(ScheduleRule));
+  return ruleCounts[valve];
+}
+
+time_t scheduleNextFire(size_t valve) {
+  for (size_t i = 0; i < pendingCount; i++) {
+    if (pending[i].valve == valve) {
+      return pending[i].at;
+    }
+  }
+  return 0;
+}
+
+int scheduleDue(time_t now) {
+  if (now < MIN_VALID_EPOCH) {
+    return -1;
+  }
+  if (!pendingBuilt) {
+    buildPending(now);
+  }
+  if (pendingCount == 0 || now < pending[0].at) {
+    return -1;
+  }
+
+  const PendingFire fired = pending[0];
+  memmove(pending, pending + 1, (pendingCount - 1) * sizeof(PendingFire));
+  pendingCount--;
+  // Reschedule from now rather than from the fire time, so a clock jump
+  // forward fires once instead of replaying every missed slot.
+  schedulePending(fired.valve, fired.rule, now);
+  return fired.valve;
+}
@@ -1,20 +1,68 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
+#include <esp_system.h>
 #include <time.h>
 #include <ArduinoJson.h>
 #include <secrets.h>
-#include <EEPROM.h>
-#include "HX711.h"
-
-// HX711 scale
-#define HX711_DT 16
+#include "edge_rules.h"
+#include "flow_meter.h"
+#include "irrigation_schedule.h"
+#include "json_documents.h"
+#include "trace_capture.h"
+#include "valve_config.h"
+#include "valve_flow.h"
+#include "valve_weight.h"
+#include "weight_sensor.h"
+
+// Build with -DWEIGHT_TEMP_COMPENSATION=1 when an AHT10 sits next to the
+// load cell.
+#ifndef WEIGHT_TEMP_COMPENSATION
+#define WEIGHT_TEMP_COMPENSATION 0
+#endif
+
+#if WEIGHT_TEMP_COMPENSATION
+#include <Adafruit_AHTX0.h>
+#include <Wire.h>
+#endif
+#include <connectivity.h>
+#include <device_id.h>
+#include <device_log.h>
+#include <device_time.h>
+#include <json_publish.h>
+#include <mqtt_topics.h>
+#include <ota_update.h>
+
+// HX711 scales share one clock and are read together. Add a DOUT pin per
+// load cell and point each valve's `scale` at the one under its reservoir.
 #define HX711_SCK 17
-const float calibration_factor = 259.6;
-HX711 scale;
+const uint8_t hx711_dout_pins[] = {16};
+const uint8_t weight_channel_count =
+    sizeof(hx711_dout_pins) / sizeof(hx711_dout_pins[0]);
+const float calibration_factor = 259.6;  // counts per gram
+
+// Flow sensors for flow mode, one PCNT unit each. Point each valve's
+// `flowMeter` at the one on its line.
+const uint8_t flow_meter_pins[] = {4};
+const uint8_t flow_meter_count =
+    sizeof(flow_meter_pins) / sizeof(flow_meter_pins[0]);
+// Bench builds feed flow meter 0 a pulse train of this rate on its own pin.
+#ifndef FLOW_SIMULATED_PULSE_HZ
+#define FLOW_SIMULATED_PULSE_HZ 0
+#endif
+
+#if WEIGHT_TEMP_COMPENSATION
+// AHT10 next to the load cell
+#define AHT10_SDA 21
+#define AHT10_SCL 22
+const unsigned long SCALE_TEMPERATURE_INTERVAL_MS = 30000;
+Adafruit_AHTX0 aht;
+bool ahtInitialized = false;
+float lastScaleTemperature = NAN;
+unsigned long lastScaleTemperatureRead = 0;
+#endif
 
 // device ID
-#define EEPROM_SIZE 8
 char deviceId[32];
 
 // Wi-Fi
@@ -26,76 +74,143 @@ const char* mqtt_server = MQTT_SERVER;
 const int mqtt_port = MQTT_PORT;
 const char* mqtt_user = MQTT_USERNAME;
 const char* mqtt_pass = MQTT_PASSWORD;
+#ifdef MQTT_CA_CERT
+const char* mqtt_ca_cert = MQTT_CA_CERT;
+#else
+const char* mqtt_ca_cert = nullptr;
+#endif
+#ifdef OTA_CA_CERT
+const char* ota_ca_cert = OTA_CA_CERT;
+#else
+const char* ota_ca_cert = mqtt_ca_cert;
+#endif
+#if MQTT_LAN_FAILOVER
+const char* mqtt_lan_ca_cert = MQTT_LAN_CA_CERT;
+const char* mqtt_lan_user = MQTT_LAN_USERNAME;
+const char* mqtt_lan_pass = MQTT_LAN_PASSWORD;
+#endif
 
 // MQTT topic to publish to
 const char* topic_type_status = "status";
 // MQTT topic to subscribe to
 const char* topic_type_control = "control";
+// MQTT topic to publish to, as <id>/<valve>/control/ack
+const char* topic_type_ack = "ack";
 // MQTT topic to subscribe to
 const char* topic_type_config = "config";
 const char* topic_type_config_request = "config/get";
 // MQTT topic to publish to
 const char* topic_type_health = "controllerhealth";
+// MQTT topic to publish to, on component index 0; controller-wide counters
+const char* topic_type_diagnostics = "diagnostics";
+// MQTT topic to subscribe to
+const char* topic_type_schedule = "schedule";
+// MQTT topic to subscribe to, on component index 0 (the controller itself)
+const char* topic_type_rules = "rules";
+// MQTT topic to subscribe to
+const char* topic_type_calibrate = "calibrate";
+// MQTT topic to publish to
+const char* topic_type_calibration = "calibration";
+// MQTT topic to subscribe to, on component index 0; answered on trace/state
+// and trace/data
+const char* topic_type_trace = "trace";
+// MQTT topic to subscribe to, on component index 0; answered on ota/state
+const char* topic_type_ota = "ota";
 
 const int message_timestamp_threshold = 5;
-
-// system health check
-const float healthInterval_max_duration = 20;
-const float healthInterval_min_duration = 0.1;
+// A UUID. Control messages with a longer commandId are dropped rather than
+// echoed into the status and ack messages.
+const size_t MAX_COMMAND_ID_LENGTH = 36;
+
+// Reconnects are retried from loop() so valves and schedules keep working
+// while the network or broker is down. WiFi.reconnect() returns at once,
+// but a broker connect blocks for up to the TLS handshake timeout plus LAN
+// broker discovery, about 13 s, so it waits until no valve is open.
+const unsigned long OFFLINE_BLINK_INTERVAL_MS = 1000;
+const unsigned long WIFI_RECONNECT_INTERVAL_MS = 10000;
+const unsigned long MQTT_RECONNECT_INTERVAL_MS = 5000;
+unsigned long lastOfflineBlinkAt = 0;
+unsigned long lastWiFiReconnectAt = 0;
+unsigned long lastMqttReconnectAt = 0;
+bool wifiLost = false;
+
+// Association and lease from the last connect, kept in NVS so a cold boot
+// skips the scan and DHCP.
+WiFiCache wifi_cache;
+
+// Boot timing in ms since reset, for the health message. Ready is the first
+// subscribe with a valid clock, when control commands start to be accepted.
+const unsigned long BOOT_TIME_WAIT_MS = 5000;
+unsigned long boot_wifi_ms = 0;
+unsigned long boot_ready_ms = 0;
+unsigned long boot_first_command_ms = 0;
+
+// Input trace: a clock record anchors millis() to wall time now and then,
+// and dumps go out in binary chunks on <id>/0/trace/data.
+const unsigned long TRACE_CLOCK_INTERVAL_MS = 60000;
+const size_t TRACE_CHUNK_BYTES = 384;
+unsigned long lastTraceClockAt = 0;
+
+// micros() when a valve output last changed, for control acks.
+unsigned long last_actuate_us = 0;
+
+// seq for messages published by edge rules, so receivers that order
+// commands by (timestamp, seq) accept several within one millisecond.
+uint32_t edge_publish_seq = 0;
+
+const char* weekday_names[] = {"sun", "mon", "tue", "wed", "thu", "fri", "sat"};
+
+// system health check; the interval is in controllerConfig
 unsigned long lastHealthPublish = 0;
-float healthInterval = 5;// 5 minutes
+
+// loop() timing since the last health publish
+unsigned long loopCount = 0;
+unsigned long loopTotalUs = 0;
+unsigned long loopMaxUs = 0;
 
 // valve status pin
 // const int valve_status_pin = 32;  //23
 #define MAX_VALVES 4
 
 
-const unsigned long DEFAULT_SENSOR_READ_INTERVAL_MS = 500;
-const unsigned long MIN_SENSOR_READ_INTERVAL_MS = 100;
-const unsigned long MAX_SENSOR_READ_INTERVAL_MS = 1000;
-const unsigned long DEFAULT_HIGH_DURATION_MS = 3000;
-const unsigned long MIN_HIGH_DURATION_MS = 1000;
-const unsigned long MAX_HIGH_DURATION_MS = 600000;
-const float DEFAULT_TARGET_WEIGHT_CHANGE = 100.0f;
-const float MIN_TARGET_WEIGHT_CHANGE = 50.0f;
-const float DEFAULT_TOLERANCE_WEIGHT = 10.0f;
-const float MIN_TOLERANCE_WEIGHT = 0.0f;
-const unsigned long DEFAULT_TOLERANCE_DURATION_MS = 5000;
-const unsigned long MIN_TOLERANCE_DURATION_MS = 1000;
-const unsigned long MAX_TOLERANCE_DURATION_MS = 600000;
 const uint8_t WEIGHT_SAMPLE_COUNT = 1; // keep reads fast to respect short intervals
+const uint8_t TARE_SAMPLE_COUNT = 20;
+const uint8_t CALIBRATION_SAMPLE_COUNT = 20;
+#define MAX_CALIBRATION_POINTS 8
 
-enum ControlMode {
-  CONTROL_MODE_WEIGHT,
-  CONTROL_MODE_TIME,
-};
+// Pin, scale and flow meter channel; config fields start at their
+// CONFIG_FIELDS defaults, see setup().
+ValveConfig valves[MAX_VALVES] = {
+    {32, 0, 0}, {15, 0, 0}, {19, 0, 0}, {18, 0, 0}};
+ControllerConfig controllerConfig;
+// Time spent in configApply() for the last config message.
+unsigned long last_config_apply_us = 0;
 
-struct ValveConfig {
-  uint8_t pin;
-  bool active;
-  unsigned long startTime;
-  unsigned long lastWeightReadTime;
-  unsigned long lastProgressPublishTime;
-  float startWeight;
-  float lastWeight;
-  ControlMode controlMode;
-  unsigned long highDurationMs;
-  float targetWeightChange;
-  float toleranceWeight;
-  unsigned long toleranceDurationMs;
-  unsigned long sensorReadIntervalMs;
-  bool toleranceSatisfied;
+int32_t lastWeightCounts[WEIGHT_MAX_CHANNELS] = {0};
+bool weightSensorInitialized = false;
+// A scale with a calibration restored from NVS needs no tare at startup.
+bool weightCalibrationLoaded[WEIGHT_MAX_CHANNELS] = {false};
+
+// Zero points kept in RTC memory across resets other than power-on, so a
+// brownout or watchdog reset restores them, zero tracking included, rather
+// than taring whatever is on the scales.
+#define RTC_TARES_MAGIC 0x54415245
+struct RtcTares {
+  uint32_t magic;
+  uint32_t channelMask;
+  int32_t tareOffset[WEIGHT_MAX_CHANNELS];
 };
+RTC_NOINIT_ATTR RtcTares rtc_tares;
 
-ValveConfig valves[MAX_VALVES] = {
-  {32, false, 0, 0, 0, 0.0f, 0.0f, CONTROL_MODE_TIME, DEFAULT_HIGH_DURATION_MS, DEFAULT_TARGET_WEIGHT_CHANGE, DEFAULT_TOLERANCE_WEIGHT, DEFAULT_TOLERANCE_DURATION_MS, DEFAULT_SENSOR_READ_INTERVAL_MS, false},
-  {15, false, 0, 0, 0, 0.0f, 0.0f, CONTROL_MODE_TIME, DEFAULT_HIGH_DURATION_MS, DEFAULT_TARGET_WEIGHT_CHANGE, DEFAULT_TOLERANCE_WEIGHT, DEFAULT_TOLERANCE_DURATION_MS, DEFAULT_SENSOR_READ_INTERVAL_MS, false},
-  {19, false, 0, 0, 0, 0.0f, 0.0f, CONTROL_MODE_TIME, DEFAULT_HIGH_DURATION_MS, DEFAULT_TARGET_WEIGHT_CHANGE, DEFAULT_TOLERANCE_WEIGHT, DEFAULT_TOLERANCE_DURATION_MS, DEFAULT_SENSOR_READ_INTERVAL_MS, false},
-  {18, false, 0, 0, 0, 0.0f, 0.0f, CONTROL_MODE_TIME, DEFAULT_HIGH_DURATION_MS, DEFAULT_TARGET_WEIGHT_CHANGE, DEFAULT_TOLERANCE_WEIGHT, DEFAULT_TOLERANCE_DURATION_MS, DEFAULT_SENSOR_READ_INTERVAL_MS, false}
-};
+// Idle drift tracking, see valve_weight.h.
+const unsigned long IDLE_WEIGHT_SAMPLE_INTERVAL_MS = 5000;
+unsigned long lastIdleWeightSampleTime = 0;
+ScaleTracking scale_tracking[WEIGHT_MAX_CHANNELS];
 
-float lastWeightReading = 0.0f;
-bool weightSensorInitialized = false;
+// A calibration session belongs to the scale of the valve that started it.
+CalibrationPoint calibration_points[MAX_CALIBRATION_POINTS];
+size_t calibration_point_count = 0;
+uint8_t calibration_scale = 0;
 
 // wifi connection status pin
 const int wifi_connection_status_pin = 27;  //15/27
@@ -108,167 +223,127 @@ bool mqtt_disconnection_blinker_on = false;
 WiFiClientSecure wifiClient;
 PubSubClient client(wifiClient);
 
+// Rules messages are the largest the controller receives; PubSubClient
+// drops anything longer than its buffer without a callback.
+const uint16_t MQTT_RECEIVE_BUFFER_SIZE =
+    EDGE_RULES_MAX_MESSAGE + MQTT_MAX_TOPIC_LENGTH + 8;
+static_assert(MQTT_RECEIVE_BUFFER_SIZE >= MQTT_PACKET_BUFFER_SIZE,
+              "receive buffer smaller than the largest publish");
+
+InboundJsonDocument inboundDoc;
+OutboundJsonDocument outboundDoc;
+
 int topicIdToIndex(int topicId);
-const char* controlModeToString(ControlMode mode);
 void publishValveConfig(int valveIdInTopic);
+void republishRetainedState();
 
 // Time config (UTC+8 for example)
 #define GMT_OFFSET_SEC 0//8 * 3600
 #define DAYLIGHT_OFFSET_SEC 0
 
-uint16_t getOrCreateDeviceId() {
-  uint16_t id;
-  EEPROM.begin(EEPROM_SIZE);
-  EEPROM.get(0, id);
-
-  if (id == 0xFFFF || id == 0) {
-    id = esp_random();
-    EEPROM.put(0, id);
-    EEPROM.commit();
-  }
-
-  return id;
-}
-
 void setDeviceId(){
   // uint64_t chipId = ESP.getEfuseMac(); // Unique ID 015C
-  uint16_t randomId = getOrCreateDeviceId();
+  uint16_t randomId = getOrCreateDeviceSuffix();
   // snprintf(deviceId, sizeof(deviceId), "esp32-%04X-%04X", (uint16_t)(chipId & 0xFFFF), randomId); 
   snprintf(deviceId, sizeof(deviceId), "esp32-%04X", randomId);
-  Serial.print("deviceId: ");
-  Serial.println(deviceId);
+  LOG_INFO("deviceId: %s", deviceId);
 
 };
 
-void connectWiFi() {
-  Serial.print("Connecting to WiFi...");
-  WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) {
-    wifi_disconnection_blinker_on = !wifi_disconnection_blinker_on;
-    delay(1000);
-    Serial.print(".");
-    if (wifi_disconnection_blinker_on) {
-      digitalWrite(wifi_connection_status_pin, HIGH);
-    } else {
-      digitalWrite(wifi_connection_status_pin, LOW);
-    }
-  }
-  Serial.println("\n✅ WiFi connected!");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
-  digitalWrite(wifi_connection_status_pin, HIGH);
+void blinkWiFiStatus() {
+  wifi_disconnection_blinker_on = !wifi_disconnection_blinker_on;
+  digitalWrite(wifi_connection_status_pin,
+               wifi_disconnection_blinker_on ? HIGH : LOW);
 }
 
-void setTime() {
-  // Set up time
-  configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, "pool.ntp.org");
-  struct tm timeinfo;
-  while (!getLocalTime(&timeinfo)) {
-    Serial.println("⏳ Waiting for NTP time...");
-    delay(500);
-  }
-  Serial.println("🕒 Time synchronized:");
-  Serial.println(&timeinfo, "%Y-%m-%d %H:%M:%S");
+void blinkMqttStatus() {
+  mqtt_disconnection_blinker_on = !mqtt_disconnection_blinker_on;
+  digitalWrite(mqtt_connection_status_pin,
+               mqtt_disconnection_blinker_on ? HIGH : LOW);
 }
 
-void testDNS() {
-  Serial.println("\n🔍 Testing DNS resolution for MQTT server...");
-  IPAddress resolvedIP;
-  if (WiFi.hostByName(mqtt_server, resolvedIP)) {
-    Serial.print("✅ DNS resolved: ");
-    Serial.println(resolvedIP);
-  } else {
-    Serial.println("❌ DNS resolution failed!");
-  }
+void reconnectWiFi() {
+  connectWiFi(ssid, password, &wifi_cache, blinkWiFiStatus);
+  digitalWrite(wifi_connection_status_pin, HIGH);
 }
 
 void mqttSubscribe(const char* topic_type) {
   char topic_fullname[64];
   for (int i=0; i < MAX_VALVES; i++ ) {
-    snprintf(topic_fullname, sizeof(topic_fullname), "%s/%i/%s", deviceId, i+1, topic_type);
+    buildTopic(topic_fullname, sizeof(topic_fullname), deviceId, i + 1,
+               topic_type);
     client.subscribe(topic_fullname);
-    Serial.print("MQTT subscribed to ");
-    Serial.println(topic_fullname);
+    LOG_DEBUG("MQTT subscribed to %s", topic_fullname);
   }
 }
 
-void connectMQTT() {
-  Serial.println("📡 Attempting MQTT connection...");
-  while (!client.connect(deviceId, mqtt_user, mqtt_pass)) {
-    mqtt_disconnection_blinker_on = !mqtt_disconnection_blinker_on;
-    Serial.print("❌ failed. mqttClientState = ");
-    Serial.println(client.state());
-    if (mqtt_disconnection_blinker_on) {
-      digitalWrite(mqtt_connection_status_pin, HIGH);
-    } else {
-      digitalWrite(mqtt_connection_status_pin, LOW);
-    }
-    delay(1000);
+void subscribeEdgeRules() {
+  char topic[64];
+  buildTopic(topic, sizeof(topic), deviceId, 0, topic_type_rules);
+  client.subscribe(topic);
+  for (size_t i = 0; i < edgeRulesSourceCount(); i++) {
+    client.subscribe(edgeRulesSource(i));
+    LOG_DEBUG("MQTT subscribed to rule source %s", edgeRulesSource(i));
   }
-  Serial.println("✅ MQTT connected!");
-  mqttSubscribe(topic_type_control);
-  mqttSubscribe(topic_type_config);
-  mqttSubscribe(topic_type_config_request);
-  digitalWrite(mqtt_connection_status_pin, HIGH);
 }
 
-String getCurrentTimestamp() {
-  struct tm timeinfo;
-  char buffer[30];
-
-  if (!getLocalTime(&timeinfo)) {
-    return "unknown";
+void maintainWiFi() {
+  unsigned long now = millis();
+  if (!wifiLost) {
+    wifiLost = true;
+    lastWiFiReconnectAt = now;
+    LOG_WARN("WiFi lost, reconnecting in the background");
   }
-
-  struct timeval tv;
-  gettimeofday(&tv, nullptr);
-
-  // Format: YYYY-MM-DDTHH:MM:SS.mmmZ
-  snprintf(buffer, sizeof(buffer),
-           "%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ",
-           timeinfo.tm_year + 1900,
-           timeinfo.tm_mon + 1,
-           timeinfo.tm_mday,
-           timeinfo.tm_hour,
-           timeinfo.tm_min,
-           timeinfo.tm_sec,
-           tv.tv_usec / 1000  // milliseconds
-  );
-
-  return String(buffer);
-}
-
-bool publishCommand(const char* topic, JsonDocument& doc, bool retain = true) {
-  doc["timestamp"] = getCurrentTimestamp();
-
-  char payload[384];
-  size_t payloadLength = serializeJson(doc, payload, sizeof(payload));
-  if (payloadLength == 0 || payloadLength >= sizeof(payload) - 1) {
-    Serial.print("Message too large to serialize safely [");
-    Serial.print(topic);
-    Serial.println("]");
-    return false;
+  if (now - lastOfflineBlinkAt >= OFFLINE_BLINK_INTERVAL_MS) {
+    lastOfflineBlinkAt = now;
+    blinkWiFiStatus();
   }
-
-  bool published = client.publish(topic, payload, retain);
-  if (published) {
-    Serial.print("Message PUBLISHED [");
-    Serial.print(topic);
-    Serial.print("]: ");
-    Serial.println(String(payload));
-  } else {
-    Serial.print("Message failed to publish ❌ [");
-    Serial.print(topic);
-    Serial.print("] payloadLength=");
-    Serial.println(payloadLength);
+  if (now - lastWiFiReconnectAt >= WIFI_RECONNECT_INTERVAL_MS) {
+    lastWiFiReconnectAt = now;
+    WiFi.reconnect();
   }
-  return published;
 }
 
-void publishCommand(const char* topic, const char* cmd, bool retain = true) {
-  JsonDocument doc;
-  doc["message"] = cmd;
-  publishCommand(topic, doc, retain);
+void maintainMQTT() {
+  unsigned long now = millis();
+  if (lastMqttReconnectAt != 0 &&
+      now - lastMqttReconnectAt < MQTT_RECONNECT_INTERVAL_MS) {
+    return;
+  }
+  lastMqttReconnectAt = now;
+  blinkMqttStatus();
+  if (!tryConnectMQTT(client, {deviceId, mqtt_user, mqtt_pass, true})) {
+    testDNS(mqtt_server);
+    return;
+  }
+  // NTP has been running since WiFi came up; commands are rejected as
+  // stale until the clock is set.
+  if (boot_ready_ms == 0 && !waitForTime(BOOT_TIME_WAIT_MS)) {
+    LOG_WARN("⚠️ Clock not set yet, control commands will be rejected");
+  }
+  if (mqttBrokerSwitched()) {
+    // Before subscribing, so this broker's older retained config and
+    // schedules are overwritten instead of applied.
+    republishRetainedState();
+  }
+  mqttSubscribe(topic_type_control);
+  mqttSubscribe(topic_type_config);
+  mqttSubscribe(topic_type_config_request);
+  mqttSubscribe(topic_type_schedule);
+  mqttSubscribe(topic_type_calibrate);
+  subscribeEdgeRules();
+  char topic[64];
+  buildTopic(topic, sizeof(topic), deviceId, 0, topic_type_trace);
+  client.subscribe(topic);
+  buildTopic(topic, sizeof(topic), deviceId, 0, topic_type_ota);
+  client.subscribe(topic);
+  buildTopic(topic, sizeof(topic), deviceId, 0, topic_type_ota, "state");
+  otaPublishRunning(client, topic);
+  digitalWrite(mqtt_connection_status_pin, HIGH);
+  if (boot_ready_ms == 0 && currentEpochMs() != 0) {
+    boot_ready_ms = millis();
+    LOG_INFO("✅ Ready for commands %lums after reset", boot_ready_ms);
+  }
 }
 
 void publishValveConfig(int valveIdInTopic) {
@@ -279,69 +354,129 @@ void publishValveConfig(int valveIdInTopic) {
 
   ValveConfig &valve = valves[index];
   char topic[64];
-  snprintf(topic, sizeof(topic), "%s/%i/%s", deviceId, valveIdInTopic,
-           topic_type_config);
+  buildTopic(topic, sizeof(topic), deviceId, valveIdInTopic,
+             topic_type_config);
 
-  JsonDocument doc;
+  JsonDocument& doc = outboundDoc.acquire();
   doc["type"] = topic_type_config;
-  JsonObject message = doc["message"].to<JsonObject>();
-  message["controlMode"] = controlModeToString(valve.controlMode);
-  message["highDuration"] = valve.highDurationMs;
-  message["targetWeightChange"] = valve.targetWeightChange;
-  message["toleranceWeight"] = valve.toleranceWeight;
-  message["toleranceDurationMs"] = valve.toleranceDurationMs;
-  message["sensorReadIntervalMs"] = valve.sensorReadIntervalMs;
-  message["heartbeatInterval"] = healthInterval;
+  configPublish(doc["message"].to<JsonObject>(), valve, controllerConfig);
 
-  publishCommand(topic, doc, true);
+  publishJson(client, topic, doc, true);
 }
 
 int topicIdToIndex(int topicId) {
   int index = topicId - 1;
   if (index < 0 || index >= MAX_VALVES) {
-    Serial.printf("Invalid valve id %d in topic\n", topicId);
+    LOG_WARN("Invalid valve id %d in topic", topicId);
     return -1;
   }
   return index;
 }
 
-const char* controlModeToString(ControlMode mode) {
-  return mode == CONTROL_MODE_TIME ? "time" : "weight";
+void refreshAllWeightThresholds() {
+  for (int i=0; i < MAX_VALVES; i++ ) {
+    refreshWeightThresholds(valves[i]);
+  }
+  for (uint8_t c = 0; c < weight_channel_count; c++) {
+    scaleTrackingRefresh(scale_tracking[c], c);
+  }
+}
+
+int32_t valveChangeCounts(const ValveConfig &valve, unsigned long now) {
+  return valveWeightChange(
+      valve, scale_tracking[valve.scale].driftCountsPerMinQ8, now);
 }
 
-ControlMode parseControlMode(const char* mode) {
-  if (mode && String(mode) == "time") {
-    return CONTROL_MODE_TIME;
+bool scaleInUse(uint8_t scale) {
+  for (int i=0; i < MAX_VALVES; i++ ) {
+    if (valves[i].active && valves[i].scale == scale) {
+      return true;
+    }
   }
-  return CONTROL_MODE_WEIGHT;
+  return false;
 }
 
-float readWeightSensor() {
-  if (!weightSensorInitialized) {
-    scale.begin(HX711_DT, HX711_SCK);
-    scale.set_scale(calibration_factor);
-    scale.tare(20);
-    weightSensorInitialized = true;
+bool flowMeterInUse(uint8_t flowMeter) {
+  for (int i=0; i < MAX_VALVES; i++ ) {
+    if (valves[i].active && valves[i].controlMode == CONTROL_MODE_FLOW &&
+        valves[i].flowMeter == flowMeter) {
+      return true;
+    }
   }
-  float weight = scale.get_units(WEIGHT_SAMPLE_COUNT);
-  lastWeightReading = weight;
-  return weight;
+  return false;
 }
 
-void publishValveState(int valveIdInTopic, const char* state, float weight,
-                       float weightChange, bool retain = true,
-                       const char* reason = nullptr) {
+void rememberTares() {
+  rtc_tares.channelMask = 0;
+  for (uint8_t c = 0; c < weight_channel_count; c++) {
+    rtc_tares.tareOffset[c] = weightSensorCalibration(c).tareOffset;
+    rtc_tares.channelMask |= 1UL << c;
+  }
+  rtc_tares.magic = RTC_TARES_MAGIC;
+}
+
+void beginWeightSensor() {
+  if (weightSensorInitialized) {
+    return;
+  }
+  weightSensorBegin(hx711_dout_pins, weight_channel_count, HX711_SCK);
+  uint32_t untared = 0;
+  for (uint8_t c = 0; c < weight_channel_count; c++) {
+    if (!weightCalibrationLoaded[c]) {
+      untared |= 1UL << c;
+    }
+  }
+  if (rtc_tares.magic == RTC_TARES_MAGIC) {
+    for (uint8_t c = 0; c < weight_channel_count; c++) {
+      if (rtc_tares.channelMask & (1UL << c)) {
+        weightSensorAdjustTare(
+            c, rtc_tares.tareOffset[c] - weightSensorCalibration(c).tareOffset);
+        untared &= ~(1UL << c);
+      }
+    }
+  }
+  if (untared != 0) {
+    weightSensorTare(untared, TARE_SAMPLE_COUNT);
+  }
+  weightSensorInitialized = true;
+  rememberTares();
+}
+
+// Reads every scale at once into lastWeightCounts. A scale that does not
+// become ready keeps its previous reading.
+void readWeightSensors() {
+  beginWeightSensor();
+  if (!readWeightCounts(WEIGHT_SAMPLE_COUNT, lastWeightCounts)) {
+    LOG_WARN("HX711 not ready, keeping the last weight");
+    return;
+  }
+  for (uint8_t c = 0; c < weight_channel_count; c++) {
+    traceWeight(c, lastWeightCounts[c]);
+  }
+}
+
+int32_t readWeightSensor(uint8_t scale) {
+  readWeightSensors();
+  return lastWeightCounts[scale];
+}
+
+void publishValveState(int valveIdInTopic, const char* state,
+                       int32_t weightCounts, int32_t changeCounts,
+                       bool retain = true, const char* reason = nullptr,
+                       const char* commandId = nullptr) {
   char topic_status[64];
-  snprintf(topic_status, sizeof(topic_status), "%s/%i/%s", deviceId,
-           valveIdInTopic, topic_type_status);
+  buildTopic(topic_status, sizeof(topic_status), deviceId, valveIdInTopic,
+             topic_type_status);
 
-  JsonDocument doc;
+  JsonDocument& doc = outboundDoc.acquire();
   doc["type"] = topic_type_status;
   JsonObject message = doc["message"].to<JsonObject>();
   message["state"] = state;
-  message["weight"] = weight;
-  message["weightChange"] = weightChange;
   int index = topicIdToIndex(valveIdInTopic);
+  const uint8_t scale = index >= 0 ? valves[index].scale : 0;
+  const float weightChange = weightCountsToGrams(scale, changeCounts);
+  message["weight"] = weightCountsToGrams(scale, weightCounts);
+  message["weightChange"] = weightChange;
   if (index >= 0) {
     ValveConfig &valve = valves[index];
     message["controlMode"] = controlModeToString(valves[index].controlMode);
@@ -355,6 +490,14 @@ void publishValveState(int valveIdInTopic, const char* state, float weight,
                                      : elapsedSeconds;
       message["targetValue"] = targetSeconds;
       message["progressUnit"] = "s";
+    } else if (valve.controlMode == CONTROL_MODE_FLOW) {
+      const float liters =
+          valveFlowVolume(valve, flowMeterPulses(valve.flowMeter));
+      message["volume"] = liters;
+      message["flowRate"] = valve.flowRateLpm;
+      message["progressValue"] = liters;
+      message["targetValue"] = valve.targetVolume;
+      message["progressUnit"] = "L";
     } else {
       message["progressValue"] = weightChange;
       message["targetValue"] = valve.targetWeightChange;
@@ -364,342 +507,839 @@ void publishValveState(int valveIdInTopic, const char* state, float weight,
   if (reason) {
     message["reason"] = reason;
   }
-  publishCommand(topic_status, doc, retain);
+  if (commandId) {
+    message["commandId"] = commandId;
+  }
+  publishJson(client, topic_status, doc, retain);
 }
 
-void activateSwitch(int valveIdInTopic) {
+// Returns false if the valve does not exist or is already open.
+bool activateSwitch(int valveIdInTopic, const char* commandId = nullptr) {
   int index = topicIdToIndex(valveIdInTopic);
   if (index < 0) {
-    return;
+    return false;
   }
 
   ValveConfig &valve = valves[index];
   if (valve.active) {
-    Serial.printf("Valve %d already active\n", valveIdInTopic);
-    return;
+    LOG_INFO("Valve %d already active", valveIdInTopic);
+    return false;
+  }
+
+  if (valve.controlMode == CONTROL_MODE_FLOW) {
+    if (valve.flowMeter >= flowMeterChannelCount() ||
+        flowMeterInUse(valve.flowMeter)) {
+      LOG_WARN("⚠️ Valve %d has no free flow meter", valveIdInTopic);
+      return false;
+    }
+    // Armed before the valve opens, so no pulse is missed; the interrupt
+    // closes the valve at the target.
+    flowMeterStart(valve.flowMeter, valveFlowTargetPulses(valve), valve.pin);
+    valveFlowStart(valve, millis());
   }
 
   digitalWrite(valve.pin, HIGH);
+  last_actuate_us = micros();
   valve.active = true;
+  scale_tracking[valve.scale].hasIdleSample = false;
   valve.startTime = millis();
-  valve.toleranceSatisfied =
-      valve.controlMode == CONTROL_MODE_WEIGHT &&
-      valve.toleranceWeight <= MIN_TOLERANCE_WEIGHT;
-  valve.startWeight = valve.controlMode == CONTROL_MODE_WEIGHT
-                          ? readWeightSensor()
-                          : 0.0f;
-  valve.lastWeight = valve.startWeight;
-  valve.lastWeightReadTime = millis();
+  valveWeightStart(valve,
+                   valve.controlMode == CONTROL_MODE_WEIGHT
+                       ? readWeightSensor(valve.scale)
+                       : 0,
+                   millis());
   valve.lastProgressPublishTime = millis();
 
-  publishValveState(valveIdInTopic, "HIGH", valve.startWeight, 0.0f, true);
+  publishValveState(valveIdInTopic, "HIGH", valve.startCounts, 0, true, nullptr,
+                    commandId);
+  return true;
 }
 
-void deactivateSwitch(int valveIdInTopic, const char* reason = nullptr) {
+// Returns false if the valve does not exist or is already closed.
+bool deactivateSwitch(int valveIdInTopic, const char* reason = nullptr,
+                      const char* commandId = nullptr) {
   int index = topicIdToIndex(valveIdInTopic);
   if (index < 0) {
-    return;
+    return false;
   }
 
   ValveConfig &valve = valves[index];
   if (!valve.active) {
-    Serial.printf("Valve %d already inactive\n", valveIdInTopic);
-    return;
+    LOG_INFO("Valve %d already inactive", valveIdInTopic);
+    return false;
   }
 
   digitalWrite(valve.pin, LOW);
+  last_actuate_us = micros();
   valve.active = false;
-  float weightChange = valve.startWeight - valve.lastWeight;
-  publishValveState(valveIdInTopic, "LOW", valve.lastWeight, weightChange, true,
-                    reason);
-  valve.startWeight = 0.0f;
-  valve.lastWeight = 0.0f;
+  if (valve.controlMode == CONTROL_MODE_FLOW) {
+    flowMeterStop(valve.flowMeter);
+  }
+  int32_t changeCounts = valveChangeCounts(valve, millis());
+  publishValveState(valveIdInTopic, "LOW", valve.lastCounts, changeCounts, true,
+                    reason, commandId);
+  valve.startCounts = 0;
+  valve.lastCounts = 0;
   valve.startTime = 0;
   valve.lastWeightReadTime = 0;
   valve.lastProgressPublishTime = 0;
   valve.toleranceSatisfied = false;
+  return true;
 }
 
-time_t timegm_fallback(struct tm *tm) {
-  time_t local = mktime(tm);
-  struct tm *gmtm = gmtime(&local);
-  time_t gm = mktime(gmtm);
-  return local + (local - gm);
+void publishCalibrationStatus(int valveIdInTopic, const char* state,
+                              float maxResidualGrams = 0.0f,
+                              const char* error = nullptr) {
+  char topic[64];
+  buildTopic(topic, sizeof(topic), deviceId, valveIdInTopic,
+             topic_type_calibration);
+
+  int index = topicIdToIndex(valveIdInTopic);
+  const uint8_t scale = index >= 0 ? valves[index].scale : 0;
+  WeightCalibration calibration = weightSensorCalibration(scale);
+  JsonDocument& doc = outboundDoc.acquire();
+  doc["type"] = topic_type_calibration;
+  JsonObject message = doc["message"].to<JsonObject>();
+  message["state"] = state;
+  message["scale"] = scale;
+  message["points"] = scale == calibration_scale ? calibration_point_count : 0;
+  message["persisted"] = weightCalibrationLoaded[scale];
+  message["tareOffset"] = calibration.tareOffset;
+  message["countsPerGram"] = calibration.countsPerGramQ16 / 65536.0f;
+  message["maxResidual"] = maxResidualGrams;
+  if (error) {
+    message["error"] = error;
+  }
+  publishJson(client, topic, doc, false);
 }
 
-// Utility to convert ISO8601 string to epoch
-time_t parseISOTimeToEpoch(const char* isoString) {
-  struct tm tm = {0};
-  char temp[25];
+// "tare" starts a session with a 0 g point, "point" adds a known weight,
+// "save" fits a line through the points and persists it, "cancel" drops the
+// session and "reset" reverts to the compiled-in factor.
+void handleCalibrationMessage(int valveIdInTopic, JsonVariantConst message) {
+  const char* action = message["action"] | "";
+  int index = topicIdToIndex(valveIdInTopic);
+  if (index < 0) {
+    return;
+  }
+  const uint8_t scale = valves[index].scale;
+  if (scaleInUse(scale)) {
+    publishCalibrationStatus(valveIdInTopic, "error", 0.0f, "valve_active");
+    return;
+  }
 
-  // Copy and strip 'Z' if it's there
-  strncpy(temp, isoString, sizeof(temp));
-  temp[sizeof(temp) - 1] = '\0';
-  size_t len = strlen(temp);
-  if (temp[len - 1] == 'Z') {
-      temp[len - 1] = '\0';
+  if (strcmp(action, "tare") == 0 || strcmp(action, "point") == 0) {
+    if (strcmp(action, "tare") == 0) {
+      calibration_point_count = 0;
+      calibration_scale = scale;
+    } else if (scale != calibration_scale) {
+      publishCalibrationStatus(valveIdInTopic, "error", 0.0f, "scale_mismatch");
+      return;
+    }
+    if (calibration_point_count >= MAX_CALIBRATION_POINTS) {
+      publishCalibrationStatus(valveIdInTopic, "error", 0.0f, "too_many_points");
+      return;
+    }
+    beginWeightSensor();
+    int32_t raw[WEIGHT_MAX_CHANNELS];
+    if (!readWeightRaw(CALIBRATION_SAMPLE_COUNT, raw)) {
+      publishCalibrationStatus(valveIdInTopic, "error", 0.0f, "not_ready");
+      return;
+    }
+    CalibrationPoint &point = calibration_points[calibration_point_count++];
+    point.grams = strcmp(action, "tare") == 0 ? 0.0f : (message["grams"] | 0.0f);
+    point.raw = raw[scale];
+    LOG_INFO("Calibration point %u: %ld counts at %fg",
+             (unsigned)calibration_point_count, (long)point.raw, point.grams);
+    publishCalibrationStatus(valveIdInTopic, "collecting");
+  } else if (strcmp(action, "save") == 0) {
+    if (scale != calibration_scale) {
+      publishCalibrationStatus(valveIdInTopic, "error", 0.0f, "scale_mismatch");
+      return;
+    }
+    WeightCalibration calibration;
+    float maxResidual = 0.0f;
+    if (!fitWeightCalibration(calibration_points, calibration_point_count,
+                              calibration, maxResidual)) {
+      publishCalibrationStatus(valveIdInTopic, "error", 0.0f, "fit_failed");
+      return;
+    }
+    weightSensorApplyCalibration(scale, calibration);
+    weightCalibrationLoaded[scale] = weightSensorSaveCalibration(scale);
+    rememberTares();
+    refreshAllWeightThresholds();
+    LOG_INFO("✅ Scale %u calibration saved: %ld counts/g Q16, tare %ld, residual %fg",
+             scale, (long)calibration.countsPerGramQ16,
+             (long)calibration.tareOffset, maxResidual);
+    calibration_point_count = 0;
+    publishCalibrationStatus(valveIdInTopic,
+                             weightCalibrationLoaded[scale] ? "saved" : "applied",
+                             maxResidual,
+                             weightCalibrationLoaded[scale] ? nullptr : "nvs_write_failed");
+  } else if (strcmp(action, "cancel") == 0) {
+    calibration_point_count = 0;
+    publishCalibrationStatus(valveIdInTopic, "idle");
+  } else if (strcmp(action, "reset") == 0) {
+    calibration_point_count = 0;
+    weightSensorClearCalibration(scale);
+    weightCalibrationLoaded[scale] = false;
+    weightSensorSetScale(scale, calibration_factor);
+    if (weightSensorInitialized) {
+      weightSensorTare(1UL << scale, TARE_SAMPLE_COUNT);
+      rememberTares();
+    }
+    refreshAllWeightThresholds();
+    publishCalibrationStatus(valveIdInTopic, "cleared");
+  } else {
+    publishCalibrationStatus(valveIdInTopic, "error", 0.0f, "unknown_action");
   }
+}
 
-  // Parse the string (assumes UTC)
-  if (strptime(temp, "%Y-%m-%dT%H:%M:%S", &tm)) {
-      // Use timegm for UTC (not mktime)
-      time_t t = timegm_fallback(&tm);
-      return t;
+void publishScheduleState(int valveIdInTopic) {
+  int index = topicIdToIndex(valveIdInTopic);
+  if (index < 0) {
+    return;
   }
+  char topic[64];
+  buildTopic(topic, sizeof(topic), deviceId, valveIdInTopic,
+             topic_type_schedule, "state");
+
+  ScheduleRule rules[SCHEDULE_MAX_RULES_PER_VALVE];
+  size_t count = scheduleGetRules(index, rules);
 
-  return 0;
+  JsonDocument& doc = outboundDoc.acquire();
+  doc["type"] = topic_type_schedule;
+  JsonObject message = doc["message"].to<JsonObject>();
+  JsonArray list = message["rules"].to<JsonArray>();
+  for (size_t i = 0; i < count; i++) {
+    const ScheduleRule &rule = rules[i];
+    JsonObject entry = list.add<JsonObject>();
+    char timeOfDay[6];
+    snprintf(timeOfDay, sizeof(timeOfDay), "%02u:%02u",
+             rule.minuteOfDay / 60, rule.minuteOfDay % 60);
+    entry["type"] = rule.kind == SCHEDULE_INTERVAL ? "interval" : "daily";
+    entry["time"] = timeOfDay;
+    if (rule.kind == SCHEDULE_INTERVAL) {
+      entry["everyMinutes"] = rule.intervalMinutes;
+    }
+    JsonArray days = entry["days"].to<JsonArray>();
+    for (int day = 0; day < 7; day++) {
+      if (rule.weekdays & (1 << day)) {
+        days.add(weekday_names[day]);
+      }
+    }
+  }
+
+  time_t nextRun = scheduleNextFire(index);
+  if (nextRun != 0) {
+    struct tm nextRunUtc;
+    gmtime_r(&nextRun, &nextRunUtc);
+    char nextRunText[24];
+    strftime(nextRunText, sizeof(nextRunText), "%Y-%m-%dT%H:%M:%SZ",
+             &nextRunUtc);
+    message["nextRun"] = nextRunText;
+  }
+  publishJson(client, topic, doc, true);
+}
+
+bool parseScheduleRule(JsonObjectConst entry, ScheduleRule &rule) {
+  const char* type = entry["type"] | "daily";
+  if (strcmp(type, "daily") == 0) {
+    rule.kind = SCHEDULE_DAILY;
+    rule.intervalMinutes = 0;
+  } else if (strcmp(type, "interval") == 0) {
+    rule.kind = SCHEDULE_INTERVAL;
+    unsigned int everyMinutes = entry["everyMinutes"] | 0u;
+    if (everyMinutes == 0 || everyMinutes > 24 * 60) {
+      return false;
+    }
+    rule.intervalMinutes = everyMinutes;
+  } else {
+    return false;
+  }
+
+  unsigned int hour = 0;
+  unsigned int minute = 0;
+  const char* timeOfDay = entry["time"] | "00:00";
+  if (sscanf(timeOfDay, "%u:%u", &hour, &minute) != 2 || hour > 23 ||
+      minute > 59) {
+    return false;
+  }
+  rule.minuteOfDay = hour * 60 + minute;
+
+  JsonArrayConst days = entry["days"];
+  if (days.isNull()) {
+    rule.weekdays = SCHEDULE_EVERY_DAY;
+    return true;
+  }
+  rule.weekdays = 0;
+  for (JsonVariantConst day : days) {
+    const char* name = day | "";
+    for (int i = 0; i < 7; i++) {
+      if (strcmp(name, weekday_names[i]) == 0) {
+        rule.weekdays |= 1 << i;
+      }
+    }
+  }
+  return rule.weekdays != 0;
 }
 
-bool isTimestampInRange(const char* timestampStr){
-    time_t messageTime = parseISOTimeToEpoch(timestampStr);
-    time_t now;
-    time(&now);
+// Replaces the valve's rules; an empty or missing list clears them.
+void handleScheduleMessage(int valveIdInTopic, JsonVariantConst message) {
+  int index = topicIdToIndex(valveIdInTopic);
+  if (index < 0) {
+    return;
+  }
 
-    Serial.printf("Message time: %ld, Current time: %ld\n", messageTime, now);
+  ScheduleRule rules[SCHEDULE_MAX_RULES_PER_VALVE];
+  size_t count = 0;
+  for (JsonObjectConst entry : message["rules"].as<JsonArrayConst>()) {
+    if (count == SCHEDULE_MAX_RULES_PER_VALVE) {
+      LOG_WARN("⚠️ Valve %d schedule truncated to %d rules", valveIdInTopic,
+               SCHEDULE_MAX_RULES_PER_VALVE);
+      break;
+    }
+    if (parseScheduleRule(entry, rules[count])) {
+      count++;
+    } else {
+      LOG_WARN("⚠️ Ignoring invalid schedule rule for valve %d",
+               valveIdInTopic);
+    }
+  }
 
-    return (abs(now - messageTime) <= message_timestamp_threshold);
+  if (!scheduleSetRules(index, rules, count)) {
+    LOG_WARN("⚠️ Valve %d schedule could not be saved", valveIdInTopic);
+  }
+  LOG_INFO("✅ Valve %d schedule updated with %u rules", valveIdInTopic,
+           (unsigned)count);
+  publishScheduleState(valveIdInTopic);
 }
 
-int getIdFromTopic(char* topic){
-  // TODO
-  char buffer[64];
-  strncpy(buffer, topic, sizeof(buffer));
-  buffer[sizeof(buffer) - 1] = '\0';
+void onEdgeRule(const EdgeRule &rule, const char* targetTopic, bool holds) {
+  switch (rule.action) {
+    case EDGE_OPEN_VALVE:
+      if (holds && !edgeRulesInhibit(rule.valve)) {
+        LOG_INFO("Valve %d opened by edge rule", rule.valve + 1);
+        activateSwitch(rule.valve + 1);
+      }
+      break;
+    case EDGE_INHIBIT_VALVE:
+      LOG_INFO("Valve %d %s by edge rule", rule.valve + 1,
+               holds ? "inhibited" : "released");
+      break;
+    case EDGE_PUBLISH: {
+      const char* payload = holds ? rule.onTrue : rule.onFalse;
+      if (payload[0] == '\0') {
+        break;
+      }
+      JsonDocument& doc = outboundDoc.acquire();
+      doc["message"] = serialized(payload);
+      doc["seq"] = ++edge_publish_seq;
+      publishJson(client, targetTopic, doc, false);
+      LOG_INFO("Edge rule published %s to %s", payload, targetTopic);
+      break;
+    }
+  }
+}
+
+void handleRulesMessage(JsonVariantConst message) {
+  for (size_t i = 0; i < edgeRulesSourceCount(); i++) {
+    client.unsubscribe(edgeRulesSource(i));
+  }
+  size_t count = edgeRulesCompile(message["rules"], MAX_VALVES);
+  LOG_INFO("✅ %u edge rules compiled", (unsigned)count);
+  subscribeEdgeRules();
+}
 
-  char* token;
-  char* saveptr;
+void publishTraceState(uint16_t chunks) {
+  char topic[64];
+  buildTopic(topic, sizeof(topic), deviceId, 0, topic_type_trace, "state");
 
-  token = strtok_r(buffer, "/", &saveptr);  // skip clientId
-  token = strtok_r(nullptr, "/", &saveptr); // pin
-  return token ? atoi(token) : -1;
+  JsonDocument& doc = outboundDoc.acquire();
+  doc["type"] = topic_type_trace;
+  JsonObject message = doc["message"].to<JsonObject>();
+  message["enabled"] = traceEnabled();
+  message["bytes"] = traceSize();
+  message["capacity"] = TRACE_BUFFER_BYTES;
+  message["dropped"] = traceDropped();
+  message["chunks"] = chunks;
+  publishJson(client, topic, doc, false);
 }
 
-char* getMessageTypeFromTopic(char* topic){
-  // TODO
-  static char buffer[64];
-  strncpy(buffer, topic, sizeof(buffer));
-  buffer[sizeof(buffer) - 1] = '\0';
+// Each chunk is <uint16 seq><uint16 chunk count> and up to
+// TRACE_CHUNK_BYTES of the record stream. Nothing is traced while the
+// chunks go out, so the state message's byte count matches the dump.
+void dumpTrace() {
+  traceClock(currentEpochMs());
+  const uint16_t chunks =
+      (traceSize() + TRACE_CHUNK_BYTES - 1) / TRACE_CHUNK_BYTES;
+  publishTraceState(chunks);
 
-  char* token;
-  char* saveptr;
+  char topic[64];
+  buildTopic(topic, sizeof(topic), deviceId, 0, topic_type_trace, "data");
+  uint8_t chunk[4 + TRACE_CHUNK_BYTES];
+  for (uint16_t seq = 0; seq < chunks; seq++) {
+    const size_t length =
+        traceRead(seq * TRACE_CHUNK_BYTES, chunk + 4, TRACE_CHUNK_BYTES);
+    memcpy(chunk, &seq, sizeof(seq));
+    memcpy(chunk + 2, &chunks, sizeof(chunks));
+    if (!client.publish(topic, chunk, 4 + length, false)) {
+      LOG_WARN("Trace dump stopped at chunk %u of %u", seq, chunks);
+      return;
+    }
+  }
+  LOG_INFO("✅ Trace dumped: %u bytes", (unsigned)traceSize());
+}
 
-  token = strtok_r(buffer, "/", &saveptr);  // skip clientId
-  token = strtok_r(nullptr, "/", &saveptr); // skip pin
-  token = strtok_r(nullptr, "/", &saveptr); // messageType
-  return token;
+// The download blocks the loop for a while, so nothing may be left open.
+void closeValvesForOta() {
+  for (int i=0; i < MAX_VALVES; i++ ) {
+    deactivateSwitch(i + 1, "ota");
+  }
 }
 
-char* getTopicActionFromTopic(char* topic){
-  static char buffer[64];
-  strncpy(buffer, topic, sizeof(buffer));
-  buffer[sizeof(buffer) - 1] = '\0';
+void handleTraceMessage(JsonVariantConst message) {
+  const char* action = message["action"] | "";
+  if (strcmp(action, "dump") == 0) {
+    dumpTrace();
+    return;
+  }
+  if (strcmp(action, "start") == 0) {
+    traceSetEnabled(true);
+    traceClock(currentEpochMs());
+  } else if (strcmp(action, "stop") == 0) {
+    traceSetEnabled(false);
+  } else if (strcmp(action, "clear") == 0) {
+    traceClear();
+    traceClock(currentEpochMs());
+  }
+  publishTraceState(0);
+}
 
-  char* token;
-  char* saveptr;
+// Answers a control message that carried a commandId on the non-retained
+// <id>/<valve>/control/ack topic. Times are relative to the callback entry:
+// sentToReceiveMs is the sender's timestamp against the NTP clock (so it
+// includes any clock skew), the others are micros() on the controller.
+void publishControlAck(int valveIdInTopic, const char* commandId,
+                       const char* command, const char* result,
+                       int64_t sentAtMs, int64_t receivedAtMs,
+                       unsigned long receivedUs, bool actuated) {
+  char topic[64];
+  buildTopic(topic, sizeof(topic), deviceId, valveIdInTopic, topic_type_control,
+             topic_type_ack);
 
-  token = strtok_r(buffer, "/", &saveptr);  // skip clientId
-  token = strtok_r(nullptr, "/", &saveptr); // skip pin
-  token = strtok_r(nullptr, "/", &saveptr); // skip messageType
-  token = strtok_r(nullptr, "/", &saveptr); // action
-  return token;
+  JsonDocument& doc = outboundDoc.acquire();
+  doc["type"] = topic_type_ack;
+  JsonObject message = doc["message"].to<JsonObject>();
+  message["commandId"] = commandId;
+  message["command"] = command;
+  message["result"] = result;
+  int index = topicIdToIndex(valveIdInTopic);
+  if (index >= 0) {
+    message["state"] = valves[index].active ? "HIGH" : "LOW";
+  }
+  if (sentAtMs != 0 && receivedAtMs != 0) {
+    message["sentToReceiveMs"] = receivedAtMs - sentAtMs;
+  }
+  if (actuated) {
+    message["receiveToActuateUs"] = last_actuate_us - receivedUs;
+  }
+  message["receiveToPublishUs"] = micros() - receivedUs;
+  publishJson(client, topic, doc, false);
 }
 
-void callback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message RECEIVED [");
-  Serial.print(topic);
-  Serial.print("]: ");
+void handleControlMessage(int valveIdInTopic, JsonDocument& doc,
+                          unsigned long receivedUs) {
+  const int64_t receivedAtMs = currentEpochMs();
+  const char* commandId = doc["commandId"];
+  if (commandId && strlen(commandId) > MAX_COMMAND_ID_LENGTH) {
+    LOG_WARN("⚠️ commandId longer than %u characters, ignoring command",
+             (unsigned)MAX_COMMAND_ID_LENGTH);
+    return;
+  }
+  const char* messageContent = doc["message"] | "";
+  const int64_t sentAtMs =
+      parseISOTimeToEpochMs(doc["timestamp"].as<const char*>());
+
+  const char* result;
+  bool actuated = false;
+  if (!isTimestampInRange(sentAtMs, message_timestamp_threshold)) {
+    LOG_INFO("Ignoring stale message");
+    result = "stale";
+  } else if (strcmp(messageContent, "HIGH") == 0) {
+    actuated = activateSwitch(valveIdInTopic, commandId);
+    result = actuated ? "applied" : "unchanged";
+  } else if (strcmp(messageContent, "LOW") == 0) {
+    actuated = deactivateSwitch(valveIdInTopic, "manual", commandId);
+    result = actuated ? "applied" : "unchanged";
+  } else {
+    result = "invalid";
+  }
+  if (boot_first_command_ms == 0 &&
+      (strcmp(result, "applied") == 0 || strcmp(result, "unchanged") == 0)) {
+    boot_first_command_ms = millis();
+  }
 
-  // Copy payload to a string
-  String message;
-  for (unsigned int i = 0; i < length; i++) {
-    message += (char)payload[i];
+  if (commandId) {
+    publishControlAck(valveIdInTopic, commandId, messageContent, result,
+                      sentAtMs, receivedAtMs, receivedUs, actuated);
   }
+}
 
-  Serial.println(message);
+void callback(char* topic, byte* payload, unsigned int length) {
+  const unsigned long receivedUs = micros();
+  traceMqtt(topic, payload, length);
+  LOG_DEBUG("Message RECEIVED [%s]: %.*s", topic, (int)length,
+            (const char*)payload);
 
   // Parse JSON
-  JsonDocument doc;
-  DeserializationError error = deserializeJson(doc, message);
+  JsonDocument& doc = inboundDoc.acquire();
+  DeserializationError error = deserializeJson(doc, payload, length);
 
+  if (error.code() == DeserializationError::NoMemory) {
+    LOG_WARN("⚠️ %u-byte payload on %s too large to parse, ignored",
+             length, topic);
+    return;
+  }
   if (error) {
-    Serial.print("deserializeJson() failed ❌: ");
-    Serial.println(error.f_str());
+    LOG_WARN("deserializeJson() failed ❌: %s", error.c_str());
+    return;
+  }
+
+  if (edgeRulesEvaluate(topic, doc["message"], onEdgeRule)) {
     return;
   }
 
-  int topic_id = getIdFromTopic(topic);
-  char* topic_type = getMessageTypeFromTopic(topic);
-  char* topic_action = getTopicActionFromTopic(topic);
+  TopicParts parts;
+  parseTopic(topic, parts);
+  int topic_id = parts.index;
 
-  if (String(topic_type) == String(topic_type_config) &&
-      topic_action != nullptr &&
-      String(topic_action) == "get") {
+  if (strcmp(parts.type, topic_type_config) == 0 &&
+      strcmp(parts.action, "get") == 0) {
     publishValveConfig(topic_id);
     return;
   }
 
-  if (String(topic_type) == String(topic_type_control)) {
-    const char* messageTimestamp = doc["timestamp"];
-    if(!isTimestampInRange(messageTimestamp)){
-      Serial.println("Ignoring stale message");
+  if (strcmp(parts.type, topic_type_rules) == 0 && topic_id == 0) {
+    handleRulesMessage(doc["message"]);
+    return;
+  }
+
+  if (strcmp(parts.type, topic_type_ota) == 0 && topic_id == 0 &&
+      parts.action[0] == '\0') {
+    char stateTopic[64];
+    buildTopic(stateTopic, sizeof(stateTopic), deviceId, 0, topic_type_ota,
+               "state");
+    otaHandleMessage(client, stateTopic, doc["message"], ota_ca_cert,
+                     closeValvesForOta);
+    return;
+  }
+
+  if (strcmp(parts.type, topic_type_trace) == 0 && topic_id == 0) {
+    if (!isTimestampInRange(doc["timestamp"].as<const char*>(),
+                            message_timestamp_threshold)) {
+      LOG_INFO("Ignoring stale trace message");
       return;
     }
+    handleTraceMessage(doc["message"]);
+    return;
+  }
+
+  if (strcmp(parts.type, topic_type_schedule) == 0 && parts.action[0] == '\0') {
+    handleScheduleMessage(topic_id, doc["message"]);
+    return;
+  }
 
-    const char* messageContent = doc["message"];
-    if (String(messageContent) == "HIGH") {
-      activateSwitch(topic_id);
-    } else if (String(messageContent) == "LOW") {
-      deactivateSwitch(topic_id, "manual");
+  if (strcmp(parts.type, topic_type_calibrate) == 0) {
+    if (!isTimestampInRange(doc["timestamp"].as<const char*>(),
+                            message_timestamp_threshold)) {
+      LOG_INFO("Ignoring stale calibration message");
+      return;
     }
-  } else if (String(topic_type) == String(topic_type_config)) {
+    handleCalibrationMessage(topic_id, doc["message"]);
+    return;
+  }
+
+  if (strcmp(parts.type, topic_type_control) == 0) {
+    handleControlMessage(topic_id, doc, receivedUs);
+  } else if (strcmp(parts.type, topic_type_config) == 0) {
     int index = topicIdToIndex(topic_id);
     if (index < 0) {
       return;
     }
 
     ValveConfig &valve = valves[index];
-
-    if (doc["message"].containsKey("controlMode")) {
-      const char* receivedMode = doc["message"]["controlMode"];
-      valve.controlMode = parseControlMode(receivedMode);
-      Serial.printf("✅ Valve %d control mode updated to %s\n", topic_id,
-                    controlModeToString(valve.controlMode));
+    const unsigned long applyStartedAt = micros();
+    uint8_t applied = configApply(doc["message"], topic_id, valve,
+                                  controllerConfig);
+    last_config_apply_us = micros() - applyStartedAt;
+    if (applied & CONFIG_WEIGHT_THRESHOLD) {
+      refreshWeightThresholds(valve);
     }
 
-    if (doc["message"].containsKey("highDuration")) {
-      unsigned long receivedDuration =
-          doc["message"]["highDuration"].as<unsigned long>();
-      if (receivedDuration < MIN_HIGH_DURATION_MS) {
-        receivedDuration = MIN_HIGH_DURATION_MS;
-      } else if (receivedDuration > MAX_HIGH_DURATION_MS) {
-        receivedDuration = MAX_HIGH_DURATION_MS;
-      }
-      valve.highDurationMs = receivedDuration;
-      Serial.printf("✅ Valve %d high duration updated to %lums\n", topic_id,
-                    valve.highDurationMs);
-    }
-
-    const char* targetWeightKey =
-        doc["message"].containsKey("targetWeightChange")
-            ? "targetWeightChange"
-            : (doc["message"].containsKey("targetWeightIncrease")
-                   ? "targetWeightIncrease"
-                   : nullptr);
-
-    if (targetWeightKey) {
-      float receivedTarget = doc["message"][targetWeightKey].as<float>();
-      if (receivedTarget >= MIN_TARGET_WEIGHT_CHANGE) {
-        valve.targetWeightChange = receivedTarget;
-        Serial.printf("✅ Valve %d target weight change updated to %f\n",
-                      topic_id, valve.targetWeightChange);
-      } else {
-        Serial.println("⚠️ targetWeightChange below minimum, ignoring update");
-      }
+    if (applied & CONFIG_TEMP_COEFFICIENT) {
+      weightSensorSetTemperatureCoefficient(controllerConfig.tempCoefficient);
     }
 
-    if (doc["message"].containsKey("toleranceWeight")) {
-      float receivedTolerance = doc["message"]["toleranceWeight"].as<float>();
-      if (receivedTolerance >= MIN_TOLERANCE_WEIGHT) {
-        valve.toleranceWeight = receivedTolerance;
-        Serial.printf("✅ Valve %d tolerance weight updated to %f\n", topic_id,
-                      valve.toleranceWeight);
-      } else {
-        Serial.println("⚠️ toleranceWeight below minimum, ignoring update");
-      }
-    }
-
-    if (doc["message"].containsKey("toleranceDurationMs")) {
-      unsigned long receivedDuration =
-          doc["message"]["toleranceDurationMs"].as<unsigned long>();
-      if (receivedDuration < MIN_TOLERANCE_DURATION_MS) {
-        receivedDuration = MIN_TOLERANCE_DURATION_MS;
-      } else if (receivedDuration > MAX_TOLERANCE_DURATION_MS) {
-        receivedDuration = MAX_TOLERANCE_DURATION_MS;
-      }
-      valve.toleranceDurationMs = receivedDuration;
-      Serial.printf("✅ Valve %d tolerance duration updated to %lums\n",
-                    topic_id, valve.toleranceDurationMs);
-    }
-
-      if (doc["message"].containsKey("sensorReadIntervalMs")) {
-        unsigned long receivedInterval =
-            doc["message"]["sensorReadIntervalMs"].as<unsigned long>();
-        if (receivedInterval < MIN_SENSOR_READ_INTERVAL_MS) {
-          receivedInterval = MIN_SENSOR_READ_INTERVAL_MS;
-        } else if (receivedInterval > MAX_SENSOR_READ_INTERVAL_MS) {
-          receivedInterval = MAX_SENSOR_READ_INTERVAL_MS;
-        }
-      valve.sensorReadIntervalMs = receivedInterval;
-      Serial.printf("✅ Valve %d sensor read interval updated to %lums\n",
-                    topic_id, valve.sensorReadIntervalMs);
-    }
-
-    if (doc["message"].containsKey("heartbeatInterval")) {
-      float receivedInterval = doc["message"]["heartbeatInterval"].as<float>();
-      if (receivedInterval > healthInterval_max_duration) {
-        Serial.printf("Received heartbeat interval duration of %fminutes\n",
-                      receivedInterval);
-        healthInterval = healthInterval_max_duration;
-      } else if (receivedInterval < healthInterval_min_duration) {
-        Serial.printf("Received heartbeat interval duration of %fminutes\n",
-                      receivedInterval);
-        healthInterval = healthInterval_min_duration;
-      } else {
-        healthInterval = receivedInterval;
-      }
-      Serial.printf(
-          "✅ Heartbeat interval duration for index %i updated to %fminutes\n",
-          topic_id, healthInterval);
+    // as<uint8_t>() turns a string or an out-of-range number into 0, which
+    // would silence the log instead of rejecting the update.
+    JsonVariantConst logLevel = doc["message"]["logLevel"];
+    if (logLevel.is<uint8_t>() &&
+        logLevel.as<uint8_t>() <= LOG_LEVEL_DEBUG) {
+      logSetLevel(logLevel.as<uint8_t>());
+      LOG_INFO("✅ Log level updated to %u", logRuntimeLevel);
+    } else if (!logLevel.isNull()) {
+      LOG_WARN("⚠️ logLevel must be 0 to %u, ignoring update",
+               (unsigned)LOG_LEVEL_DEBUG);
     }
   }
 }
 
-void publishHealthStatus() {
+// Per valve: what the dashboard shows next to it.
+void buildValveHealth(JsonDocument& doc, int index) {
   IPAddress ip = WiFi.localIP();
   char ipStr[16];
   snprintf(ipStr, sizeof(ipStr), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
 
+  doc["type"] = topic_type_health;
+  JsonObject message = doc["message"].to<JsonObject>();
+  message["ipAddress"] = ipStr;
+  message["active"] = digitalRead(valves[index].pin) == HIGH;
+  const uint8_t scale = valves[index].scale;
+  message["scale"] = scale;
+  message["flowMeter"] = valves[index].flowMeter;
+  message["weight"] = weightCountsToGrams(scale, lastWeightCounts[scale]);
+  message["weightDriftPerMin"] = weightCountsToGrams(
+      scale, scale_tracking[scale].driftCountsPerMinQ8 >> 8);
+  message["zeroTracked"] =
+      weightCountsToGrams(scale, scale_tracking[scale].zeroTrackedCounts);
+#if WEIGHT_TEMP_COMPENSATION
+  message["scaleTemperature"] = lastScaleTemperature;
+#endif
+}
+
+// Controller-wide counters, once per health interval rather than once per
+// valve.
+void buildDiagnostics(JsonDocument& doc) {
+  doc["type"] = topic_type_diagnostics;
+  JsonObject message = doc["message"].to<JsonObject>();
+  message["weightReadUs"] = weightSensorLastReadUs();
+  message["mqttConnectMs"] = lastMqttConnectMs();
+  message["mqttConnectCount"] = mqttConnectCount();
+  message["loopAvgUs"] = loopCount == 0 ? 0 : loopTotalUs / loopCount;
+  message["loopMaxUs"] = loopMaxUs;
+  message["logDropped"] = logDroppedCount();
+  message["freeHeap"] = ESP.getFreeHeap();
+  message["minFreeHeap"] = ESP.getMinFreeHeap();
+  message["maxAllocHeap"] = ESP.getMaxAllocHeap();
+  message["jsonInboundPeak"] = inboundDoc.arena().peak();
+  message["jsonOutboundPeak"] = outboundDoc.arena().peak();
+  message["publishPeak"] = publishJsonPeak();
+  message["publishOversize"] = publishJsonOversizeCount();
+  message["edgeRules"] = edgeRulesCount();
+  message["edgeRuleMaxEvalUs"] = edgeRulesMaxEvalUs();
+  message["traceBytes"] = traceSize();
+  message["traceDropped"] = traceDropped();
+  message["configApplyUs"] = last_config_apply_us;
+  message["mqttLan"] = mqttOnLanBroker();
+  message["resetReason"] = static_cast<int>(esp_reset_reason());
+  message["bootWiFiMs"] = boot_wifi_ms;
+  message["bootReadyMs"] = boot_ready_ms;
+  message["bootFirstCommandMs"] = boot_first_command_ms;
+}
+
+void publishHealthStatus() {
+  char topic[64];
+  for (int i=0; i < MAX_VALVES; i++ ) {
+    buildTopic(topic, sizeof(topic), deviceId, i + 1, topic_type_health);
+    JsonDocument& doc = outboundDoc.acquire();
+    buildValveHealth(doc, i);
+    publishJson(client, topic, doc, true);
+  }
+
+  buildTopic(topic, sizeof(topic), deviceId, 0, topic_type_diagnostics);
+  JsonDocument& doc = outboundDoc.acquire();
+  buildDiagnostics(doc);
+  publishJson(client, topic, doc, true);
+}
+
+// Health and diagnostics grow with every counter added; refuse to start
+// quietly with one that can outgrow the publish buffer.
+void checkHealthMessageSizes() {
+  JsonDocument& health = outboundDoc.acquire();
+  buildValveHealth(health, 0);
+  bool fits = publishJsonFits(topic_type_health, health);
+  JsonDocument& diagnostics = outboundDoc.acquire();
+  buildDiagnostics(diagnostics);
+  fits = publishJsonFits(topic_type_diagnostics, diagnostics) && fits;
+  if (!fits) {
+    LOG_ERROR("Health messages can exceed JSON_PUBLISH_MAX_PAYLOAD; raise it");
+  }
+}
+
+// Everything this controller publishes retained, from its current state.
+void republishRetainedState() {
+  for (int i=0; i < MAX_VALVES; i++ ) {
+    publishValveConfig(i + 1);
+    publishScheduleState(i + 1);
+    publishValveState(i + 1, valves[i].active ? "HIGH" : "LOW",
+                      lastWeightCounts[valves[i].scale], 0);
+  }
+  publishHealthStatus();
+}
+
+bool anyValveActive() {
   for (int i=0; i < MAX_VALVES; i++ ) {
-    char topic[64];
-    snprintf(topic, sizeof(topic), "%s/%i/%s", deviceId, i+1, topic_type_health);
+    if (valves[i].active) {
+      return true;
+    }
+  }
+  return false;
+}
 
-    JsonDocument doc;
-    doc["type"] = topic_type_health;
-    JsonObject message = doc["message"].to<JsonObject>();
-    message["ipAddress"] = ipStr;
-    message["active"] = digitalRead(valves[i].pin) == HIGH;
-    message["weight"] = lastWeightReading;
-    publishCommand(topic, doc, true);
+#if WEIGHT_TEMP_COMPENSATION
+void updateScaleTemperature() {
+  if (!ahtInitialized) {
+    return;
   }
+  sensors_event_t humidityEvent;
+  sensors_event_t temperatureEvent;
+  aht.getEvent(&humidityEvent, &temperatureEvent);
+  if (isnan(temperatureEvent.temperature)) {
+    LOG_WARN("AHT10 read failed");
+    return;
+  }
+  lastScaleTemperature = temperatureEvent.temperature;
+  traceTemperature(lastScaleTemperature);
+  weightSensorSetTemperature(lastScaleTemperature);
+}
+
+void setupScaleTemperature() {
+  Wire.begin(AHT10_SDA, AHT10_SCL);
+  ahtInitialized = aht.begin(&Wire);
+  if (!ahtInitialized) {
+    LOG_ERROR("Failed to initialize AHT10, weight temperature compensation off");
+    return;
+  }
+  updateScaleTemperature();
+  lastScaleTemperatureRead = millis();
+}
+#endif
+
+void trackIdleWeight(unsigned long now) {
+  if (now - lastIdleWeightSampleTime < IDLE_WEIGHT_SAMPLE_INTERVAL_MS) {
+    return;
+  }
+  bool anyIdle = false;
+  for (uint8_t c = 0; c < weight_channel_count; c++) {
+    anyIdle = anyIdle || !scaleInUse(c);
+  }
+  if (!anyIdle) {
+    return;
+  }
+  readWeightSensors();
+
+  for (uint8_t c = 0; c < weight_channel_count; c++) {
+    if (!scaleInUse(c)) {
+      scaleTrackingSample(scale_tracking[c], c, lastWeightCounts[c],
+                          now - lastIdleWeightSampleTime);
+    }
+  }
+  rememberTares();
+  lastIdleWeightSampleTime = now;
 }
 
 void setup() {
   Serial.begin(115200);
+  logBegin();
   pinMode(wifi_connection_status_pin, OUTPUT);
   pinMode(mqtt_connection_status_pin, OUTPUT);
+  for (uint8_t c = 0; c < weight_channel_count; c++) {
+    weightSensorSetScale(c, calibration_factor);
+    weightCalibrationLoaded[c] = weightSensorLoadCalibration(c);
+  }
   for (int i=0; i < MAX_VALVES; i++ ) {
+    configApplyDefaults(valves[i], controllerConfig);
     pinMode(valves[i].pin, OUTPUT);
   }
+  // Persisted by the weight sensor; the table default is only for a new
+  // board.
+  controllerConfig.tempCoefficient = weightSensorTemperatureCoefficient();
+  refreshAllWeightThresholds();
+  flowMeterBegin(flow_meter_pins, flow_meter_count);
+#if FLOW_SIMULATED_PULSE_HZ
+  flowMeterSimulatePulses(0, FLOW_SIMULATED_PULSE_HZ);
+#endif
+  scheduleBegin(MAX_VALVES);
+  edgeRulesBegin();
+#if WEIGHT_TEMP_COMPENSATION
+  setupScaleTemperature();
+#endif
 
   setDeviceId();
-  connectWiFi();
-  setTime();
-
-  wifiClient.setInsecure();  // For testing with self-signed cert
+  // Associate in the background while the scales start up, then let NTP
+  // run while MQTT connects.
+  if (esp_reset_reason() == ESP_RST_POWERON) {
+    rtc_tares.magic = 0;
+  }
+  loadWiFiCache(wifi_cache);
+  beginWiFi(ssid, password, &wifi_cache);
+  beginWeightSensor();
+  reconnectWiFi();
+  boot_wifi_ms = millis();
+  saveWiFiCache(wifi_cache);
+  startTimeSync(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC);
+
+  configureTls(wifiClient, mqtt_ca_cert);
   client.setServer(mqtt_server, mqtt_port);
   client.setCallback(callback);
-  client.setBufferSize(512);
+  client.setBufferSize(MQTT_RECEIVE_BUFFER_SIZE);
+#if MQTT_LAN_FAILOVER
+  mqttFailoverBegin(client, wifiClient, mqtt_server, mqtt_port,
+                    {mqtt_lan_ca_cert, mqtt_lan_user, mqtt_lan_pass});
+  mqttDiscoverLanBroker();
+#endif
+  checkHealthMessageSizes();
 }
 
 void loop() {
+  const unsigned long loopStartedAt = micros();
   if (WiFi.status() != WL_CONNECTED) {
-    connectWiFi();
-    setTime();
-  } else if (!client.connected()) {
-    testDNS();
-    connectMQTT();
+    maintainWiFi();
   } else {
-    client.loop();
+    if (wifiLost) {
+      // SNTP keeps polling on its own once configured, so the clock needs
+      // no blocking resync here.
+      wifiLost = false;
+      digitalWrite(wifi_connection_status_pin, HIGH);
+      LOG_INFO("✅ WiFi reconnected");
+    }
+    if (!client.connected()) {
+      // A blocked connect would hold a timed valve open past its duration
+      // and a weight or flow valve past its target.
+      if (!anyValveActive()) {
+        maintainMQTT();
+      }
+    } else {
+      client.loop();
+#if MQTT_LAN_FAILOVER
+      // The probe can block for 500 ms, so not while a valve is open. On
+      // success the session is dropped and the next pass reconnects.
+      if (!anyValveActive()) {
+        mqttFailbackDue();
+      }
+#endif
+    }
+  }
+
+  int dueValve;
+  while ((dueValve = scheduleDue(time(nullptr))) >= 0) {
+    if (edgeRulesInhibit(dueValve)) {
+      LOG_INFO("Valve %d schedule skipped by edge rule", dueValve + 1);
+      continue;
+    }
+    LOG_INFO("Valve %d started by schedule", dueValve + 1);
+    activateSwitch(dueValve + 1);
   }
 
   for (int i=0; i < MAX_VALVES; i++ ) {
@@ -712,56 +1352,83 @@ void loop() {
 
     if (valve.controlMode == CONTROL_MODE_TIME) {
       if (now - valve.lastProgressPublishTime >= valve.sensorReadIntervalMs) {
-        publishValveState(i + 1, "HIGH", valve.lastWeight, 0.0f, false);
+        publishValveState(i + 1, "HIGH", valve.lastCounts, 0, false);
         valve.lastProgressPublishTime = now;
       }
       if (now - valve.startTime >= valve.highDurationMs) {
-        Serial.printf("Valve %d timer elapsed, closing valve\n", i + 1);
+        LOG_INFO("Valve %d timer elapsed, closing valve", i + 1);
         deactivateSwitch(i + 1, "duration_elapsed");
       }
       continue;
     }
 
-    if (now - valve.lastWeightReadTime >= valve.sensorReadIntervalMs) {
-      float currentWeight = readWeightSensor();
-      valve.lastWeight = currentWeight;
-      valve.lastWeightReadTime = now;
+    if (valve.controlMode == CONTROL_MODE_FLOW) {
+      // On target the pin is already low; this records and reports the
+      // close.
+      const bool targetReached = flowMeterTargetReached(valve.flowMeter);
+      if (!targetReached &&
+          now - valve.lastProgressPublishTime >= valve.sensorReadIntervalMs) {
+        valveFlowSample(valve, flowMeterPulses(valve.flowMeter), now);
+        publishValveState(i + 1, "HIGH", valve.lastCounts, 0, false);
+        valve.lastProgressPublishTime = now;
+      }
+      const char* closeReason = valveFlowCheck(valve, targetReached, now);
+      if (closeReason) {
+        LOG_INFO("Valve %d closing: %s", i + 1, closeReason);
+        deactivateSwitch(i + 1, closeReason);
+      }
+      continue;
+    }
 
-      float weightChange = valve.startWeight - valve.lastWeight;
+    const bool sampled =
+        now - valve.lastWeightReadTime >= valve.sensorReadIntervalMs;
+    if (sampled) {
+      valve.lastCounts = readWeightSensor(valve.scale);
+      valve.lastWeightReadTime = now;
+    }
+    const int32_t changeCounts = valveChangeCounts(valve, now);
+    if (sampled) {
       int pinState = digitalRead(valve.pin);
       publishValveState(i + 1, pinState == HIGH ? "HIGH" : "LOW",
-                        valve.lastWeight, weightChange, false);
+                        valve.lastCounts, changeCounts, false);
       valve.lastProgressPublishTime = now;
-
-      if (weightChange >= valve.targetWeightChange) {
-        Serial.printf("Valve %d target weight change reached, closing valve\n",
-                      i + 1);
-        deactivateSwitch(i + 1, "target_reached");
-        continue;
-      }
-
-      if (!valve.toleranceSatisfied && weightChange >= valve.toleranceWeight) {
-        valve.toleranceSatisfied = true;
-      }
     }
 
-    if (!valve.toleranceSatisfied &&
-        now - valve.startTime >= valve.toleranceDurationMs) {
-      float weightChange = valve.startWeight - valve.lastWeight;
-      if (weightChange < valve.toleranceWeight) {
-        Serial.printf("Valve %d tolerance condition not met, closing valve\n",
-                      i + 1);
-        deactivateSwitch(i + 1, "tolerance_timeout");
-        continue;
-      } else {
-        valve.toleranceSatisfied = true;
-      }
+    const char* closeReason =
+        valveWeightCheck(valve, changeCounts, sampled, now);
+    if (closeReason) {
+      LOG_INFO("Valve %d closing: %s", i + 1, closeReason);
+      deactivateSwitch(i + 1, closeReason);
     }
  }
 
+#if WEIGHT_TEMP_COMPENSATION
+ if (millis() - lastScaleTemperatureRead >= SCALE_TEMPERATURE_INTERVAL_MS) {
+   updateScaleTemperature();
+   lastScaleTemperatureRead = millis();
+ }
+#endif
+
+ trackIdleWeight(millis());
+
+ if (millis() - lastTraceClockAt >= TRACE_CLOCK_INTERVAL_MS) {
+   traceClock(currentEpochMs());
+   lastTraceClockAt = millis();
+ }
+
 //  system health
- if (millis() - lastHealthPublish >= healthInterval * 60 * 1000) {
+ if (millis() - lastHealthPublish >= controllerConfig.healthIntervalMin * 60 * 1000) {
   publishHealthStatus();
   lastHealthPublish = millis();
+  loopCount = 0;
+  loopTotalUs = 0;
+  loopMaxUs = 0;
 }
+
+ const unsigned long loopUs = micros() - loopStartedAt;
+ loopCount++;
+ loopTotalUs += loopUs;
+ if (loopUs > loopMaxUs) {
+   loopMaxUs = loopUs;
+ }
 }
@@ -0,0 +1,125 @@
+#include "trace_capture.h"
+
+#include <Arduino.h>
+#include <string.h>
+
+namespace {
+constexpr size_t RECORD_HEADER = 1 + sizeof(uint32_t);
+constexpr size_t MQTT_HEADER = RECORD_HEADER + 1 + sizeof(uint16_t);
+
+uint8_t ring[TRACE_BUFFER_BYTES];
+size_t tail = 0;  // start of the oldest record
+size_t used = 0;
+uint32_t dropped = 0;
+bool enabled = true;
+
+uint8_t byteAt(size_t offset) {
+  return ring[(tail + offset) % TRACE_BUFFER_BYTES];
+}
+
+size_t recordLength(size_t offset) {
+  switch (byteAt(offset)) {
+    case TRACE_CLOCK:
+      return RECORD_HEADER + sizeof(int64_t);
+    case TRACE_WEIGHT:
+      return RECORD_HEADER + 1 + sizeof(int32_t);
+    case TRACE_TEMPERATURE:
+      return RECORD_HEADER + sizeof(int32_t);
+    case TRACE_MQTT:
+      return MQTT_HEADER + byteAt(offset + 5) +
+             (byteAt(offset + 6) | (byteAt(offset + 7) << 8));
+  }
+  return used;
+}
+
+void append(const void* data, size_t length) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  size_t head = (tail + used) % TRACE_BUFFER_BYTES;
+  for (size_t i = 0; i < length; i++) {
+    ring[head] = bytes[i];
+    head = (head + 1) % TRACE_BUFFER_BYTES;
+  }
+  used += length;
+}
+
+bool beginRecord(TraceKind kind, size_t length) {
+  if (!enabled || length > TRACE_BUFFER_BYTES) {
+    return false;
+  }
+  while (TRACE_BUFFER_BYTES - used < length) {
+    const size_t oldest = recordLength(0);
+    tail = (tail + oldest) % TRACE_BUFFER_BYTES;
+    used -= oldest;
+    dropped++;
+  }
+  const uint32_t now = millis();
+  append(&kind, 1);
+  append(&now, sizeof(now));
+  return true;
+}
+}  // namespace
+
+void traceSetEnabled(bool value) {
+  enabled = value;
+}
+
+bool traceEnabled() {
+  return enabled;
+}
+
+void traceClear() {
+  tail = 0;
+  used = 0;
+  dropped = 0;
+}
+
+void traceClock(int64_t epochMs) {
+  if (beginRecord(TRACE_CLOCK, RECORD_HEADER + sizeof(epochMs))) {
+    append(&epochMs, sizeof(epochMs));
+  }
+}
+
+void traceWeight(uint8_t channel, int32_t counts) {
+  if (beginRecord(TRACE_WEIGHT, RECORD_HEADER + 1 + sizeof(counts))) {
+    append(&channel, 1);
+    append(&counts, sizeof(counts));
+  }
+}
+
+void traceTemperature(float celsius) {
+  if (beginRecord(TRACE_TEMPERATURE, RECORD_HEADER + sizeof(celsius))) {
+    append(&celsius, sizeof(celsius));
+  }
+}
+
+void traceMqtt(const char* topic, const uint8_t* payload, size_t length) {
+  const size_t topicLength = strnlen(topic, UINT8_MAX);
+  const uint8_t topicByte = topicLength;
+  const uint16_t payloadLength =
+      length > TRACE_MAX_PAYLOAD ? TRACE_MAX_PAYLOAD : length;
+  if (beginRecord(TRACE_MQTT, MQTT_HEADER + topicLength + payloadLength)) {
+    append(&topicByte, 1);
+    append(&payloadLength, sizeof(payloadLength));
+    append(topic, topicLength);
+    append(payload, payloadLength);
+  }
+}
+
+size_t traceSize() {
+  return used;
+}
+
+uint32_t traceDropped() {
+  return dropped;
+}
+
+size_t traceRead(size_t offset, uint8_t* buffer, size_t size) {
+  if (offset >= used) {
+    return 0;
+  }
+  const size_t count = used - offset < size ? used - offset : size;
+  for (size_t i = 0; i < count; i++) {
+    buffer[i] = byteAt(offset + i);
+  }
+  return count;
+}
@@ -0,0 +1,142 @@
+#include "valve_config.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <device_log.h>
+
+namespace {
+
+uint8_t* fieldAddress(const ConfigField& field, ValveConfig& valve,
+                      ControllerConfig& controller) {
+  uint8_t* base = field.scope == CONFIG_SCOPE_VALVE
+                      ? reinterpret_cast<uint8_t*>(&valve)
+                      : reinterpret_cast<uint8_t*>(&controller);
+  return base + field.offset;
+}
+
+const uint8_t* fieldAddress(const ConfigField& field, const ValveConfig& valve,
+                            const ControllerConfig& controller) {
+  return fieldAddress(field, const_cast<ValveConfig&>(valve),
+                      const_cast<ControllerConfig&>(controller));
+}
+
+const ConfigField* findField(const char* key) {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    if (strcmp(key, field.name) == 0 ||
+        (field.alias && strcmp(key, field.alias) == 0)) {
+      return &field;
+    }
+  }
+  return nullptr;
+}
+
+void storeNumber(const ConfigField& field, uint8_t* target, float value) {
+  if (field.type == CONFIG_ULONG) {
+    *reinterpret_cast<unsigned long*>(target) =
+        static_cast<unsigned long>(lroundf(value));
+  } else {
+    *reinterpret_cast<float*>(target) = value;
+  }
+}
+
+bool applyField(const ConfigField& field, JsonVariantConst value,
+                int valveId, uint8_t* target) {
+  if (field.type == CONFIG_CONTROL_MODE) {
+    ControlMode mode = parseControlMode(value.as<const char*>());
+    *reinterpret_cast<ControlMode*>(target) = mode;
+    LOG_INFO("✅ Valve %d %s updated to %s", valveId, field.name,
+             controlModeToString(mode));
+    return true;
+  }
+
+  if (!value.is<float>()) {
+    LOG_WARN("⚠️ %s is not a number, ignoring update", field.name);
+    return false;
+  }
+  float received = value.as<float>();
+  if (received < field.min || received > field.max) {
+    if (field.flags & CONFIG_REJECT_OUT_OF_RANGE) {
+      LOG_WARN("⚠️ %s out of range, ignoring update", field.name);
+      return false;
+    }
+    LOG_WARN("Received %s of %f, clamping", field.name, received);
+    received = received < field.min ? field.min : field.max;
+  }
+  storeNumber(field, target, received);
+  LOG_INFO("✅ Valve %d %s updated to %f", valveId, field.name, received);
+  return true;
+}
+
+}  // namespace
+
+const char* controlModeToString(ControlMode mode) {
+  switch (mode) {
+    case CONTROL_MODE_TIME:
+      return "time";
+    case CONTROL_MODE_FLOW:
+      return "flow";
+    default:
+      return "weight";
+  }
+}
+
+ControlMode parseControlMode(const char* mode) {
+  if (mode && strcmp(mode, "time") == 0) {
+    return CONTROL_MODE_TIME;
+  }
+  if (mode && strcmp(mode, "flow") == 0) {
+    return CONTROL_MODE_FLOW;
+  }
+  return CONTROL_MODE_WEIGHT;
+}
+
+void configApplyDefaults(ValveConfig& valve, ControllerConfig& controller) {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    uint8_t* target = fieldAddress(field, valve, controller);
+    if (field.type == CONFIG_CONTROL_MODE) {
+      *reinterpret_cast<ControlMode*>(target) =
+          static_cast<ControlMode>(field.defaultValue);
+    } else {
+      storeNumber(field, target, field.defaultValue);
+    }
+  }
+}
+
+uint8_t configApply(JsonObjectConst message, int valveId, ValveConfig& valve,
+                    ControllerConfig& controller) {
+  uint8_t applied = 0;
+  for (JsonPairConst member : message) {
+    const ConfigField* field = findField(member.key().c_str());
+    if (field && (field->flags & CONFIG_FIXED_WHILE_ACTIVE) && valve.active) {
+      LOG_WARN("⚠️ Valve %d is open, ignoring %s update", valveId,
+               field->name);
+      continue;
+    }
+    if (field &&
+        applyField(*field, member.value(), valveId,
+                   fieldAddress(*field, valve, controller))) {
+      applied |= field->flags;
+    }
+  }
+  return applied;
+}
+
+void configPublish(JsonObject message, const ValveConfig& valve,
+                   const ControllerConfig& controller) {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    const uint8_t* source = fieldAddress(field, valve, controller);
+    switch (field.type) {
+      case CONFIG_CONTROL_MODE:
+        message[field.name] = controlModeToString(
+            *reinterpret_cast<const ControlMode*>(source));
+        break;
+      case CONFIG_ULONG:
+        message[field.name] = *reinterpret_cast<const unsigned long*>(source);
+        break;
+      case CONFIG_FLOAT:
+        message[field.name] = *reinterpret_cast<const float*>(source);
+        break;
+    }
+  }
+}
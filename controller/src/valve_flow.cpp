@@ -0,0 +1,47 @@
+#include "valve_flow.h"
+
+#include <math.h>
+
+uint32_t valveFlowTargetPulses(const ValveConfig& valve) {
+  return static_cast<uint32_t>(
+      lroundf(valve.targetVolume * valve.pulsesPerLiter));
+}
+
+void valveFlowStart(ValveConfig& valve, unsigned long now) {
+  valve.lastFlowPulses = 0;
+  valve.lastFlowPulseTime = now;
+  valve.flowRateLpm = 0.0f;
+}
+
+float valveFlowVolume(const ValveConfig& valve, uint32_t pulses) {
+  return pulses / valve.pulsesPerLiter;
+}
+
+// Rate over the interval since the last sample, in liters per minute.
+void valveFlowSample(ValveConfig& valve, uint32_t pulses, unsigned long now) {
+  const unsigned long elapsedMs = now - valve.lastProgressPublishTime;
+  if (elapsedMs > 0) {
+    valve.flowRateLpm = (pulses - valve.lastFlowPulses) * 60000.0f /
+                        (valve.pulsesPerLiter * elapsedMs);
+  }
+  if (pulses != valve.lastFlowPulses) {
+    valve.lastFlowPulseTime = now;
+  }
+  valve.lastFlowPulses = pulses;
+}
+
+const char* valveFlowCheck(const ValveConfig& valve, bool targetReached,
+                           unsigned long now) {
+  if (targetReached) {
+    return "target_reached";
+  }
+  // A noisy sensor keeps resetting the no-flow timer, so the run length is
+  // capped on its own.
+  if (now - valve.startTime >= valve.maxOpenDurationMs) {
+    return "max_duration";
+  }
+  if (now - valve.lastFlowPulseTime >= valve.toleranceDurationMs) {
+    return "no_flow";
+  }
+  return nullptr;
+}
@@ -0,0 +1,98 @@
+#include "valve_weight.h"
+
+#include <stdlib.h>
+
+#include "weight_sensor.h"
+
+namespace {
+constexpr float ZERO_TRACKING_BAND_GRAMS = 2.0f;
+constexpr float DRIFT_STABLE_BAND_GRAMS = 0.5f;
+constexpr uint8_t ZERO_TRACKING_SHIFT = 3;  // move 1/8 of the residual per sample
+constexpr uint8_t DRIFT_FILTER_SHIFT = 4;   // average over about 16 samples
+
+// Whether `counts` has gone as far as `threshold`, in its direction.
+bool reached(int32_t counts, int32_t threshold) {
+  return threshold < 0 ? counts <= threshold : counts >= threshold;
+}
+}  // namespace
+
+void refreshWeightThresholds(ValveConfig& valve) {
+  valve.targetCounts =
+      gramsToWeightCounts(valve.scale, valve.targetWeightChange);
+  valve.toleranceCounts =
+      gramsToWeightCounts(valve.scale, valve.toleranceWeight);
+}
+
+void valveWeightStart(ValveConfig& valve, int32_t counts, unsigned long now) {
+  valve.startCounts = counts;
+  valve.lastCounts = counts;
+  valve.lastWeightReadTime = now;
+  valve.toleranceSatisfied = valve.toleranceCounts == 0;
+}
+
+int32_t valveWeightChange(const ValveConfig& valve,
+                          int32_t driftCountsPerMinQ8, unsigned long now) {
+  if (valve.controlMode != CONTROL_MODE_WEIGHT) {
+    return 0;
+  }
+  // Signed throughout: a falling drift times a 64-bit unsigned long
+  // would wrap on the host.
+  const int64_t elapsedMs = static_cast<int64_t>(now - valve.startTime);
+  const int64_t driftCounts =
+      static_cast<int64_t>(driftCountsPerMinQ8) * elapsedMs / (60000LL << 8);
+  return valve.startCounts - valve.lastCounts +
+         static_cast<int32_t>(driftCounts);
+}
+
+const char* valveWeightCheck(ValveConfig& valve, int32_t changeCounts,
+                             bool sampled, unsigned long now) {
+  if (sampled) {
+    if (reached(changeCounts, valve.targetCounts)) {
+      return "target_reached";
+    }
+    if (reached(changeCounts, valve.toleranceCounts)) {
+      valve.toleranceSatisfied = true;
+    }
+  }
+  if (now - valve.startTime >= valve.maxOpenDurationMs) {
+    return "max_duration";
+  }
+  if (!valve.toleranceSatisfied &&
+      now - valve.startTime >= valve.toleranceDurationMs) {
+    if (!reached(changeCounts, valve.toleranceCounts)) {
+      return "tolerance_timeout";
+    }
+    valve.toleranceSatisfied = true;
+  }
+  return nullptr;
+}
+
+void scaleTrackingRefresh(ScaleTracking& tracking, uint8_t channel) {
+  tracking.zeroTrackingBandCounts =
+      abs(gramsToWeightCounts(channel, ZERO_TRACKING_BAND_GRAMS));
+  tracking.driftStableBandCounts =
+      abs(gramsToWeightCounts(channel, DRIFT_STABLE_BAND_GRAMS));
+  tracking.hasIdleSample = false;
+}
+
+void scaleTrackingSample(ScaleTracking& tracking, uint8_t channel,
+                         int32_t counts, unsigned long elapsedMs) {
+  if (tracking.hasIdleSample && elapsedMs > 0 &&
+      abs(counts - tracking.lastIdleCounts) <= tracking.driftStableBandCounts) {
+    int64_t instantQ8 =
+        (static_cast<int64_t>(counts - tracking.lastIdleCounts) * 60000LL
+         << 8) / static_cast<int64_t>(elapsedMs);
+    tracking.driftCountsPerMinQ8 += static_cast<int32_t>(
+        (instantQ8 - tracking.driftCountsPerMinQ8) >> DRIFT_FILTER_SHIFT);
+  }
+
+  if (abs(counts) <= tracking.zeroTrackingBandCounts) {
+    int32_t step = counts >> ZERO_TRACKING_SHIFT;
+    weightSensorAdjustTare(channel, step);
+    tracking.zeroTrackedCounts += step;
+    counts -= step;
+  }
+
+  tracking.lastIdleCounts = counts;
+  tracking.hasIdleSample = true;
+}
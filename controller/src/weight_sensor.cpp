@@ -0,0 +1,405 @@
+#include "weight_sensor.h"
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include <freertos/FreeRTOS.h>
+#include <math.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+#include <stdio.h>
+
+namespace {
+constexpr int32_t Q16_ONE = 1 << 16;
+constexpr const char* PREFS_NAMESPACE = "scale";
+// Channel 0 uses the bare keys, so calibrations saved before there were
+// several channels still load; other channels append their number.
+constexpr const char* PREFS_TARE_KEY = "tare";
+constexpr const char* PREFS_SCALE_KEY = "cpgQ16";
+constexpr const char* PREFS_TEMP_REFERENCE_KEY = "tempRef";
+constexpr const char* PREFS_TEMP_COEFFICIENT_KEY = "tempCo";
+
+// HX711s at 10 SPS have a conversion ready every 100 ms.
+constexpr unsigned long READY_TIMEOUT_MS = 200;
+constexpr uint8_t DATA_BITS = 24;
+// Extra SCK pulses after the data select channel A, gain 128.
+constexpr uint8_t GAIN_PULSES = 1;
+
+struct Channel {
+  uint8_t dataPin;
+  bool highBank;  // GPIO 32-39, read from GPIO_IN1_REG
+  uint32_t mask;
+  int32_t tareOffset;
+  int32_t countsPerGramQ16;
+  float temperatureReference;
+  // Cached so the read path only subtracts an integer.
+  int32_t temperatureCorrectionCounts;
+};
+
+Channel channels[WEIGHT_MAX_CHANNELS] = {
+  {0, false, 0, 0, Q16_ONE, NAN, 0},
+  {0, false, 0, 0, Q16_ONE, NAN, 0},
+  {0, false, 0, 0, Q16_ONE, NAN, 0},
+  {0, false, 0, 0, Q16_ONE, NAN, 0},
+};
+uint8_t channelCount = 0;
+uint8_t clockPin = 0;
+uint32_t lastReadUs = 0;
+portMUX_TYPE clockMux = portMUX_INITIALIZER_UNLOCKED;
+
+float temperature = NAN;
+float temperatureCoefficient = 0.0f;  // grams per degree
+
+// Division rounding half away from zero, for either sign of divisor.
+int64_t divideRounded(int64_t numerator, int64_t denominator) {
+  const int64_t half = denominator / 2;
+  return (numerator < 0) == (denominator < 0)
+             ? (numerator + half) / denominator
+             : (numerator - half) / denominator;
+}
+
+int32_t toQ16(double value) {
+  return static_cast<int32_t>(llround(value * Q16_ONE));
+}
+
+void prefsKey(char* key, size_t size, const char* base, uint8_t channel) {
+  if (channel == 0) {
+    snprintf(key, size, "%s", base);
+  } else {
+    snprintf(key, size, "%s%u", base, channel);
+  }
+}
+
+void updateTemperatureCorrection(uint8_t channel) {
+  Channel& c = channels[channel];
+  if (isnan(temperature) || isnan(c.temperatureReference)) {
+    c.temperatureCorrectionCounts = 0;
+    return;
+  }
+  c.temperatureCorrectionCounts = gramsToWeightCounts(
+      channel, temperatureCoefficient * (temperature - c.temperatureReference));
+}
+
+// Readings are corrected relative to the temperature at the current zero.
+void resetTemperatureReference(uint8_t channel) {
+  channels[channel].temperatureReference = temperature;
+  channels[channel].temperatureCorrectionCounts = 0;
+}
+
+// DOUT goes low when a conversion is ready and stays low until it is
+// clocked out, so channels that finish early simply wait for the rest.
+bool waitReady() {
+  const unsigned long startedAt = millis();
+  for (;;) {
+    const uint32_t low = REG_READ(GPIO_IN_REG);
+    const uint32_t high = REG_READ(GPIO_IN1_REG);
+    bool ready = true;
+    for (uint8_t i = 0; i < channelCount; i++) {
+      if (((channels[i].highBank ? high : low) & channels[i].mask) != 0) {
+        ready = false;
+        break;
+      }
+    }
+    if (ready) {
+      return true;
+    }
+    if (millis() - startedAt >= READY_TIMEOUT_MS) {
+      return false;
+    }
+    delay(1);
+  }
+}
+
+// Clocks one conversion out of every channel. Each bit is one SCK pulse and
+// one snapshot of the GPIO input registers, whatever the channel count.
+// SCK held high for 60 us powers the HX711s down, so an interrupt must not
+// land mid-pulse; the 25 pulses take about 60 us with interrupts off.
+void readConversion(int32_t* values) {
+  uint32_t bits[WEIGHT_MAX_CHANNELS] = {0};
+  portENTER_CRITICAL(&clockMux);
+  for (uint8_t bit = 0; bit < DATA_BITS; bit++) {
+    digitalWrite(clockPin, HIGH);
+    delayMicroseconds(1);
+    const uint32_t low = REG_READ(GPIO_IN_REG);
+    const uint32_t high = REG_READ(GPIO_IN1_REG);
+    digitalWrite(clockPin, LOW);
+    for (uint8_t i = 0; i < channelCount; i++) {
+      const uint32_t level =
+          ((channels[i].highBank ? high : low) & channels[i].mask) != 0;
+      bits[i] = (bits[i] << 1) | level;
+    }
+    delayMicroseconds(1);
+  }
+  for (uint8_t pulse = 0; pulse < GAIN_PULSES; pulse++) {
+    digitalWrite(clockPin, HIGH);
+    delayMicroseconds(1);
+    digitalWrite(clockPin, LOW);
+    delayMicroseconds(1);
+  }
+  portEXIT_CRITICAL(&clockMux);
+
+  for (uint8_t i = 0; i < channelCount; i++) {
+    // Sign-extend the 24-bit two's complement value.
+    values[i] = static_cast<int32_t>(bits[i] << 8) >> 8;
+  }
+}
+}  // namespace
+
+void weightSensorBegin(const uint8_t* dataPins, uint8_t count,
+                       uint8_t clock) {
+  channelCount = count > WEIGHT_MAX_CHANNELS ? WEIGHT_MAX_CHANNELS : count;
+  clockPin = clock;
+  pinMode(clockPin, OUTPUT);
+  digitalWrite(clockPin, LOW);
+  for (uint8_t i = 0; i < channelCount; i++) {
+    Channel& c = channels[i];
+    c.dataPin = dataPins[i];
+    c.highBank = c.dataPin >= 32;
+    c.mask = 1UL << (c.dataPin & 31);
+    pinMode(c.dataPin, INPUT);
+  }
+}
+
+uint8_t weightSensorChannelCount() {
+  return channelCount;
+}
+
+void weightSensorSetScale(uint8_t channel, float countsPerGram) {
+  Channel& c = channels[channel];
+  c.countsPerGramQ16 = toQ16(countsPerGram);
+  if (c.countsPerGramQ16 == 0) {
+    c.countsPerGramQ16 = Q16_ONE;
+  }
+}
+
+void weightSensorTare(uint32_t channelMask, uint8_t samples) {
+  int32_t raw[WEIGHT_MAX_CHANNELS];
+  if (!readWeightRaw(samples, raw)) {
+    return;
+  }
+  for (uint8_t i = 0; i < channelCount; i++) {
+    if ((channelMask & (1UL << i)) == 0) {
+      continue;
+    }
+    channels[i].tareOffset = raw[i];
+    resetTemperatureReference(i);
+  }
+}
+
+bool readWeightCounts(uint8_t samples, int32_t* counts) {
+  int32_t raw[WEIGHT_MAX_CHANNELS];
+  if (!readWeightRaw(samples, raw)) {
+    return false;
+  }
+  for (uint8_t i = 0; i < channelCount; i++) {
+    counts[i] = raw[i] - channels[i].tareOffset -
+                channels[i].temperatureCorrectionCounts;
+  }
+  return true;
+}
+
+bool readWeightRaw(uint8_t samples, int32_t* raw) {
+  const unsigned long startedAt = micros();
+  if (samples == 0) {
+    samples = 1;
+  }
+  int64_t sums[WEIGHT_MAX_CHANNELS] = {0};
+  int32_t values[WEIGHT_MAX_CHANNELS];
+  for (uint8_t sample = 0; sample < samples; sample++) {
+    if (!waitReady()) {
+      lastReadUs = micros() - startedAt;
+      return false;
+    }
+    readConversion(values);
+    for (uint8_t i = 0; i < channelCount; i++) {
+      sums[i] += values[i];
+    }
+  }
+  for (uint8_t i = 0; i < channelCount; i++) {
+    raw[i] = static_cast<int32_t>(sums[i] / samples);
+  }
+  lastReadUs = micros() - startedAt;
+  return true;
+}
+
+uint32_t weightSensorLastReadUs() {
+  return lastReadUs;
+}
+
+// Saturates instead of wrapping, so an absurd threshold or correction
+// can never come out as a small or negative count.
+int32_t gramsToWeightCounts(uint8_t channel, float grams) {
+  const double counts = static_cast<double>(grams) *
+                        channels[channel].countsPerGramQ16 / Q16_ONE;
+  if (isnan(counts)) {
+    return 0;
+  }
+  if (counts >= INT32_MAX) {
+    return INT32_MAX;
+  }
+  if (counts <= INT32_MIN) {
+    return INT32_MIN;
+  }
+  return static_cast<int32_t>(llround(counts));
+}
+
+float weightCountsToGrams(uint8_t channel, int32_t counts) {
+  const int64_t milligrams =
+      divideRounded(static_cast<int64_t>(counts) * Q16_ONE * 1000,
+                    channels[channel].countsPerGramQ16);
+  return milligrams / 1000.0f;
+}
+
+WeightCalibration weightSensorCalibration(uint8_t channel) {
+  return {channels[channel].tareOffset, channels[channel].countsPerGramQ16};
+}
+
+void weightSensorApplyCalibration(uint8_t channel,
+                                  const WeightCalibration& calibration) {
+  channels[channel].tareOffset = calibration.tareOffset;
+  channels[channel].countsPerGramQ16 = calibration.countsPerGramQ16;
+  resetTemperatureReference(channel);
+}
+
+void weightSensorAdjustTare(uint8_t channel, int32_t counts) {
+  channels[channel].tareOffset += counts;
+}
+
+void weightSensorSetTemperature(float celsius) {
+  temperature = celsius;
+  for (uint8_t i = 0; i < WEIGHT_MAX_CHANNELS; i++) {
+    if (isnan(channels[i].temperatureReference)) {
+      channels[i].temperatureReference = celsius;
+    }
+    updateTemperatureCorrection(i);
+  }
+}
+
+void weightSensorSetTemperatureCoefficient(float gramsPerDegree) {
+  // Every config message may carry it; only a change costs a flash write.
+  if (gramsPerDegree == temperatureCoefficient) {
+    return;
+  }
+  temperatureCoefficient = gramsPerDegree;
+  for (uint8_t i = 0; i < WEIGHT_MAX_CHANNELS; i++) {
+    updateTemperatureCorrection(i);
+  }
+  Preferences prefs;
+  if (prefs.begin(PREFS_NAMESPACE, false)) {
+    prefs.putFloat(PREFS_TEMP_COEFFICIENT_KEY, temperatureCoefficient);
+    prefs.end();
+  }
+}
+
+float weightSensorTemperatureCoefficient() {
+  return temperatureCoefficient;
+}
+
+bool fitWeightCalibration(const CalibrationPoint* points, size_t count,
+                          WeightCalibration& calibration,
+                          float& maxResidualGrams) {
+  if (count < 2) {
+    return false;
+  }
+
+  double meanGrams = 0;
+  double meanRaw = 0;
+  for (size_t i = 0; i < count; i++) {
+    meanGrams += points[i].grams;
+    meanRaw += points[i].raw;
+  }
+  meanGrams /= count;
+  meanRaw /= count;
+
+  double sumSquares = 0;
+  double sumProducts = 0;
+  for (size_t i = 0; i < count; i++) {
+    const double dx = points[i].grams - meanGrams;
+    sumSquares += dx * dx;
+    sumProducts += dx * (points[i].raw - meanRaw);
+  }
+  if (sumSquares <= 0) {
+    return false;
+  }
+
+  const double countsPerGram = sumProducts / sumSquares;
+  const double intercept = meanRaw - countsPerGram * meanGrams;
+  if (toQ16(countsPerGram) == 0 || fabs(intercept) > INT32_MAX) {
+    return false;
+  }
+
+  double worst = 0;
+  for (size_t i = 0; i < count; i++) {
+    const double fitted = (points[i].raw - intercept) / countsPerGram;
+    const double residual = fabs(fitted - points[i].grams);
+    if (residual > worst) {
+      worst = residual;
+    }
+  }
+
+  calibration.tareOffset = static_cast<int32_t>(llround(intercept));
+  calibration.countsPerGramQ16 = toQ16(countsPerGram);
+  maxResidualGrams = static_cast<float>(worst);
+  return true;
+}
+
+bool weightSensorLoadCalibration(uint8_t channel) {
+  char tareKey[16];
+  char scaleKey[16];
+  char referenceKey[16];
+  prefsKey(tareKey, sizeof(tareKey), PREFS_TARE_KEY, channel);
+  prefsKey(scaleKey, sizeof(scaleKey), PREFS_SCALE_KEY, channel);
+  prefsKey(referenceKey, sizeof(referenceKey), PREFS_TEMP_REFERENCE_KEY,
+           channel);
+
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, true)) {
+    return false;
+  }
+  const int32_t storedScale = prefs.getInt(scaleKey, 0);
+  const int32_t storedTare = prefs.getInt(tareKey, 0);
+  const float storedReference = prefs.getFloat(referenceKey, NAN);
+  temperatureCoefficient = prefs.getFloat(PREFS_TEMP_COEFFICIENT_KEY, 0.0f);
+  prefs.end();
+  if (storedScale == 0) {
+    return false;
+  }
+  weightSensorApplyCalibration(channel, {storedTare, storedScale});
+  channels[channel].temperatureReference = storedReference;
+  updateTemperatureCorrection(channel);
+  return true;
+}
+
+bool weightSensorSaveCalibration(uint8_t channel) {
+  char tareKey[16];
+  char scaleKey[16];
+  char referenceKey[16];
+  prefsKey(tareKey, sizeof(tareKey), PREFS_TARE_KEY, channel);
+  prefsKey(scaleKey, sizeof(scaleKey), PREFS_SCALE_KEY, channel);
+  prefsKey(referenceKey, sizeof(referenceKey), PREFS_TEMP_REFERENCE_KEY,
+           channel);
+
+  Preferences prefs;
+  if (!prefs.begin(PREFS_NAMESPACE, false)) {
+    return false;
+  }
+  const Channel& c = channels[channel];
+  const bool saved = prefs.putInt(tareKey, c.tareOffset) > 0 &&
+                     prefs.putInt(scaleKey, c.countsPerGramQ16) > 0;
+  prefs.putFloat(referenceKey, c.temperatureReference);
+  prefs.end();
+  return saved;
+}
+
+void weightSensorClearCalibration(uint8_t channel) {
+  char key[16];
+  Preferences prefs;
+  if (prefs.begin(PREFS_NAMESPACE, false)) {
+    prefsKey(key, sizeof(key), PREFS_TARE_KEY, channel);
+    prefs.remove(key);
+    prefsKey(key, sizeof(key), PREFS_SCALE_KEY, channel);
+    prefs.remove(key);
+    prefsKey(key, sizeof(key), PREFS_TEMP_REFERENCE_KEY, channel);
+    prefs.remove(key);
+    prefs.end();
+  }
+}
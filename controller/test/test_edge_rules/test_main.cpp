@@ -0,0 +1,270 @@
+#include <unity.h>
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <Preferences.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "edge_rules.h"
+#include "json_documents.h"
+
+const char* SENSOR = "esp32-82A3/1/status";
+const char* OTHER_SENSOR = "esp32-EECB/1/status";
+const size_t VALVES = 2;
+const unsigned long SOURCE_TIMEOUT_MS = 15UL * 60UL * 1000UL;
+
+struct Transition {
+  uint8_t action;
+  uint8_t valve;
+  bool holds;
+  char target[EDGE_TOPIC_LENGTH];
+  char payload[EDGE_PAYLOAD_LENGTH];
+};
+
+Transition transitions[64];
+size_t transitionCount;
+
+void record(const EdgeRule& rule, const char* targetTopic, bool holds) {
+  if (transitionCount == sizeof(transitions) / sizeof(transitions[0])) {
+    return;
+  }
+  Transition& t = transitions[transitionCount++];
+  t.action = rule.action;
+  t.valve = rule.valve;
+  t.holds = holds;
+  snprintf(t.target, sizeof(t.target), "%s", targetTopic ? targetTopic : "");
+  snprintf(t.payload, sizeof(t.payload), "%s",
+           holds ? rule.onTrue : rule.onFalse);
+}
+
+size_t compile(const char* json) {
+  JsonDocument doc;
+  TEST_ASSERT_FALSE(deserializeJson(doc, json));
+  return edgeRulesCompile(doc.as<JsonArrayConst>(), VALVES);
+}
+
+bool report(const char* topic, const char* message) {
+  JsonDocument doc;
+  TEST_ASSERT_FALSE(deserializeJson(doc, message));
+  return edgeRulesEvaluate(topic, doc.as<JsonVariantConst>(), record);
+}
+
+bool reportTemperature(float celsius) {
+  char message[48];
+  snprintf(message, sizeof(message), "{\"temperature\":%.2f}", celsius);
+  return report(SENSOR, message);
+}
+
+void setUp() {
+  preferencesReset();
+  edgeRulesBegin();
+  transitionCount = 0;
+}
+
+void tearDown() {}
+
+void test_invalid_rules_are_skipped() {
+  TEST_ASSERT_EQUAL(1, compile(
+      "[{\"source\":\"a\",\"field\":\"pressure\",\"above\":1,\"openValve\":1},"
+      "{\"source\":\"a\",\"field\":\"humidity\",\"openValve\":1},"
+      "{\"source\":\"a\",\"field\":\"humidity\",\"above\":90,\"openValve\":3},"
+      "{\"source\":\"a\",\"field\":\"humidity\",\"above\":90},"
+      "{\"field\":\"humidity\",\"above\":90,\"inhibitValve\":1},"
+      "{\"source\":\"a\",\"field\":\"humidity\",\"above\":90,\"inhibitValve\":2}]"));
+  TEST_ASSERT_EQUAL(1, edgeRulesSourceCount());
+  TEST_ASSERT_EQUAL_STRING("a", edgeRulesSource(0));
+}
+
+void test_rule_table_is_bounded() {
+  char json[1024] = "[";
+  for (int i = 0; i < EDGE_MAX_RULES + 3; i++) {
+    char entry[96];
+    snprintf(entry, sizeof(entry),
+             "%s{\"source\":\"s\",\"field\":\"humidity\",\"above\":%d,\"openValve\":1}",
+             i ? "," : "", 50 + i);
+    strcat(json, entry);
+  }
+  strcat(json, "]");
+  TEST_ASSERT_EQUAL(EDGE_MAX_RULES, compile(json));
+}
+
+void test_above_with_hysteresis() {
+  compile("[{\"source\":\"esp32-82A3/1/status\",\"field\":\"temperature\","
+          "\"above\":28,\"hysteresis\":1,\"openValve\":1}]");
+  reportTemperature(27.9f);
+  TEST_ASSERT_EQUAL(0, transitionCount);
+  reportTemperature(28.1f);
+  TEST_ASSERT_EQUAL(1, transitionCount);
+  TEST_ASSERT_TRUE(transitions[0].holds);
+  TEST_ASSERT_EQUAL(0, transitions[0].valve);
+  // Inside the band it keeps holding.
+  reportTemperature(27.5f);
+  reportTemperature(27.01f);
+  TEST_ASSERT_EQUAL(1, transitionCount);
+  reportTemperature(26.9f);
+  TEST_ASSERT_EQUAL(2, transitionCount);
+  TEST_ASSERT_FALSE(transitions[1].holds);
+  // And it has to cross the threshold itself to hold again.
+  reportTemperature(27.9f);
+  TEST_ASSERT_EQUAL(2, transitionCount);
+}
+
+void test_below_with_hysteresis() {
+  compile("[{\"source\":\"esp32-82A3/1/status\",\"field\":\"humidity\","
+          "\"below\":40,\"hysteresis\":5,\"openValve\":2}]");
+  report(SENSOR, "{\"humidity\":39}");
+  report(SENSOR, "{\"humidity\":44}");
+  TEST_ASSERT_EQUAL(1, transitionCount);
+  report(SENSOR, "{\"humidity\":45.5}");
+  TEST_ASSERT_EQUAL(2, transitionCount);
+  TEST_ASSERT_EQUAL(1, transitions[0].valve);
+}
+
+void test_out_of_range_numbers_do_not_wrap() {
+  // Thresholds past +-327.67 cannot be held in hundredths and are refused.
+  TEST_ASSERT_EQUAL(0, compile(
+      "[{\"source\":\"esp32-82A3/1/status\",\"field\":\"temperature\","
+      "\"below\":400,\"openValve\":1},"
+      "{\"source\":\"esp32-82A3/1/status\",\"field\":\"temperature\","
+      "\"above\":20,\"hysteresis\":1000,\"openValve\":1}]"));
+  // Readings past the range saturate instead of turning negative.
+  compile("[{\"source\":\"esp32-82A3/1/status\",\"field\":\"temperature\","
+          "\"above\":300,\"openValve\":1}]");
+  reportTemperature(400.0f);
+  TEST_ASSERT_EQUAL(1, transitionCount);
+  TEST_ASSERT_TRUE(transitions[0].holds);
+  reportTemperature(-400.0f);
+  TEST_ASSERT_EQUAL(2, transitionCount);
+  TEST_ASSERT_FALSE(transitions[1].holds);
+}
+
+void test_hysteresis_stops_chatter() {
+  compile("[{\"source\":\"esp32-82A3/1/status\",\"field\":\"temperature\","
+          "\"above\":25,\"hysteresis\":0.5,\"openValve\":1}]");
+  // A reading wobbling +-0.3 °C around the threshold.
+  const float wobble[] = {-0.3f, 0.3f, -0.1f, 0.2f, -0.3f, 0.1f};
+  for (int i = 0; i < 60; i++) {
+    reportTemperature(25.0f + wobble[i % 6]);
+  }
+  TEST_ASSERT_EQUAL(1, transitionCount);
+}
+
+void test_messages_without_the_field_or_from_elsewhere() {
+  compile("[{\"source\":\"esp32-82A3/1/status\",\"field\":\"temperature\","
+          "\"above\":28,\"openValve\":1}]");
+  TEST_ASSERT_TRUE(report(SENSOR, "{\"humidity\":99}"));
+  TEST_ASSERT_TRUE(report(SENSOR, "{\"temperature\":\"hot\"}"));
+  TEST_ASSERT_FALSE(report(OTHER_SENSOR, "{\"temperature\":40}"));
+  TEST_ASSERT_EQUAL(0, transitionCount);
+}
+
+void test_publish_action_carries_target_and_payloads() {
+  compile("[{\"source\":\"esp32-82A3/1/status\",\"field\":\"temperature\","
+          "\"above\":28,\"publish\":\"esp32-aircon-3C4D/1/control\","
+          "\"onTrue\":\"ON\",\"onFalse\":{\"power\":false}}]");
+  reportTemperature(29);
+  reportTemperature(27);
+  TEST_ASSERT_EQUAL(2, transitionCount);
+  TEST_ASSERT_EQUAL(EDGE_PUBLISH, transitions[0].action);
+  TEST_ASSERT_EQUAL_STRING("esp32-aircon-3C4D/1/control", transitions[0].target);
+  TEST_ASSERT_EQUAL_STRING("\"ON\"", transitions[0].payload);
+  TEST_ASSERT_EQUAL_STRING("{\"power\":false}", transitions[1].payload);
+}
+
+void test_inhibit_times_out_when_the_source_goes_silent() {
+  compile("[{\"source\":\"esp32-82A3/1/status\",\"field\":\"humidity\","
+          "\"above\":90,\"inhibitValve\":1}]");
+  TEST_ASSERT_FALSE(edgeRulesInhibit(0));
+  report(SENSOR, "{\"humidity\":95}");
+  TEST_ASSERT_TRUE(edgeRulesInhibit(0));
+  TEST_ASSERT_FALSE(edgeRulesInhibit(1));
+
+  hostAdvanceMillis(SOURCE_TIMEOUT_MS - 1000);
+  TEST_ASSERT_TRUE(edgeRulesInhibit(0));
+  hostAdvanceMillis(2000);
+  TEST_ASSERT_FALSE(edgeRulesInhibit(0));
+
+  // A fresh reading restores it.
+  report(SENSOR, "{\"humidity\":95}");
+  TEST_ASSERT_TRUE(edgeRulesInhibit(0));
+  report(SENSOR, "{\"humidity\":80}");
+  TEST_ASSERT_FALSE(edgeRulesInhibit(0));
+}
+
+void test_rules_persist_and_redelivery_keeps_state() {
+  const char* rules =
+      "[{\"source\":\"esp32-82A3/1/status\",\"field\":\"humidity\","
+      "\"above\":90,\"inhibitValve\":1}]";
+  compile(rules);
+  TEST_ASSERT_EQUAL(1, preferencesWriteCount());
+  report(SENSOR, "{\"humidity\":95}");
+
+  // The retained rule message comes back on reconnect.
+  compile(rules);
+  TEST_ASSERT_EQUAL(1, preferencesWriteCount());
+  TEST_ASSERT_TRUE(edgeRulesInhibit(0));
+
+  edgeRulesBegin();
+  TEST_ASSERT_EQUAL(1, edgeRulesCount());
+  TEST_ASSERT_EQUAL_STRING(SENSOR, edgeRulesSource(0));
+  // State does not survive a reboot; the next reading rebuilds it.
+  TEST_ASSERT_FALSE(edgeRulesInhibit(0));
+}
+
+// The longest rules message the README allows: every rule a publish rule
+// with the longest topics, payloads and numbers.
+void test_full_table_fits_the_receive_limit() {
+  char sources[EDGE_MAX_TOPICS][EDGE_TOPIC_LENGTH];
+  char targets[EDGE_MAX_TOPICS][EDGE_TOPIC_LENGTH];
+  char payload[EDGE_PAYLOAD_LENGTH - 3];
+  for (int i = 0; i < EDGE_MAX_TOPICS; i++) {
+    memset(sources[i], 's', EDGE_TOPIC_LENGTH - 1);
+    memset(targets[i], 't', EDGE_TOPIC_LENGTH - 1);
+    sources[i][0] = targets[i][0] = static_cast<char>('0' + i);
+    sources[i][EDGE_TOPIC_LENGTH - 1] = targets[i][EDGE_TOPIC_LENGTH - 1] = '\0';
+  }
+  memset(payload, 'p', sizeof(payload) - 1);
+  payload[sizeof(payload) - 1] = '\0';
+
+  JsonDocument full;
+  JsonArray list = full["message"]["rules"].to<JsonArray>();
+  for (int i = 0; i < EDGE_MAX_RULES; i++) {
+    JsonObject rule = list.add<JsonObject>();
+    rule["source"] = sources[i % EDGE_MAX_TOPICS];
+    rule["field"] = "temperature";
+    rule["below"] = -327.67;
+    rule["hysteresis"] = 327.67;
+    rule["publish"] = targets[i % EDGE_MAX_TOPICS];
+    rule["onTrue"] = payload;
+    rule["onFalse"] = payload;
+  }
+  full["timestamp"] = "2024-01-01T12:00:00.123Z";
+  static char message[EDGE_RULES_MAX_MESSAGE + 1];
+  const size_t length = serializeJson(full, message, sizeof(message));
+  TEST_ASSERT_LESS_OR_EQUAL(EDGE_RULES_MAX_MESSAGE - 1, length);
+
+  // Parsed the way the controller's callback does.
+  static InboundJsonDocument inbound;
+  JsonDocument& doc = inbound.acquire();
+  TEST_ASSERT_FALSE(deserializeJson(doc, message, length));
+  TEST_ASSERT_EQUAL(EDGE_MAX_RULES,
+                    edgeRulesCompile(doc["message"]["rules"], VALVES));
+  TEST_ASSERT_EQUAL(EDGE_MAX_TOPICS, edgeRulesSourceCount());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_invalid_rules_are_skipped);
+  RUN_TEST(test_rule_table_is_bounded);
+  RUN_TEST(test_above_with_hysteresis);
+  RUN_TEST(test_below_with_hysteresis);
+  RUN_TEST(test_out_of_range_numbers_do_not_wrap);
+  RUN_TEST(test_hysteresis_stops_chatter);
+  RUN_TEST(test_messages_without_the_field_or_from_elsewhere);
+  RUN_TEST(test_publish_action_carries_target_and_payloads);
+  RUN_TEST(test_inhibit_times_out_when_the_source_goes_silent);
+  RUN_TEST(test_rules_persist_and_redelivery_keeps_state);
+  RUN_TEST(test_full_table_fits_the_receive_limit);
+  return UNITY_END();
+}
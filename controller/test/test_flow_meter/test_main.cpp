@@ -0,0 +1,160 @@
+#include <unity.h>
+
+#include <Arduino.h>
+#include <driver/pcnt.h>
+#include <string.h>
+
+#include "flow_meter.h"
+#include "valve_config.h"
+#include "valve_flow.h"
+
+// Flow-mode cycles against the host PCNT unit: pulses go in through
+// hostPcntPulses(), the interrupt handler runs as each event is reached,
+// and the valve pin is the one it drives low.
+const uint8_t PULSE_PIN = 4;
+const uint8_t VALVE_PIN = 13;
+const uint32_t PCNT_LIMIT = 30000;
+const unsigned long STEP_MS = 100;
+
+ValveConfig valve;
+ControllerConfig controller;
+
+struct CycleResult {
+  const char* reason;
+  unsigned long closedAtMs;
+  uint32_t pulses;
+};
+
+// Opens the valve at t=0 the way activateSwitch() does and feeds
+// `pulsesPerStep` every STEP_MS until the valve closes or `limitMs` passes.
+CycleResult runCycle(uint32_t pulsesPerStep, unsigned long limitMs) {
+  flowMeterStart(0, valveFlowTargetPulses(valve), VALVE_PIN);
+  digitalWrite(VALVE_PIN, HIGH);
+  valve.startTime = 0;
+  valve.lastProgressPublishTime = 0;
+  valveFlowStart(valve, 0);
+  for (unsigned long now = STEP_MS; now <= limitMs; now += STEP_MS) {
+    hostPcntPulses(PCNT_UNIT_0, pulsesPerStep);
+    const bool targetReached = flowMeterTargetReached(0);
+    if (!targetReached &&
+        now - valve.lastProgressPublishTime >= valve.sensorReadIntervalMs) {
+      valveFlowSample(valve, flowMeterPulses(0), now);
+      valve.lastProgressPublishTime = now;
+    }
+    const char* reason = valveFlowCheck(valve, targetReached, now);
+    if (reason) {
+      flowMeterStop(0);
+      return {reason, now, flowMeterPulses(0)};
+    }
+  }
+  return {nullptr, limitMs, flowMeterPulses(0)};
+}
+
+void setUp() {
+  hostPcntReset();
+  memset(&valve, 0, sizeof(valve));
+  configApplyDefaults(valve, controller);
+  valve.controlMode = CONTROL_MODE_FLOW;
+  valve.pulsesPerLiter = 450.0f;
+  valve.toleranceDurationMs = 5000;
+  valve.sensorReadIntervalMs = 500;
+  valve.maxOpenDurationMs = 600000;
+  const uint8_t pins[] = {PULSE_PIN};
+  flowMeterBegin(pins, 1);
+}
+
+void tearDown() {}
+
+void test_counts_past_the_hardware_limit() {
+  flowMeterStart(0, 0, VALVE_PIN);
+  hostPcntPulses(PCNT_UNIT_0, PCNT_LIMIT - 1);
+  TEST_ASSERT_EQUAL_UINT32(PCNT_LIMIT - 1, flowMeterPulses(0));
+  hostPcntPulses(PCNT_UNIT_0, 1);
+  TEST_ASSERT_EQUAL_UINT32(PCNT_LIMIT, flowMeterPulses(0));
+  hostPcntPulses(PCNT_UNIT_0, 2 * PCNT_LIMIT + 123);
+  TEST_ASSERT_EQUAL_UINT32(3 * PCNT_LIMIT + 123, flowMeterPulses(0));
+  TEST_ASSERT_FALSE(flowMeterTargetReached(0));
+}
+
+void test_target_after_wraps_drives_the_pin_low() {
+  // 150 L at 450 pulses/L: two wraps and a remainder of 7500.
+  valve.targetVolume = 150.0f;
+  const uint32_t target = valveFlowTargetPulses(valve);
+  TEST_ASSERT_EQUAL_UINT32(67500, target);
+  flowMeterStart(0, target, VALVE_PIN);
+  digitalWrite(VALVE_PIN, HIGH);
+
+  // The remainder is passed on each earlier wrap without closing.
+  hostPcntPulses(PCNT_UNIT_0, 7500);
+  TEST_ASSERT_EQUAL(HIGH, digitalRead(VALVE_PIN));
+  hostPcntPulses(PCNT_UNIT_0, target - 7500 - 1);
+  TEST_ASSERT_EQUAL(HIGH, digitalRead(VALVE_PIN));
+  TEST_ASSERT_FALSE(flowMeterTargetReached(0));
+
+  hostPcntPulses(PCNT_UNIT_0, 1);
+  TEST_ASSERT_EQUAL(LOW, digitalRead(VALVE_PIN));
+  TEST_ASSERT_TRUE(flowMeterTargetReached(0));
+  TEST_ASSERT_FALSE(flowMeterTargetReached(0));
+  TEST_ASSERT_EQUAL_UINT32(target, flowMeterPulses(0));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 150.0f, valveFlowVolume(valve, target));
+}
+
+void test_target_on_a_whole_wrap_closes_at_the_limit() {
+  flowMeterStart(0, 2 * PCNT_LIMIT, VALVE_PIN);
+  digitalWrite(VALVE_PIN, HIGH);
+  hostPcntPulses(PCNT_UNIT_0, 2 * PCNT_LIMIT - 1);
+  TEST_ASSERT_EQUAL(HIGH, digitalRead(VALVE_PIN));
+  hostPcntPulses(PCNT_UNIT_0, 1);
+  TEST_ASSERT_EQUAL(LOW, digitalRead(VALVE_PIN));
+  TEST_ASSERT_TRUE(flowMeterTargetReached(0));
+}
+
+void test_restart_zeroes_the_count() {
+  flowMeterStart(0, 0, VALVE_PIN);
+  hostPcntPulses(PCNT_UNIT_0, PCNT_LIMIT + 10);
+  flowMeterStart(0, 0, VALVE_PIN);
+  TEST_ASSERT_EQUAL_UINT32(0, flowMeterPulses(0));
+  hostPcntPulses(PCNT_UNIT_0, 5);
+  TEST_ASSERT_EQUAL_UINT32(5, flowMeterPulses(0));
+}
+
+void test_cycle_closes_at_target_with_rate() {
+  // 750 Hz is 100 L/min at 450 pulses/L; 80 L takes 48 s and wraps once.
+  valve.targetVolume = 80.0f;
+  const CycleResult result = runCycle(75, 600000);
+  TEST_ASSERT_EQUAL_STRING("target_reached", result.reason);
+  TEST_ASSERT_EQUAL_UINT32(48000, result.closedAtMs);
+  TEST_ASSERT_EQUAL_UINT32(36000, result.pulses);
+  TEST_ASSERT_EQUAL(LOW, digitalRead(VALVE_PIN));
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 100.0f, valve.flowRateLpm);
+}
+
+void test_cycle_without_pulses_closes_on_no_flow() {
+  valve.targetVolume = 10.0f;
+  const CycleResult result = runCycle(0, 60000);
+  TEST_ASSERT_EQUAL_STRING("no_flow", result.reason);
+  TEST_ASSERT_UINT32_WITHIN(STEP_MS, valve.toleranceDurationMs,
+                            result.closedAtMs);
+}
+
+void test_noisy_sensor_is_capped_by_max_open_duration() {
+  // A trickle far short of the target keeps the no-flow timer from firing.
+  valve.targetVolume = 1000.0f;
+  valve.maxOpenDurationMs = 60000;
+  const CycleResult result = runCycle(1, 600000);
+  TEST_ASSERT_EQUAL_STRING("max_duration", result.reason);
+  TEST_ASSERT_EQUAL_UINT32(60000, result.closedAtMs);
+  TEST_ASSERT_LESS_THAN_UINT32(valveFlowTargetPulses(valve), result.pulses);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_counts_past_the_hardware_limit);
+  RUN_TEST(test_target_after_wraps_drives_the_pin_low);
+  RUN_TEST(test_target_on_a_whole_wrap_closes_at_the_limit);
+  RUN_TEST(test_restart_zeroes_the_count);
+  RUN_TEST(test_cycle_closes_at_target_with_rate);
+  RUN_TEST(test_cycle_without_pulses_closes_on_no_flow);
+  RUN_TEST(test_noisy_sensor_is_capped_by_max_open_duration);
+  return UNITY_END();
+}
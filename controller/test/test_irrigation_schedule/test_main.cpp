@@ -0,0 +1,175 @@
+#include <unity.h>
+
+#include <Preferences.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "irrigation_schedule.h"
+
+// Local time is UTC unless a test sets another zone.
+time_t utc(int year, int month, int day, int hour = 0, int minute = 0) {
+  struct tm t = {};
+  t.tm_year = year - 1900;
+  t.tm_mon = month - 1;
+  t.tm_mday = day;
+  t.tm_hour = hour;
+  t.tm_min = minute;
+  return timegm(&t);
+}
+
+void useTimeZone(const char* tz) {
+  setenv("TZ", tz, 1);
+  tzset();
+}
+
+const uint8_t MON_WED_FRI = (1 << 1) | (1 << 3) | (1 << 5);
+
+void setUp() {
+  useTimeZone("UTC0");
+  preferencesReset();
+  scheduleBegin(3);
+}
+
+void tearDown() {}
+
+void test_daily_fires_today_then_tomorrow() {
+  const ScheduleRule rule = {SCHEDULE_DAILY, SCHEDULE_EVERY_DAY, 6 * 60 + 30, 0};
+  TEST_ASSERT_EQUAL(utc(2026, 3, 10, 6, 30),
+                    nextScheduleFire(rule, utc(2026, 3, 10, 5, 0)));
+  // Strictly after: the fire time itself moves on to the next day.
+  TEST_ASSERT_EQUAL(utc(2026, 3, 11, 6, 30),
+                    nextScheduleFire(rule, utc(2026, 3, 10, 6, 30)));
+}
+
+void test_weekdays_are_skipped() {
+  // 2026-03-06 is a Friday; the next Mon/Wed/Fri after it is Monday.
+  const ScheduleRule rule = {SCHEDULE_DAILY, MON_WED_FRI, 18 * 60, 0};
+  TEST_ASSERT_EQUAL(utc(2026, 3, 9, 18, 0),
+                    nextScheduleFire(rule, utc(2026, 3, 6, 19, 0)));
+}
+
+void test_interval_within_the_day() {
+  const ScheduleRule rule = {SCHEDULE_INTERVAL, SCHEDULE_EVERY_DAY, 6 * 60, 120};
+  TEST_ASSERT_EQUAL(utc(2026, 3, 10, 6, 0),
+                    nextScheduleFire(rule, utc(2026, 3, 10, 5, 59)));
+  TEST_ASSERT_EQUAL(utc(2026, 3, 10, 8, 0),
+                    nextScheduleFire(rule, utc(2026, 3, 10, 7, 0)));
+}
+
+void test_interval_window_runs_past_midnight() {
+  // Every 5 h from 22:00: 22, 03, 08, 13, 18, then the next day's 22:00.
+  const ScheduleRule rule = {SCHEDULE_INTERVAL, SCHEDULE_EVERY_DAY, 22 * 60, 300};
+  TEST_ASSERT_EQUAL(utc(2026, 3, 11, 3, 0),
+                    nextScheduleFire(rule, utc(2026, 3, 11, 0, 0)));
+  TEST_ASSERT_EQUAL(utc(2026, 3, 11, 22, 0),
+                    nextScheduleFire(rule, utc(2026, 3, 11, 18, 0)));
+}
+
+void test_rules_that_never_fire() {
+  const ScheduleRule noDays = {SCHEDULE_DAILY, 0, 60, 0};
+  const ScheduleRule noInterval = {SCHEDULE_INTERVAL, SCHEDULE_EVERY_DAY, 60, 0};
+  TEST_ASSERT_EQUAL(0, nextScheduleFire(noDays, utc(2026, 3, 10)));
+  TEST_ASSERT_EQUAL(0, nextScheduleFire(noInterval, utc(2026, 3, 10)));
+}
+
+void test_daily_keeps_local_time_across_dst() {
+  useTimeZone("CET-1CEST,M3.5.0,M10.5.0/3");
+  // 07:00 local is 06:00 UTC before 2026-03-29 and 05:00 UTC after.
+  const ScheduleRule rule = {SCHEDULE_DAILY, SCHEDULE_EVERY_DAY, 7 * 60, 0};
+  const time_t saturday = nextScheduleFire(rule, utc(2026, 3, 28, 0, 0));
+  const time_t sunday = nextScheduleFire(rule, saturday);
+  TEST_ASSERT_EQUAL(utc(2026, 3, 28, 6, 0), saturday);
+  TEST_ASSERT_EQUAL(utc(2026, 3, 29, 5, 0), sunday);
+  TEST_ASSERT_EQUAL(23 * 3600, sunday - saturday);
+}
+
+// March 2026 minute by minute, as loop() would poll it.
+void test_month_of_ticks() {
+  const ScheduleRule daily[] = {{SCHEDULE_DAILY, SCHEDULE_EVERY_DAY, 6 * 60 + 30, 0}};
+  const ScheduleRule weekly[] = {{SCHEDULE_DAILY, MON_WED_FRI, 18 * 60, 0}};
+  const ScheduleRule interval[] = {{SCHEDULE_INTERVAL, SCHEDULE_EVERY_DAY, 8 * 60, 240}};
+  TEST_ASSERT_TRUE(scheduleSetRules(0, daily, 1));
+  TEST_ASSERT_TRUE(scheduleSetRules(1, weekly, 1));
+  TEST_ASSERT_TRUE(scheduleSetRules(2, interval, 1));
+
+  const time_t start = utc(2026, 3, 1);
+  const time_t end = utc(2026, 4, 1);
+  unsigned fires[3] = {0, 0, 0};
+  for (time_t now = start; now < end; now += 60) {
+    time_t expected[3];
+    for (size_t valve = 0; valve < 3; valve++) {
+      expected[valve] = scheduleNextFire(valve);
+    }
+    int valve;
+    while ((valve = scheduleDue(now)) >= 0) {
+      fires[valve]++;
+      // Each valve fires on the minute it was scheduled for.
+      TEST_ASSERT_EQUAL(now, expected[valve]);
+    }
+  }
+
+  TEST_ASSERT_EQUAL(31, fires[0]);
+  // 5 Mondays, 4 Wednesdays and 4 Fridays.
+  TEST_ASSERT_EQUAL(13, fires[1]);
+  // 04:00 on the 1st from February's last window, then 08, 12, 16, 20,
+  // 00 and 04 for each day, cut off at midnight after the 31st's 20:00.
+  TEST_ASSERT_EQUAL(1 + 30 * 6 + 4, fires[2]);
+}
+
+void test_clock_jump_fires_once() {
+  const ScheduleRule rule[] = {{SCHEDULE_INTERVAL, SCHEDULE_EVERY_DAY, 0, 60}};
+  TEST_ASSERT_TRUE(scheduleSetRules(0, rule, 1));
+  TEST_ASSERT_EQUAL(-1, scheduleDue(utc(2026, 3, 10, 0, 30)));
+  // Six hours missed: one catch-up firing, then the next slot.
+  TEST_ASSERT_EQUAL(0, scheduleDue(utc(2026, 3, 10, 6, 30)));
+  TEST_ASSERT_EQUAL(-1, scheduleDue(utc(2026, 3, 10, 6, 30)));
+  TEST_ASSERT_EQUAL(utc(2026, 3, 10, 7, 0), scheduleNextFire(0));
+}
+
+void test_unsynced_clock_never_fires() {
+  const ScheduleRule rule[] = {{SCHEDULE_INTERVAL, SCHEDULE_EVERY_DAY, 0, 1}};
+  TEST_ASSERT_TRUE(scheduleSetRules(0, rule, 1));
+  TEST_ASSERT_EQUAL(-1, scheduleDue(3600));
+}
+
+void test_rules_persist_and_redelivery_skips_the_write() {
+  const ScheduleRule rules[] = {
+    {SCHEDULE_DAILY, SCHEDULE_EVERY_DAY, 6 * 60, 0},
+    {SCHEDULE_DAILY, MON_WED_FRI, 20 * 60, 0},
+  };
+  TEST_ASSERT_TRUE(scheduleSetRules(1, rules, 2));
+  TEST_ASSERT_EQUAL(1, preferencesWriteCount());
+  TEST_ASSERT_TRUE(scheduleSetRules(1, rules, 2));
+  TEST_ASSERT_EQUAL(1, preferencesWriteCount());
+
+  scheduleBegin(3);
+  ScheduleRule loaded[SCHEDULE_MAX_RULES_PER_VALVE];
+  TEST_ASSERT_EQUAL(2, scheduleGetRules(1, loaded));
+  TEST_ASSERT_EQUAL_MEMORY(rules, loaded, sizeof(rules));
+
+  TEST_ASSERT_TRUE(scheduleSetRules(1, nullptr, 0));
+  scheduleBegin(3);
+  TEST_ASSERT_EQUAL(0, scheduleGetRules(1, loaded));
+}
+
+void test_rejects_bad_valve_and_too_many_rules() {
+  ScheduleRule rules[SCHEDULE_MAX_RULES_PER_VALVE + 1] = {};
+  TEST_ASSERT_FALSE(scheduleSetRules(3, rules, 1));
+  TEST_ASSERT_FALSE(scheduleSetRules(0, rules, SCHEDULE_MAX_RULES_PER_VALVE + 1));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_daily_fires_today_then_tomorrow);
+  RUN_TEST(test_weekdays_are_skipped);
+  RUN_TEST(test_interval_within_the_day);
+  RUN_TEST(test_interval_window_runs_past_midnight);
+  RUN_TEST(test_rules_that_never_fire);
+  RUN_TEST(test_daily_keeps_local_time_across_dst);
+  RUN_TEST(test_month_of_ticks);
+  RUN_TEST(test_clock_jump_fires_once);
+  RUN_TEST(test_unsynced_clock_never_fires);
+  RUN_TEST(test_rules_persist_and_redelivery_skips_the_write);
+  RUN_TEST(test_rejects_bad_valve_and_too_many_rules);
+  return UNITY_END();
+}
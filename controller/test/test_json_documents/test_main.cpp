@@ -0,0 +1,234 @@
+#include <unity.h>
+
+#include <string.h>
+
+#include "edge_rules.h"
+#include "json_documents.h"
+#include "valve_config.h"
+
+// Soak of the controller's two static JSON documents: many cycles of the
+// messages it receives and builds must not grow either arena, and a
+// message that does not fit must be reported without corrupting the next.
+const int CYCLES = 2000;
+const char* TIMESTAMP = "2024-01-01T12:00:00.123Z";
+
+InboundJsonDocument inbound;
+OutboundJsonDocument outbound;
+ValveConfig valve;
+ControllerConfig controller;
+
+// Serialized inbound messages, one of each kind the callback parses.
+static char inboundMessages[6][EDGE_RULES_MAX_MESSAGE];
+size_t inboundLengths[6];
+size_t inboundCount = 0;
+
+void addInbound(JsonDocument& doc) {
+  doc["timestamp"] = TIMESTAMP;
+  inboundLengths[inboundCount] = serializeJson(
+      doc, inboundMessages[inboundCount], sizeof(inboundMessages[0]));
+  TEST_ASSERT_LESS_THAN(sizeof(inboundMessages[0]) - 1,
+                        inboundLengths[inboundCount]);
+  inboundCount++;
+}
+
+// A full rules table with the longest topics and payloads it stores.
+void buildFullRulesMessage(JsonDocument& doc) {
+  char topic[EDGE_TOPIC_LENGTH];
+  char payload[EDGE_PAYLOAD_LENGTH - 3];
+  memset(topic, 't', sizeof(topic) - 1);
+  topic[sizeof(topic) - 1] = '\0';
+  memset(payload, 'p', sizeof(payload) - 1);
+  payload[sizeof(payload) - 1] = '\0';
+  JsonArray rules = doc["message"]["rules"].to<JsonArray>();
+  for (int i = 0; i < EDGE_MAX_RULES; i++) {
+    topic[0] = static_cast<char>('0' + i % EDGE_MAX_TOPICS);
+    JsonObject rule = rules.add<JsonObject>();
+    rule["source"] = topic;
+    rule["field"] = "temperature";
+    rule["below"] = -327.67;
+    rule["hysteresis"] = 327.67;
+    rule["publish"] = topic;
+    rule["onTrue"] = payload;
+    rule["onFalse"] = payload;
+  }
+}
+
+void buildInboundMessages() {
+  inboundCount = 0;
+  JsonDocument doc;
+  doc["message"] = "HIGH";
+  doc["commandId"] = "0b1c2d3e-4f50-6172-8394-a5b6c7d8e9f0";
+  addInbound(doc);
+
+  doc.clear();
+  configPublish(doc["message"].to<JsonObject>(), valve, controller);
+  doc["message"]["logLevel"] = 3;
+  addInbound(doc);
+
+  doc.clear();
+  JsonArray schedule = doc["message"]["rules"].to<JsonArray>();
+  for (int i = 0; i < 4; i++) {
+    JsonObject rule = schedule.add<JsonObject>();
+    rule["type"] = "interval";
+    rule["time"] = "06:30";
+    rule["everyMinutes"] = 240;
+    JsonArray days = rule["days"].to<JsonArray>();
+    days.add("mon");
+    days.add("wed");
+    days.add("fri");
+  }
+  addInbound(doc);
+
+  doc.clear();
+  doc["message"]["command"] = "point";
+  doc["message"]["grams"] = 500;
+  addInbound(doc);
+
+  doc.clear();
+  doc["type"] = "status";
+  doc["message"]["temperature"] = 23.4;
+  doc["message"]["humidity"] = 55.1;
+  addInbound(doc);
+
+  doc.clear();
+  buildFullRulesMessage(doc);
+  addInbound(doc);
+}
+
+// The outbound messages the loop builds most often.
+void buildStatus(JsonDocument& doc) {
+  doc["type"] = "status";
+  JsonObject message = doc["message"].to<JsonObject>();
+  message["state"] = "HIGH";
+  message["weight"] = 1234.567f;
+  message["weightChange"] = -98.765f;
+  message["controlMode"] = "weight";
+  message["progressValue"] = 98.765f;
+  message["targetValue"] = 100.0f;
+  message["progressUnit"] = "g";
+  message["reason"] = "tolerance_timeout";
+  message["commandId"] = "0b1c2d3e-4f50-6172-8394-a5b6c7d8e9f0";
+}
+
+void buildConfig(JsonDocument& doc) {
+  doc["type"] = "config";
+  configPublish(doc["message"].to<JsonObject>(), valve, controller);
+}
+
+void buildDiagnostics(JsonDocument& doc) {
+  static const char* const COUNTERS[] = {
+    "weightReadUs", "mqttConnectMs", "mqttConnectCount", "loopAvgUs",
+    "loopMaxUs", "logDropped", "freeHeap", "minFreeHeap", "maxAllocHeap",
+    "jsonInboundPeak", "jsonOutboundPeak", "publishPeak", "publishOversize",
+    "edgeRules", "edgeRuleMaxEvalUs", "traceBytes", "traceDropped",
+    "configApplyUs", "resetReason", "bootWiFiMs", "bootReadyMs",
+    "bootFirstCommandMs",
+  };
+  doc["type"] = "diagnostics";
+  JsonObject message = doc["message"].to<JsonObject>();
+  for (const char* counter : COUNTERS) {
+    message[counter] = 4294967295UL;
+  }
+  message["mqttLan"] = false;
+}
+
+void (*const OUTBOUND_BUILDERS[])(JsonDocument&) = {
+  buildStatus, buildConfig, buildDiagnostics,
+};
+
+void setUp() {
+  memset(&valve, 0, sizeof(valve));
+  configApplyDefaults(valve, controller);
+}
+
+void tearDown() {}
+
+void test_inbound_cycles_do_not_grow_the_arena() {
+  buildInboundMessages();
+  size_t warmPeak = 0;
+  for (int cycle = 0; cycle < CYCLES; cycle++) {
+    for (size_t i = 0; i < inboundCount; i++) {
+      JsonDocument& doc = inbound.acquire();
+      TEST_ASSERT_FALSE(
+          deserializeJson(doc, inboundMessages[i], inboundLengths[i]));
+    }
+    if (cycle == 0) {
+      warmPeak = inbound.arena().peak();
+    }
+  }
+  TEST_ASSERT_EQUAL(warmPeak, inbound.arena().peak());
+  TEST_ASSERT_LESS_OR_EQUAL(inbound.arena().capacity(),
+                            inbound.arena().peak());
+}
+
+void test_oversized_inbound_is_reported_and_the_next_parses() {
+  buildInboundMessages();
+  // One string longer than the whole arena.
+  static char oversized[sizeof(InboundJsonDocument) + 64];
+  const size_t fill = inbound.arena().capacity() + 16;
+  memcpy(oversized, "{\"message\":\"", 12);
+  memset(oversized + 12, 'x', fill);
+  memcpy(oversized + 12 + fill, "\"}", 3);
+
+  for (int cycle = 0; cycle < CYCLES / 10; cycle++) {
+    JsonDocument& doc = inbound.acquire();
+    TEST_ASSERT_EQUAL(DeserializationError::NoMemory,
+                      deserializeJson(doc, oversized, strlen(oversized)).code());
+    TEST_ASSERT_LESS_OR_EQUAL(inbound.arena().capacity(),
+                              inbound.arena().peak());
+
+    const size_t last = inboundCount - 1;
+    JsonDocument& next = inbound.acquire();
+    TEST_ASSERT_FALSE(deserializeJson(next, inboundMessages[last],
+                                      inboundLengths[last]));
+    TEST_ASSERT_EQUAL(EDGE_MAX_RULES, next["message"]["rules"].size());
+  }
+}
+
+void test_outbound_cycles_do_not_grow_the_arena() {
+  size_t warmPeak = 0;
+  for (int cycle = 0; cycle < CYCLES; cycle++) {
+    for (auto build : OUTBOUND_BUILDERS) {
+      JsonDocument& doc = outbound.acquire();
+      build(doc);
+      doc["timestamp"] = TIMESTAMP;
+      TEST_ASSERT_FALSE(doc.overflowed());
+    }
+    if (cycle == 0) {
+      warmPeak = outbound.arena().peak();
+    }
+  }
+  TEST_ASSERT_EQUAL(warmPeak, outbound.arena().peak());
+  TEST_ASSERT_LESS_OR_EQUAL(outbound.arena().capacity(),
+                            outbound.arena().peak());
+}
+
+void test_outbound_overflow_is_reported() {
+  // What publishJson() refuses and counts as oversize: more distinct
+  // strings than the arena holds.
+  JsonDocument& doc = outbound.acquire();
+  JsonArray values = doc["message"].to<JsonArray>();
+  char value[48];
+  const size_t count = outbound.arena().capacity() / 32;
+  for (size_t i = 0; i < count; i++) {
+    snprintf(value, sizeof(value), "%040zu", i);
+    values.add(value);
+  }
+  TEST_ASSERT_TRUE(doc.overflowed());
+  TEST_ASSERT_LESS_OR_EQUAL(outbound.arena().capacity(),
+                            outbound.arena().peak());
+
+  JsonDocument& next = outbound.acquire();
+  buildStatus(next);
+  TEST_ASSERT_FALSE(next.overflowed());
+  TEST_ASSERT_EQUAL_STRING("HIGH", next["message"]["state"]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_inbound_cycles_do_not_grow_the_arena);
+  RUN_TEST(test_oversized_inbound_is_reported_and_the_next_parses);
+  RUN_TEST(test_outbound_cycles_do_not_grow_the_arena);
+  RUN_TEST(test_outbound_overflow_is_reported);
+  return UNITY_END();
+}
@@ -0,0 +1,220 @@
+#include <unity.h>
+
+#include <ArduinoJson.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "valve_config.h"
+
+ValveConfig valve;
+ControllerConfig controller;
+
+uint8_t apply(const char* json) {
+  JsonDocument doc;
+  TEST_ASSERT_FALSE(deserializeJson(doc, json));
+  return configApply(doc.as<JsonObjectConst>(), 1, valve, controller);
+}
+
+uint8_t applyNumber(const char* name, double value) {
+  char json[96];
+  snprintf(json, sizeof(json), "{\"%s\":%.9g}", name, value);
+  return apply(json);
+}
+
+// Reads a field back through the same table the firmware uses.
+double fieldValue(const ConfigField& field, const ValveConfig& v,
+                  const ControllerConfig& c) {
+  const uint8_t* base = field.scope == CONFIG_SCOPE_VALVE
+                            ? reinterpret_cast<const uint8_t*>(&v)
+                            : reinterpret_cast<const uint8_t*>(&c);
+  const uint8_t* source = base + field.offset;
+  switch (field.type) {
+    case CONFIG_ULONG:
+      return *reinterpret_cast<const unsigned long*>(source);
+    case CONFIG_FLOAT:
+      return *reinterpret_cast<const float*>(source);
+    case CONFIG_CONTROL_MODE:
+      return *reinterpret_cast<const ControlMode*>(source);
+  }
+  return 0;
+}
+
+double fieldValue(const ConfigField& field) {
+  return fieldValue(field, valve, controller);
+}
+
+bool isNumeric(const ConfigField& field) {
+  return field.type != CONFIG_CONTROL_MODE;
+}
+
+void setUp() {
+  memset(&valve, 0, sizeof(valve));
+  memset(&controller, 0, sizeof(controller));
+  configApplyDefaults(valve, controller);
+}
+
+void tearDown() {}
+
+void test_table_is_consistent() {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    TEST_ASSERT_TRUE_MESSAGE(field.min <= field.defaultValue, field.name);
+    TEST_ASSERT_TRUE_MESSAGE(field.defaultValue <= field.max, field.name);
+    for (const ConfigField& other : CONFIG_FIELDS) {
+      if (&other != &field) {
+        TEST_ASSERT_TRUE_MESSAGE(strcmp(field.name, other.name) != 0, field.name);
+      }
+    }
+  }
+}
+
+void test_defaults_come_from_the_table() {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, field.defaultValue, fieldValue(field));
+  }
+}
+
+void test_in_range_values_are_stored() {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    if (!isNumeric(field)) {
+      continue;
+    }
+    const double value = field.min + (field.max - field.min) / 3;
+    TEST_ASSERT_EQUAL_MESSAGE(field.flags, applyNumber(field.name, value),
+                              field.name);
+    const double tolerance =
+        field.type == CONFIG_ULONG ? 0.5 : fabs(value) * 1e-5;
+    TEST_ASSERT_FLOAT_WITHIN(tolerance, value, fieldValue(field));
+  }
+}
+
+void test_limits_are_inclusive() {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    if (!isNumeric(field)) {
+      continue;
+    }
+    applyNumber(field.name, field.min);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, field.min, fieldValue(field));
+    applyNumber(field.name, field.max);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, field.max, fieldValue(field));
+  }
+}
+
+void test_out_of_range_is_clamped_or_rejected_per_flag() {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    if (!isNumeric(field)) {
+      continue;
+    }
+    // Also outside ranges that straddle zero.
+    const double below = field.min - 1 - fabs(field.min) / 2;
+    const double above = field.max + 1 + fabs(field.max) / 2;
+    const bool rejects = field.flags & CONFIG_REJECT_OUT_OF_RANGE;
+
+    setUp();
+    applyNumber(field.name, below);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, rejects ? field.defaultValue : field.min,
+                             fieldValue(field));
+    setUp();
+    applyNumber(field.name, above);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, rejects ? field.defaultValue : field.max,
+                             fieldValue(field));
+  }
+}
+
+void test_non_numbers_are_ignored() {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    if (!isNumeric(field)) {
+      continue;
+    }
+    char json[96];
+    snprintf(json, sizeof(json), "{\"%s\":\"12\"}", field.name);
+    TEST_ASSERT_EQUAL_MESSAGE(0, apply(json), field.name);
+    snprintf(json, sizeof(json), "{\"%s\":null}", field.name);
+    TEST_ASSERT_EQUAL_MESSAGE(0, apply(json), field.name);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, field.defaultValue, fieldValue(field));
+  }
+}
+
+void test_aliases_are_accepted() {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    if (!field.alias) {
+      continue;
+    }
+    applyNumber(field.alias, field.max);
+    TEST_ASSERT_FLOAT_WITHIN(1e-3, field.max, fieldValue(field));
+  }
+}
+
+void test_control_mode() {
+  apply("{\"controlMode\":\"flow\"}");
+  TEST_ASSERT_EQUAL(CONTROL_MODE_FLOW, valve.controlMode);
+  apply("{\"controlMode\":\"time\"}");
+  TEST_ASSERT_EQUAL(CONTROL_MODE_TIME, valve.controlMode);
+  apply("{\"controlMode\":\"weight\"}");
+  TEST_ASSERT_EQUAL(CONTROL_MODE_WEIGHT, valve.controlMode);
+}
+
+void test_control_mode_is_fixed_while_open() {
+  apply("{\"controlMode\":\"flow\"}");
+  valve.active = true;
+  const uint8_t flags =
+      apply("{\"controlMode\":\"weight\",\"highDuration\":4000}");
+  TEST_ASSERT_EQUAL(CONTROL_MODE_FLOW, valve.controlMode);
+  TEST_ASSERT_FALSE(flags & CONFIG_FIXED_WHILE_ACTIVE);
+  // The rest of the message still applies.
+  TEST_ASSERT_EQUAL(4000, valve.highDurationMs);
+  valve.active = false;
+  apply("{\"controlMode\":\"weight\"}");
+  TEST_ASSERT_EQUAL(CONTROL_MODE_WEIGHT, valve.controlMode);
+}
+
+void test_one_pass_applies_everything_and_reports_flags() {
+  const uint8_t flags = apply(
+      "{\"highDuration\":4000,\"heartbeatInterval\":2,\"unknown\":1,"
+      "\"toleranceWeight\":25}");
+  TEST_ASSERT_EQUAL(4000, valve.highDurationMs);
+  TEST_ASSERT_EQUAL_FLOAT(2.0f, controller.healthIntervalMin);
+  TEST_ASSERT_EQUAL_FLOAT(25.0f, valve.toleranceWeight);
+  TEST_ASSERT_TRUE(flags & CONFIG_WEIGHT_THRESHOLD);
+  // Fields that do not affect the count thresholds do not ask for a refresh.
+  TEST_ASSERT_EQUAL(0, apply("{\"highDuration\":5000,\"unknown\":1}"));
+}
+
+void test_publish_round_trips() {
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    if (isNumeric(field)) {
+      applyNumber(field.name, field.max);
+    }
+  }
+  apply("{\"controlMode\":\"flow\"}");
+  const ValveConfig published = valve;
+  const ControllerConfig publishedController = controller;
+
+  JsonDocument doc;
+  configPublish(doc.to<JsonObject>(), valve, controller);
+  TEST_ASSERT_EQUAL(CONFIG_FIELD_COUNT, doc.size());
+
+  setUp();
+  configApply(doc.as<JsonObjectConst>(), 1, valve, controller);
+  for (const ConfigField& field : CONFIG_FIELDS) {
+    TEST_ASSERT_FLOAT_WITHIN(
+        1e-3, fieldValue(field, published, publishedController),
+        fieldValue(field));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_table_is_consistent);
+  RUN_TEST(test_defaults_come_from_the_table);
+  RUN_TEST(test_in_range_values_are_stored);
+  RUN_TEST(test_limits_are_inclusive);
+  RUN_TEST(test_out_of_range_is_clamped_or_rejected_per_flag);
+  RUN_TEST(test_non_numbers_are_ignored);
+  RUN_TEST(test_aliases_are_accepted);
+  RUN_TEST(test_control_mode);
+  RUN_TEST(test_control_mode_is_fixed_while_open);
+  RUN_TEST(test_one_pass_applies_everything_and_reports_flags);
+  RUN_TEST(test_publish_round_trips);
+  return UNITY_END();
+}
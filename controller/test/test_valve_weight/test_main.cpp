@@ -0,0 +1,150 @@
+#include <unity.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "valve_config.h"
+#include "valve_weight.h"
+#include "weight_sensor.h"
+
+// A weight-mode cycle against a simulated reservoir on scale 0, with the
+// load cell wired either way round.
+const float COUNTS_PER_GRAM = 420.5f;
+const float RESERVOIR_GRAMS = 1500.0f;
+const unsigned long STEP_MS = 100;
+
+ValveConfig valve;
+ControllerConfig controller;
+
+struct CycleResult {
+  const char* reason;
+  unsigned long closedAtMs;
+  float dispensedGrams;
+};
+
+// Tared counts of the reservoir holding `grams`.
+int32_t countsFor(float grams) {
+  return gramsToWeightCounts(0, grams);
+}
+
+// Opens the valve at t=0 and drains `gramsPerSecond` until the valve
+// closes or `limitMs` passes.
+CycleResult runCycle(float gramsPerSecond, unsigned long limitMs) {
+  float grams = RESERVOIR_GRAMS;
+  valve.startTime = 0;
+  valveWeightStart(valve, countsFor(grams), 0);
+  for (unsigned long now = STEP_MS; now <= limitMs; now += STEP_MS) {
+    grams -= gramsPerSecond * STEP_MS / 1000.0f;
+    const bool sampled =
+        now - valve.lastWeightReadTime >= valve.sensorReadIntervalMs;
+    if (sampled) {
+      valve.lastCounts = countsFor(grams);
+      valve.lastWeightReadTime = now;
+    }
+    const int32_t change = valveWeightChange(valve, 0, now);
+    const char* reason = valveWeightCheck(valve, change, sampled, now);
+    if (reason) {
+      return {reason, now, RESERVOIR_GRAMS - grams};
+    }
+  }
+  return {nullptr, limitMs, RESERVOIR_GRAMS - grams};
+}
+
+void useScale(float countsPerGram) {
+  weightSensorSetScale(0, countsPerGram);
+  refreshWeightThresholds(valve);
+}
+
+void setUp() {
+  memset(&valve, 0, sizeof(valve));
+  configApplyDefaults(valve, controller);
+  valve.controlMode = CONTROL_MODE_WEIGHT;
+  valve.targetWeightChange = 100.0f;
+  valve.toleranceWeight = 10.0f;
+  valve.toleranceDurationMs = 5000;
+  valve.sensorReadIntervalMs = 500;
+  useScale(COUNTS_PER_GRAM);
+}
+
+void tearDown() {}
+
+void test_closes_at_target() {
+  const CycleResult result = runCycle(20.0f, 60000);
+  TEST_ASSERT_EQUAL_STRING("target_reached", result.reason);
+  TEST_ASSERT_FLOAT_WITHIN(10.0f, 100.0f, result.dispensedGrams);
+  TEST_ASSERT_UINT32_WITHIN(500, 5000, result.closedAtMs);
+}
+
+void test_reversed_cell_closes_at_target() {
+  useScale(-COUNTS_PER_GRAM);
+  TEST_ASSERT_LESS_THAN(0, valve.targetCounts);
+  const CycleResult result = runCycle(20.0f, 60000);
+  TEST_ASSERT_EQUAL_STRING("target_reached", result.reason);
+  TEST_ASSERT_FLOAT_WITHIN(10.0f, 100.0f, result.dispensedGrams);
+  TEST_ASSERT_UINT32_WITHIN(500, 5000, result.closedAtMs);
+}
+
+void test_reversed_cell_is_not_within_tolerance_at_open() {
+  useScale(-COUNTS_PER_GRAM);
+  valve.startTime = 0;
+  valveWeightStart(valve, countsFor(RESERVOIR_GRAMS), 0);
+  TEST_ASSERT_FALSE(valve.toleranceSatisfied);
+  TEST_ASSERT_NULL(valveWeightCheck(valve, 0, true, STEP_MS));
+  TEST_ASSERT_FALSE(valve.toleranceSatisfied);
+}
+
+void test_no_flow_times_out_either_way_round() {
+  const float scales[] = {COUNTS_PER_GRAM, -COUNTS_PER_GRAM};
+  for (float scale : scales) {
+    useScale(scale);
+    const CycleResult result = runCycle(0.0f, 60000);
+    TEST_ASSERT_EQUAL_STRING("tolerance_timeout", result.reason);
+    TEST_ASSERT_EQUAL_UINT32(valve.toleranceDurationMs, result.closedAtMs);
+  }
+}
+
+void test_slow_flow_meets_tolerance_and_runs_on() {
+  useScale(-COUNTS_PER_GRAM);
+  // 2.5 g/s passes the 10 g tolerance inside 5 s and reaches 100 g at 40 s.
+  const CycleResult result = runCycle(2.5f, 60000);
+  TEST_ASSERT_EQUAL_STRING("target_reached", result.reason);
+  TEST_ASSERT_UINT32_WITHIN(500, 40000, result.closedAtMs);
+}
+
+void test_slow_flow_is_capped_by_max_open_duration() {
+  valve.maxOpenDurationMs = 20000;
+  const CycleResult result = runCycle(2.5f, 60000);
+  TEST_ASSERT_EQUAL_STRING("max_duration", result.reason);
+  TEST_ASSERT_EQUAL_UINT32(20000, result.closedAtMs);
+}
+
+void test_zero_tolerance_is_satisfied_at_open() {
+  valve.toleranceWeight = 0.0f;
+  useScale(-COUNTS_PER_GRAM);
+  valve.startTime = 0;
+  valveWeightStart(valve, countsFor(RESERVOIR_GRAMS), 0);
+  TEST_ASSERT_TRUE(valve.toleranceSatisfied);
+}
+
+void test_other_modes_report_no_change() {
+  valve.startTime = 0;
+  valveWeightStart(valve, countsFor(RESERVOIR_GRAMS), 0);
+  valve.lastCounts = countsFor(RESERVOIR_GRAMS - 50.0f);
+  valve.controlMode = CONTROL_MODE_TIME;
+  TEST_ASSERT_EQUAL_INT32(0, valveWeightChange(valve, 1 << 16, 60000));
+  valve.controlMode = CONTROL_MODE_WEIGHT;
+  TEST_ASSERT_EQUAL_INT32(countsFor(50.0f), valveWeightChange(valve, 0, 60000));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_closes_at_target);
+  RUN_TEST(test_reversed_cell_closes_at_target);
+  RUN_TEST(test_reversed_cell_is_not_within_tolerance_at_open);
+  RUN_TEST(test_no_flow_times_out_either_way_round);
+  RUN_TEST(test_slow_flow_meets_tolerance_and_runs_on);
+  RUN_TEST(test_slow_flow_is_capped_by_max_open_duration);
+  RUN_TEST(test_zero_tolerance_is_satisfied_at_open);
+  RUN_TEST(test_other_modes_report_no_change);
+  return UNITY_END();
+}
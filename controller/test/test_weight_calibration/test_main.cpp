@@ -0,0 +1,119 @@
+#include <unity.h>
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "weight_sensor.h"
+
+const int32_t TARE = 84123;
+const double COUNTS_PER_GRAM = 412.75;
+
+int32_t rawFor(double grams, double noiseCounts = 0) {
+  return static_cast<int32_t>(lround(TARE + COUNTS_PER_GRAM * grams + noiseCounts));
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_exact_points_recover_the_line() {
+  const CalibrationPoint points[] = {
+    {rawFor(0), 0}, {rawFor(100), 100}, {rawFor(500), 500}, {rawFor(1000), 1000},
+  };
+  WeightCalibration calibration;
+  float residual = -1;
+  TEST_ASSERT_TRUE(fitWeightCalibration(points, 4, calibration, residual));
+  TEST_ASSERT_INT32_WITHIN(1, TARE, calibration.tareOffset);
+  TEST_ASSERT_INT32_WITHIN(1, lround(COUNTS_PER_GRAM * 65536),
+                           calibration.countsPerGramQ16);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, residual);
+}
+
+void test_two_points_are_enough() {
+  // No empty-scale reading: the zero comes from the line.
+  const CalibrationPoint points[] = {{rawFor(200), 200}, {rawFor(700), 700}};
+  WeightCalibration calibration;
+  float residual;
+  TEST_ASSERT_TRUE(fitWeightCalibration(points, 2, calibration, residual));
+  TEST_ASSERT_INT32_WITHIN(1, TARE, calibration.tareOffset);
+}
+
+void test_noise_averages_out() {
+  srand(35);
+  CalibrationPoint points[40];
+  for (size_t i = 0; i < 40; i++) {
+    const float grams = (i % 8) * 250.0f;
+    points[i] = {rawFor(grams, (rand() % 401 - 200)), grams};
+  }
+  WeightCalibration calibration;
+  float residual;
+  TEST_ASSERT_TRUE(fitWeightCalibration(points, 40, calibration, residual));
+  // +-200 counts of noise is under half a gram per point.
+  TEST_ASSERT_FLOAT_WITHIN(0.002f * COUNTS_PER_GRAM,
+                           COUNTS_PER_GRAM,
+                           calibration.countsPerGramQ16 / 65536.0);
+  TEST_ASSERT_INT32_WITHIN(200, TARE, calibration.tareOffset);
+  TEST_ASSERT_LESS_OR_EQUAL(0.6f, residual);
+}
+
+void test_residual_flags_a_bad_point() {
+  // The 500 g weight was read with a finger on the pan: 20 g heavy.
+  const CalibrationPoint points[] = {
+    {rawFor(0), 0}, {rawFor(250), 250}, {rawFor(520), 500}, {rawFor(1000), 1000},
+  };
+  WeightCalibration calibration;
+  float residual;
+  TEST_ASSERT_TRUE(fitWeightCalibration(points, 4, calibration, residual));
+  TEST_ASSERT_GREATER_THAN(10.0f, residual);
+}
+
+// A cell wired A+/A- the other way round fits with a negative slope; the
+// valve still runs on it, see test_valve_weight.
+void test_reversed_load_cell() {
+  const CalibrationPoint points[] = {{1000, 0}, {1000 - 41275, 100}};
+  WeightCalibration calibration;
+  float residual;
+  TEST_ASSERT_TRUE(fitWeightCalibration(points, 2, calibration, residual));
+  TEST_ASSERT_LESS_THAN(0, calibration.countsPerGramQ16);
+  TEST_ASSERT_INT32_WITHIN(1, 1000, calibration.tareOffset);
+}
+
+void test_rejects_degenerate_input() {
+  WeightCalibration calibration = {7, 7};
+  float residual = 0;
+  const CalibrationPoint one[] = {{rawFor(100), 100}};
+  TEST_ASSERT_FALSE(fitWeightCalibration(one, 1, calibration, residual));
+  // The same weight twice says nothing about the slope.
+  const CalibrationPoint same[] = {{rawFor(100), 100}, {rawFor(100, 50), 100}};
+  TEST_ASSERT_FALSE(fitWeightCalibration(same, 2, calibration, residual));
+  // Readings that do not move with weight.
+  const CalibrationPoint flat[] = {{5000, 0}, {5000, 1000}};
+  TEST_ASSERT_FALSE(fitWeightCalibration(flat, 2, calibration, residual));
+  // A zero point that cannot be held in int32.
+  const CalibrationPoint far[] = {{2000000000, -200000}, {2000001000, -199999}};
+  TEST_ASSERT_FALSE(fitWeightCalibration(far, 2, calibration, residual));
+  // Nothing was written on failure.
+  TEST_ASSERT_EQUAL_INT32(7, calibration.tareOffset);
+  TEST_ASSERT_EQUAL_INT32(7, calibration.countsPerGramQ16);
+}
+
+void test_fit_applies_to_readings() {
+  const CalibrationPoint points[] = {{rawFor(0), 0}, {rawFor(2000), 2000}};
+  WeightCalibration calibration;
+  float residual;
+  TEST_ASSERT_TRUE(fitWeightCalibration(points, 2, calibration, residual));
+  weightSensorApplyCalibration(0, calibration);
+  const int32_t counts = rawFor(1234.5) - calibration.tareOffset;
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 1234.5f, weightCountsToGrams(0, counts));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_exact_points_recover_the_line);
+  RUN_TEST(test_two_points_are_enough);
+  RUN_TEST(test_noise_averages_out);
+  RUN_TEST(test_residual_flags_a_bad_point);
+  RUN_TEST(test_reversed_load_cell);
+  RUN_TEST(test_rejects_degenerate_input);
+  RUN_TEST(test_fit_applies_to_readings);
+  return UNITY_END();
+}
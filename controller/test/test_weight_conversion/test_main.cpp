@@ -0,0 +1,98 @@
+#include <unity.h>
+
+#include <Preferences.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "weight_sensor.h"
+
+// 420.5 counts per gram is exact in Q16.16, so expected values are exact.
+const float SCALE = 420.5f;
+
+void setUp() {
+  for (uint8_t channel = 0; channel < WEIGHT_MAX_CHANNELS; channel++) {
+    weightSensorSetScale(channel, SCALE);
+  }
+}
+
+void tearDown() {}
+
+void test_grams_to_counts() {
+  TEST_ASSERT_EQUAL_INT32(42050, gramsToWeightCounts(0, 100));
+  TEST_ASSERT_EQUAL_INT32(-42050, gramsToWeightCounts(0, -100));
+  TEST_ASSERT_EQUAL_INT32(0, gramsToWeightCounts(0, 0));
+  // 0.5 g is 210.25 counts.
+  TEST_ASSERT_EQUAL_INT32(210, gramsToWeightCounts(0, 0.5f));
+}
+
+void test_counts_to_grams_rounds_to_milligrams() {
+  TEST_ASSERT_EQUAL_FLOAT(100.0f, weightCountsToGrams(0, 42050));
+  // 1 count is 2.378 mg.
+  TEST_ASSERT_EQUAL_FLOAT(0.002f, weightCountsToGrams(0, 1));
+  TEST_ASSERT_EQUAL_FLOAT(-0.002f, weightCountsToGrams(0, -1));
+  // At 400 counts per gram 1 count is 2.5 mg, rounded away from zero.
+  weightSensorSetScale(1, 400.0f);
+  TEST_ASSERT_EQUAL_FLOAT(0.003f, weightCountsToGrams(1, 1));
+  TEST_ASSERT_EQUAL_FLOAT(-0.003f, weightCountsToGrams(1, -1));
+}
+
+void test_round_trip_across_threshold_range() {
+  for (float grams = 0.0f; grams <= 20000.0f; grams += 7.3f) {
+    const int32_t counts = gramsToWeightCounts(0, grams);
+    TEST_ASSERT_FLOAT_WITHIN(0.5f / SCALE + 0.001f, grams,
+                             weightCountsToGrams(0, counts));
+  }
+}
+
+void test_negative_scale() {
+  // A load cell wired the other way round reads down as weight goes up.
+  weightSensorSetScale(2, -SCALE);
+  TEST_ASSERT_EQUAL_INT32(-42050, gramsToWeightCounts(2, 100));
+  TEST_ASSERT_EQUAL_FLOAT(100.0f, weightCountsToGrams(2, -42050));
+}
+
+void test_zero_scale_falls_back_to_one_count_per_gram() {
+  weightSensorSetScale(3, 0.0f);
+  TEST_ASSERT_EQUAL_INT32(250, gramsToWeightCounts(3, 250));
+}
+
+void test_channels_are_independent() {
+  weightSensorSetScale(1, 2 * SCALE);
+  TEST_ASSERT_EQUAL_INT32(42050, gramsToWeightCounts(0, 100));
+  TEST_ASSERT_EQUAL_INT32(84100, gramsToWeightCounts(1, 100));
+}
+
+void test_grams_to_counts_saturates() {
+  weightSensorSetScale(0, 30000.0f);
+  TEST_ASSERT_EQUAL_INT32(INT32_MAX, gramsToWeightCounts(0, 1e6f));
+  TEST_ASSERT_EQUAL_INT32(INT32_MIN, gramsToWeightCounts(0, -1e6f));
+  TEST_ASSERT_EQUAL_INT32(INT32_MAX, gramsToWeightCounts(0, INFINITY));
+  TEST_ASSERT_EQUAL_INT32(INT32_MIN, gramsToWeightCounts(0, -INFINITY));
+  TEST_ASSERT_EQUAL_INT32(0, gramsToWeightCounts(0, NAN));
+  // Just inside the range still converts exactly.
+  TEST_ASSERT_EQUAL_INT32(30000 * 70000, gramsToWeightCounts(0, 70000));
+}
+
+void test_unchanged_temperature_coefficient_is_not_written() {
+  preferencesReset();
+  weightSensorSetTemperatureCoefficient(0.25f);
+  TEST_ASSERT_EQUAL_UINT32(1, preferencesWriteCount());
+  weightSensorSetTemperatureCoefficient(0.25f);
+  TEST_ASSERT_EQUAL_UINT32(1, preferencesWriteCount());
+  weightSensorSetTemperatureCoefficient(0.5f);
+  TEST_ASSERT_EQUAL_UINT32(2, preferencesWriteCount());
+  TEST_ASSERT_EQUAL_FLOAT(0.5f, weightSensorTemperatureCoefficient());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_grams_to_counts);
+  RUN_TEST(test_counts_to_grams_rounds_to_milligrams);
+  RUN_TEST(test_round_trip_across_threshold_range);
+  RUN_TEST(test_negative_scale);
+  RUN_TEST(test_zero_scale_falls_back_to_one_count_per_gram);
+  RUN_TEST(test_channels_are_independent);
+  RUN_TEST(test_grams_to_counts_saturates);
+  RUN_TEST(test_unchanged_temperature_coefficient_is_not_written);
+  return UNITY_END();
+}
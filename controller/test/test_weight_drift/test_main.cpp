@@ -0,0 +1,119 @@
+#include <unity.h>
+
+#include <math.h>
+#include <string.h>
+
+#include "valve_config.h"
+#include "valve_weight.h"
+#include "weight_sensor.h"
+
+// A load cell whose raw output creeps at a constant rate while the
+// reservoir on it does not change. Idle tracking samples it every 5 s as
+// the controller does; a weight-mode run that moves no water must then
+// report no change, however long it lasts.
+const int32_t RAW_TARE = 84123;
+const float COUNTS_PER_GRAM = 420.5f;
+const unsigned long IDLE_SAMPLE_MS = 5000;
+const unsigned long READ_INTERVAL_MS = 500;
+
+ScaleTracking tracking;
+ValveConfig valve;
+ControllerConfig controller;
+float creepGramsPerMin = 0.0f;
+
+// Raw counts at `nowMs`, tared by whatever zero point tracking has left.
+int32_t taredCountsAt(unsigned long nowMs) {
+  const float creepGrams = creepGramsPerMin * nowMs / 60000.0f;
+  const int32_t raw = RAW_TARE + gramsToWeightCounts(0, creepGrams);
+  return raw - weightSensorCalibration(0).tareOffset;
+}
+
+// Idle samples from `fromMs` up to `toMs`; returns the last sample time.
+unsigned long idleUntil(unsigned long fromMs, unsigned long toMs) {
+  unsigned long lastMs = fromMs;
+  for (unsigned long now = fromMs + IDLE_SAMPLE_MS; now <= toMs;
+       now += IDLE_SAMPLE_MS) {
+    scaleTrackingSample(tracking, 0, taredCountsAt(now), now - lastMs);
+    lastMs = now;
+  }
+  return lastMs;
+}
+
+void useScale(float countsPerGram, float gramsPerMin) {
+  weightSensorSetScale(0, countsPerGram);
+  weightSensorApplyCalibration(
+      0, {RAW_TARE, weightSensorCalibration(0).countsPerGramQ16});
+  creepGramsPerMin = gramsPerMin;
+  memset(&tracking, 0, sizeof(tracking));
+  scaleTrackingRefresh(tracking, 0);
+  refreshWeightThresholds(valve);
+}
+
+void setUp() {
+  memset(&valve, 0, sizeof(valve));
+  configApplyDefaults(valve, controller);
+  valve.controlMode = CONTROL_MODE_WEIGHT;
+  valve.sensorReadIntervalMs = READ_INTERVAL_MS;
+}
+
+void tearDown() {}
+
+// Learns the drift for 30 minutes, then runs the valve for 20 with no
+// water moving, checking the corrected change at every read.
+void checkRunStaysFlat(float countsPerGram, float gramsPerMin) {
+  useScale(countsPerGram, gramsPerMin);
+  const unsigned long openedAt = idleUntil(0, 30 * 60000UL);
+
+  const float learned =
+      weightCountsToGrams(0, tracking.driftCountsPerMinQ8 >> 8);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, gramsPerMin, learned);
+  // Zero tracking kept up with the creep: it stays inside the 2 g band.
+  TEST_ASSERT_INT32_WITHIN(abs(gramsToWeightCounts(0, 2.0f)), 0,
+                           taredCountsAt(openedAt));
+
+  valve.startTime = openedAt;
+  valveWeightStart(valve, taredCountsAt(openedAt), openedAt);
+  float worstGrams = 0.0f;
+  for (unsigned long now = openedAt; now <= openedAt + 20 * 60000UL;
+       now += READ_INTERVAL_MS) {
+    valve.lastCounts = taredCountsAt(now);
+    const float grams = weightCountsToGrams(
+        0, valveWeightChange(valve, tracking.driftCountsPerMinQ8, now));
+    worstGrams = fmaxf(worstGrams, fabsf(grams));
+  }
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, 0.0f, worstGrams);
+
+  // Uncorrected, the same run would have drifted by the full creep.
+  const float rawChange =
+      weightCountsToGrams(0, valve.startCounts - valve.lastCounts);
+  TEST_ASSERT_FLOAT_WITHIN(1.0f, -gramsPerMin * 20, rawChange);
+}
+
+void test_rising_creep_is_corrected() {
+  checkRunStaysFlat(COUNTS_PER_GRAM, 1.5f);
+}
+
+void test_falling_creep_is_corrected() {
+  checkRunStaysFlat(COUNTS_PER_GRAM, -0.8f);
+}
+
+void test_creep_on_a_reversed_cell_is_corrected() {
+  checkRunStaysFlat(-COUNTS_PER_GRAM, 1.5f);
+}
+
+void test_fast_change_is_not_taken_for_drift() {
+  // Beyond 0.5 g per sample the readings are not stable; nothing is
+  // learned, so nothing is subtracted from a run.
+  useScale(COUNTS_PER_GRAM, 12.0f);
+  idleUntil(0, 30 * 60000UL);
+  TEST_ASSERT_EQUAL_INT32(0, tracking.driftCountsPerMinQ8);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_rising_creep_is_corrected);
+  RUN_TEST(test_falling_creep_is_corrected);
+  RUN_TEST(test_creep_on_a_reversed_cell_is_corrected);
+  RUN_TEST(test_fast_change_is_not_taken_for_drift);
+  return UNITY_END();
+}
@@ -0,0 +1,158 @@
+#include <unity.h>
+
+#include <Arduino.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+
+#include "weight_sensor.h"
+
+// Simulated HX711s on one SCK line. DOUT stays high until a chip's
+// conversion is ready, then shifts out one bit, MSB first, on each rising
+// SCK edge. The 25th edge ends the conversion and selects gain 128.
+const uint8_t CLOCK_PIN = 17;
+const uint8_t DATA_BITS = 24;
+const uint8_t PULSES_PER_CONVERSION = DATA_BITS + 1;
+const unsigned long NEVER = 0xFFFFFFFFUL;
+
+struct SimulatedHx711 {
+  uint8_t dataPin;
+  int32_t value;
+  unsigned long readyAfterMs;  // since the read started; NEVER for a dead chip
+  uint8_t pulses;
+  uint8_t conversions;
+};
+
+SimulatedHx711 chips[WEIGHT_MAX_CHANNELS];
+uint8_t chipCount = 0;
+unsigned long readStartedAt = 0;
+uint32_t risingEdges = 0;
+
+void setDataLevel(const SimulatedHx711& chip, bool high) {
+  uint32_t& bank = hostRegister(chip.dataPin >= 32 ? GPIO_IN1_REG : GPIO_IN_REG);
+  const uint32_t mask = 1UL << (chip.dataPin & 31);
+  bank = high ? (bank | mask) : (bank & ~mask);
+}
+
+bool isReady(const SimulatedHx711& chip) {
+  return chip.readyAfterMs != NEVER &&
+         millis() - readStartedAt >= chip.readyAfterMs;
+}
+
+// Between conversions DOUT only tells whether one is ready.
+void refreshReadiness(uint32_t) {
+  for (uint8_t i = 0; i < chipCount; i++) {
+    if (chips[i].pulses == 0) {
+      setDataLevel(chips[i], !isReady(chips[i]));
+    }
+  }
+}
+
+void onPin(uint8_t pin, uint8_t level) {
+  if (pin != CLOCK_PIN || level != HIGH) {
+    return;
+  }
+  risingEdges++;
+  for (uint8_t i = 0; i < chipCount; i++) {
+    SimulatedHx711& chip = chips[i];
+    TEST_ASSERT_TRUE_MESSAGE(isReady(chip), "clocked before DOUT went low");
+    chip.pulses++;
+    if (chip.pulses <= DATA_BITS) {
+      const uint32_t bits = static_cast<uint32_t>(chip.value) & 0xFFFFFF;
+      setDataLevel(chip, (bits >> (DATA_BITS - chip.pulses)) & 1);
+    } else {
+      chip.pulses = 0;
+      chip.conversions++;
+      setDataLevel(chip, true);
+    }
+  }
+}
+
+void addChip(uint8_t dataPin, int32_t value, unsigned long readyAfterMs) {
+  chips[chipCount++] = {dataPin, value, readyAfterMs, 0, 0};
+}
+
+void beginChips() {
+  uint8_t pins[WEIGHT_MAX_CHANNELS];
+  for (uint8_t i = 0; i < chipCount; i++) {
+    pins[i] = chips[i].dataPin;
+  }
+  weightSensorBegin(pins, chipCount, CLOCK_PIN);
+  readStartedAt = millis();
+}
+
+void setUp() {
+  chipCount = 0;
+  risingEdges = 0;
+  hostRegister(GPIO_IN_REG) = 0xFFFFFFFF;
+  hostRegister(GPIO_IN1_REG) = 0xFFFFFFFF;
+  hostRegisterReadHook() = refreshReadiness;
+  hostPinHook() = onPin;
+}
+
+void tearDown() {
+  hostRegisterReadHook() = nullptr;
+  hostPinHook() = nullptr;
+}
+
+void test_waits_for_the_slowest_channel() {
+  addChip(16, 123456, 0);
+  addChip(34, -654321, 15);  // GPIO_IN1_REG
+  addChip(5, 8388607, 40);
+  addChip(35, -8388608, 25);
+  beginChips();
+
+  int32_t raw[WEIGHT_MAX_CHANNELS] = {0};
+  TEST_ASSERT_TRUE(readWeightRaw(1, raw));
+  TEST_ASSERT_EQUAL_INT32(123456, raw[0]);
+  TEST_ASSERT_EQUAL_INT32(-654321, raw[1]);
+  TEST_ASSERT_EQUAL_INT32(8388607, raw[2]);
+  TEST_ASSERT_EQUAL_INT32(-8388608, raw[3]);
+  // One clock train for all four.
+  TEST_ASSERT_EQUAL_UINT32(PULSES_PER_CONVERSION, risingEdges);
+  for (uint8_t i = 0; i < chipCount; i++) {
+    TEST_ASSERT_EQUAL(1, chips[i].conversions);
+    TEST_ASSERT_EQUAL(0, chips[i].pulses);
+  }
+  // millis() ticks whole milliseconds, hence the 1 ms of slack.
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(39000, weightSensorLastReadUs());
+}
+
+void test_averages_every_channel_over_the_samples() {
+  addChip(16, 1000, 0);
+  addChip(18, -3000, 10);
+  beginChips();
+  int32_t raw[WEIGHT_MAX_CHANNELS];
+  TEST_ASSERT_TRUE(readWeightRaw(3, raw));
+  TEST_ASSERT_EQUAL_INT32(1000, raw[0]);
+  TEST_ASSERT_EQUAL_INT32(-3000, raw[1]);
+  TEST_ASSERT_EQUAL_UINT32(3 * PULSES_PER_CONVERSION, risingEdges);
+}
+
+void test_a_channel_that_never_becomes_ready_times_out() {
+  addChip(16, 1000, 0);
+  addChip(34, 2000, NEVER);
+  beginChips();
+
+  int32_t raw[WEIGHT_MAX_CHANNELS] = {7, 7};
+  TEST_ASSERT_FALSE(readWeightRaw(1, raw));
+  TEST_ASSERT_EQUAL_INT32(7, raw[0]);
+  TEST_ASSERT_EQUAL_INT32(7, raw[1]);
+  // Nothing was clocked, so the ready chip still holds its conversion.
+  TEST_ASSERT_EQUAL_UINT32(0, risingEdges);
+  TEST_ASSERT_EQUAL(0, chips[0].conversions);
+  // The 200 ms ready timeout, not a hang.
+  TEST_ASSERT_GREATER_OR_EQUAL_UINT32(199000, weightSensorLastReadUs());
+  TEST_ASSERT_LESS_THAN_UINT32(1000000, weightSensorLastReadUs());
+
+  int32_t counts[WEIGHT_MAX_CHANNELS] = {7, 7};
+  TEST_ASSERT_FALSE(readWeightCounts(1, counts));
+  TEST_ASSERT_EQUAL_INT32(7, counts[0]);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_waits_for_the_slowest_channel);
+  RUN_TEST(test_averages_every_channel_over_the_samples);
+  RUN_TEST(test_a_channel_that_never_becomes_ready_times_out);
+  return UNITY_END();
+}
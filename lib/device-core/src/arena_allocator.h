@@ -0,0 +1,119 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Bump allocator over a caller-owned buffer, for JsonDocuments that must not
+// touch the heap. Call reset() (after clearing the document) before reusing
+// it for the next message; a document that does not fit fails with NoMemory
+// instead of allocating.
+class ArenaAllocator : public ArduinoJson::Allocator {
+ public:
+  ArenaAllocator(uint8_t* buffer, size_t capacity)
+      : buffer_(buffer), capacity_(capacity) {}
+
+  void* allocate(size_t size) override {
+    size_t offset = align(used_);
+    size_t end = offset + kHeaderSize + align(size);
+    if (end > capacity_) {
+      return nullptr;
+    }
+    memcpy(buffer_ + offset, &size, sizeof(size_t));
+    last_ = offset;
+    used_ = end;
+    trackPeak();
+    return buffer_ + offset + kHeaderSize;
+  }
+
+  void deallocate(void* ptr) override {
+    // Only the most recent block can be released before reset().
+    if (ptr && blockOffset(ptr) == last_) {
+      used_ = last_;
+    }
+  }
+
+  void* reallocate(void* ptr, size_t newSize) override {
+    if (!ptr) {
+      return allocate(newSize);
+    }
+    size_t offset = blockOffset(ptr);
+    size_t oldSize;
+    memcpy(&oldSize, buffer_ + offset, sizeof(size_t));
+    if (newSize <= oldSize) {
+      return ptr;
+    }
+    if (offset == last_) {
+      size_t end = offset + kHeaderSize + align(newSize);
+      if (end > capacity_) {
+        return nullptr;
+      }
+      memcpy(buffer_ + offset, &newSize, sizeof(size_t));
+      used_ = end;
+      trackPeak();
+      return ptr;
+    }
+    void* moved = allocate(newSize);
+    if (moved) {
+      memcpy(moved, ptr, oldSize);
+    }
+    return moved;
+  }
+
+  void reset() {
+    used_ = 0;
+    last_ = 0;
+  }
+
+  // High-water mark since construction, for sizing the buffer.
+  size_t peak() const { return peak_; }
+  size_t capacity() const { return capacity_; }
+
+ private:
+  static constexpr size_t align(size_t value) {
+    return (value + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+  }
+
+  // Block size header, padded so the payload stays max-aligned.
+  static constexpr size_t kHeaderSize = alignof(max_align_t);
+  static_assert(sizeof(size_t) <= kHeaderSize, "header too small");
+
+  size_t blockOffset(void* ptr) const {
+    return static_cast<uint8_t*>(ptr) - buffer_ - kHeaderSize;
+  }
+
+  void trackPeak() {
+    if (used_ > peak_) {
+      peak_ = used_;
+    }
+  }
+
+  uint8_t* buffer_;
+  size_t capacity_;
+  size_t used_ = 0;
+  size_t last_ = 0;
+  size_t peak_ = 0;
+};
+
+// A JsonDocument with its own statically sized arena. acquire() hands back
+// the document emptied and the arena rewound, so reusing it for every
+// message never reaches malloc. Only one user may hold it at a time.
+template <size_t Capacity>
+class ArenaJsonDocument {
+ public:
+  ArenaJsonDocument() : arena_(buffer_, Capacity), doc_(&arena_) {}
+
+  JsonDocument& acquire() {
+    doc_.clear();
+    arena_.reset();
+    return doc_;
+  }
+
+  const ArenaAllocator& arena() const { return arena_; }
+
+ private:
+  alignas(max_align_t) uint8_t buffer_[Capacity];
+  ArenaAllocator arena_;
+  JsonDocument doc_;
+};
@@ -0,0 +1,334 @@
+#include "connectivity.h"
+
+#include <ESPmDNS.h>
+#include <Preferences.h>
+
+#include "device_log.h"
+
+namespace {
+constexpr unsigned long WIFI_POLL_INTERVAL_MS = 100;
+constexpr unsigned long WIFI_FAST_CONNECT_TIMEOUT_MS = 3000;
+constexpr unsigned long RETRY_HOOK_INTERVAL_MS = 1000;
+constexpr unsigned long MQTT_RETRY_DELAY_MS = 1000;
+constexpr unsigned long FAILBACK_PROBE_INTERVAL_MS = 30000;
+constexpr int32_t FAILBACK_PROBE_TIMEOUT_MS = 500;
+
+constexpr char WIFI_CACHE_PREFS_NAMESPACE[] = "wifi";
+constexpr char WIFI_CACHE_PREFS_KEY[] = "cache";
+
+unsigned long lastConnectMs = 0;
+unsigned long connectCount = 0;
+
+// Association started by beginWiFi() that connectWiFi() has yet to finish.
+enum WiFiAttempt : uint8_t {
+  WIFI_ATTEMPT_NONE,
+  WIFI_ATTEMPT_CACHED,
+  WIFI_ATTEMPT_SCAN,
+};
+WiFiAttempt wifiAttempt = WIFI_ATTEMPT_NONE;
+unsigned long wifiAttemptStartedAt = 0;
+
+enum Broker : int8_t {
+  BROKER_NONE = -1,
+  BROKER_PRIMARY = 0,
+  BROKER_LAN = 1,
+};
+
+struct Failover {
+  PubSubClient* client;
+  Client* primaryClient;
+  const char* primaryHost;
+  uint16_t primaryPort;
+  LanBroker lan;
+  // Resolved on the last primary connect, so probes need no DNS while the
+  // internet is down.
+  IPAddress primaryIp;
+  IPAddress lanIp;
+  uint16_t lanPort;  // 0 until discovered
+  bool mdnsStarted;
+  Broker target;
+  Broker lastConnected;
+  bool switched;
+  unsigned long lastProbeAt;
+};
+Failover failover = {nullptr, nullptr, nullptr, 0, {nullptr, nullptr, nullptr},
+                     IPAddress(), IPAddress(), 0, false, BROKER_PRIMARY,
+                     BROKER_NONE, false, 0};
+WiFiClientSecure lanClient;
+
+void targetBroker(Broker broker) {
+  failover.target = broker;
+  if (broker == BROKER_LAN) {
+    failover.client->setClient(lanClient);
+    failover.client->setServer(failover.lanIp, failover.lanPort);
+  } else {
+    failover.client->setClient(*failover.primaryClient);
+    failover.client->setServer(failover.primaryHost, failover.primaryPort);
+  }
+}
+
+void noteConnected() {
+  if (failover.lastConnected != BROKER_NONE &&
+      failover.lastConnected != failover.target) {
+    failover.switched = true;
+  }
+  failover.lastConnected = failover.target;
+  if (failover.target == BROKER_PRIMARY) {
+    WiFi.hostByName(failover.primaryHost, failover.primaryIp);
+  } else {
+    failover.lastProbeAt = millis();
+  }
+}
+
+bool attemptConnect(PubSubClient& client, const MqttSession& session) {
+  LOG_INFO("📡 Attempting MQTT connection...");
+  const unsigned long attemptStartedAt = millis();
+  const bool lan = failover.client && failover.target == BROKER_LAN;
+  const char* user = lan ? failover.lan.user : session.user;
+  const char* password = lan ? failover.lan.password : session.password;
+  if (!client.connect(session.clientId, user, password, nullptr, 0, false,
+                      nullptr, session.cleanSession)) {
+    LOG_WARN("❌ failed. mqttClientState = %d", client.state());
+    return false;
+  }
+  lastConnectMs = millis() - attemptStartedAt;
+  connectCount++;
+  LOG_INFO("✅ MQTT connected in %lums!", lastConnectMs);
+  return true;
+}
+
+void startWiFiAttempt(const char* ssid, const char* password,
+                      WiFiCache* cache) {
+  wifiAttemptStartedAt = millis();
+  if (cache && cache->channel != 0 && cache->localIp != 0) {
+    WiFi.config(IPAddress(cache->localIp), IPAddress(cache->gateway),
+                IPAddress(cache->subnet), IPAddress(cache->dns));
+    WiFi.begin(ssid, password, cache->channel, cache->bssid, true);
+    wifiAttempt = WIFI_ATTEMPT_CACHED;
+  } else {
+    WiFi.begin(ssid, password);
+    wifiAttempt = WIFI_ATTEMPT_SCAN;
+  }
+}
+
+bool finishCachedWiFiAttempt(WiFiCache& cache) {
+  while (WiFi.status() != WL_CONNECTED) {
+    if (millis() - wifiAttemptStartedAt >= WIFI_FAST_CONNECT_TIMEOUT_MS) {
+      LOG_WARN("Cached WiFi parameters failed, falling back to DHCP");
+      WiFi.disconnect();
+      WiFi.config(IPAddress(), IPAddress(), IPAddress());
+      cache.channel = 0;
+      return false;
+    }
+    delay(10);
+  }
+  return true;
+}
+
+void storeWiFiCache(WiFiCache& cache) {
+  memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+  cache.channel = WiFi.channel();
+  cache.localIp = WiFi.localIP();
+  cache.gateway = WiFi.gatewayIP();
+  cache.subnet = WiFi.subnetMask();
+  cache.dns = WiFi.dnsIP();
+}
+}  // namespace
+
+void beginWiFi(const char* ssid, const char* password, WiFiCache* cache) {
+  LOG_INFO("Connecting to WiFi in the background...");
+  startWiFiAttempt(ssid, password, cache);
+}
+
+void connectWiFi(const char* ssid, const char* password, WiFiCache* cache,
+                 ConnectRetryHook onRetry) {
+  LOG_INFO("Connecting to WiFi...");
+  // Timed from beginWiFi() when that started the attempt.
+  [[maybe_unused]] const unsigned long startedAt =
+      wifiAttempt == WIFI_ATTEMPT_NONE ? millis() : wifiAttemptStartedAt;
+
+  if (wifiAttempt == WIFI_ATTEMPT_NONE) {
+    startWiFiAttempt(ssid, password, cache);
+  }
+  if (wifiAttempt == WIFI_ATTEMPT_CACHED &&
+      (!cache || !finishCachedWiFiAttempt(*cache))) {
+    WiFi.begin(ssid, password);
+    wifiAttempt = WIFI_ATTEMPT_SCAN;
+  }
+  if (wifiAttempt == WIFI_ATTEMPT_SCAN) {
+    unsigned long lastHookAt = millis();
+    while (WiFi.status() != WL_CONNECTED) {
+      delay(WIFI_POLL_INTERVAL_MS);
+      if (onRetry && millis() - lastHookAt >= RETRY_HOOK_INTERVAL_MS) {
+        lastHookAt = millis();
+        onRetry();
+      }
+    }
+  }
+  wifiAttempt = WIFI_ATTEMPT_NONE;
+
+  if (cache) {
+    storeWiFiCache(*cache);
+  }
+  LOG_INFO("✅ WiFi connected in %lums! IP Address: %s", millis() - startedAt,
+           WiFi.localIP().toString().c_str());
+}
+
+bool loadWiFiCache(WiFiCache& cache) {
+  Preferences prefs;
+  if (!prefs.begin(WIFI_CACHE_PREFS_NAMESPACE, true)) {
+    return false;
+  }
+  const bool loaded = prefs.getBytes(WIFI_CACHE_PREFS_KEY, &cache,
+                                     sizeof(cache)) == sizeof(cache);
+  prefs.end();
+  if (!loaded) {
+    memset(&cache, 0, sizeof(cache));
+  }
+  return loaded;
+}
+
+void saveWiFiCache(const WiFiCache& cache) {
+  Preferences prefs;
+  if (!prefs.begin(WIFI_CACHE_PREFS_NAMESPACE, false)) {
+    return;
+  }
+  WiFiCache stored;
+  if (prefs.getBytes(WIFI_CACHE_PREFS_KEY, &stored, sizeof(stored)) !=
+          sizeof(stored) ||
+      memcmp(&stored, &cache, sizeof(cache)) != 0) {
+    prefs.putBytes(WIFI_CACHE_PREFS_KEY, &cache, sizeof(cache));
+  }
+  prefs.end();
+}
+
+void testDNS(const char* host) {
+  LOG_DEBUG("🔍 Testing DNS resolution for MQTT server...");
+  IPAddress resolvedIP;
+  if (WiFi.hostByName(host, resolvedIP)) {
+    LOG_DEBUG("✅ DNS resolved: %s", resolvedIP.toString().c_str());
+  } else {
+    LOG_WARN("❌ DNS resolution failed!");
+  }
+}
+
+// With failover, a failed primary attempt falls through to the LAN broker
+// in the same call, and once there reconnects stay on the LAN until
+// mqttFailbackDue() or the LAN broker itself fails.
+bool tryConnectMQTT(PubSubClient& client, const MqttSession& session) {
+  if (!failover.client) {
+    return attemptConnect(client, session);
+  }
+  if (failover.target == BROKER_PRIMARY) {
+    if (attemptConnect(client, session)) {
+      noteConnected();
+      return true;
+    }
+    if (failover.lanPort == 0 && !mqttDiscoverLanBroker()) {
+      return false;
+    }
+    LOG_WARN("Primary broker unreachable, failing over to %s:%u",
+             failover.lanIp.toString().c_str(), failover.lanPort);
+    targetBroker(BROKER_LAN);
+  }
+  if (attemptConnect(client, session)) {
+    noteConnected();
+    return true;
+  }
+  // Rediscover next time, the LAN broker may have moved.
+  failover.lanPort = 0;
+  targetBroker(BROKER_PRIMARY);
+  return false;
+}
+
+void connectMQTT(PubSubClient& client, const MqttSession& session,
+                 ConnectRetryHook onRetry) {
+  while (!tryConnectMQTT(client, session)) {
+    if (onRetry) {
+      onRetry();
+    }
+    delay(MQTT_RETRY_DELAY_MS);
+  }
+}
+
+unsigned long lastMqttConnectMs() {
+  return lastConnectMs;
+}
+
+unsigned long mqttConnectCount() {
+  return connectCount;
+}
+
+void mqttFailoverBegin(PubSubClient& client, Client& primaryClient,
+                       const char* primaryHost, uint16_t primaryPort,
+                       const LanBroker& lan) {
+  if (!lan.caCert) {
+    LOG_WARN("⚠️ No LAN broker CA, LAN failover disabled");
+    return;
+  }
+  configureTls(lanClient, lan.caCert);
+  failover.lan = lan;
+  failover.client = &client;
+  failover.primaryClient = &primaryClient;
+  failover.primaryHost = primaryHost;
+  failover.primaryPort = primaryPort;
+  targetBroker(BROKER_PRIMARY);
+}
+
+bool mqttDiscoverLanBroker() {
+  if (!failover.client) {
+    return false;
+  }
+  if (!failover.mdnsStarted) {
+    failover.mdnsStarted = MDNS.begin(WiFi.getHostname());
+    if (!failover.mdnsStarted) {
+      LOG_WARN("mDNS start failed, no LAN broker failover");
+      return false;
+    }
+  }
+  const unsigned long startedAt = millis();
+  if (MDNS.queryService("mqtt", "tcp") <= 0) {
+    LOG_WARN("No LAN broker found over mDNS");
+    return false;
+  }
+  failover.lanIp = MDNS.IP(0);
+  failover.lanPort = MDNS.port(0);
+  LOG_INFO("✅ LAN broker %s:%u found in %lums",
+           failover.lanIp.toString().c_str(), failover.lanPort,
+           millis() - startedAt);
+  return true;
+}
+
+bool mqttOnLanBroker() {
+  return failover.client && failover.target == BROKER_LAN &&
+         failover.client->connected();
+}
+
+bool mqttBrokerSwitched() {
+  const bool switched = failover.switched;
+  failover.switched = false;
+  return switched;
+}
+
+bool mqttFailbackDue() {
+  if (!failover.client || failover.target != BROKER_LAN ||
+      millis() - failover.lastProbeAt < FAILBACK_PROBE_INTERVAL_MS) {
+    return false;
+  }
+  failover.lastProbeAt = millis();
+  WiFiClient probe;
+  const bool reachable =
+      failover.primaryIp != IPAddress()
+          ? probe.connect(failover.primaryIp, failover.primaryPort,
+                          FAILBACK_PROBE_TIMEOUT_MS)
+          : probe.connect(failover.primaryHost, failover.primaryPort,
+                          FAILBACK_PROBE_TIMEOUT_MS);
+  probe.stop();
+  if (!reachable) {
+    return false;
+  }
+  LOG_INFO("Primary broker reachable again, failing back");
+  failover.client->disconnect();
+  targetBroker(BROKER_PRIMARY);
+  return true;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+
+#include "tls_client.h"
+#include "wifi_cache.h"
+
+struct MqttSession {
+  const char* clientId;
+  const char* user;
+  const char* password;
+  bool cleanSession;
+};
+
+// Called about once a second while a connect is still pending.
+typedef void (*ConnectRetryHook)();
+
+// Blocks until associated. With a cache, first tries the cached BSSID,
+// channel and static lease, then falls back to a normal connect; the cache
+// is refreshed on success.
+void connectWiFi(const char* ssid, const char* password,
+                 WiFiCache* cache = nullptr, ConnectRetryHook onRetry = nullptr);
+// Starts the same connect without waiting, so other startup work can run
+// while associating; connectWiFi() with the same cache then finishes it.
+void beginWiFi(const char* ssid, const char* password,
+               WiFiCache* cache = nullptr);
+
+// Copy of a WiFiCache in NVS, for devices whose restarts do not keep RTC
+// memory. Saving skips the flash write when nothing changed.
+bool loadWiFiCache(WiFiCache& cache);
+void saveWiFiCache(const WiFiCache& cache);
+
+void testDNS(const char* host);
+
+// Blocks until the MQTT session is up. Subscriptions are left to the caller.
+void connectMQTT(PubSubClient& client, const MqttSession& session,
+                 ConnectRetryHook onRetry = nullptr);
+// Single attempt, for loops that must keep running while the broker is
+// unreachable.
+bool tryConnectMQTT(PubSubClient& client, const MqttSession& session);
+
+unsigned long lastMqttConnectMs();
+unsigned long mqttConnectCount();
+
+// The broker to fail over to. Its certificate is verified against caCert,
+// which should be a private CA: the broker is reached at the address mDNS
+// returned, so no host name is checked and a public root would accept any
+// certificate it ever issued. The LAN broker gets its own credentials, never
+// the primary's.
+struct LanBroker {
+  const char* caCert;
+  const char* user;
+  const char* password;
+};
+
+// Optional LAN failover. When the primary broker cannot be reached, the
+// connect functions above switch to a broker on the LAN advertised over
+// mDNS as _mqtt._tcp, over TLS with lan's credentials. Failover stays off
+// without lan.caCert. Call once after setServer(); primaryClient is the
+// (TLS) client the PubSubClient was built with.
+void mqttFailoverBegin(PubSubClient& client, Client& primaryClient,
+                       const char* primaryHost, uint16_t primaryPort,
+                       const LanBroker& lan);
+// Browses for the LAN broker now instead of at the first failover. The
+// query blocks for up to 3 s.
+bool mqttDiscoverLanBroker();
+bool mqttOnLanBroker();
+// True once after a connect that landed on a different broker than the
+// previous one. The new broker's retained copies of this device's state
+// predate the switch, so the caller should republish its retained state
+// before subscribing rather than have the stale copies applied.
+bool mqttBrokerSwitched();
+// While on the LAN broker, probes the primary every 30 s with a TCP connect
+// bounded to 500 ms. When it answers, drops the LAN session and returns
+// true; the caller's normal reconnect then lands on the primary again.
+bool mqttFailbackDue();
@@ -0,0 +1,22 @@
+#include "device_id.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+namespace {
+constexpr int EEPROM_SIZE = 8;
+}  // namespace
+
+uint16_t getOrCreateDeviceSuffix() {
+  uint16_t value;
+  EEPROM.begin(EEPROM_SIZE);
+  EEPROM.get(0, value);
+
+  if (value == 0xFFFF || value == 0) {
+    value = static_cast<uint16_t>(esp_random());
+    EEPROM.put(0, value);
+    EEPROM.commit();
+  }
+
+  return value;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <stdint.h>
+
+// Random 16-bit suffix persisted in EEPROM so the device ID (and therefore
+// its topics) survives reflashing.
+uint16_t getOrCreateDeviceSuffix();
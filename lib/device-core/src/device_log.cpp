@@ -0,0 +1,118 @@
+#include "device_log.h"
+
+#include <stdarg.h>
+
+#include <atomic>
+
+namespace {
+constexpr size_t LOG_RING_SIZE = 4096;  // must be a power of two
+constexpr size_t LOG_LINE_MAX = 256;
+constexpr uint32_t LOG_DRAIN_IDLE_MS = 5;
+constexpr char LOG_LEVEL_TAGS[] = {'-', 'E', 'W', 'I', 'D'};
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0,
+              "LOG_RING_SIZE must be a power of two");
+
+// Single producer (the Arduino loop task) and single consumer (the drain
+// task); head and tail are free-running byte counters.
+char ring[LOG_RING_SIZE];
+std::atomic<size_t> ringHead{0};
+std::atomic<size_t> ringTail{0};
+std::atomic<unsigned long> droppedLines{0};
+unsigned long reportedDroppedLines = 0;
+TaskHandle_t drainTask = nullptr;
+
+void drainLog(void*) {
+  for (;;) {
+    const size_t tail = ringTail.load(std::memory_order_relaxed);
+    const size_t head = ringHead.load(std::memory_order_acquire);
+    if (head == tail) {
+      const unsigned long dropped = droppedLines.load(std::memory_order_relaxed);
+      if (dropped != reportedDroppedLines) {
+        Serial.printf("[log] %lu lines dropped\n", dropped - reportedDroppedLines);
+        reportedDroppedLines = dropped;
+      }
+      vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_IDLE_MS));
+      continue;
+    }
+
+    const size_t start = tail & (LOG_RING_SIZE - 1);
+    size_t count = head - tail;
+    if (count > LOG_RING_SIZE - start) {
+      count = LOG_RING_SIZE - start;
+    }
+    Serial.write(reinterpret_cast<const uint8_t*>(ring + start), count);
+    ringTail.store(tail + count, std::memory_order_release);
+  }
+}
+
+void enqueue(const char* line, size_t length) {
+  const size_t head = ringHead.load(std::memory_order_relaxed);
+  const size_t tail = ringTail.load(std::memory_order_acquire);
+  if (LOG_RING_SIZE - (head - tail) < length) {
+    droppedLines.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  const size_t start = head & (LOG_RING_SIZE - 1);
+  const size_t firstPart =
+      length < LOG_RING_SIZE - start ? length : LOG_RING_SIZE - start;
+  memcpy(ring + start, line, firstPart);
+  memcpy(ring, line + firstPart, length - firstPart);
+  ringHead.store(head + length, std::memory_order_release);
+}
+}  // namespace
+
+uint8_t logRuntimeLevel = LOG_LEVEL;
+
+void logBegin() {
+#if LOG_BUFFERED && LOG_LEVEL > LOG_LEVEL_NONE
+  if (!drainTask) {
+    xTaskCreatePinnedToCore(drainLog, "log", 2048, nullptr,
+                            tskIDLE_PRIORITY + 1, &drainTask, 0);
+  }
+#endif
+}
+
+void logSetLevel(uint8_t level) {
+  logRuntimeLevel = level > LOG_LEVEL ? LOG_LEVEL : level;
+}
+
+unsigned long logDroppedCount() {
+  return droppedLines.load(std::memory_order_relaxed);
+}
+
+void logFlush(uint32_t timeoutMs) {
+  const unsigned long startedAt = millis();
+  while (drainTask &&
+         ringTail.load(std::memory_order_acquire) !=
+             ringHead.load(std::memory_order_relaxed) &&
+         millis() - startedAt < timeoutMs) {
+    delay(1);
+  }
+  Serial.flush();
+}
+
+void logWrite(uint8_t level, const char* format, ...) {
+  char line[LOG_LINE_MAX];
+  const int prefixLength = snprintf(line, sizeof(line), "[%lu][%c] ", millis(),
+                                    LOG_LEVEL_TAGS[level]);
+
+  va_list args;
+  va_start(args, format);
+  const size_t room = sizeof(line) - prefixLength - 1;
+  const int bodyLength = vsnprintf(line + prefixLength, room + 1, format, args);
+  va_end(args);
+
+  size_t length = prefixLength;
+  if (bodyLength > 0) {
+    length += static_cast<size_t>(bodyLength) < room ? bodyLength : room;
+  }
+  line[length++] = '\n';
+
+  if (LOG_BUFFERED && drainTask) {
+    enqueue(line, length);
+  } else {
+    Serial.write(reinterpret_cast<const uint8_t*>(line), length);
+  }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Leveled logging. LOG_LEVEL sets the most verbose level compiled in (calls
+// above it expand to nothing); logSetLevel() filters further at runtime.
+// With LOG_BUFFERED, lines are formatted into a ring buffer and written to
+// Serial by a low-priority task so the loop never blocks on the UART.
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+#ifndef LOG_BUFFERED
+#define LOG_BUFFERED 1
+#endif
+
+extern uint8_t logRuntimeLevel;
+
+void logBegin();
+void logSetLevel(uint8_t level);
+unsigned long logDroppedCount();
+// Blocks until buffered lines reach the UART or timeoutMs elapses; call
+// before deep sleep or restart so the last lines are not lost.
+void logFlush(uint32_t timeoutMs = 200);
+void logWrite(uint8_t level, const char* format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#define LOG_AT(level, ...)               \
+  do {                                   \
+    if ((level) <= logRuntimeLevel) {    \
+      logWrite((level), __VA_ARGS__);    \
+    }                                    \
+  } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
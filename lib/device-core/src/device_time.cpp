@@ -0,0 +1,114 @@
+#include "device_time.h"
+
+#include <Arduino.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "device_log.h"
+
+namespace {
+constexpr char NTP_SERVER[] = "pool.ntp.org";
+constexpr int MIN_VALID_YEAR = 2016;
+
+time_t timegm_fallback(struct tm* tm) {
+  time_t local = mktime(tm);
+  struct tm* gmtm = gmtime(&local);
+  time_t gm = mktime(gmtm);
+  return local + (local - gm);
+}
+}  // namespace
+
+void syncTime(long gmtOffsetSec, int daylightOffsetSec) {
+  configTime(gmtOffsetSec, daylightOffsetSec, NTP_SERVER);
+  struct tm timeInfo;
+  while (!getLocalTime(&timeInfo)) {
+    LOG_INFO("⏳ Waiting for NTP time...");
+    delay(500);
+  }
+  char formatted[20];
+  strftime(formatted, sizeof(formatted), "%Y-%m-%d %H:%M:%S", &timeInfo);
+  LOG_INFO("🕒 Time synchronized: %s", formatted);
+}
+
+void startTimeSync(long gmtOffsetSec, int daylightOffsetSec) {
+  configTime(gmtOffsetSec, daylightOffsetSec, NTP_SERVER);
+  if (currentEpochMs() != 0) {
+    LOG_INFO("🕒 Clock kept across reset, NTP will refine it");
+  }
+}
+
+bool waitForTime(unsigned long timeoutMs) {
+  const unsigned long startedAt = millis();
+  while (currentEpochMs() == 0) {
+    if (millis() - startedAt >= timeoutMs) {
+      return false;
+    }
+    delay(50);
+  }
+  return true;
+}
+
+bool formatCurrentTimestamp(char* buffer, size_t size) {
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+
+  struct tm timeInfo;
+  gmtime_r(&now.tv_sec, &timeInfo);
+  if (timeInfo.tm_year + 1900 < MIN_VALID_YEAR) {
+    snprintf(buffer, size, "unknown");
+    return false;
+  }
+
+  snprintf(buffer, size, "%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ",
+           timeInfo.tm_year + 1900, timeInfo.tm_mon + 1, timeInfo.tm_mday,
+           timeInfo.tm_hour, timeInfo.tm_min, timeInfo.tm_sec,
+           static_cast<long>(now.tv_usec / 1000));
+  return true;
+}
+
+int64_t currentEpochMs() {
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  struct tm timeInfo;
+  gmtime_r(&now.tv_sec, &timeInfo);
+  if (timeInfo.tm_year + 1900 < MIN_VALID_YEAR) {
+    return 0;
+  }
+  return static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_usec / 1000;
+}
+
+int64_t parseISOTimeToEpochMs(const char* isoString) {
+  if (!isoString) {
+    return 0;
+  }
+  struct tm tm = {};
+  const char* rest = strptime(isoString, "%Y-%m-%dT%H:%M:%S", &tm);
+  if (!rest) {
+    return 0;
+  }
+  int millisPart = 0;
+  if (*rest == '.') {
+    int scale = 100;
+    for (const char* p = rest + 1; *p >= '0' && *p <= '9' && scale > 0;
+         ++p, scale /= 10) {
+      millisPart += (*p - '0') * scale;
+    }
+  }
+  return static_cast<int64_t>(timegm_fallback(&tm)) * 1000 + millisPart;
+}
+
+bool isTimestampInRange(int64_t epochMs, int thresholdSeconds) {
+  if (epochMs == 0) {
+    return false;
+  }
+  time_t now;
+  time(&now);
+  const int64_t skewMs = static_cast<int64_t>(now) * 1000 - epochMs;
+  LOG_DEBUG("Message time: %lld, skew: %lldms", (long long)epochMs,
+            (long long)skewMs);
+  return llabs(skewMs) <= thresholdSeconds * 1000LL;
+}
+
+bool isTimestampInRange(const char* isoString, int thresholdSeconds) {
+  return isTimestampInRange(parseISOTimeToEpochMs(isoString), thresholdSeconds);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Blocks until the clock has been set from NTP.
+void syncTime(long gmtOffsetSec = 0, int daylightOffsetSec = 0);
+
+// Starts NTP without waiting. The system clock runs on the RTC timer and
+// survives every reset but power-on, so after a brownout or watchdog reset
+// it is usually already valid and stays in use until NTP corrects it.
+void startTimeSync(long gmtOffsetSec = 0, int daylightOffsetSec = 0);
+// Waits up to timeoutMs for a valid clock and returns whether there is one.
+bool waitForTime(unsigned long timeoutMs);
+
+// Writes the current UTC time as YYYY-MM-DDTHH:MM:SS.mmmZ, or "unknown" if
+// the clock has not been set yet. Never waits for NTP.
+bool formatCurrentTimestamp(char* buffer, size_t size);
+
+// Current UTC time in epoch milliseconds, or 0 if the clock has not been set.
+int64_t currentEpochMs();
+
+// ISO 8601 UTC string to epoch milliseconds, or 0 if it cannot be parsed.
+int64_t parseISOTimeToEpochMs(const char* isoString);
+
+// False for unparseable timestamps as well as out-of-range ones.
+bool isTimestampInRange(const char* isoString, int thresholdSeconds);
+bool isTimestampInRange(int64_t epochMs, int thresholdSeconds);
@@ -0,0 +1,93 @@
+#include "json_publish.h"
+
+#include "device_log.h"
+#include "device_time.h"
+
+namespace {
+// "-1.2345678e+300" and the longest 64-bit integers fit.
+constexpr size_t JSON_NUMBER_MAX_WIDTH = 21;
+// ,"timestamp":"2024-01-01T12:00:00.123Z"
+constexpr size_t TIMESTAMP_FIELD_SIZE = 40;
+
+// Only ever used from the loop task; static to keep it off the stack.
+char payload[JSON_PUBLISH_MAX_PAYLOAD];
+uint32_t oversizeCount = 0;
+size_t peakLength = 0;
+
+size_t numberSlack(JsonVariantConst value) {
+  if (value.is<JsonObjectConst>()) {
+    size_t slack = 0;
+    for (JsonPairConst pair : value.as<JsonObjectConst>()) {
+      slack += numberSlack(pair.value());
+    }
+    return slack;
+  }
+  if (value.is<JsonArrayConst>()) {
+    size_t slack = 0;
+    for (JsonVariantConst element : value.as<JsonArrayConst>()) {
+      slack += numberSlack(element);
+    }
+    return slack;
+  }
+  if (value.is<double>()) {
+    const size_t width = measureJson(value);
+    return width < JSON_NUMBER_MAX_WIDTH ? JSON_NUMBER_MAX_WIDTH - width : 0;
+  }
+  return 0;
+}
+}  // namespace
+
+bool publishJson(PubSubClient& client, const char* topic, JsonDocument& doc,
+                 bool retain) {
+  char timestamp[32];
+  formatCurrentTimestamp(timestamp, sizeof(timestamp));
+  doc["timestamp"] = timestamp;
+  // A document that ran out of memory has silently lost members.
+  if (doc.overflowed()) {
+    oversizeCount++;
+    LOG_ERROR("Message overflowed its JSON document [%s]", topic);
+    return false;
+  }
+
+  const size_t payloadLength = serializeJson(doc, payload, sizeof(payload));
+  if (payloadLength == 0 || payloadLength >= sizeof(payload) - 1) {
+    oversizeCount++;
+    LOG_ERROR("Message too large to serialize safely [%s]", topic);
+    return false;
+  }
+  if (payloadLength > peakLength) {
+    peakLength = payloadLength;
+  }
+
+  const bool published = client.publish(topic, payload, retain);
+  if (published) {
+    LOG_DEBUG("Message PUBLISHED [%s]: %s", topic, payload);
+  } else {
+    LOG_WARN("Message failed to publish ❌ [%s] payloadLength=%u", topic,
+             (unsigned)payloadLength);
+  }
+  return published;
+}
+
+size_t publishJsonWorstCaseSize(JsonDocument& doc) {
+  const size_t stamp = doc["timestamp"].isNull() ? TIMESTAMP_FIELD_SIZE : 0;
+  return measureJson(doc) + numberSlack(doc.as<JsonVariantConst>()) + stamp;
+}
+
+bool publishJsonFits(const char* topic, JsonDocument& doc) {
+  const size_t worstCase = publishJsonWorstCaseSize(doc);
+  if (worstCase >= JSON_PUBLISH_MAX_PAYLOAD - 1) {
+    LOG_ERROR("Message can reach %u bytes, over the %u byte limit [%s]",
+              (unsigned)worstCase, (unsigned)JSON_PUBLISH_MAX_PAYLOAD, topic);
+    return false;
+  }
+  return true;
+}
+
+uint32_t publishJsonOversizeCount() {
+  return oversizeCount;
+}
+
+size_t publishJsonPeak() {
+  return peakLength;
+}
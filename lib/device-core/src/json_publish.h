@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+
+// Largest serialized payload publishJson() accepts, timestamp included.
+#define JSON_PUBLISH_MAX_PAYLOAD 768
+// Longest topic any firmware builds (their topic buffers are 64 bytes).
+#define MQTT_MAX_TOPIC_LENGTH 64
+// For PubSubClient::setBufferSize(): fixed header, topic and the largest
+// payload. Received messages share this buffer.
+#define MQTT_PACKET_BUFFER_SIZE \
+  (JSON_PUBLISH_MAX_PAYLOAD + MQTT_MAX_TOPIC_LENGTH + 8)
+
+static_assert(MQTT_PACKET_BUFFER_SIZE >=
+                  MQTT_MAX_HEADER_SIZE + 2 + MQTT_MAX_TOPIC_LENGTH +
+                      JSON_PUBLISH_MAX_PAYLOAD,
+              "PubSubClient buffer cannot hold the largest publishJson()");
+
+// Stamps doc["timestamp"], serializes into a shared buffer and publishes.
+// Returns false if the document overflowed, the payload does not fit or
+// the publish fails.
+bool publishJson(PubSubClient& client, const char* topic, JsonDocument& doc,
+                 bool retain = true);
+
+// Size of `doc` once stamped, with every number at its widest. Builders of
+// messages with counters check this at startup, so a message that can
+// outgrow the buffer is reported before it is first dropped.
+size_t publishJsonWorstCaseSize(JsonDocument& doc);
+bool publishJsonFits(const char* topic, JsonDocument& doc);
+
+// Messages publishJson() dropped for being too large or overflowed, and
+// the largest payload it has sent, since boot.
+uint32_t publishJsonOversizeCount();
+size_t publishJsonPeak();
@@ -0,0 +1,54 @@
+#include "mqtt_topics.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+// Copies the segment starting at `segment` up to the next '/' and returns a
+// pointer just past that '/', or nullptr at the end of the topic.
+const char* copySegment(const char* segment, char* out, size_t size) {
+  const char* end = strchr(segment, '/');
+  size_t length = end ? static_cast<size_t>(end - segment) : strlen(segment);
+  if (out && size > 0) {
+    size_t copied = length < size - 1 ? length : size - 1;
+    memcpy(out, segment, copied);
+    out[copied] = '\0';
+  }
+  return end ? end + 1 : nullptr;
+}
+}  // namespace
+
+bool buildTopic(char* buffer, size_t size, const char* deviceId, int index,
+                const char* type, const char* action) {
+  int written =
+      action ? snprintf(buffer, size, "%s/%d/%s/%s", deviceId, index, type,
+                        action)
+             : snprintf(buffer, size, "%s/%d/%s", deviceId, index, type);
+  return written > 0 && static_cast<size_t>(written) < size;
+}
+
+bool parseTopic(const char* topic, TopicParts& parts) {
+  parts.index = -1;
+  parts.type[0] = '\0';
+  parts.action[0] = '\0';
+  if (!topic) {
+    return false;
+  }
+
+  const char* next = copySegment(topic, nullptr, 0);  // skip deviceId
+  if (!next) {
+    return false;
+  }
+  char index[8];
+  next = copySegment(next, index, sizeof(index));
+  parts.index = atoi(index);
+  if (!next) {
+    return false;
+  }
+  next = copySegment(next, parts.type, sizeof(parts.type));
+  if (next) {
+    copySegment(next, parts.action, sizeof(parts.action));
+  }
+  return true;
+}
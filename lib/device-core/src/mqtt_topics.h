@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stddef.h>
+
+// Topics are <deviceId>/<index>/<type>[/<action>], e.g.
+// esp32-1A2B/3/config/get.
+bool buildTopic(char* buffer, size_t size, const char* deviceId, int index,
+                const char* type, const char* action = nullptr);
+
+struct TopicParts {
+  int index;
+  char type[24];
+  char action[16];
+};
+
+// Single pass over the topic; index is -1 and type/action are empty when
+// the segment is missing.
+bool parseTopic(const char* topic, TopicParts& parts);
@@ -0,0 +1,109 @@
+#include "ota_patch.h"
+
+#include <string.h>
+
+namespace {
+constexpr size_t COPY_CHUNK_BYTES = 1024;
+constexpr char PATCH_MAGIC[] = "ODP1";
+
+enum PatchOp : uint8_t {
+  OP_LITERAL = 'L',
+  OP_COPY = 'C',
+  OP_END = 'E',
+};
+}  // namespace
+
+bool PatchApplier::feed(const uint8_t* data, size_t length) {
+  while (length > 0 && state_ != DONE) {
+    switch (state_) {
+      case MAGIC:
+        header_[headerLength_++] = *data++;
+        length--;
+        if (headerLength_ == 4) {
+          if (memcmp(header_, PATCH_MAGIC, 4) != 0) {
+            return fail("bad_patch");
+          }
+          state_ = OPCODE;
+        }
+        break;
+      case OPCODE:
+        op_ = *data++;
+        length--;
+        headerLength_ = 0;
+        if (op_ == OP_END) {
+          state_ = DONE;
+        } else if (op_ == OP_LITERAL || op_ == OP_COPY) {
+          state_ = ARGS;
+        } else {
+          return fail("bad_patch");
+        }
+        break;
+      case ARGS:
+        header_[headerLength_++] = *data++;
+        length--;
+        if (headerLength_ == (op_ == OP_COPY ? 8 : 4)) {
+          memcpy(&remaining_, header_, sizeof(remaining_));
+          if (op_ == OP_COPY) {
+            uint32_t offset;
+            memcpy(&offset, header_ + 4, sizeof(offset));
+            if (!copyFromBase(offset, remaining_)) {
+              return false;
+            }
+            state_ = OPCODE;
+          } else {
+            state_ = remaining_ > 0 ? LITERAL : OPCODE;
+          }
+        }
+        break;
+      case LITERAL: {
+        const size_t count = length < remaining_ ? length : remaining_;
+        if (!write(data, count)) {
+          return false;
+        }
+        data += count;
+        length -= count;
+        remaining_ -= count;
+        if (remaining_ == 0) {
+          state_ = OPCODE;
+        }
+        break;
+      }
+      case DONE:
+        break;
+    }
+  }
+  return true;
+}
+
+bool PatchApplier::fail(const char* error) {
+  error_ = error;
+  return false;
+}
+
+bool PatchApplier::write(const uint8_t* data, size_t length) {
+  if (!sink_.write(data, length)) {
+    return fail("write_failed");
+  }
+  written_ += length;
+  return true;
+}
+
+bool PatchApplier::copyFromBase(uint32_t offset, uint32_t length) {
+  const size_t baseSize = sink_.baseSize();
+  if (baseSize == 0 || offset > baseSize || length > baseSize - offset) {
+    return fail("bad_patch");
+  }
+  uint8_t chunk[COPY_CHUNK_BYTES];
+  while (length > 0) {
+    const size_t count = length < sizeof(chunk) ? length : sizeof(chunk);
+    if (!sink_.readBase(offset, chunk, count)) {
+      return fail("read_failed");
+    }
+    if (!write(chunk, count)) {
+      return false;
+    }
+    offset += count;
+    length -= count;
+  }
+  return true;
+}
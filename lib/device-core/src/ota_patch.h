@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Parser for the inflated OTA patch stream (see ota_update.h). It takes the
+// stream in whatever pieces the inflater hands over and turns it into
+// sequential image writes plus reads from the running image, so it needs
+// neither the flash nor the network and builds on the host.
+
+// Where the applier writes the new image and reads the running one.
+class PatchSink {
+ public:
+  virtual bool write(const uint8_t* data, size_t length) = 0;
+  virtual bool readBase(uint32_t offset, uint8_t* data, size_t length) = 0;
+  // 0 when there is no image to copy from.
+  virtual size_t baseSize() const = 0;
+
+ protected:
+  ~PatchSink() = default;
+};
+
+class PatchApplier {
+ public:
+  explicit PatchApplier(PatchSink& sink) : sink_(sink) {}
+
+  // Returns false on a malformed patch or a failed write or read; error()
+  // then says which. Bytes after the end op are ignored.
+  bool feed(const uint8_t* data, size_t length);
+
+  bool finished() const { return state_ == DONE; }
+  size_t written() const { return written_; }
+  const char* error() const { return error_; }
+
+ private:
+  enum State { MAGIC, OPCODE, ARGS, LITERAL, DONE };
+
+  bool fail(const char* error);
+  bool write(const uint8_t* data, size_t length);
+  bool copyFromBase(uint32_t offset, uint32_t length);
+
+  PatchSink& sink_;
+  State state_ = MAGIC;
+  uint8_t op_ = 0;
+  uint8_t header_[8];
+  size_t headerLength_ = 0;
+  uint32_t remaining_ = 0;
+  size_t written_ = 0;
+  const char* error_ = nullptr;
+};
@@ -0,0 +1,315 @@
+#include "ota_update.h"
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <Update.h>
+#include <WiFiClientSecure.h>
+#include <esp32/rom/miniz.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+#include <mbedtls/sha256.h>
+#include <string.h>
+
+#include "connectivity.h"
+#include "device_log.h"
+#include "json_publish.h"
+#include "ota_patch.h"
+
+namespace {
+constexpr unsigned long READ_TIMEOUT_MS = 15000;
+constexpr size_t INPUT_CHUNK_BYTES = 1024;
+
+constexpr size_t HASH_CHUNK_BYTES = 1024;
+constexpr size_t SHA256_BYTES = 32;
+
+// SHA-256 of an update that failed since boot, so a retained request is not
+// retried on every reconnect.
+char failedSha256[OTA_SHA256_HEX_LENGTH + 1] = "";
+
+void toHex(const uint8_t* digest, char* hex) {
+  for (size_t i = 0; i < SHA256_BYTES; i++) {
+    snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+  }
+}
+
+// Writes the new image through Update, hashing it on the way, and copies
+// from the running partition.
+class UpdateSink : public PatchSink {
+ public:
+  explicit UpdateSink(const esp_partition_t* base) : base_(base) {
+    mbedtls_sha256_init(&sha_);
+    mbedtls_sha256_starts(&sha_, 0);
+  }
+
+  ~UpdateSink() { mbedtls_sha256_free(&sha_); }
+
+  bool write(const uint8_t* data, size_t length) override {
+    if (Update.write(const_cast<uint8_t*>(data), length) != length) {
+      return false;
+    }
+    mbedtls_sha256_update(&sha_, data, length);
+    return true;
+  }
+
+  bool readBase(uint32_t offset, uint8_t* data, size_t length) override {
+    return esp_partition_read(base_, offset, data, length) == ESP_OK;
+  }
+
+  size_t baseSize() const override { return base_ ? base_->size : 0; }
+
+  bool matches(const char* expectedHex) {
+    uint8_t digest[SHA256_BYTES];
+    char hex[OTA_SHA256_HEX_LENGTH + 1];
+    mbedtls_sha256_finish(&sha_, digest);
+    toHex(digest, hex);
+    return strcasecmp(hex, expectedHex) == 0;
+  }
+
+ private:
+  const esp_partition_t* base_;
+  mbedtls_sha256_context sha_;
+};
+
+// Inflates the HTTP body through a 32 KB ring, which tinfl also uses as
+// its dictionary, and feeds each inflated run to the applier.
+const char* inflateInto(HTTPClient& http, PatchApplier& applier,
+                        size_t& received) {
+  tinfl_decompressor* inflator =
+      static_cast<tinfl_decompressor*>(malloc(sizeof(tinfl_decompressor)));
+  uint8_t* dictionary = static_cast<uint8_t*>(malloc(TINFL_LZ_DICT_SIZE));
+  if (!inflator || !dictionary) {
+    free(inflator);
+    free(dictionary);
+    return "no_memory";
+  }
+  tinfl_init(inflator);
+
+  WiFiClient* stream = http.getStreamPtr();
+  const int contentLength = http.getSize();
+  uint8_t input[INPUT_CHUNK_BYTES];
+  size_t inputLength = 0;
+  size_t inputPos = 0;
+  size_t dictionaryPos = 0;
+  bool endOfInput = false;
+  unsigned long lastDataAt = millis();
+  const char* error = nullptr;
+
+  while (!error) {
+    if (inputPos == inputLength && !endOfInput) {
+      const size_t available = stream->available();
+      if (available == 0) {
+        if (!stream->connected() ||
+            (contentLength >= 0 && received >= (size_t)contentLength)) {
+          endOfInput = true;
+        } else if (millis() - lastDataAt >= READ_TIMEOUT_MS) {
+          error = "timeout";
+          break;
+        } else {
+          delay(1);
+          continue;
+        }
+      } else {
+        inputLength = stream->readBytes(
+            input, available < sizeof(input) ? available : sizeof(input));
+        inputPos = 0;
+        received += inputLength;
+        lastDataAt = millis();
+        endOfInput =
+            contentLength >= 0 && received >= (size_t)contentLength;
+      }
+    }
+
+    size_t inBytes = inputLength - inputPos;
+    size_t outBytes = TINFL_LZ_DICT_SIZE - dictionaryPos;
+    const tinfl_status status = tinfl_decompress(
+        inflator, input + inputPos, &inBytes, dictionary,
+        dictionary + dictionaryPos, &outBytes,
+        TINFL_FLAG_PARSE_ZLIB_HEADER |
+            (endOfInput ? 0 : TINFL_FLAG_HAS_MORE_INPUT));
+    inputPos += inBytes;
+    if (outBytes > 0 &&
+        !applier.feed(dictionary + dictionaryPos, outBytes)) {
+      error = applier.error();
+      break;
+    }
+    dictionaryPos = (dictionaryPos + outBytes) & (TINFL_LZ_DICT_SIZE - 1);
+
+    if (status == TINFL_STATUS_DONE) {
+      break;
+    }
+    if (status < TINFL_STATUS_DONE ||
+        (status == TINFL_STATUS_NEEDS_MORE_INPUT && endOfInput &&
+         inputPos == inputLength)) {
+      error = "inflate_failed";
+    }
+  }
+
+  free(inflator);
+  free(dictionary);
+  return error;
+}
+
+bool publishState(PubSubClient& client, const char* stateTopic,
+                  const char* state, const OtaResult* result) {
+  JsonDocument doc;
+  doc["type"] = "ota";
+  JsonObject message = doc["message"].to<JsonObject>();
+  message["state"] = state;
+  message["sha256"] = otaRunningSha256();
+  if (result) {
+    if (result->error) {
+      message["error"] = result->error;
+    }
+    message["transferred"] = result->transferred;
+    message["written"] = result->written;
+    message["durationMs"] = result->durationMs;
+  }
+  return publishJson(client, stateTopic, doc, true);
+}
+}  // namespace
+
+const char* otaRunningSha256() {
+  static char hex[OTA_SHA256_HEX_LENGTH + 1] = "";
+  if (hex[0] != '\0') {
+    return hex;
+  }
+  // The same span ESP.getSketchMD5() hashes: the image without the padding
+  // to the end of the partition.
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  uint32_t remaining = ESP.getSketchSize();
+  uint32_t offset = 0;
+  uint8_t chunk[HASH_CHUNK_BYTES];
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts(&sha, 0);
+  while (remaining > 0) {
+    const size_t count = remaining < sizeof(chunk) ? remaining : sizeof(chunk);
+    if (esp_partition_read(running, offset, chunk, count) != ESP_OK) {
+      mbedtls_sha256_free(&sha);
+      return "";
+    }
+    mbedtls_sha256_update(&sha, chunk, count);
+    offset += count;
+    remaining -= count;
+  }
+  uint8_t digest[SHA256_BYTES];
+  mbedtls_sha256_finish(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  toHex(digest, hex);
+  return hex;
+}
+
+bool otaIsRunning(const char* sha256) {
+  return sha256 && strcasecmp(otaRunningSha256(), sha256) == 0;
+}
+
+OtaResult otaApply(const OtaRequest& request, const char* caCert) {
+  OtaResult result = {};
+  const unsigned long startedAt = millis();
+  const esp_partition_t* running = esp_ota_get_running_partition();
+
+  if (request.baseSha256 && !otaIsRunning(request.baseSha256)) {
+    result.error = "base_mismatch";
+    return result;
+  }
+
+  WiFiClientSecure secureClient;
+  WiFiClient plainClient;
+  HTTPClient http;
+  // HTTP/1.0 rules out chunked encoding, so the stream is the raw body.
+  http.useHTTP10(true);
+  http.setTimeout(READ_TIMEOUT_MS);
+  bool begun;
+  if (strncmp(request.url, "https://", 8) == 0) {
+    if (!caCert) {
+      LOG_WARN("⚠️ OTA server certificate not verified, relying on sha256");
+    }
+    configureTls(secureClient, caCert);
+    begun = http.begin(secureClient, request.url);
+  } else {
+    begun = http.begin(plainClient, request.url);
+  }
+  if (!begun || http.GET() != HTTP_CODE_OK) {
+    result.error = "http_failed";
+    http.end();
+    return result;
+  }
+
+  if (!Update.begin(request.size > 0 ? request.size : UPDATE_SIZE_UNKNOWN)) {
+    result.error = "no_space";
+    http.end();
+    return result;
+  }
+  UpdateSink sink(running);
+  PatchApplier applier(sink);
+  result.error = inflateInto(http, applier, result.transferred);
+  http.end();
+  result.written = applier.written();
+
+  if (!result.error && !applier.finished()) {
+    result.error = "bad_patch";
+  }
+  if (!result.error && !sink.matches(request.sha256)) {
+    result.error = "verify_failed";
+  }
+  if (!result.error && !Update.end(true)) {
+    result.error = "verify_failed";
+  }
+  if (result.error) {
+    Update.abort();
+  }
+  result.ok = result.error == nullptr;
+  result.durationMs = millis() - startedAt;
+  return result;
+}
+
+void otaHandleMessage(PubSubClient& client, const char* stateTopic,
+                      JsonVariantConst message, const char* caCert,
+                      OtaPrepareHook prepare) {
+  OtaRequest request = {
+      message["url"] | "",
+      message["sha256"].as<const char*>(),
+      message["baseSha256"].as<const char*>(),
+      message["size"] | 0u,
+  };
+  if (request.url[0] == '\0' || !request.sha256 ||
+      strlen(request.sha256) != OTA_SHA256_HEX_LENGTH) {
+    OtaResult invalid = {false, "bad_request", 0, 0, 0};
+    publishState(client, stateTopic, "failed", &invalid);
+    return;
+  }
+  if (otaIsRunning(request.sha256) ||
+      strcasecmp(failedSha256, request.sha256) == 0) {
+    return;
+  }
+
+  LOG_INFO("OTA update to %s from %s", request.sha256, request.url);
+  if (prepare) {
+    prepare();
+  }
+  // No client.loop() from here on: it could deliver another message into
+  // the document `message` points into.
+  publishState(client, stateTopic, "updating", nullptr);
+
+  const OtaResult result = otaApply(request, caCert);
+  if (!result.ok) {
+    LOG_ERROR("OTA update failed: %s", result.error);
+    snprintf(failedSha256, sizeof(failedSha256), "%s", request.sha256);
+    publishState(client, stateTopic, "failed", &result);
+    return;
+  }
+
+  LOG_INFO("✅ OTA update written (%u bytes in %lu ms), restarting",
+           (unsigned)result.transferred, result.durationMs);
+  publishState(client, stateTopic, "restarting", &result);
+  logFlush();
+  delay(100);
+  ESP.restart();
+}
+
+void otaPublishRunning(PubSubClient& client, const char* stateTopic) {
+  static bool published = false;
+  if (!published) {
+    published = publishState(client, stateTopic, "running", nullptr);
+  }
+}
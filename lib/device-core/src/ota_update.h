@@ -0,0 +1,63 @@
+#pragma once
+
+#include <ArduinoJson.h>
+#include <PubSubClient.h>
+#include <stddef.h>
+
+// Over-the-air updates from a zlib-compressed patch served over HTTP(S).
+// The patch inflates to "ODP1" followed by ops, each streamed straight
+// into the inactive OTA partition without holding the image in RAM:
+//
+//   'L' uint32 length, <length> bytes   literal image bytes
+//   'C' uint32 length, uint32 offset    copy from the running image
+//   'E'                                 end
+//
+// A full image is a single 'L' op; a delta built against the running image
+// copies the unchanged runs. server/otaPatch.js builds both. The image is
+// hashed as it is written and only marked bootable if its SHA-256 matches
+// the one in the MQTT message, so a tampered or corrupted download is
+// refused whichever server it came from.
+
+#define OTA_SHA256_HEX_LENGTH 64
+
+struct OtaRequest {
+  const char* url;
+  const char* sha256;      // of the new image, hex
+  const char* baseSha256;  // image the delta was built against, nullptr if full
+  size_t size;             // new image size, 0 if unknown
+};
+
+struct OtaResult {
+  bool ok;
+  const char* error;
+  size_t transferred;  // patch bytes received
+  size_t written;      // image bytes written
+  unsigned long durationMs;
+};
+
+// Runs before the download starts, e.g. to put outputs in a safe state.
+typedef void (*OtaPrepareHook)();
+
+// SHA-256 of the running image in hex, as sha256sum prints it for the .bin.
+// Computed on first use.
+const char* otaRunningSha256();
+bool otaIsRunning(const char* sha256);
+
+// Blocks until the image is written and verified, or the update fails.
+// caCert verifies an https server. Firmwares pass the broker's pinned CA
+// unless OTA_CA_CERT names the backend's; with nullptr the connection is
+// encrypted but unauthenticated and only the SHA-256 check guards the
+// image.
+OtaResult otaApply(const OtaRequest& request, const char* caCert);
+
+// Handles an `ota` message {url, sha256, baseSha256?, size?}. A request for the
+// image already running is ignored, so the message can be retained and
+// reach devices that were asleep or offline when it was sent. Progress and
+// the result go to stateTopic; on success the device restarts.
+void otaHandleMessage(PubSubClient& client, const char* stateTopic,
+                      JsonVariantConst message, const char* caCert,
+                      OtaPrepareHook prepare = nullptr);
+
+// Retained report of the running image. Call after each connect; it
+// publishes once per boot so a failure report survives reconnects.
+void otaPublishRunning(PubSubClient& client, const char* stateTopic);
@@ -0,0 +1,10 @@
+#include "tls_client.h"
+
+void configureTls(WiFiClientSecure& tlsClient, const char* caCert) {
+  if (caCert) {
+    tlsClient.setCACert(caCert);
+  } else {
+    tlsClient.setInsecure();  // For testing with self-signed cert
+  }
+  tlsClient.setHandshakeTimeout(TLS_HANDSHAKE_TIMEOUT_SECONDS);
+}
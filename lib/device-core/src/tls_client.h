@@ -0,0 +1,10 @@
+#pragma once
+
+#include <WiFiClientSecure.h>
+
+// WiFiClientSecure defaults to 120s, which would stall valve handling.
+constexpr unsigned long TLS_HANDSHAKE_TIMEOUT_SECONDS = 10;
+
+// Verifies the broker against caCert, or connects insecurely when it is
+// nullptr. Bounds the handshake so a stalled broker cannot hang the loop.
+void configureTls(WiFiClientSecure& tlsClient, const char* caCert);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// Association and DHCP lease from the last connect, typically kept in RTC
+// memory so the next boot can skip the scan and DHCP.
+struct WiFiCache {
+  uint8_t bssid[6];
+  int32_t channel;
+  uint32_t localIp;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
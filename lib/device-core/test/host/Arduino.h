@@ -0,0 +1,89 @@
+#pragma once
+
+// The parts of the Arduino core the host-tested sources use. Time runs on
+// the host clock; NTP is never configured. Pins and the GPIO registers in
+// soc/ are plain memory, driver/pcnt.h counts pulses tests hand it, and
+// Preferences.h keeps NVS in RAM.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Tests move time forward without sleeping through hostAdvanceMillis().
+inline unsigned long& hostMillisOffset() {
+  static unsigned long offset = 0;
+  return offset;
+}
+
+inline void hostAdvanceMillis(unsigned long ms) {
+  hostMillisOffset() += ms;
+}
+
+inline unsigned long millis() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<unsigned long>(now.tv_sec * 1000 + now.tv_nsec / 1000000) +
+         hostMillisOffset();
+}
+
+inline unsigned long micros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return static_cast<unsigned long>(now.tv_sec * 1000000 + now.tv_nsec / 1000);
+}
+
+inline void delay(unsigned long ms) {
+  struct timespec wait = {static_cast<time_t>(ms / 1000),
+                          static_cast<long>((ms % 1000) * 1000000)};
+  nanosleep(&wait, nullptr);
+}
+
+inline void delayMicroseconds(unsigned int) {}
+
+#define IRAM_ATTR
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+// Output pins only remember their level; tests that need to react to a
+// clock edge install a hook.
+typedef void (*HostPinHook)(uint8_t pin, uint8_t level);
+
+inline HostPinHook& hostPinHook() {
+  static HostPinHook hook = nullptr;
+  return hook;
+}
+
+inline uint8_t* hostPinLevels() {
+  static uint8_t levels[40];
+  return levels;
+}
+
+inline void pinMode(uint8_t, uint8_t) {}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+  hostPinLevels()[pin] = level;
+  if (hostPinHook()) {
+    hostPinHook()(pin, level);
+  }
+}
+
+inline int digitalRead(uint8_t pin) {
+  return hostPinLevels()[pin];
+}
+
+// LEDC output is not modelled; flow meter tests feed PCNT directly.
+inline void ledcSetup(uint8_t, uint32_t, uint8_t) {}
+inline void ledcAttachPin(uint8_t, uint8_t) {}
+inline void ledcWrite(uint8_t, uint32_t) {}
+
+inline void configTime(long, int, const char*) {}
+
+inline bool getLocalTime(struct tm* info) {
+  time_t now = time(nullptr);
+  localtime_r(&now, info);
+  return true;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+// In-memory NVS for host tests. Every namespace lives for the whole test
+// binary; preferencesReset() wipes them between tests, and
+// preferencesWriteCount() counts the puts that reached "flash".
+#include <map>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace host_nvs {
+typedef std::map<std::string, std::vector<uint8_t>> Namespace;
+
+inline std::map<std::string, Namespace>& store() {
+  static std::map<std::string, Namespace> namespaces;
+  return namespaces;
+}
+
+inline unsigned long& writes() {
+  static unsigned long count = 0;
+  return count;
+}
+}  // namespace host_nvs
+
+inline void preferencesReset() {
+  host_nvs::store().clear();
+  host_nvs::writes() = 0;
+}
+
+inline unsigned long preferencesWriteCount() {
+  return host_nvs::writes();
+}
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false) {
+    space_ = &host_nvs::store()[name];
+    readOnly_ = readOnly;
+    return true;
+  }
+
+  void end() { space_ = nullptr; }
+
+  bool isKey(const char* key) {
+    return space_ && space_->count(key) > 0;
+  }
+
+  bool remove(const char* key) {
+    return space_ && !readOnly_ && space_->erase(key) > 0;
+  }
+
+  bool clear() {
+    if (!space_ || readOnly_) {
+      return false;
+    }
+    space_->clear();
+    return true;
+  }
+
+  size_t putBytes(const char* key, const void* value, size_t length) {
+    if (!space_ || readOnly_) {
+      return 0;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    (*space_)[key].assign(bytes, bytes + length);
+    host_nvs::writes()++;
+    return length;
+  }
+
+  size_t getBytesLength(const char* key) {
+    const std::vector<uint8_t>* value = find(key);
+    return value ? value->size() : 0;
+  }
+
+  size_t getBytes(const char* key, void* buffer, size_t maxLength) {
+    const std::vector<uint8_t>* value = find(key);
+    if (!value || value->size() > maxLength) {
+      return 0;
+    }
+    memcpy(buffer, value->data(), value->size());
+    return value->size();
+  }
+
+  size_t putInt(const char* key, int32_t value) {
+    return putBytes(key, &value, sizeof(value));
+  }
+  int32_t getInt(const char* key, int32_t fallback = 0) {
+    return get(key, fallback);
+  }
+  size_t putUInt(const char* key, uint32_t value) {
+    return putBytes(key, &value, sizeof(value));
+  }
+  uint32_t getUInt(const char* key, uint32_t fallback = 0) {
+    return get(key, fallback);
+  }
+  size_t putFloat(const char* key, float value) {
+    return putBytes(key, &value, sizeof(value));
+  }
+  float getFloat(const char* key, float fallback = 0) {
+    return get(key, fallback);
+  }
+  size_t putBool(const char* key, bool value) {
+    const uint8_t stored = value;
+    return putBytes(key, &stored, sizeof(stored));
+  }
+  bool getBool(const char* key, bool fallback = false) {
+    return get<uint8_t>(key, fallback) != 0;
+  }
+
+ private:
+  const std::vector<uint8_t>* find(const char* key) {
+    if (!space_) {
+      return nullptr;
+    }
+    auto entry = space_->find(key);
+    return entry == space_->end() ? nullptr : &entry->second;
+  }
+
+  template <typename T>
+  T get(const char* key, T fallback) {
+    T value;
+    return getBytes(key, &value, sizeof(value)) == sizeof(value) ? value
+                                                                  : fallback;
+  }
+
+  host_nvs::Namespace* space_ = nullptr;
+  bool readOnly_ = false;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+// A TLS client with no network behind it. connect() completes at once
+// unless the test stalls the broker; then the handshake hangs until its
+// timeout, which on the host moves millis() on by that much, and fails.
+// Like arduino-esp32 the timeout defaults to 120 s.
+#include <Arduino.h>
+
+inline bool& hostTlsBrokerStalled() {
+  static bool stalled = false;
+  return stalled;
+}
+
+class WiFiClientSecure {
+ public:
+  void setCACert(const char* rootCA) {
+    caCert_ = rootCA;
+    insecure_ = false;
+  }
+  void setInsecure() {
+    caCert_ = nullptr;
+    insecure_ = true;
+  }
+  void setHandshakeTimeout(unsigned long seconds) {
+    handshakeTimeoutSeconds_ = seconds;
+  }
+
+  int connect(const char*, uint16_t) {
+    if (hostTlsBrokerStalled()) {
+      hostAdvanceMillis(handshakeTimeoutSeconds_ * 1000UL);
+      connected_ = false;
+      return 0;
+    }
+    connected_ = true;
+    return 1;
+  }
+  uint8_t connected() { return connected_; }
+  void stop() { connected_ = false; }
+
+  const char* hostCaCert() const { return caCert_; }
+  bool hostInsecure() const { return insecure_; }
+
+ private:
+  const char* caCert_ = nullptr;
+  bool insecure_ = false;
+  bool connected_ = false;
+  unsigned long handshakeTimeoutSeconds_ = 120;
+};
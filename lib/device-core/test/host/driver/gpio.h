@@ -0,0 +1,14 @@
+#pragma once
+
+// Pin direction is not modelled; levels live in Arduino.h.
+typedef int gpio_num_t;
+
+enum gpio_mode_t {
+  GPIO_MODE_INPUT,
+  GPIO_MODE_OUTPUT,
+  GPIO_MODE_INPUT_OUTPUT,
+};
+
+inline int gpio_set_direction(gpio_num_t, gpio_mode_t) {
+  return 0;
+}
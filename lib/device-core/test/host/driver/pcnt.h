@@ -0,0 +1,174 @@
+#pragma once
+
+// PCNT units as plain counters that tests feed with hostPcntPulses(). Like
+// the hardware, a unit restarts from 0 at its high limit, and each pulse
+// that lands on an enabled event calls the unit's handler with that event
+// latched in the status pcnt_get_event_status() returns.
+#include <stdint.h>
+
+typedef int esp_err_t;
+
+enum pcnt_unit_t {
+  PCNT_UNIT_0,
+  PCNT_UNIT_1,
+  PCNT_UNIT_2,
+  PCNT_UNIT_3,
+  PCNT_UNIT_4,
+  PCNT_UNIT_5,
+  PCNT_UNIT_6,
+  PCNT_UNIT_7,
+  PCNT_UNIT_MAX,
+};
+
+enum pcnt_channel_t {
+  PCNT_CHANNEL_0,
+  PCNT_CHANNEL_1,
+};
+
+enum pcnt_count_mode_t {
+  PCNT_COUNT_DIS,
+  PCNT_COUNT_INC,
+  PCNT_COUNT_DEC,
+};
+
+enum pcnt_ctrl_mode_t {
+  PCNT_MODE_KEEP,
+  PCNT_MODE_REVERSE,
+  PCNT_MODE_DISABLE,
+};
+
+enum pcnt_evt_type_t {
+  PCNT_EVT_THRES_1 = 0x04,
+  PCNT_EVT_THRES_0 = 0x08,
+  PCNT_EVT_L_LIM = 0x10,
+  PCNT_EVT_H_LIM = 0x20,
+  PCNT_EVT_ZERO = 0x40,
+};
+
+#define PCNT_PIN_NOT_USED (-1)
+
+struct pcnt_config_t {
+  int pulse_gpio_num;
+  int ctrl_gpio_num;
+  pcnt_ctrl_mode_t lctrl_mode;
+  pcnt_ctrl_mode_t hctrl_mode;
+  pcnt_count_mode_t pos_mode;
+  pcnt_count_mode_t neg_mode;
+  int16_t counter_h_lim;
+  int16_t counter_l_lim;
+  pcnt_unit_t unit;
+  pcnt_channel_t channel;
+};
+
+struct HostPcntUnit {
+  int16_t count;
+  int16_t highLimit;
+  int16_t threshold0;
+  uint32_t enabledEvents;
+  uint32_t status;
+  bool running;
+  void (*handler)(void*);
+  void* handlerArg;
+};
+
+inline HostPcntUnit* hostPcntUnits() {
+  static HostPcntUnit units[PCNT_UNIT_MAX];
+  return units;
+}
+
+inline void hostPcntReset() {
+  for (int i = 0; i < PCNT_UNIT_MAX; i++) {
+    hostPcntUnits()[i] = HostPcntUnit();
+  }
+}
+
+// Rising edges on the unit's pulse pin; ignored while it is paused.
+inline void hostPcntPulses(pcnt_unit_t unit, uint32_t pulses) {
+  HostPcntUnit& u = hostPcntUnits()[unit];
+  for (uint32_t i = 0; i < pulses && u.running; i++) {
+    u.count++;
+    uint32_t events = 0;
+    if ((u.enabledEvents & PCNT_EVT_THRES_0) && u.count == u.threshold0) {
+      events |= PCNT_EVT_THRES_0;
+    }
+    if ((u.enabledEvents & PCNT_EVT_H_LIM) && u.count == u.highLimit) {
+      events |= PCNT_EVT_H_LIM;
+    }
+    if (u.count == u.highLimit) {
+      u.count = 0;
+    }
+    if (events && u.handler) {
+      u.status = events;
+      u.handler(u.handlerArg);
+    }
+  }
+}
+
+inline esp_err_t pcnt_isr_service_install(int) {
+  return 0;
+}
+
+inline esp_err_t pcnt_unit_config(const pcnt_config_t* config) {
+  HostPcntUnit& u = hostPcntUnits()[config->unit];
+  u.highLimit = config->counter_h_lim;
+  u.count = 0;
+  return 0;
+}
+
+inline esp_err_t pcnt_set_filter_value(pcnt_unit_t, uint16_t) {
+  return 0;
+}
+
+inline esp_err_t pcnt_filter_enable(pcnt_unit_t) {
+  return 0;
+}
+
+inline esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t event) {
+  hostPcntUnits()[unit].enabledEvents |= event;
+  return 0;
+}
+
+inline esp_err_t pcnt_event_disable(pcnt_unit_t unit, pcnt_evt_type_t event) {
+  hostPcntUnits()[unit].enabledEvents &= ~static_cast<uint32_t>(event);
+  return 0;
+}
+
+inline esp_err_t pcnt_set_event_value(pcnt_unit_t unit, pcnt_evt_type_t event,
+                                      int16_t value) {
+  if (event == PCNT_EVT_THRES_0) {
+    hostPcntUnits()[unit].threshold0 = value;
+  }
+  return 0;
+}
+
+inline esp_err_t pcnt_isr_handler_add(pcnt_unit_t unit, void (*handler)(void*),
+                                      void* arg) {
+  hostPcntUnits()[unit].handler = handler;
+  hostPcntUnits()[unit].handlerArg = arg;
+  return 0;
+}
+
+inline esp_err_t pcnt_get_event_status(pcnt_unit_t unit, uint32_t* status) {
+  *status = hostPcntUnits()[unit].status;
+  return 0;
+}
+
+inline esp_err_t pcnt_counter_pause(pcnt_unit_t unit) {
+  hostPcntUnits()[unit].running = false;
+  return 0;
+}
+
+inline esp_err_t pcnt_counter_resume(pcnt_unit_t unit) {
+  hostPcntUnits()[unit].running = true;
+  return 0;
+}
+
+inline esp_err_t pcnt_counter_clear(pcnt_unit_t unit) {
+  hostPcntUnits()[unit].count = 0;
+  return 0;
+}
+
+inline esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t* count) {
+  *count = hostPcntUnits()[unit].count;
+  return 0;
+}
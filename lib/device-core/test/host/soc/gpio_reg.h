@@ -0,0 +1,8 @@
+#pragma once
+
+#include "soc.h"
+
+#define GPIO_IN_REG 0u          // GPIO 0-31
+#define GPIO_IN1_REG 1u         // GPIO 32-39
+#define GPIO_OUT_W1TC_REG 2u    // GPIO 0-31
+#define GPIO_OUT1_W1TC_REG 3u   // GPIO 32-39
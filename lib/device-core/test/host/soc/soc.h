@@ -0,0 +1,41 @@
+#pragma once
+
+// GPIO registers as plain variables that tests drive directly, or refresh
+// from a hook just before each read. The two write-1-to-clear output
+// registers also drop the pins they name, as digitalWrite(pin, LOW) would.
+#include <Arduino.h>
+#include <stdint.h>
+
+inline uint32_t& hostRegister(uint32_t address) {
+  static uint32_t registers[4];
+  return registers[address & 3];
+}
+
+typedef void (*HostRegisterHook)(uint32_t address);
+
+inline HostRegisterHook& hostRegisterReadHook() {
+  static HostRegisterHook hook = nullptr;
+  return hook;
+}
+
+inline uint32_t hostRegisterRead(uint32_t address) {
+  if (hostRegisterReadHook()) {
+    hostRegisterReadHook()(address);
+  }
+  return hostRegister(address);
+}
+
+inline void hostRegisterWrite(uint32_t address, uint32_t value) {
+  hostRegister(address) = value;
+  if (address & 2) {
+    const uint8_t firstPin = (address & 1) ? 32 : 0;
+    for (uint8_t bit = 0; bit < 32 && firstPin + bit < 40; bit++) {
+      if (value & (1UL << bit)) {
+        digitalWrite(firstPin + bit, LOW);
+      }
+    }
+  }
+}
+
+#define REG_READ(address) (hostRegisterRead(address))
+#define REG_WRITE(address, value) (hostRegisterWrite((address), (value)))
@@ -0,0 +1,128 @@
+#include <unity.h>
+
+#include <string.h>
+
+#include "arena_allocator.h"
+
+constexpr size_t ALIGNMENT = alignof(max_align_t);
+
+alignas(max_align_t) uint8_t buffer[256];
+ArenaAllocator* arena;
+
+void setUp() {
+  static ArenaAllocator instance(buffer, sizeof(buffer));
+  instance.reset();
+  arena = &instance;
+}
+void tearDown() {}
+
+bool inBuffer(const void* ptr, size_t size) {
+  const uint8_t* p = static_cast<const uint8_t*>(ptr);
+  return p >= buffer && p + size <= buffer + sizeof(buffer);
+}
+
+void test_blocks_are_aligned_and_disjoint() {
+  uint8_t* a = static_cast<uint8_t*>(arena->allocate(3));
+  uint8_t* b = static_cast<uint8_t*>(arena->allocate(5));
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(a) % ALIGNMENT);
+  TEST_ASSERT_EQUAL(0, reinterpret_cast<uintptr_t>(b) % ALIGNMENT);
+  TEST_ASSERT_TRUE(b >= a + 3);
+  TEST_ASSERT_TRUE(inBuffer(b, 5));
+}
+
+void test_exhaustion_returns_null() {
+  TEST_ASSERT_NULL(arena->allocate(sizeof(buffer)));
+  // A block that fits still succeeds after a failed one.
+  TEST_ASSERT_NOT_NULL(arena->allocate(16));
+  void* last = nullptr;
+  while (void* block = arena->allocate(16)) {
+    last = block;
+  }
+  TEST_ASSERT_TRUE(inBuffer(last, 16));
+  TEST_ASSERT_TRUE(arena->peak() <= arena->capacity());
+}
+
+void test_deallocate_releases_only_the_last_block() {
+  void* a = arena->allocate(32);
+  void* b = arena->allocate(32);
+  arena->deallocate(b);
+  // b's space is reused.
+  TEST_ASSERT_EQUAL_PTR(b, arena->allocate(32));
+  arena->deallocate(a);
+  // a was not the last block, so nothing moved.
+  void* c = arena->allocate(8);
+  TEST_ASSERT_TRUE(static_cast<uint8_t*>(c) > static_cast<uint8_t*>(b));
+}
+
+void test_reallocate_last_block_grows_in_place() {
+  uint8_t* a = static_cast<uint8_t*>(arena->allocate(8));
+  memset(a, 0xAB, 8);
+  uint8_t* grown = static_cast<uint8_t*>(arena->reallocate(a, 40));
+  TEST_ASSERT_EQUAL_PTR(a, grown);
+  TEST_ASSERT_EQUAL_HEX8(0xAB, grown[7]);
+  // Shrinking never moves.
+  TEST_ASSERT_EQUAL_PTR(a, arena->reallocate(a, 4));
+}
+
+void test_reallocate_earlier_block_moves_and_copies() {
+  uint8_t* a = static_cast<uint8_t*>(arena->allocate(8));
+  for (int i = 0; i < 8; i++) {
+    a[i] = static_cast<uint8_t>(i);
+  }
+  arena->allocate(8);
+  uint8_t* moved = static_cast<uint8_t*>(arena->reallocate(a, 24));
+  TEST_ASSERT_NOT_NULL(moved);
+  TEST_ASSERT_TRUE(moved != a);
+  for (int i = 0; i < 8; i++) {
+    TEST_ASSERT_EQUAL_UINT8(i, moved[i]);
+  }
+}
+
+void test_reallocate_past_capacity_fails() {
+  void* a = arena->allocate(8);
+  TEST_ASSERT_NULL(arena->reallocate(a, sizeof(buffer)));
+  TEST_ASSERT_NULL(arena->reallocate(nullptr, sizeof(buffer)));
+}
+
+void test_reset_rewinds_but_keeps_peak() {
+  void* first = arena->allocate(64);
+  arena->allocate(64);
+  const size_t peak = arena->peak();
+  TEST_ASSERT_TRUE(peak >= 128);
+  arena->reset();
+  TEST_ASSERT_EQUAL_PTR(first, arena->allocate(8));
+  TEST_ASSERT_EQUAL(peak, arena->peak());
+}
+
+void test_document_never_exceeds_its_arena() {
+  // Room for one slot pool, but not for a string longer than the arena.
+  static ArenaJsonDocument<4096> small;
+  static char oversized[4096 + 32];
+  memcpy(oversized, "{\"message\":\"", 12);
+  memset(oversized + 12, 'x', 4096);
+  memcpy(oversized + 12 + 4096, "\"}", 3);
+  JsonDocument& doc = small.acquire();
+  DeserializationError error = deserializeJson(doc, oversized);
+  TEST_ASSERT_EQUAL(DeserializationError::NoMemory, error.code());
+  TEST_ASSERT_TRUE(small.arena().peak() <= 4096);
+
+  // acquire() rewinds, so a message that fits parses afterwards.
+  JsonDocument& again = small.acquire();
+  TEST_ASSERT_FALSE(deserializeJson(again, "{\"message\":\"HIGH\"}"));
+  TEST_ASSERT_EQUAL_STRING("HIGH", again["message"].as<const char*>());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_blocks_are_aligned_and_disjoint);
+  RUN_TEST(test_exhaustion_returns_null);
+  RUN_TEST(test_deallocate_releases_only_the_last_block);
+  RUN_TEST(test_reallocate_last_block_grows_in_place);
+  RUN_TEST(test_reallocate_earlier_block_moves_and_copies);
+  RUN_TEST(test_reallocate_past_capacity_fails);
+  RUN_TEST(test_reset_rewinds_but_keeps_peak);
+  RUN_TEST(test_document_never_exceeds_its_arena);
+  return UNITY_END();
+}
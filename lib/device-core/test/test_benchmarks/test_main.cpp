@@ -0,0 +1,73 @@
+// Host timings of the per-message helpers. They report rather than assert:
+// host numbers only compare changes against each other, not the ESP32.
+#include <unity.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#include "arena_allocator.h"
+#include "device_time.h"
+#include "mqtt_topics.h"
+
+constexpr int ITERATIONS = 200000;
+
+void setUp() {}
+void tearDown() {}
+
+double nowNs() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+void report(const char* name, double startedNs) {
+  char line[96];
+  snprintf(line, sizeof(line), "%s: %.1f ns/op", name,
+           (nowNs() - startedNs) / ITERATIONS);
+  TEST_MESSAGE(line);
+}
+
+void bench_build_and_parse_topic() {
+  char topic[64];
+  TopicParts parts;
+  int checksum = 0;
+  const double started = nowNs();
+  for (int i = 0; i < ITERATIONS; i++) {
+    buildTopic(topic, sizeof(topic), "esp32-1A2B", i & 3, "config", "get");
+    parseTopic(topic, parts);
+    checksum += parts.index;
+  }
+  report("buildTopic+parseTopic", started);
+  TEST_ASSERT_TRUE(checksum > 0);
+}
+
+void bench_parse_timestamp() {
+  int64_t checksum = 0;
+  const double started = nowNs();
+  for (int i = 0; i < ITERATIONS; i++) {
+    checksum += parseISOTimeToEpochMs("2024-01-01T12:00:00.123Z");
+  }
+  report("parseISOTimeToEpochMs", started);
+  TEST_ASSERT_TRUE(checksum != 0);
+}
+
+void bench_arena_document() {
+  static ArenaJsonDocument<4096> arenaDoc;
+  size_t checksum = 0;
+  const double started = nowNs();
+  for (int i = 0; i < ITERATIONS; i++) {
+    JsonDocument& doc = arenaDoc.acquire();
+    deserializeJson(doc, "{\"message\":\"HIGH\",\"commandId\":\"3f1c9a52\"}");
+    checksum += doc["message"].as<const char*>()[0];
+  }
+  report("ArenaJsonDocument acquire+deserialize", started);
+  TEST_ASSERT_TRUE(checksum > 0);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(bench_build_and_parse_topic);
+  RUN_TEST(bench_parse_timestamp);
+  RUN_TEST(bench_arena_document);
+  return UNITY_END();
+}
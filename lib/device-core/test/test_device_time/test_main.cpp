@@ -0,0 +1,84 @@
+#include <unity.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "device_time.h"
+
+// 2024-01-01T12:00:00Z
+constexpr int64_t NEW_YEAR_NOON_MS = 1704110400000LL;
+
+void setUp() {
+  setenv("TZ", "UTC0", 1);
+  tzset();
+}
+void tearDown() {}
+
+void test_parse_with_milliseconds() {
+  TEST_ASSERT_EQUAL_INT64(NEW_YEAR_NOON_MS + 123,
+                          parseISOTimeToEpochMs("2024-01-01T12:00:00.123Z"));
+}
+
+void test_parse_without_fraction() {
+  TEST_ASSERT_EQUAL_INT64(NEW_YEAR_NOON_MS,
+                          parseISOTimeToEpochMs("2024-01-01T12:00:00Z"));
+}
+
+void test_parse_short_and_long_fractions() {
+  TEST_ASSERT_EQUAL_INT64(NEW_YEAR_NOON_MS + 500,
+                          parseISOTimeToEpochMs("2024-01-01T12:00:00.5Z"));
+  // Digits past milliseconds are dropped, not rounded.
+  TEST_ASSERT_EQUAL_INT64(NEW_YEAR_NOON_MS + 123,
+                          parseISOTimeToEpochMs("2024-01-01T12:00:00.123999Z"));
+}
+
+void test_parse_invalid() {
+  TEST_ASSERT_EQUAL_INT64(0, parseISOTimeToEpochMs(nullptr));
+  TEST_ASSERT_EQUAL_INT64(0, parseISOTimeToEpochMs(""));
+  TEST_ASSERT_EQUAL_INT64(0, parseISOTimeToEpochMs("unknown"));
+  TEST_ASSERT_EQUAL_INT64(0, parseISOTimeToEpochMs("2024-01-01"));
+}
+
+void test_parse_is_utc_in_any_zone() {
+  // The conversion must not depend on the zone the clock was set up in,
+  // including across a DST change.
+  setenv("TZ", "CET-1CEST,M3.5.0,M10.5.0/3", 1);
+  tzset();
+  TEST_ASSERT_EQUAL_INT64(NEW_YEAR_NOON_MS,
+                          parseISOTimeToEpochMs("2024-01-01T12:00:00Z"));
+  TEST_ASSERT_EQUAL_INT64(1719835200000LL,
+                          parseISOTimeToEpochMs("2024-07-01T12:00:00Z"));
+}
+
+void test_format_round_trips() {
+  char timestamp[32];
+  TEST_ASSERT_TRUE(formatCurrentTimestamp(timestamp, sizeof(timestamp)));
+  TEST_ASSERT_EQUAL(24, strlen(timestamp));
+  TEST_ASSERT_EQUAL('Z', timestamp[23]);
+  const int64_t parsed = parseISOTimeToEpochMs(timestamp);
+  TEST_ASSERT_INT64_WITHIN(1000, currentEpochMs(), parsed);
+}
+
+void test_range_check() {
+  const int64_t now = currentEpochMs();
+  TEST_ASSERT_TRUE(isTimestampInRange(now, 5));
+  TEST_ASSERT_TRUE(isTimestampInRange(now - 4000, 5));
+  TEST_ASSERT_FALSE(isTimestampInRange(now - 6000, 5));
+  TEST_ASSERT_FALSE(isTimestampInRange(now + 6000, 5));
+  TEST_ASSERT_FALSE(isTimestampInRange(static_cast<int64_t>(0), 5));
+  TEST_ASSERT_FALSE(isTimestampInRange("unknown", 5));
+  TEST_ASSERT_FALSE(isTimestampInRange("2024-01-01T12:00:00.000Z", 5));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_parse_with_milliseconds);
+  RUN_TEST(test_parse_without_fraction);
+  RUN_TEST(test_parse_short_and_long_fractions);
+  RUN_TEST(test_parse_invalid);
+  RUN_TEST(test_parse_is_utc_in_any_zone);
+  RUN_TEST(test_format_round_trips);
+  RUN_TEST(test_range_check);
+  return UNITY_END();
+}
@@ -0,0 +1,95 @@
+#include <unity.h>
+
+#include <string.h>
+
+#include "mqtt_topics.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_build_without_action() {
+  char topic[64];
+  TEST_ASSERT_TRUE(buildTopic(topic, sizeof(topic), "esp32-1A2B", 3, "config"));
+  TEST_ASSERT_EQUAL_STRING("esp32-1A2B/3/config", topic);
+}
+
+void test_build_with_action() {
+  char topic[64];
+  TEST_ASSERT_TRUE(
+      buildTopic(topic, sizeof(topic), "esp32-1A2B", 0, "ota", "state"));
+  TEST_ASSERT_EQUAL_STRING("esp32-1A2B/0/ota/state", topic);
+}
+
+void test_build_rejects_truncation() {
+  char topic[12];
+  TEST_ASSERT_FALSE(buildTopic(topic, sizeof(topic), "esp32-1A2B", 3, "config"));
+  // Still terminated, never overrun.
+  TEST_ASSERT_EQUAL(11, strlen(topic));
+}
+
+void test_build_exact_fit() {
+  // "d/1/status" is 10 characters plus the terminator.
+  char topic[11];
+  TEST_ASSERT_TRUE(buildTopic(topic, sizeof(topic), "d", 1, "status"));
+  TEST_ASSERT_FALSE(buildTopic(topic, sizeof(topic) - 1, "d", 1, "status"));
+}
+
+void test_parse_type_and_action() {
+  TopicParts parts;
+  TEST_ASSERT_TRUE(parseTopic("esp32-1A2B/3/config/get", parts));
+  TEST_ASSERT_EQUAL(3, parts.index);
+  TEST_ASSERT_EQUAL_STRING("config", parts.type);
+  TEST_ASSERT_EQUAL_STRING("get", parts.action);
+}
+
+void test_parse_without_action() {
+  TopicParts parts;
+  TEST_ASSERT_TRUE(parseTopic("esp32-1A2B/0/rules", parts));
+  TEST_ASSERT_EQUAL(0, parts.index);
+  TEST_ASSERT_EQUAL_STRING("rules", parts.type);
+  TEST_ASSERT_EQUAL_STRING("", parts.action);
+}
+
+void test_parse_missing_segments() {
+  TopicParts parts;
+  TEST_ASSERT_FALSE(parseTopic(nullptr, parts));
+  TEST_ASSERT_EQUAL(-1, parts.index);
+  TEST_ASSERT_FALSE(parseTopic("esp32-1A2B", parts));
+  TEST_ASSERT_EQUAL(-1, parts.index);
+  TEST_ASSERT_FALSE(parseTopic("esp32-1A2B/2", parts));
+  TEST_ASSERT_EQUAL(2, parts.index);
+  TEST_ASSERT_EQUAL_STRING("", parts.type);
+}
+
+void test_parse_truncates_long_segments() {
+  TopicParts parts;
+  TEST_ASSERT_TRUE(parseTopic(
+      "d/1/a-type-name-much-longer-than-the-field/an-action-that-is-too-long",
+      parts));
+  TEST_ASSERT_EQUAL(sizeof(parts.type) - 1, strlen(parts.type));
+  TEST_ASSERT_EQUAL(sizeof(parts.action) - 1, strlen(parts.action));
+}
+
+void test_build_then_parse_round_trip() {
+  char topic[64];
+  TopicParts parts;
+  buildTopic(topic, sizeof(topic), "esp32-FFFF", 4, "control", "ack");
+  TEST_ASSERT_TRUE(parseTopic(topic, parts));
+  TEST_ASSERT_EQUAL(4, parts.index);
+  TEST_ASSERT_EQUAL_STRING("control", parts.type);
+  TEST_ASSERT_EQUAL_STRING("ack", parts.action);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_build_without_action);
+  RUN_TEST(test_build_with_action);
+  RUN_TEST(test_build_rejects_truncation);
+  RUN_TEST(test_build_exact_fit);
+  RUN_TEST(test_parse_type_and_action);
+  RUN_TEST(test_parse_without_action);
+  RUN_TEST(test_parse_missing_segments);
+  RUN_TEST(test_parse_truncates_long_segments);
+  RUN_TEST(test_build_then_parse_round_trip);
+  return UNITY_END();
+}
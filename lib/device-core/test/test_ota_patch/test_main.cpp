@@ -0,0 +1,237 @@
+#include <unity.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "ota_patch.h"
+
+typedef std::vector<uint8_t> Bytes;
+
+// Flash stand-in: the running image and the partition being written.
+class MemorySink : public PatchSink {
+ public:
+  Bytes base;
+  Bytes image;
+  size_t failWriteAt = SIZE_MAX;
+  unsigned long reads = 0;
+
+  bool write(const uint8_t* data, size_t length) override {
+    if (image.size() + length > failWriteAt) {
+      return false;
+    }
+    image.insert(image.end(), data, data + length);
+    return true;
+  }
+
+  bool readBase(uint32_t offset, uint8_t* data, size_t length) override {
+    reads++;
+    memcpy(data, base.data() + offset, length);
+    return true;
+  }
+
+  size_t baseSize() const override { return base.size(); }
+};
+
+void putU32(Bytes& out, uint32_t value) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+  }
+}
+
+Bytes magic() {
+  return Bytes{'O', 'D', 'P', '1'};
+}
+
+void literal(Bytes& patch, const Bytes& data, size_t from, size_t length) {
+  patch.push_back('L');
+  putU32(patch, length);
+  patch.insert(patch.end(), data.begin() + from, data.begin() + from + length);
+}
+
+void copy(Bytes& patch, uint32_t offset, uint32_t length) {
+  patch.push_back('C');
+  putU32(patch, length);
+  putU32(patch, offset);
+}
+
+Bytes randomBytes(size_t length) {
+  Bytes out(length);
+  for (uint8_t& byte : out) {
+    byte = static_cast<uint8_t>(rand());
+  }
+  return out;
+}
+
+// Feeds the patch in random pieces of 1..maxChunk bytes, as the inflater
+// does when its output wraps around the dictionary ring.
+bool feedInChunks(PatchApplier& applier, const Bytes& patch, size_t maxChunk) {
+  size_t position = 0;
+  while (position < patch.size()) {
+    size_t chunk = 1 + static_cast<size_t>(rand()) % maxChunk;
+    if (chunk > patch.size() - position) {
+      chunk = patch.size() - position;
+    }
+    if (!applier.feed(patch.data() + position, chunk)) {
+      return false;
+    }
+    position += chunk;
+  }
+  return true;
+}
+
+// A firmware-like delta: the new image keeps most of the old one, with a
+// few runs replaced or inserted.
+void buildDelta(const Bytes& base, Bytes& image, Bytes& patch) {
+  const Bytes fresh = randomBytes(3000);
+  image.clear();
+  image.insert(image.end(), base.begin(), base.begin() + 5000);
+  image.insert(image.end(), fresh.begin(), fresh.begin() + 1000);
+  image.insert(image.end(), base.begin() + 6000, base.begin() + 14000);
+  image.insert(image.end(), fresh.begin() + 1000, fresh.end());
+  image.insert(image.end(), base.begin() + 2000, base.begin() + 3000);
+
+  patch = magic();
+  copy(patch, 0, 5000);
+  literal(patch, fresh, 0, 1000);
+  copy(patch, 6000, 8000);
+  literal(patch, fresh, 1000, 2000);
+  copy(patch, 2000, 1000);
+  patch.push_back('E');
+}
+
+void setUp() {
+  srand(44);
+}
+
+void tearDown() {}
+
+void test_full_image_in_random_chunks() {
+  const Bytes image = randomBytes(20000);
+  Bytes patch = magic();
+  literal(patch, image, 0, image.size());
+  patch.push_back('E');
+
+  for (size_t maxChunk : {1, 3, 17, 1024, 40000}) {
+    MemorySink sink;
+    PatchApplier applier(sink);
+    TEST_ASSERT_TRUE(feedInChunks(applier, patch, maxChunk));
+    TEST_ASSERT_TRUE(applier.finished());
+    TEST_ASSERT_EQUAL(image.size(), applier.written());
+    TEST_ASSERT_TRUE(sink.image == image);
+  }
+}
+
+void test_delta_in_random_chunks() {
+  MemorySink reference;
+  reference.base = randomBytes(16000);
+  Bytes image;
+  Bytes patch;
+  buildDelta(reference.base, image, patch);
+
+  for (int run = 0; run < 200; run++) {
+    MemorySink sink;
+    sink.base = reference.base;
+    PatchApplier applier(sink);
+    TEST_ASSERT_TRUE(feedInChunks(applier, patch, 1 + run * 7));
+    TEST_ASSERT_TRUE(applier.finished());
+    TEST_ASSERT_TRUE(sink.image == image);
+  }
+}
+
+void test_empty_literal_and_trailing_bytes() {
+  Bytes patch = magic();
+  literal(patch, Bytes{}, 0, 0);
+  literal(patch, Bytes{1, 2, 3}, 0, 3);
+  patch.push_back('E');
+  patch.push_back('X');  // after the end op: ignored
+  MemorySink sink;
+  PatchApplier applier(sink);
+  TEST_ASSERT_TRUE(applier.feed(patch.data(), patch.size()));
+  TEST_ASSERT_TRUE(applier.finished());
+  TEST_ASSERT_TRUE(sink.image == (Bytes{1, 2, 3}));
+}
+
+void test_truncated_patch_is_not_finished() {
+  const Bytes image = randomBytes(100);
+  Bytes patch = magic();
+  literal(patch, image, 0, image.size());
+  patch.push_back('E');
+  patch.resize(patch.size() - 10);
+  MemorySink sink;
+  PatchApplier applier(sink);
+  TEST_ASSERT_TRUE(feedInChunks(applier, patch, 8));
+  TEST_ASSERT_FALSE(applier.finished());
+}
+
+void test_bad_magic() {
+  const Bytes patch = {'O', 'D', 'P', '2', 'E'};
+  MemorySink sink;
+  PatchApplier applier(sink);
+  TEST_ASSERT_FALSE(feedInChunks(applier, patch, 2));
+  TEST_ASSERT_EQUAL_STRING("bad_patch", applier.error());
+}
+
+void test_unknown_op() {
+  Bytes patch = magic();
+  patch.push_back('Z');
+  MemorySink sink;
+  PatchApplier applier(sink);
+  TEST_ASSERT_FALSE(applier.feed(patch.data(), patch.size()));
+  TEST_ASSERT_EQUAL_STRING("bad_patch", applier.error());
+}
+
+void test_copy_outside_the_base() {
+  const uint32_t cases[][2] = {
+    {0, 1001},           // too long
+    {1001, 0},           // starts past the end
+    {500, 0xFFFFFFF0u},  // offset + length wraps
+  };
+  for (const auto& c : cases) {
+    Bytes patch = magic();
+    copy(patch, c[0], c[1]);
+    MemorySink sink;
+    sink.base = randomBytes(1000);
+    PatchApplier applier(sink);
+    TEST_ASSERT_FALSE(applier.feed(patch.data(), patch.size()));
+    TEST_ASSERT_EQUAL_STRING("bad_patch", applier.error());
+    TEST_ASSERT_EQUAL(0, sink.reads);
+  }
+}
+
+void test_copy_without_a_base() {
+  Bytes patch = magic();
+  copy(patch, 0, 16);
+  MemorySink sink;
+  PatchApplier applier(sink);
+  TEST_ASSERT_FALSE(applier.feed(patch.data(), patch.size()));
+  TEST_ASSERT_EQUAL_STRING("bad_patch", applier.error());
+}
+
+void test_write_failure_stops_the_patch() {
+  const Bytes image = randomBytes(4096);
+  Bytes patch = magic();
+  literal(patch, image, 0, image.size());
+  patch.push_back('E');
+  MemorySink sink;
+  sink.failWriteAt = 2048;
+  PatchApplier applier(sink);
+  TEST_ASSERT_FALSE(feedInChunks(applier, patch, 512));
+  TEST_ASSERT_EQUAL_STRING("write_failed", applier.error());
+  TEST_ASSERT_LESS_OR_EQUAL(2048, applier.written());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_full_image_in_random_chunks);
+  RUN_TEST(test_delta_in_random_chunks);
+  RUN_TEST(test_empty_literal_and_trailing_bytes);
+  RUN_TEST(test_truncated_patch_is_not_finished);
+  RUN_TEST(test_bad_magic);
+  RUN_TEST(test_unknown_op);
+  RUN_TEST(test_copy_outside_the_base);
+  RUN_TEST(test_copy_without_a_base);
+  RUN_TEST(test_write_failure_stops_the_patch);
+  return UNITY_END();
+}
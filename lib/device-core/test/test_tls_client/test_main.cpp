@@ -0,0 +1,86 @@
+#include <unity.h>
+
+#include <Arduino.h>
+#include <WiFiClientSecure.h>
+
+#include "tls_client.h"
+
+const char* BROKER = "broker.example";
+const uint16_t PORT = 8883;
+const char* CA_CERT = "-----BEGIN CERTIFICATE-----\n...\n";
+
+// Time a connect to the broker takes, on the host clock.
+unsigned long timedConnect(WiFiClientSecure& client, int& result) {
+  const unsigned long startedAt = millis();
+  result = client.connect(BROKER, PORT);
+  return millis() - startedAt;
+}
+
+void setUp() {
+  hostTlsBrokerStalled() = false;
+}
+
+void tearDown() {}
+
+void test_unconfigured_client_waits_out_the_default() {
+  // Why configureTls() bounds it: the library default holds the loop
+  // for two minutes.
+  WiFiClientSecure client;
+  hostTlsBrokerStalled() = true;
+  int result = 1;
+  const unsigned long elapsed = timedConnect(client, result);
+  TEST_ASSERT_EQUAL(0, result);
+  TEST_ASSERT_UINT32_WITHIN(100, 120000, elapsed);
+}
+
+void test_stalled_handshake_times_out_with_a_pinned_ca() {
+  WiFiClientSecure client;
+  configureTls(client, CA_CERT);
+  TEST_ASSERT_EQUAL_PTR(CA_CERT, client.hostCaCert());
+  TEST_ASSERT_FALSE(client.hostInsecure());
+
+  hostTlsBrokerStalled() = true;
+  int result = 1;
+  const unsigned long elapsed = timedConnect(client, result);
+  TEST_ASSERT_EQUAL(0, result);
+  TEST_ASSERT_FALSE(client.connected());
+  TEST_ASSERT_UINT32_WITHIN(100, TLS_HANDSHAKE_TIMEOUT_SECONDS * 1000,
+                            elapsed);
+}
+
+void test_stalled_handshake_times_out_when_insecure() {
+  WiFiClientSecure client;
+  configureTls(client, nullptr);
+  TEST_ASSERT_TRUE(client.hostInsecure());
+
+  hostTlsBrokerStalled() = true;
+  int result = 1;
+  const unsigned long elapsed = timedConnect(client, result);
+  TEST_ASSERT_EQUAL(0, result);
+  TEST_ASSERT_UINT32_WITHIN(100, TLS_HANDSHAKE_TIMEOUT_SECONDS * 1000,
+                            elapsed);
+}
+
+void test_retry_after_a_timeout_connects() {
+  WiFiClientSecure client;
+  configureTls(client, CA_CERT);
+  hostTlsBrokerStalled() = true;
+  int result = 1;
+  timedConnect(client, result);
+  TEST_ASSERT_EQUAL(0, result);
+
+  hostTlsBrokerStalled() = false;
+  const unsigned long elapsed = timedConnect(client, result);
+  TEST_ASSERT_EQUAL(1, result);
+  TEST_ASSERT_TRUE(client.connected());
+  TEST_ASSERT_LESS_THAN_UINT32(100, elapsed);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_unconfigured_client_waits_out_the_default);
+  RUN_TEST(test_stalled_handshake_times_out_with_a_pinned_ca);
+  RUN_TEST(test_stalled_handshake_times_out_when_insecure);
+  RUN_TEST(test_retry_after_a_timeout_connects);
+  return UNITY_END();
+}
@@ -3,6 +3,7 @@ const cookieParser = require("cookie-parser");
 const cors = require("cors");
 require("dotenv").config();
 const { startMqttLogger } = require("../mqttLogger");
+const { startLiveRelay } = require("../liveRelay");
 
 const app = express();
 // const PORT = 4000;
@@ -59,6 +60,21 @@ app.post("/auth/logout", (req, res) => {
   res.json({ message: "Logged out" });
 });
 
+// Firmware patches built by otaPatch.js. Devices fetch them without a
+// session; each image is checked against the sha256 in the MQTT ota message.
+if (process.env.OTA_DIR) {
+  app.use("/ota", express.static(process.env.OTA_DIR));
+}
+
+// Downsampled device status for dashboards, from one broker subscription.
+const liveRelay = startLiveRelay();
+if (liveRelay) {
+  app.get("/live", authMiddleware, (req, res) => liveRelay.handle(req, res));
+  app.get("/live/stats", authMiddleware, (req, res) => {
+    res.json(liveRelay.stats());
+  });
+}
+
 // Fallback route
 app.get("/", (req, res) => {
   res.send("ESP32 backend auth server reached");
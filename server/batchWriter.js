@@ -0,0 +1,173 @@
+// Buffers rows and writes them to Postgres in multi-row statements.
+// Batches flush when they reach maxBatchSize or every flushIntervalMs. Each
+// batch is one transaction; subclasses fill it in writeRowsWith() using
+// fixed-text named (prepared) statements over unnest()ed arrays.
+
+const DEFAULTS = {
+  maxBatchSize: 500,
+  flushIntervalMs: 200,
+  highWaterMark: 5000,
+  retryDelayMs: 1000,
+};
+
+class BatchWriter {
+  constructor(pool, options = {}) {
+    this.pool = pool;
+    this.options = { ...DEFAULTS, ...options };
+    this.pending = [];
+    this.flushing = null;
+    this.timer = null;
+    this.capacityWaiters = [];
+    this.stats = { written: 0, failed: 0, batches: 0 };
+  }
+
+  push(row) {
+    this.pending.push(row);
+    if (this.pending.length >= this.options.maxBatchSize) {
+      this.flush();
+    } else if (!this.timer) {
+      this.timer = setTimeout(() => this.flush(), this.options.flushIntervalMs);
+    }
+  }
+
+  // Resolves once the backlog has drained to half the high-water mark, so
+  // callers can stop acknowledging input while the database lags.
+  waitForCapacity() {
+    if (this.pending.length < this.options.highWaterMark) {
+      return Promise.resolve();
+    }
+    return new Promise((resolve) => this.capacityWaiters.push(resolve));
+  }
+
+  // Returns the in-flight drain if one is running; it keeps going until the
+  // backlog is empty, so rows added meanwhile are included.
+  flush() {
+    clearTimeout(this.timer);
+    this.timer = null;
+    if (!this.flushing) {
+      this.flushing = this.drain().finally(() => {
+        this.flushing = null;
+      });
+    }
+    return this.flushing;
+  }
+
+  async drain() {
+    while (this.pending.length > 0) {
+      const batch = this.pending.splice(0, this.options.maxBatchSize);
+      await this.writeBatch(batch);
+      this.releaseCapacity();
+    }
+  }
+
+  close() {
+    return this.flush();
+  }
+
+  releaseCapacity() {
+    if (this.pending.length >= this.options.highWaterMark / 2) return;
+    const waiters = this.capacityWaiters;
+    this.capacityWaiters = [];
+    waiters.forEach((resolve) => resolve());
+  }
+
+  async writeBatch(batch) {
+    try {
+      await this.writeRows(batch);
+    } catch (err) {
+      console.error(`Batch of ${batch.length} rows failed, retrying`, err);
+      await new Promise((r) => setTimeout(r, this.options.retryDelayMs));
+      try {
+        await this.writeRows(batch);
+      } catch {
+        // One bad row fails the whole statement; isolate it.
+        await this.writeRowsIndividually(batch);
+        return;
+      }
+    }
+    this.stats.written += batch.length;
+    this.stats.batches += 1;
+  }
+
+  // One transaction, so a retry after a partial failure cannot duplicate
+  // rows.
+  async writeRows(rows) {
+    const client = await this.pool.connect();
+    try {
+      await client.query("BEGIN");
+      await this.writeRowsWith(client, rows);
+      await client.query("COMMIT");
+    } catch (err) {
+      await client.query("ROLLBACK").catch(() => {});
+      throw err;
+    } finally {
+      client.release();
+    }
+  }
+
+  async writeRowsWith() {
+    throw new Error("writeRowsWith() not implemented");
+  }
+
+  async writeRowsIndividually(rows) {
+    for (const row of rows) {
+      try {
+        await this.writeRows([row]);
+        this.stats.written += 1;
+      } catch (err) {
+        this.stats.failed += 1;
+        console.error("Failed to log to database", err);
+      }
+    }
+  }
+}
+
+// Application events in EVENT_TABLE: plain inserts, plus upserts for rows
+// carrying a recordId.
+class EventBatcher extends BatchWriter {
+  constructor(pool, table, options = {}) {
+    super(pool, options);
+    this.insertStatement = {
+      name: `insert-${table}`,
+      text: `INSERT INTO ${table} (event_type, payload) SELECT * FROM unnest($1::text[], $2::jsonb[])`,
+    };
+    this.upsertStatement = {
+      name: `upsert-${table}`,
+      text: `INSERT INTO ${table} (id, event_type, payload) SELECT * FROM unnest($1::uuid[], $2::text[], $3::jsonb[]) ON CONFLICT (id) DO UPDATE SET event_type = EXCLUDED.event_type, payload = EXCLUDED.payload`,
+    };
+  }
+
+  add(eventType, payload) {
+    this.push({ id: payload.recordId, eventType, payload });
+  }
+
+  async writeRowsWith(client, rows) {
+    const inserts = rows.filter((row) => !row.id);
+    // A statement cannot upsert the same id twice; the latest event wins.
+    const upserts = [
+      ...new Map(rows.filter((row) => row.id).map((row) => [row.id, row])).values(),
+    ];
+
+    if (inserts.length > 0) {
+      await client.query({
+        ...this.insertStatement,
+        values: [
+          inserts.map((row) => row.eventType),
+          inserts.map((row) => JSON.stringify(row.payload)),
+        ],
+      });
+    }
+    if (upserts.length > 0) {
+      await client.query({
+        ...this.upsertStatement,
+        values: [
+          upserts.map((row) => row.id),
+          upserts.map((row) => row.eventType),
+          upserts.map((row) => JSON.stringify(row.payload)),
+        ],
+      });
+    }
+  }
+}
+
+module.exports = { BatchWriter, EventBatcher };
@@ -0,0 +1,133 @@
+// Broker failover drill for MQTT_LAN_FAILOVER firmware: stops the primary
+// broker, measures how long a controller takes to reappear on the LAN
+// broker, checks that commands reach it there, then restores the primary
+// and measures the failback.
+//
+//   MQTT_URL=mqtt://primary:1883 node failoverDrill.js --device esp32-1A2B \
+//     --lan mqtt://lan-broker:1883 \
+//     --kill "systemctl stop mosquitto" --restore "systemctl start mosquitto"
+//
+// The controller republishes its retained state on the broker it switched
+// to, so its first live config message there marks the switch. Both times
+// run from the --kill / --restore command returning to that message.
+// Options: --timeout seconds per phase (default 90; failback includes the
+// 30 s probe interval).
+require("dotenv").config();
+const { execSync } = require("child_process");
+const mqtt = require("mqtt");
+
+function parseArgs(argv) {
+  const options = { timeout: 90 };
+  for (let i = 0; i < argv.length; i += 2) {
+    const value = argv[i + 1];
+    switch (argv[i]) {
+      case "--device":
+        options.device = value;
+        break;
+      case "--lan":
+        options.lan = value;
+        break;
+      case "--kill":
+        options.kill = value;
+        break;
+      case "--restore":
+        options.restore = value;
+        break;
+      case "--timeout":
+        options.timeout = Number(value);
+        break;
+      default:
+        throw new Error(`Unknown option ${argv[i]}`);
+    }
+  }
+  for (const required of ["device", "lan", "kill", "restore"]) {
+    if (!options[required]) throw new Error(`--${required} is required`);
+  }
+  return options;
+}
+
+// Keeps reconnecting, so the primary observer comes back with the broker.
+function observe(url, clientId) {
+  return new Promise((resolve, reject) => {
+    const client = mqtt.connect(url, {
+      clientId,
+      username: process.env.MQTT_USERNAME,
+      password: process.env.MQTT_PASSWORD,
+      reconnectPeriod: 500,
+    });
+    client.once("connect", () => resolve(client));
+    client.once("error", reject);
+    client.on("error", () => {});
+  });
+}
+
+// Resolves with the arrival time of the next live (not retained) message
+// on `topic`.
+function nextLiveMessage(client, topic, timeoutSeconds) {
+  return new Promise((resolve, reject) => {
+    const timer = setTimeout(() => {
+      client.off("message", onMessage);
+      reject(new Error(`No live ${topic} within ${timeoutSeconds}s`));
+    }, timeoutSeconds * 1000);
+    function onMessage(received, payload, packet) {
+      if (received !== topic || packet.retain) return;
+      clearTimeout(timer);
+      client.off("message", onMessage);
+      resolve(performance.now());
+    }
+    client.on("message", onMessage);
+  });
+}
+
+function run(command) {
+  console.log(`$ ${command}`);
+  execSync(command, { stdio: "inherit" });
+  return performance.now();
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  const configTopic = `${options.device}/1/config`;
+  const primary = await observe(
+    process.env.MQTT_URL || "mqtt://localhost:1883",
+    `failover-drill-primary-${process.pid}`
+  );
+  const lan = await observe(options.lan, `failover-drill-lan-${process.pid}`);
+  await primary.subscribeAsync(configTopic);
+  await lan.subscribeAsync(configTopic);
+
+  const onLan = nextLiveMessage(lan, configTopic, options.timeout);
+  const killedAt = run(options.kill);
+  const failoverMs = (await onLan) - killedAt;
+  console.log(`Failed over to the LAN broker in ${failoverMs.toFixed(0)} ms`);
+
+  const reply = nextLiveMessage(lan, configTopic, 10);
+  const requestedAt = performance.now();
+  lan.publish(
+    `${configTopic}/get`,
+    JSON.stringify({ type: "config", message: {}, timestamp: new Date().toISOString() })
+  );
+  const lanRoundTripMs = (await reply) - requestedAt;
+  console.log(`config/get answered over the LAN in ${lanRoundTripMs.toFixed(0)} ms`);
+
+  const onPrimary = nextLiveMessage(primary, configTopic, options.timeout);
+  const restoredAt = run(options.restore);
+  const failbackMs = (await onPrimary) - restoredAt;
+  console.log(`Failed back to the primary in ${failbackMs.toFixed(0)} ms`);
+
+  console.log(
+    JSON.stringify({
+      device: options.device,
+      failoverMs: Math.round(failoverMs),
+      lanRoundTripMs: Math.round(lanRoundTripMs),
+      failbackMs: Math.round(failbackMs),
+    })
+  );
+  primary.end(true);
+  lan.end(true);
+}
+
+main().catch((err) => {
+  console.error(err.message);
+  process.exit(1);
+});
@@ -0,0 +1,219 @@
+// Live relay for dashboards: one upstream MQTT subscription fanned out to
+// browsers over Server-Sent Events. Controllers publish progress up to
+// 10 times a second per valve; each viewer instead gets at most `rateHz`
+// frames per topic, always the latest, so what the browser shows is never
+// older than one interval. A new viewer is first sent the last message of
+// every topic it asked for.
+//
+//   GET /live?topics=<filter>,<filter>&rateHz=2
+//
+// Filters use MQTT wildcards and must fall under RELAY_TOPICS. Each event's
+// data is the topic, a newline, then the message JSON.
+const mqtt = require("mqtt");
+
+const DEFAULT_RELAY_TOPICS = "+/+/status,+/+/controllerhealth";
+const MIN_RATE_HZ = 0.1;
+const MAX_RATE_HZ = 10;
+const DEFAULT_RATE_HZ = 2;
+// Below the idle timeouts of common proxies.
+const KEEPALIVE_MS = 25000;
+
+function topicMatches(filter, topic) {
+  const filterLevels = filter.split("/");
+  const topicLevels = topic.split("/");
+  for (let i = 0; i < filterLevels.length; i++) {
+    if (filterLevels[i] === "#") return true;
+    if (i >= topicLevels.length) return false;
+    if (filterLevels[i] !== "+" && filterLevels[i] !== topicLevels[i]) {
+      return false;
+    }
+  }
+  return filterLevels.length === topicLevels.length;
+}
+
+// JSON never needs a raw line break, and one would end the SSE field.
+function toFrame(topic, payload) {
+  return `data: ${topic}\ndata: ${payload.replace(/[\r\n]/g, "")}\n\n`;
+}
+
+class Viewer {
+  constructor(res, filters, intervalMs, stats) {
+    this.res = res;
+    this.filters = filters;
+    this.intervalMs = intervalMs;
+    this.stats = stats;
+    this.matchCache = new Map();
+    this.lastSentAt = new Map();
+    this.pending = new Map();
+    this.timer = null;
+    this.blocked = false;
+    res.on("drain", () => {
+      this.blocked = false;
+      this.flush();
+    });
+  }
+
+  matches(topic) {
+    let match = this.matchCache.get(topic);
+    if (match === undefined) {
+      match = this.filters.some((filter) => topicMatches(filter, topic));
+      this.matchCache.set(topic, match);
+    }
+    return match;
+  }
+
+  offer(topic, frame, now) {
+    if (this.pending.has(topic)) {
+      this.stats.framesCoalesced += 1;
+      this.pending.set(topic, frame);
+      return;
+    }
+    const lastSentAt = this.lastSentAt.get(topic);
+    if (
+      !this.blocked &&
+      (lastSentAt === undefined || now - lastSentAt >= this.intervalMs)
+    ) {
+      this.send(topic, frame, now);
+      return;
+    }
+    this.pending.set(topic, frame);
+    this.schedule(this.intervalMs - (now - lastSentAt));
+  }
+
+  send(topic, frame, now) {
+    this.lastSentAt.set(topic, now);
+    this.stats.framesSent += 1;
+    this.stats.bytesSent += frame.length;
+    // A slow viewer keeps coalescing into `pending` until the socket drains.
+    if (!this.res.write(frame)) {
+      this.blocked = true;
+    }
+  }
+
+  schedule(delayMs) {
+    if (this.timer || this.blocked) return;
+    this.timer = setTimeout(() => {
+      this.timer = null;
+      this.flush();
+    }, Math.max(0, delayMs));
+  }
+
+  flush() {
+    const now = Date.now();
+    let nextDueMs = Infinity;
+    for (const [topic, frame] of this.pending) {
+      if (this.blocked) return;
+      const waitMs = this.intervalMs - (now - this.lastSentAt.get(topic));
+      if (waitMs > 0) {
+        nextDueMs = Math.min(nextDueMs, waitMs);
+        continue;
+      }
+      this.pending.delete(topic);
+      this.send(topic, frame, now);
+    }
+    if (nextDueMs !== Infinity) this.schedule(nextDueMs);
+  }
+
+  close() {
+    clearTimeout(this.timer);
+    this.pending.clear();
+  }
+}
+
+class LiveRelay {
+  constructor() {
+    this.latest = new Map();
+    this.viewers = new Set();
+    this.counters = {
+      received: 0,
+      framesSent: 0,
+      framesCoalesced: 0,
+      bytesSent: 0,
+    };
+  }
+
+  // Called for every upstream message; `payload` is the message text.
+  ingest(topic, payload) {
+    this.counters.received += 1;
+    const frame = toFrame(topic, payload);
+    this.latest.set(topic, frame);
+    const now = Date.now();
+    for (const viewer of this.viewers) {
+      if (viewer.matches(topic)) viewer.offer(topic, frame, now);
+    }
+  }
+
+  handle(req, res) {
+    const params = new URL(req.url, "http://relay").searchParams;
+    const filters = (params.get("topics") || "")
+      .split(",")
+      .map((t) => t.trim())
+      .filter(Boolean);
+    if (filters.length === 0) {
+      res.statusCode = 400;
+      res.end("topics is required");
+      return;
+    }
+    const requestedHz = Number(params.get("rateHz")) || DEFAULT_RATE_HZ;
+    const rateHz = Math.min(MAX_RATE_HZ, Math.max(MIN_RATE_HZ, requestedHz));
+
+    res.writeHead(200, {
+      "Content-Type": "text/event-stream",
+      "Cache-Control": "no-cache, no-transform",
+      Connection: "keep-alive",
+      "X-Accel-Buffering": "no",
+    });
+    res.write("retry: 2000\n\n");
+
+    const viewer = new Viewer(res, filters, 1000 / rateHz, this.counters);
+    const now = Date.now();
+    for (const [topic, frame] of this.latest) {
+      if (viewer.matches(topic)) viewer.send(topic, frame, now);
+    }
+    this.viewers.add(viewer);
+
+    const keepalive = setInterval(() => res.write(":\n\n"), KEEPALIVE_MS);
+    req.on("close", () => {
+      clearInterval(keepalive);
+      viewer.close();
+      this.viewers.delete(viewer);
+    });
+  }
+
+  stats() {
+    return {
+      viewers: this.viewers.size,
+      topics: this.latest.size,
+      ...this.counters,
+    };
+  }
+}
+
+function startLiveRelay() {
+  const topics = (process.env.RELAY_TOPICS ?? DEFAULT_RELAY_TOPICS)
+    .split(",")
+    .map((t) => t.trim())
+    .filter(Boolean);
+  if (!process.env.MQTT_URL || topics.length === 0) {
+    console.warn("Live relay not started. Missing configuration.");
+    return null;
+  }
+
+  const relay = new LiveRelay();
+  const client = mqtt.connect(process.env.MQTT_URL, {
+    username: process.env.MQTT_USERNAME,
+    password: process.env.MQTT_PASSWORD,
+  });
+  client.on("connect", () => {
+    topics.forEach((t) => client.subscribe(t));
+  });
+  client.on("message", (topic, payload) => {
+    relay.ingest(topic, payload.toString());
+  });
+  client.on("error", (err) => {
+    console.error("Live relay MQTT error", err);
+  });
+  return relay;
+}
+
+module.exports = { LiveRelay, startLiveRelay, topicMatches };
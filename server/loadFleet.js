@@ -0,0 +1,401 @@
+// Load generator: simulates a fleet of irrigation controllers and
+// temperature/humidity sensors against a broker, drives control commands
+// the way the web app does, and reports throughput and latency per fleet
+// size. The simulated devices publish the same topics and payloads as the
+// firmware; with DATABASE_URL set it also measures how far mqttLogger.js
+// lags behind.
+//
+//   MQTT_URL=mqtt://localhost:1883 node loadFleet.js --steps 5,20,50
+//
+// Options: --steps (controllers per step, one sensor per controller),
+// --duration seconds per step, --commands per second across the fleet,
+// --prefix for the simulated device ids.
+require("dotenv").config();
+const crypto = require("crypto");
+const mqtt = require("mqtt");
+const { Pool } = require("pg");
+
+const MAX_VALVES = 4;
+const HIGH_DURATION_MS = 3000;
+const SENSOR_READ_INTERVAL_MS = 500;
+const HEALTH_INTERVAL_MS = 30000;
+const SENSOR_HEARTBEAT_MS = 10000;
+const STALE_COMMAND_MS = 5000;
+
+function parseArgs(argv) {
+  const options = {
+    steps: [5, 10, 20],
+    duration: 30,
+    commands: 5,
+    prefix: "load",
+  };
+  for (let i = 0; i < argv.length; i += 2) {
+    const value = argv[i + 1];
+    switch (argv[i]) {
+      case "--steps":
+        options.steps = value.split(",").map(Number).filter((n) => n > 0);
+        break;
+      case "--duration":
+        options.duration = Number(value);
+        break;
+      case "--commands":
+        options.commands = Number(value);
+        break;
+      case "--prefix":
+        options.prefix = value;
+        break;
+      default:
+        throw new Error(`Unknown option ${argv[i]}`);
+    }
+  }
+  return options;
+}
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) return NaN;
+  const rank = Math.min(sorted.length - 1, Math.ceil(p * sorted.length) - 1);
+  return sorted[Math.max(0, rank)];
+}
+
+function connect(clientId) {
+  return new Promise((resolve, reject) => {
+    const client = mqtt.connect(process.env.MQTT_URL || "mqtt://localhost:1883", {
+      clientId,
+      username: process.env.MQTT_USERNAME,
+      password: process.env.MQTT_PASSWORD,
+      reconnectPeriod: 0,
+    });
+    client.once("connect", () => resolve(client));
+    client.once("error", reject);
+  });
+}
+
+class Counter {
+  constructor() {
+    this.published = 0;
+  }
+
+  publish(client, topic, type, message, retain = false) {
+    this.published += 1;
+    client.publish(
+      topic,
+      JSON.stringify({ type, message, timestamp: new Date().toISOString() }),
+      { retain }
+    );
+  }
+}
+
+// Mirrors controller/src/main.cpp: retained status on every transition,
+// progress while open, an ack per commandId, a health message per valve and
+// one diagnostics message.
+class SimulatedController {
+  constructor(deviceId, counter) {
+    this.deviceId = deviceId;
+    this.counter = counter;
+    this.valves = Array.from({ length: MAX_VALVES }, () => {
+      const weight = 1000 + Math.random() * 500;
+      return { active: false, weight, startWeight: weight, openedAt: 0, timers: [] };
+    });
+    this.timers = [];
+  }
+
+  async start() {
+    this.client = await connect(this.deviceId);
+    this.client.on("message", (topic, payload) => this.onMessage(topic, payload));
+    await this.client.subscribeAsync(`${this.deviceId}/+/control`);
+    this.timers.push(
+      setInterval(() => this.publishHealth(), HEALTH_INTERVAL_MS)
+    );
+    this.publishHealth();
+  }
+
+  onMessage(topic, payload) {
+    const receivedUs = process.hrtime.bigint() / 1000n;
+    const index = parseInt(topic.split("/")[1], 10);
+    const valve = this.valves[index - 1];
+    let command;
+    try {
+      command = JSON.parse(payload.toString());
+    } catch {
+      return;
+    }
+    if (!valve) return;
+
+    const sentAt = Date.parse(command.timestamp);
+    let result;
+    let actuatedUs = null;
+    if (!(Math.abs(Date.now() - sentAt) <= STALE_COMMAND_MS)) {
+      result = "stale";
+    } else if (command.message === "HIGH" || command.message === "LOW") {
+      const open = command.message === "HIGH";
+      if (valve.active === open) {
+        result = "unchanged";
+      } else {
+        actuatedUs = process.hrtime.bigint() / 1000n;
+        if (open) this.open(index, command.commandId);
+        else this.close(index, "manual", command.commandId);
+        result = "applied";
+      }
+    } else {
+      result = "invalid";
+    }
+
+    if (command.commandId) {
+      const nowUs = process.hrtime.bigint() / 1000n;
+      this.counter.publish(this.client, `${topic}/ack`, "ack", {
+        commandId: command.commandId,
+        command: command.message,
+        result,
+        state: valve.active ? "HIGH" : "LOW",
+        sentToReceiveMs: Date.now() - sentAt,
+        ...(actuatedUs !== null
+          ? { receiveToActuateUs: Number(actuatedUs - receivedUs) }
+          : {}),
+        receiveToPublishUs: Number(nowUs - receivedUs),
+      });
+    }
+  }
+
+  open(index, commandId) {
+    const valve = this.valves[index - 1];
+    valve.active = true;
+    valve.startWeight = valve.weight;
+    valve.openedAt = Date.now();
+    this.publishStatus(index, "HIGH", true, undefined, commandId);
+    valve.timers.push(
+      setInterval(() => {
+        valve.weight += 5 + Math.random() * 10;
+        this.publishStatus(index, "HIGH", false);
+      }, SENSOR_READ_INTERVAL_MS),
+      setTimeout(() => this.close(index, "duration_elapsed"), HIGH_DURATION_MS)
+    );
+  }
+
+  close(index, reason, commandId) {
+    const valve = this.valves[index - 1];
+    if (!valve.active) return;
+    valve.active = false;
+    valve.timers.forEach((timer) => clearTimeout(timer));
+    valve.timers = [];
+    this.publishStatus(index, "LOW", true, reason, commandId);
+  }
+
+  publishStatus(index, state, retain, reason, commandId) {
+    const valve = this.valves[index - 1];
+    const weightChange = valve.weight - valve.startWeight;
+    const elapsedS = valve.openedAt === 0 ? 0 : (Date.now() - valve.openedAt) / 1000;
+    this.counter.publish(
+      this.client,
+      `${this.deviceId}/${index}/status`,
+      "status",
+      {
+        state,
+        weight: valve.weight,
+        weightChange,
+        controlMode: "time",
+        progressValue: Math.min(elapsedS, HIGH_DURATION_MS / 1000),
+        targetValue: HIGH_DURATION_MS / 1000,
+        progressUnit: "s",
+        ...(reason ? { reason } : {}),
+        ...(commandId ? { commandId } : {}),
+      },
+      retain
+    );
+  }
+
+  publishHealth() {
+    const memory = process.memoryUsage();
+    this.valves.forEach((valve, i) => {
+      this.counter.publish(
+        this.client,
+        `${this.deviceId}/${i + 1}/controllerhealth`,
+        "controllerhealth",
+        {
+          ipAddress: "127.0.0.1",
+          active: valve.active,
+          weight: valve.weight,
+        },
+        true
+      );
+    });
+    this.counter.publish(
+      this.client,
+      `${this.deviceId}/0/diagnostics`,
+      "diagnostics",
+      { freeHeap: memory.heapTotal - memory.heapUsed, loopAvgUs: 0 },
+      true
+    );
+  }
+
+  async stop() {
+    this.timers.forEach((timer) => clearInterval(timer));
+    this.valves.forEach((valve) => valve.timers.forEach((t) => clearTimeout(t)));
+    await this.client.endAsync();
+  }
+}
+
+// Mirrors temp-humidity-sensor/src/main.cpp status and health messages.
+class SimulatedSensor {
+  constructor(deviceId, counter) {
+    this.deviceId = deviceId;
+    this.counter = counter;
+    this.temperature = 18 + Math.random() * 8;
+    this.humidity = 40 + Math.random() * 30;
+  }
+
+  async start() {
+    this.client = await connect(this.deviceId);
+    // Spread heartbeats so the fleet does not publish in lockstep.
+    this.timer = setTimeout(() => {
+      this.publish();
+      this.timer = setInterval(() => this.publish(), SENSOR_HEARTBEAT_MS);
+    }, Math.random() * SENSOR_HEARTBEAT_MS);
+  }
+
+  publish() {
+    this.temperature += (Math.random() - 0.5) * 0.2;
+    this.humidity += (Math.random() - 0.5) * 0.5;
+    this.counter.publish(this.client, `${this.deviceId}/1/status`, "status", {
+      temperature: Number(this.temperature.toFixed(1)),
+      humidity: Number(this.humidity.toFixed(1)),
+      heartbeatIntervalSeconds: SENSOR_HEARTBEAT_MS / 1000,
+    });
+    this.counter.publish(
+      this.client,
+      `${this.deviceId}/1/controllerhealth`,
+      "controllerhealth",
+      { ipAddress: "127.0.0.1", online: true },
+      true
+    );
+  }
+
+  async stop() {
+    clearTimeout(this.timer);
+    clearInterval(this.timer);
+    await this.client.endAsync();
+  }
+}
+
+// Waits until every ack of the step is in command_acks and returns how long
+// that took after the last ack reached the driver.
+async function measureLoggerLag(pool, commandIds, lastAckAt) {
+  const deadline = Date.now() + 60000;
+  while (Date.now() < deadline) {
+    const { rows } = await pool.query(
+      "SELECT count(*)::int AS stored, percentile_cont(ARRAY[0.5, 0.99]) WITHIN GROUP (ORDER BY extract(epoch FROM logged_at - recorded_at) * 1000) AS transit FROM command_acks WHERE command_id = ANY($1)",
+      [commandIds]
+    );
+    if (rows[0].stored >= commandIds.length) {
+      return { lagMs: Date.now() - lastAckAt, transitMs: rows[0].transit };
+    }
+    await new Promise((r) => setTimeout(r, 250));
+  }
+  return { lagMs: NaN, transitMs: null };
+}
+
+async function runStep(size, options, pool) {
+  const counter = new Counter();
+  const controllers = Array.from(
+    { length: size },
+    (_, i) => new SimulatedController(`${options.prefix}-ctrl-${i}`, counter)
+  );
+  const sensors = Array.from(
+    { length: size },
+    (_, i) => new SimulatedSensor(`${options.prefix}-sensor-${i}`, counter)
+  );
+  await Promise.all([...controllers, ...sensors].map((d) => d.start()));
+
+  // The driver plays the web app; the monitor sees everything the broker
+  // delivers for the simulated fleet.
+  const driver = await connect(`${options.prefix}-driver`);
+  const monitor = await connect(`${options.prefix}-monitor`);
+  let delivered = 0;
+  monitor.on("message", (topic) => {
+    if (topic.startsWith(`${options.prefix}-`)) delivered += 1;
+  });
+  await monitor.subscribeAsync("+/+/#");
+
+  const sent = new Map();
+  const latencies = [];
+  const commandIds = [];
+  let lastAckAt = 0;
+  driver.on("message", (topic, payload) => {
+    const ack = JSON.parse(payload.toString()).message;
+    const sentAt = sent.get(ack.commandId);
+    if (sentAt === undefined) return;
+    sent.delete(ack.commandId);
+    lastAckAt = Date.now();
+    latencies.push(Number(process.hrtime.bigint() - sentAt) / 1e6);
+  });
+  await driver.subscribeAsync("+/+/control/ack");
+
+  const deliveredBefore = delivered;
+  const publishedBefore = counter.published;
+  const startedAt = Date.now();
+  const commandTimer = setInterval(() => {
+    const controller = controllers[Math.floor(Math.random() * size)];
+    const valve = 1 + Math.floor(Math.random() * MAX_VALVES);
+    const commandId = crypto.randomUUID();
+    commandIds.push(commandId);
+    sent.set(commandId, process.hrtime.bigint());
+    driver.publish(
+      `${controller.deviceId}/${valve}/control`,
+      JSON.stringify({
+        type: "control",
+        message: controller.valves[valve - 1].active ? "LOW" : "HIGH",
+        timestamp: new Date().toISOString(),
+        commandId,
+      })
+    );
+  }, 1000 / options.commands);
+
+  await new Promise((r) => setTimeout(r, options.duration * 1000));
+  clearInterval(commandTimer);
+  await new Promise((r) => setTimeout(r, 1000));
+  const elapsedS = (Date.now() - startedAt) / 1000;
+
+  const logger = pool
+    ? await measureLoggerLag(pool, commandIds, lastAckAt)
+    : null;
+
+  await Promise.all([...controllers, ...sensors].map((d) => d.stop()));
+  await Promise.all([driver.endAsync(), monitor.endAsync()]);
+
+  latencies.sort((a, b) => a - b);
+  return {
+    devices: size * 2,
+    publishedPerS: ((counter.published - publishedBefore) / elapsedS).toFixed(1),
+    deliveredPerS: ((delivered - deliveredBefore) / elapsedS).toFixed(1),
+    commands: commandIds.length,
+    lostAcks: sent.size,
+    p50Ms: percentile(latencies, 0.5).toFixed(1),
+    p99Ms: percentile(latencies, 0.99).toFixed(1),
+    loggerLagMs: logger ? logger.lagMs : "-",
+    ackTransitP50P99Ms: logger && logger.transitMs
+      ? logger.transitMs.map((v) => v.toFixed(1)).join("/")
+      : "-",
+  };
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  const pool = process.env.DATABASE_URL
+    ? new Pool({
+        connectionString: process.env.DATABASE_URL,
+        ssl: { rejectUnauthorized: false },
+      })
+    : null;
+
+  const results = [];
+  for (const size of options.steps) {
+    console.log(`Running ${size} controllers + ${size} sensors for ${options.duration}s`);
+    results.push(await runStep(size, options, pool));
+  }
+  console.table(results);
+  if (pool) await pool.end();
+}
+
+main().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
@@ -1,12 +1,20 @@
 const mqtt = require("mqtt");
-const { Client } = require("pg");
+const { Pool } = require("pg");
+const { EventBatcher } = require("./batchWriter");
+const { TelemetryWriter } = require("./telemetryWriter");
+
+const DEFAULT_TELEMETRY_TOPICS =
+  "+/+/status,+/+/controllerhealth,+/+/diagnostics,+/+/control/ack";
 
 const EVENT_TYPES = {
   AIRCON: "aircon",
   IRRIGATION: "irrigation",
 };
 
-let dbClient;
+function intFromEnv(name, fallback) {
+  const value = parseInt(process.env[name], 10);
+  return Number.isFinite(value) && value > 0 ? value : fallback;
+}
 
 function startMqttLogger() {
   const topicEventMap = {};
@@ -17,66 +25,85 @@ function startMqttLogger() {
     topicEventMap[process.env.IRRIGATION_TOPIC] = EVENT_TYPES.IRRIGATION;
   }
 
-  const topics = Object.keys(topicEventMap);
+  const telemetryTopics = (
+    process.env.TELEMETRY_TOPICS ?? DEFAULT_TELEMETRY_TOPICS
+  )
+    .split(",")
+    .map((t) => t.trim())
+    .filter(Boolean);
+
+  const eventTopics = process.env.EVENT_TABLE ? Object.keys(topicEventMap) : [];
+  const topics = [...new Set([...eventTopics, ...telemetryTopics])];
   if (
     !process.env.MQTT_URL ||
     !process.env.DATABASE_URL ||
-    !process.env.EVENT_TABLE ||
     topics.length === 0
   ) {
     console.warn("MQTT logger not started. Missing configuration.");
     return;
   }
 
-  dbClient = new Client({
+  const pool = new Pool({
     connectionString: process.env.DATABASE_URL,
     ssl: { rejectUnauthorized: false },
+    max: intFromEnv("DB_POOL_SIZE", 4),
   });
-  dbClient.connect().catch((err) => {
-    console.error("Failed to connect to Postgres", err);
+  pool.on("error", (err) => {
+    console.error("Postgres pool error", err);
   });
 
+  const batchOptions = {
+    maxBatchSize: intFromEnv("LOG_BATCH_SIZE", 500),
+    flushIntervalMs: intFromEnv("LOG_FLUSH_MS", 200),
+    highWaterMark: intFromEnv("LOG_MAX_PENDING", 5000),
+  };
+  const batcher = process.env.EVENT_TABLE
+    ? new EventBatcher(pool, process.env.EVENT_TABLE, batchOptions)
+    : null;
+  const telemetry =
+    telemetryTopics.length > 0 ? new TelemetryWriter(pool, batchOptions) : null;
+  const schemaReady = telemetry
+    ? telemetry.ensureSchema().catch((err) => {
+        console.error("Failed to create telemetry tables", err);
+      })
+    : Promise.resolve();
+
   const client = mqtt.connect(process.env.MQTT_URL, {
     username: process.env.MQTT_USERNAME,
     password: process.env.MQTT_PASSWORD,
   });
 
-  client.on("connect", () => {
+  client.on("connect", async () => {
+    await schemaReady;
     topics.forEach((t) => client.subscribe(t, { qos: 1 }));
   });
 
-  client.on("message", async (topic, message) => {
+  // mqtt.js processes messages one at a time and only acknowledges a QoS 1
+  // message once this callback is called. Holding it while the database
+  // backlog is full stops the broker from sending more.
+  client.handleMessage = (packet, done) => {
     let payload;
     try {
-      payload = JSON.parse(message.toString());
+      payload = JSON.parse(packet.payload.toString());
     } catch (err) {
       console.error("Invalid JSON payload", err);
+      done();
       return;
     }
-    const eventType = topicEventMap[topic];
-    await logToDb(eventType, payload);
-  });
-}
-
-async function logToDb(eventType, payload) {
-  if (!dbClient) return;
-  const table = process.env.EVENT_TABLE;
-  const id = payload.recordId;
-  try {
-    if (id) {
-      await dbClient.query(
-        `INSERT INTO ${table} (id, event_type, payload) VALUES ($1, $2, $3) ON CONFLICT (id) DO UPDATE SET event_type = EXCLUDED.event_type, payload = EXCLUDED.payload`,
-        [id, eventType, payload]
-      );
-    } else {
-      await dbClient.query(
-        `INSERT INTO ${table} (event_type, payload) VALUES ($1, $2)`,
-        [eventType, payload]
-      );
+    const eventType = topicEventMap[packet.topic];
+    if (batcher && eventType && payload && typeof payload === "object") {
+      batcher.add(eventType, payload);
     }
-  } catch (err) {
-    console.error("Failed to log to database", err);
-  }
+    // Retained messages are replayed on every (re)subscribe and were already
+    // stored when first published.
+    if (telemetry && !packet.retain) {
+      telemetry.add(packet.topic, payload);
+    }
+    Promise.all([
+      batcher && batcher.waitForCapacity(),
+      telemetry && telemetry.waitForCapacity(),
+    ]).then(() => done());
+  };
 }
 
 module.exports = { startMqttLogger };
@@ -0,0 +1,156 @@
+// Builds OTA patches for lib/device-core/src/ota_update.cpp: a zlib stream
+// of "ODP1" followed by literal ('L') and copy-from-running-image ('C') ops.
+//
+//   node otaPatch.js <new.bin> <out.odp> [--base <running.bin>] [--url <url>]
+//
+// Without --base the patch is the whole image, compressed. With --base,
+// runs of the new image that also occur anywhere in the running image are
+// copied on the device instead of transferred. Prints the sizes and the
+// `ota` message to publish (retained) to <deviceId>/0/ota.
+const crypto = require("crypto");
+const fs = require("fs");
+const zlib = require("zlib");
+
+// Shortest run worth a copy op (9 bytes of op header).
+const BLOCK = 64;
+const BASE = 257;
+
+function sha256(buffer) {
+  return crypto.createHash("sha256").update(buffer).digest("hex");
+}
+
+function hashAt(buffer, start) {
+  let h = 0;
+  for (let i = start; i < start + BLOCK; i++) {
+    h = (Math.imul(h, BASE) + buffer[i]) >>> 0;
+  }
+  return h;
+}
+
+// BASE^(BLOCK-1) mod 2^32, to remove the outgoing byte when rolling.
+const OUTGOING = (() => {
+  let p = 1;
+  for (let i = 0; i < BLOCK - 1; i++) p = Math.imul(p, BASE) >>> 0;
+  return p;
+})();
+
+function indexBlocks(base) {
+  const index = new Map();
+  for (let offset = 0; offset + BLOCK <= base.length; offset += BLOCK) {
+    const h = hashAt(base, offset);
+    if (!index.has(h)) index.set(h, offset);
+  }
+  return index;
+}
+
+function encodeOps(image, base) {
+  const ops = [Buffer.from("ODP1")];
+  const stats = { copyBytes: 0, literalBytes: 0, copies: 0 };
+  const literal = (start, end) => {
+    if (end <= start) return;
+    const header = Buffer.alloc(5);
+    header.write("L", 0);
+    header.writeUInt32LE(end - start, 1);
+    ops.push(header, image.subarray(start, end));
+    stats.literalBytes += end - start;
+  };
+
+  const index = base ? indexBlocks(base) : new Map();
+  let literalStart = 0;
+  let p = 0;
+  let h = image.length >= BLOCK ? hashAt(image, 0) : 0;
+  while (p + BLOCK <= image.length) {
+    const candidate = index.get(h);
+    if (
+      candidate !== undefined &&
+      base.compare(image, p, p + BLOCK, candidate, candidate + BLOCK) === 0
+    ) {
+      let length = BLOCK;
+      while (
+        p + length < image.length &&
+        candidate + length < base.length &&
+        image[p + length] === base[candidate + length]
+      ) {
+        length++;
+      }
+      literal(literalStart, p);
+      const header = Buffer.alloc(9);
+      header.write("C", 0);
+      header.writeUInt32LE(length, 1);
+      header.writeUInt32LE(candidate, 5);
+      ops.push(header);
+      stats.copyBytes += length;
+      stats.copies += 1;
+      p += length;
+      literalStart = p;
+      if (p + BLOCK <= image.length) h = hashAt(image, p);
+      continue;
+    }
+    if (p + BLOCK < image.length) {
+      h = (Math.imul(h - Math.imul(image[p], OUTGOING), BASE) + image[p + BLOCK]) >>> 0;
+    }
+    p++;
+  }
+  literal(literalStart, image.length);
+  ops.push(Buffer.from("E"));
+  return { ops: Buffer.concat(ops), stats };
+}
+
+function buildPatch(image, base) {
+  const { ops, stats } = encodeOps(image, base);
+  return { patch: zlib.deflateSync(ops, { level: 9 }), stats };
+}
+
+function main() {
+  const args = process.argv.slice(2);
+  const option = (name) => {
+    const i = args.indexOf(name);
+    if (i < 0) return undefined;
+    const [, value] = args.splice(i, 2);
+    return value;
+  };
+  const basePath = option("--base");
+  const url = option("--url");
+  if (args.length !== 2) {
+    console.error(
+      "Usage: otaPatch.js <new.bin> <out.odp> [--base <running.bin>] [--url <url>]"
+    );
+    process.exit(1);
+  }
+
+  const image = fs.readFileSync(args[0]);
+  const base = basePath ? fs.readFileSync(basePath) : null;
+  const { patch, stats } = buildPatch(image, base);
+  fs.writeFileSync(args[1], patch);
+
+  const fullCompressed = base ? buildPatch(image, null).patch.length : patch.length;
+  console.log(
+    JSON.stringify(
+      {
+        imageBytes: image.length,
+        fullCompressedBytes: fullCompressed,
+        patchBytes: patch.length,
+        ...stats,
+      },
+      null,
+      2
+    )
+  );
+  console.log(
+    JSON.stringify({
+      message: {
+        url: url || `<url of ${args[1]}>`,
+        sha256: sha256(image),
+        ...(base ? { baseSha256: sha256(base) } : {}),
+        size: image.length,
+      },
+      timestamp: new Date().toISOString(),
+    })
+  );
+}
+
+if (require.main === module) {
+  main();
+}
+
+module.exports = { buildPatch };
@@ -0,0 +1,161 @@
+// Benchmark for liveRelay.js: simulated controllers stream status at 10 Hz
+// per valve into a relay served over HTTP, and simulated dashboards watch
+// every topic over SSE. Reports what each viewer receives against the raw
+// stream a direct broker subscription would deliver, the age of the data
+// on arrival and the time to first paint.
+//
+//   node relayBench.js --viewers 100 --controllers 4 --rate 2 --duration 20
+//
+// Runs in-process without a broker, so it measures the relay and the
+// SSE fan-out, not broker delivery.
+const http = require("http");
+const { LiveRelay } = require("./liveRelay");
+
+const MAX_VALVES = 4;
+const PROGRESS_INTERVAL_MS = 100;
+
+function parseArgs(argv) {
+  const options = { viewers: 100, controllers: 4, rate: 2, duration: 20 };
+  for (let i = 0; i < argv.length; i += 2) {
+    const name = argv[i].replace(/^--/, "");
+    if (!(name in options)) throw new Error(`Unknown option ${argv[i]}`);
+    options[name] = Number(argv[i + 1]);
+  }
+  return options;
+}
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) return NaN;
+  const rank = Math.min(sorted.length - 1, Math.ceil(p * sorted.length) - 1);
+  return sorted[Math.max(0, rank)];
+}
+
+function statusPayload(deviceId, valve, weight) {
+  return JSON.stringify({
+    type: "status",
+    message: {
+      state: "HIGH",
+      weight,
+      weightChange: 0,
+      deviceId,
+      valve,
+    },
+    timestamp: new Date().toISOString(),
+    sentAt: Date.now(),
+  });
+}
+
+// One SSE connection; records arrival age and first-paint time.
+function openViewer(port, rateHz, topicCount, result) {
+  const openedAt = Date.now();
+  const seen = new Set();
+  return new Promise((resolve) => {
+    const req = http.get(
+      {
+        port,
+        path: `/live?topics=${encodeURIComponent("+/+/status")}&rateHz=${rateHz}`,
+        agent: false,
+      },
+      (res) => {
+        res.setEncoding("utf8");
+        let buffered = "";
+        res.on("data", (chunk) => {
+          buffered += chunk;
+          let end;
+          while ((end = buffered.indexOf("\n\n")) >= 0) {
+            const event = buffered.slice(0, end);
+            buffered = buffered.slice(end + 2);
+            const lines = event.split("\n").filter((l) => l.startsWith("data: "));
+            if (lines.length !== 2) continue;
+            const topic = lines[0].slice(6);
+            const payload = JSON.parse(lines[1].slice(6));
+            result.frames += 1;
+            result.bytes += event.length + 2;
+            result.ages.push(Date.now() - payload.sentAt);
+            if (!seen.has(topic)) {
+              seen.add(topic);
+              if (seen.size === topicCount) {
+                result.firstPaint.push(Date.now() - openedAt);
+              }
+            }
+          }
+        });
+        resolve(req);
+      }
+    );
+  });
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  const relay = new LiveRelay();
+  const server = http.createServer((req, res) => relay.handle(req, res));
+  await new Promise((resolve) => server.listen(0, resolve));
+  const { port } = server.address();
+
+  const topics = [];
+  for (let c = 1; c <= options.controllers; c++) {
+    for (let v = 1; v <= MAX_VALVES; v++) {
+      topics.push({ deviceId: `bench-ctrl-${c}`, valve: v, weight: 1000 });
+    }
+  }
+  const publishAll = () => {
+    for (const t of topics) {
+      t.weight += Math.random();
+      relay.ingest(
+        `${t.deviceId}/${t.valve}/status`,
+        statusPayload(t.deviceId, t.valve, t.weight)
+      );
+    }
+  };
+  // Seed the cache so first paint has something to show.
+  publishAll();
+
+  const result = { frames: 0, bytes: 0, ages: [], firstPaint: [] };
+  const requests = [];
+  for (let i = 0; i < options.viewers; i++) {
+    requests.push(await openViewer(port, options.rate, topics.length, result));
+  }
+
+  const cpuBefore = process.cpuUsage();
+  const startedAt = Date.now();
+  const ticker = setInterval(publishAll, PROGRESS_INTERVAL_MS);
+  await new Promise((resolve) => setTimeout(resolve, options.duration * 1000));
+  clearInterval(ticker);
+  const elapsedS = (Date.now() - startedAt) / 1000;
+  const cpu = process.cpuUsage(cpuBefore);
+
+  requests.forEach((req) => req.destroy());
+  server.close();
+
+  const ages = result.ages.sort((a, b) => a - b);
+  const firstPaint = result.firstPaint.sort((a, b) => a - b);
+  const stats = relay.stats();
+  const rawPerViewer = stats.received / elapsedS;
+  console.log(
+    JSON.stringify(
+      {
+        viewers: options.viewers,
+        topics: topics.length,
+        rateHz: options.rate,
+        framesPerViewerPerSecond: +(result.frames / options.viewers / elapsedS).toFixed(1),
+        directFramesPerViewerPerSecond: Math.round(rawPerViewer),
+        bytesPerViewerPerSecond: Math.round(result.bytes / options.viewers / elapsedS),
+        framesCoalesced: stats.framesCoalesced,
+        ageP50Ms: percentile(ages, 0.5),
+        ageP99Ms: percentile(ages, 0.99),
+        firstPaintP50Ms: percentile(firstPaint, 0.5),
+        firstPaintP99Ms: percentile(firstPaint, 0.99),
+        // Includes parsing on the simulated viewers' side.
+        processCpuPercent: +(((cpu.user + cpu.system) / 1e6 / elapsedS) * 100).toFixed(1),
+      },
+      null,
+      2
+    )
+  );
+}
+
+main().catch((err) => {
+  console.error(err);
+  process.exit(1);
+});
@@ -0,0 +1,264 @@
+const { BatchWriter } = require("./batchWriter");
+
+// Typed time-series tables for device telemetry. Each is range-partitioned
+// by month on recorded_at; partitions are created on first use. The first
+// three columns (device, index, time) are the key and are never null.
+const TABLES = {
+  valve_readings: {
+    columns: [
+      ["device_id", "text"],
+      ["valve", "smallint"],
+      ["recorded_at", "timestamptz"],
+      ["state", "text"],
+      ["control_mode", "text"],
+      ["weight", "real"],
+      ["weight_change", "real"],
+      ["progress", "real"],
+      ["target", "real"],
+    ],
+  },
+  climate_readings: {
+    columns: [
+      ["device_id", "text"],
+      ["sensor", "smallint"],
+      ["recorded_at", "timestamptz"],
+      ["temperature", "real"],
+      ["humidity", "real"],
+    ],
+  },
+  device_health: {
+    columns: [
+      ["device_id", "text"],
+      ["component", "smallint"],
+      ["recorded_at", "timestamptz"],
+      ["free_heap", "integer"],
+      ["min_free_heap", "integer"],
+      ["loop_avg_us", "integer"],
+      ["mqtt_connect_ms", "integer"],
+      ["weight", "real"],
+      ["metrics", "jsonb"],
+    ],
+  },
+  command_acks: {
+    columns: [
+      ["device_id", "text"],
+      ["valve", "smallint"],
+      ["recorded_at", "timestamptz"],
+      ["command_id", "text"],
+      ["command", "text"],
+      ["result", "text"],
+      ["sent_to_receive_ms", "integer"],
+      ["receive_to_actuate_us", "integer"],
+      ["receive_to_publish_us", "integer"],
+      ["logged_at", "timestamptz"],
+    ],
+  },
+};
+
+function numberOrNull(value) {
+  return typeof value === "number" && Number.isFinite(value) ? value : null;
+}
+
+function integerOrNull(value) {
+  const number = numberOrNull(value);
+  return number === null ? null : Math.round(number);
+}
+
+function stringOrNull(value) {
+  return typeof value === "string" ? value : null;
+}
+
+// Devices stamp messages with an ISO time, or "unknown" before NTP sync.
+// A stamp more than this far from arrival is a bad clock, and would
+// otherwise create a partition for a month the device never saw.
+const MAX_CLOCK_SKEW_MS = 24 * 60 * 60 * 1000;
+
+function recordedAt(payload, arrivedAt = Date.now()) {
+  const parsed = Date.parse(payload.timestamp);
+  return Number.isFinite(parsed) &&
+    Math.abs(parsed - arrivedAt) <= MAX_CLOCK_SKEW_MS
+    ? new Date(parsed)
+    : new Date(arrivedAt);
+}
+
+// Maps a `<deviceId>/<index>/<type>[/<action>]` message to a typed row, or
+// null if the topic carries nothing this writer stores (e.g. aircon status).
+function classifyTelemetry(topic, payload) {
+  const parts = topic.split("/");
+  if (
+    parts.length < 3 ||
+    parts.length > 4 ||
+    !payload ||
+    typeof payload !== "object"
+  ) {
+    return null;
+  }
+  const [deviceId, indexText] = parts;
+  const type = parts.slice(2).join("/");
+  const index = parseInt(indexText, 10);
+  const message = payload.message;
+  if (!Number.isInteger(index) || !message || typeof message !== "object") {
+    return null;
+  }
+  const at = recordedAt(payload).toISOString();
+
+  if (type === "status") {
+    // Aircon status also has a temperature (the setpoint) but no humidity.
+    if (numberOrNull(message.humidity) !== null) {
+      return {
+        table: "climate_readings",
+        values: [
+          deviceId,
+          index,
+          at,
+          numberOrNull(message.temperature),
+          numberOrNull(message.humidity),
+        ],
+      };
+    }
+    if (numberOrNull(message.weight) !== null) {
+      return {
+        table: "valve_readings",
+        values: [
+          deviceId,
+          index,
+          at,
+          stringOrNull(message.state),
+          stringOrNull(message.controlMode),
+          numberOrNull(message.weight),
+          numberOrNull(message.weightChange),
+          numberOrNull(message.progressValue),
+          numberOrNull(message.targetValue),
+        ],
+      };
+    }
+    return null;
+  }
+
+  // Valve health carries the weight; the controller's counters arrive on
+  // component 0 as diagnostics.
+  if (type === "controllerhealth" || type === "diagnostics") {
+    return {
+      table: "device_health",
+      values: [
+        deviceId,
+        index,
+        at,
+        integerOrNull(message.freeHeap),
+        integerOrNull(message.minFreeHeap),
+        integerOrNull(message.loopAvgUs),
+        integerOrNull(message.mqttConnectMs),
+        numberOrNull(message.weight),
+        JSON.stringify(message),
+      ],
+    };
+  }
+
+  // logged_at is the arrival here, so logged_at - recorded_at covers the
+  // controller's publish through the broker to this logger.
+  if (type === "control/ack" && typeof message.commandId === "string") {
+    return {
+      table: "command_acks",
+      values: [
+        deviceId,
+        index,
+        at,
+        message.commandId,
+        stringOrNull(message.command),
+        stringOrNull(message.result),
+        integerOrNull(message.sentToReceiveMs),
+        integerOrNull(message.receiveToActuateUs),
+        integerOrNull(message.receiveToPublishUs),
+        new Date().toISOString(),
+      ],
+    };
+  }
+  return null;
+}
+
+function monthStart(isoTimestamp) {
+  return isoTimestamp.slice(0, 7);
+}
+
+function nextMonth(month) {
+  const [year, mm] = month.split("-").map(Number);
+  return mm === 12
+    ? `${year + 1}-01`
+    : `${year}-${String(mm + 1).padStart(2, "0")}`;
+}
+
+class TelemetryWriter extends BatchWriter {
+  constructor(pool, options = {}) {
+    super(pool, options);
+    this.partitions = new Set();
+    this.statements = {};
+    for (const [table, spec] of Object.entries(TABLES)) {
+      const names = spec.columns.map(([name]) => name).join(", ");
+      const arrays = spec.columns
+        .map(([, type], i) => `$${i + 1}::${type}[]`)
+        .join(", ");
+      this.statements[table] = {
+        name: `insert-${table}`,
+        text: `INSERT INTO ${table} (${names}) SELECT * FROM unnest(${arrays})`,
+      };
+    }
+  }
+
+  // Safe to run on every start.
+  async ensureSchema() {
+    for (const [table, spec] of Object.entries(TABLES)) {
+      const columns = spec.columns
+        .map(([name, type], i) => `${name} ${type}${i < 3 ? " NOT NULL" : ""}`)
+        .join(", ");
+      await this.pool.query(
+        `CREATE TABLE IF NOT EXISTS ${table} (${columns}) PARTITION BY RANGE (recorded_at)`
+      );
+      await this.pool.query(
+        `CREATE INDEX IF NOT EXISTS ${table}_device_time_idx ON ${table} (device_id, recorded_at)`
+      );
+    }
+  }
+
+  add(topic, payload) {
+    const row = classifyTelemetry(topic, payload);
+    if (row) this.push(row);
+    return row !== null;
+  }
+
+  // DDL runs outside the batch transaction so a rolled-back batch cannot
+  // leave a cached partition that does not exist.
+  async ensurePartitions(rows) {
+    for (const row of rows) {
+      const month = monthStart(row.values[2]);
+      const name = `${row.table}_${month.replace("-", "_")}`;
+      if (this.partitions.has(name)) continue;
+      await this.pool.query(
+        `CREATE TABLE IF NOT EXISTS ${name} PARTITION OF ${row.table} FOR VALUES FROM ('${month}-01 00:00Z') TO ('${nextMonth(month)}-01 00:00Z')`
+      );
+      this.partitions.add(name);
+    }
+  }
+
+  async writeRows(rows) {
+    await this.ensurePartitions(rows);
+    return super.writeRows(rows);
+  }
+
+  async writeRowsWith(client, rows) {
+    const byTable = new Map();
+    for (const row of rows) {
+      if (!byTable.has(row.table)) byTable.set(row.table, []);
+      byTable.get(row.table).push(row.values);
+    }
+    for (const [table, tableRows] of byTable) {
+      const columnCount = TABLES[table].columns.length;
+      const values = [];
+      for (let i = 0; i < columnCount; i++) {
+        values.push(tableRows.map((row) => row[i]));
+      }
+      await client.query({ ...this.statements[table], values });
+    }
+  }
+}
+
+module.exports = { TelemetryWriter, classifyTelemetry };
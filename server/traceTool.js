@@ -0,0 +1,196 @@
+// Fetches, decodes and replays the controller's input trace (see
+// controller/include/trace_capture.h for the record format).
+//
+//   node traceTool.js dump <deviceId> <file.bin>
+//   node traceTool.js decode <file.bin>
+//   node traceTool.js replay <file.bin> <benchDeviceId> [--speed 10]
+//
+// decode prints one JSON record per line with wall time reconstructed from
+// the nearest preceding clock record. replay republishes the recorded MQTT
+// messages to another controller, with their original spacing divided by
+// --speed and their `timestamp` shifted to now, so they pass the freshness
+// check; scale and temperature samples are printed alongside for reference.
+require("dotenv").config();
+const fs = require("fs");
+const mqtt = require("mqtt");
+
+const TRACE_CLOCK = 1;
+const TRACE_WEIGHT = 2;
+const TRACE_TEMPERATURE = 3;
+const TRACE_MQTT = 4;
+
+function connect() {
+  return mqtt.connect(process.env.MQTT_URL, {
+    username: process.env.MQTT_USERNAME,
+    password: process.env.MQTT_PASSWORD,
+  });
+}
+
+function decodeTrace(buffer) {
+  const records = [];
+  let offset = 0;
+  let anchor = null;
+  while (offset + 5 <= buffer.length) {
+    const kind = buffer.readUInt8(offset);
+    const ms = buffer.readUInt32LE(offset + 1);
+    const record = { ms };
+    let length;
+    switch (kind) {
+      case TRACE_CLOCK: {
+        const epochMs = Number(buffer.readBigInt64LE(offset + 5));
+        record.kind = "clock";
+        record.epochMs = epochMs;
+        if (epochMs !== 0) anchor = { ms, epochMs };
+        length = 13;
+        break;
+      }
+      case TRACE_WEIGHT:
+        record.kind = "weight";
+        record.scale = buffer.readUInt8(offset + 5);
+        record.counts = buffer.readInt32LE(offset + 6);
+        length = 10;
+        break;
+      case TRACE_TEMPERATURE:
+        record.kind = "temperature";
+        record.celsius = buffer.readFloatLE(offset + 5);
+        length = 9;
+        break;
+      case TRACE_MQTT: {
+        const topicLength = buffer.readUInt8(offset + 5);
+        const payloadLength = buffer.readUInt16LE(offset + 6);
+        const start = offset + 8;
+        record.kind = "mqtt";
+        record.topic = buffer.toString("utf8", start, start + topicLength);
+        record.payload = buffer.toString(
+          "utf8",
+          start + topicLength,
+          start + topicLength + payloadLength
+        );
+        length = 8 + topicLength + payloadLength;
+        break;
+      }
+      default:
+        throw new Error(`Unknown record kind ${kind} at byte ${offset}`);
+    }
+    if (anchor) {
+      // millis() is unsigned 32-bit and wraps after ~49 days.
+      const delta = (ms - anchor.ms) | 0;
+      record.at = new Date(anchor.epochMs + delta).toISOString();
+    }
+    records.push(record);
+    offset += length;
+  }
+  return records;
+}
+
+function dump(deviceId, file) {
+  const client = connect();
+  const stateTopic = `${deviceId}/0/trace/state`;
+  const dataTopic = `${deviceId}/0/trace/data`;
+  let expected = null;
+  const chunks = new Map();
+
+  const finish = () => {
+    const data = Buffer.concat(
+      [...chunks.keys()].sort((a, b) => a - b).map((seq) => chunks.get(seq))
+    );
+    fs.writeFileSync(file, data);
+    console.log(`Wrote ${data.length} of ${expected.bytes} bytes to ${file}`);
+    client.end();
+  };
+
+  client.on("message", (topic, payload) => {
+    if (topic === stateTopic) {
+      expected = JSON.parse(payload.toString()).message;
+      console.log(
+        `Trace: ${expected.bytes} bytes, ${expected.dropped} records dropped`
+      );
+      if (expected.chunks === 0) finish();
+      return;
+    }
+    chunks.set(payload.readUInt16LE(0), payload.subarray(4));
+    if (expected && chunks.size === expected.chunks) finish();
+  });
+
+  client.on("connect", async () => {
+    await client.subscribeAsync([stateTopic, dataTopic]);
+    client.publish(
+      `${deviceId}/0/trace`,
+      JSON.stringify({
+        message: { action: "dump" },
+        timestamp: new Date().toISOString(),
+      })
+    );
+    setTimeout(() => {
+      console.error("Timed out waiting for the trace");
+      process.exit(1);
+    }, 30000).unref();
+  });
+}
+
+async function replay(file, benchDeviceId, speed) {
+  const records = decodeTrace(fs.readFileSync(file));
+  // The dump request is itself traced, which names the recorded device.
+  const traceRequest = records
+    .filter((r) => r.kind === "mqtt" && r.topic.endsWith("/0/trace"))
+    .pop();
+  const recordedId = traceRequest ? traceRequest.topic.split("/")[0] : null;
+  const client = connect();
+  await new Promise((resolve) => client.once("connect", resolve));
+
+  const firstMs = records.length > 0 ? records[0].ms : 0;
+  const startedAt = Date.now();
+  for (const record of records) {
+    const dueAt = startedAt + ((record.ms - firstMs) | 0) / speed;
+    await new Promise((r) => setTimeout(r, Math.max(0, dueAt - Date.now())));
+    if (record.kind !== "mqtt") {
+      console.log(JSON.stringify(record));
+      continue;
+    }
+    // The recorded controller's own topics go to the bench controller;
+    // other nodes' topics (edge rule sources) are replayed as recorded.
+    const [owner, ...rest] = record.topic.split("/");
+    if (owner === recordedId && rest.join("/") === "0/trace") continue;
+    const topic =
+      owner === recordedId ? `${benchDeviceId}/${rest.join("/")}` : record.topic;
+    let payload = record.payload;
+    try {
+      const parsed = JSON.parse(payload);
+      if (typeof parsed.timestamp === "string") {
+        parsed.timestamp = new Date().toISOString();
+      }
+      payload = JSON.stringify(parsed);
+    } catch {
+      // Truncated payloads are sent as captured.
+    }
+    console.log(JSON.stringify({ ...record, topic, payload }));
+    client.publish(topic, payload);
+  }
+  await client.endAsync();
+}
+
+function main() {
+  const [command, ...args] = process.argv.slice(2);
+  if (command === "dump" && args.length === 2) {
+    dump(args[0], args[1]);
+  } else if (command === "decode" && args.length === 1) {
+    decodeTrace(fs.readFileSync(args[0])).forEach((record) =>
+      console.log(JSON.stringify(record))
+    );
+  } else if (command === "replay" && args.length >= 2) {
+    const speedIndex = args.indexOf("--speed");
+    const speed = speedIndex >= 0 ? Number(args[speedIndex + 1]) : 1;
+    replay(args[0], args[1], speed > 0 ? speed : 1);
+  } else {
+    console.error(
+      "Usage: traceTool.js dump <deviceId> <file> | decode <file> | replay <file> <benchDeviceId> [--speed n]"
+    );
+    process.exit(1);
+  }
+}
+
+if (require.main === module) {
+  main();
+}
+
+module.exports = { decodeTrace };
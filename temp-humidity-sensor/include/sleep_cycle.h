@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <wifi_cache.h>
+
+// Deep-sleep bookkeeping for the battery build, apart from the radio and
+// sensor code so it runs on the host against a simulated clock.
+
+// Survives deep sleep (but not power loss) so a timer wake can skip the
+// EEPROM read, DHCP, the channel scan and NTP.
+struct RtcState {
+  uint32_t magic;
+  uint16_t deviceSuffix;
+  unsigned long heartbeatIntervalSeconds;
+  time_t lastTimeSyncEpoch;
+  WiFiCache wifi;
+  uint32_t wakeCount;
+  unsigned long lastAwakeMs;
+};
+
+// Whether this boot may use `state`: only a timer wake that finds it
+// intact. A warm wake counts itself; any other boot clears it.
+bool rtcStateRestore(RtcState& state, bool timerWake);
+
+// Marks `state` intact just before sleeping, with the interval to wake on
+// and how long this wake was up.
+void rtcStateSave(RtcState& state, unsigned long heartbeatIntervalSeconds,
+                  unsigned long awakeMs);
+
+// NTP runs on every cold boot; a warm wake relies on the RTC until the
+// last sync is six hours old.
+bool rtcTimeSyncDue(const RtcState& state, bool warmWake, time_t now);
+
+// Sleep that puts the next wake one heartbeat after this one, given how
+// long this one has been up. Never less than a second.
+uint64_t sleepDurationUs(unsigned long heartbeatIntervalSeconds,
+                         unsigned long awakeMs);
+
+// Rough charge for one report: `awakeMs` at the active current plus the
+// sleep that follows it.
+float chargePerReportUah(unsigned long heartbeatIntervalSeconds,
+                         unsigned long awakeMs);
@@ -1,23 +1,41 @@
 #include <Adafruit_AHTX0.h>
 #include <Arduino.h>
 #include <ArduinoJson.h>
-#include <EEPROM.h>
 #include <LiquidCrystal_I2C.h>
 #include <PubSubClient.h>
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <Wire.h>
+#include <esp_sleep.h>
 #include <secrets.h>
 #include <time.h>
+#include <connectivity.h>
+#include <device_id.h>
+#include <device_log.h>
+#include <device_time.h>
+#include <json_publish.h>
+#include <mqtt_topics.h>
+#include <ota_update.h>
+
+#include "sleep_cycle.h"
+
+// Build with -DSENSOR_DEEP_SLEEP=1 (see the esp32dev-battery environment) to
+// deep-sleep between readings instead of holding Wi-Fi/MQTT open.
+#ifndef SENSOR_DEEP_SLEEP
+#define SENSOR_DEEP_SLEEP 0
+#endif
 
 namespace {
-constexpr int EEPROM_SIZE = 8;
 constexpr uint8_t AHT10_SCL_PIN = 27;
 constexpr uint8_t AHT10_SDA_PIN = 25;
 constexpr uint8_t COMPONENT_INDEX = 1;
 constexpr uint8_t LCD_I2C_ADDRESS = 0x27;
 constexpr uint8_t LCD_COLUMNS = 16;
 constexpr uint8_t LCD_ROWS = 2;
+// Drop back to 100000 if an LCD backpack garbles characters in fast mode.
+constexpr uint32_t I2C_CLOCK_HZ = 400000;
+// 4-bit mode: 2 nibbles x 3 expander writes x (address + data) per char/cmd.
+constexpr uint8_t LCD_I2C_BYTES_PER_WRITE = 12;
 
 constexpr unsigned long DEFAULT_HEARTBEAT_INTERVAL_SECONDS = 60;
 constexpr unsigned long MIN_HEARTBEAT_INTERVAL_SECONDS = 1;
@@ -27,11 +45,18 @@ constexpr char TOPIC_TYPE_STATUS[] = "status";
 constexpr char TOPIC_TYPE_CONFIG[] = "config";
 constexpr char TOPIC_TYPE_HEALTH[] = "controllerhealth";
 constexpr char TOPIC_ACTION_GET[] = "get";
+// Device-level, on component index 0 like the controller's.
+constexpr char TOPIC_TYPE_OTA[] = "ota";
 
 constexpr long GMT_OFFSET_SEC = 0;
 constexpr int DAYLIGHT_OFFSET_SEC = 0;
+
+constexpr bool DEEP_SLEEP_MODE = SENSOR_DEEP_SLEEP;
+constexpr unsigned long MQTT_DRAIN_WINDOW_MS = 300;
 }  // namespace
 
+RTC_DATA_ATTR RtcState rtcState;
+
 const char* ssid = WIFI_SSID;
 const char* password = WIFI_PASSWORD;
 
@@ -39,6 +64,21 @@ const char* mqttServer = MQTT_SERVER;
 const int mqttPort = MQTT_PORT;
 const char* mqttUser = MQTT_USERNAME;
 const char* mqttPassword = MQTT_PASSWORD;
+#ifdef MQTT_CA_CERT
+const char* mqttCaCert = MQTT_CA_CERT;
+#else
+const char* mqttCaCert = nullptr;
+#endif
+#ifdef OTA_CA_CERT
+const char* otaCaCert = OTA_CA_CERT;
+#else
+const char* otaCaCert = mqttCaCert;
+#endif
+#if MQTT_LAN_FAILOVER
+const char* mqttLanCaCert = MQTT_LAN_CA_CERT;
+const char* mqttLanUser = MQTT_LAN_USERNAME;
+const char* mqttLanPassword = MQTT_LAN_PASSWORD;
+#endif
 
 WiFiClientSecure wifiClient;
 PubSubClient mqttClient(wifiClient);
@@ -52,27 +92,23 @@ char topicConfig[96];
 char topicConfigGet[96];
 char topicConfigSet[96];
 char topicHealth[96];
+char topicOta[96];
+char topicOtaState[96];
 
 unsigned long heartbeatIntervalSeconds = DEFAULT_HEARTBEAT_INTERVAL_SECONDS;
 float lastTemperature = NAN;
 float lastHumidity = NAN;
-String lastReadingTimestamp = "unknown";
+char lastReadingTimestamp[32] = "unknown";
 
 unsigned long lastHeartbeatPublishAtMs = 0;
 
-uint16_t getOrCreateDeviceSuffix() {
-  uint16_t value;
-  EEPROM.begin(EEPROM_SIZE);
-  EEPROM.get(0, value);
+bool warmWake = false;
+unsigned long wakeToPublishMs = 0;
 
-  if (value == 0xFFFF || value == 0) {
-    value = static_cast<uint16_t>(esp_random());
-    EEPROM.put(0, value);
-    EEPROM.commit();
-  }
-
-  return value;
-}
+// Shadow of the LCD contents; updateLcd() only rewrites cells that differ.
+char lcdFrame[LCD_ROWS][LCD_COLUMNS];
+unsigned long lcdLastUpdateMicros = 0;
+unsigned long lcdLastUpdateI2cBytes = 0;
 
 unsigned long clampUnsignedLong(unsigned long value, unsigned long minValue,
                                 unsigned long maxValue) {
@@ -81,72 +117,39 @@ unsigned long clampUnsignedLong(unsigned long value, unsigned long minValue,
   return value;
 }
 
-String getCurrentTimestamp() {
-  struct tm timeInfo;
-  if (!getLocalTime(&timeInfo)) {
-    return "unknown";
+void restoreRtcState() {
+  warmWake = rtcStateRestore(
+      rtcState, DEEP_SLEEP_MODE &&
+                    esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER);
+  if (warmWake) {
+    heartbeatIntervalSeconds = rtcState.heartbeatIntervalSeconds;
   }
-
-  struct timeval now;
-  gettimeofday(&now, nullptr);
-
-  char buffer[32];
-  snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ",
-           timeInfo.tm_year + 1900, timeInfo.tm_mon + 1, timeInfo.tm_mday,
-           timeInfo.tm_hour, timeInfo.tm_min, timeInfo.tm_sec,
-           now.tv_usec / 1000);
-
-  return String(buffer);
 }
 
 void setDeviceId() {
-  const uint16_t suffix = getOrCreateDeviceSuffix();
+  const uint16_t suffix =
+      warmWake ? rtcState.deviceSuffix : getOrCreateDeviceSuffix();
+  rtcState.deviceSuffix = suffix;
   snprintf(deviceId, sizeof(deviceId), "esp32-%04X", suffix);
-  Serial.print("deviceId: ");
-  Serial.println(deviceId);
+  LOG_INFO("deviceId: %s", deviceId);
 }
 
 void buildTopics() {
-  snprintf(topicStatus, sizeof(topicStatus), "%s/%u/%s", deviceId,
-           COMPONENT_INDEX, TOPIC_TYPE_STATUS);
-  snprintf(topicStatusGet, sizeof(topicStatusGet), "%s/%u/%s/%s", deviceId,
-           COMPONENT_INDEX, TOPIC_TYPE_STATUS, TOPIC_ACTION_GET);
-  snprintf(topicConfig, sizeof(topicConfig), "%s/%u/%s", deviceId,
-           COMPONENT_INDEX, TOPIC_TYPE_CONFIG);
-  snprintf(topicConfigGet, sizeof(topicConfigGet), "%s/%u/%s/%s", deviceId,
-           COMPONENT_INDEX, TOPIC_TYPE_CONFIG, TOPIC_ACTION_GET);
-  snprintf(topicConfigSet, sizeof(topicConfigSet), "%s/%u/%s/set", deviceId,
-           COMPONENT_INDEX, TOPIC_TYPE_CONFIG);
-  snprintf(topicHealth, sizeof(topicHealth), "%s/%u/%s", deviceId,
-           COMPONENT_INDEX, TOPIC_TYPE_HEALTH);
-}
-
-bool publishJson(const char* topic, JsonDocument& doc, bool retain = true) {
-  doc["timestamp"] = getCurrentTimestamp();
-
-  char payload[384];
-  const size_t payloadLength = serializeJson(doc, payload, sizeof(payload));
-  if (payloadLength == 0 || payloadLength >= sizeof(payload) - 1) {
-    Serial.print("Message too large to serialize safely [");
-    Serial.print(topic);
-    Serial.println("]");
-    return false;
-  }
-
-  const bool published = mqttClient.publish(topic, payload, retain);
-  if (published) {
-    Serial.print("Message PUBLISHED [");
-    Serial.print(topic);
-    Serial.print("]: ");
-    Serial.println(String(payload));
-  } else {
-    Serial.print("Message failed to publish [");
-    Serial.print(topic);
-    Serial.print("] payloadLength=");
-    Serial.println(payloadLength);
-  }
-
-  return published;
+  buildTopic(topicStatus, sizeof(topicStatus), deviceId, COMPONENT_INDEX,
+             TOPIC_TYPE_STATUS);
+  buildTopic(topicStatusGet, sizeof(topicStatusGet), deviceId,
+             COMPONENT_INDEX, TOPIC_TYPE_STATUS, TOPIC_ACTION_GET);
+  buildTopic(topicConfig, sizeof(topicConfig), deviceId, COMPONENT_INDEX,
+             TOPIC_TYPE_CONFIG);
+  buildTopic(topicConfigGet, sizeof(topicConfigGet), deviceId,
+             COMPONENT_INDEX, TOPIC_TYPE_CONFIG, TOPIC_ACTION_GET);
+  buildTopic(topicConfigSet, sizeof(topicConfigSet), deviceId,
+             COMPONENT_INDEX, TOPIC_TYPE_CONFIG, "set");
+  buildTopic(topicHealth, sizeof(topicHealth), deviceId, COMPONENT_INDEX,
+             TOPIC_TYPE_HEALTH);
+  buildTopic(topicOta, sizeof(topicOta), deviceId, 0, TOPIC_TYPE_OTA);
+  buildTopic(topicOtaState, sizeof(topicOtaState), deviceId, 0, TOPIC_TYPE_OTA,
+             "state");
 }
 
 void publishConfig() {
@@ -160,7 +163,7 @@ void publishConfig() {
   message["heartbeatIntervalDefaultSeconds"] =
       DEFAULT_HEARTBEAT_INTERVAL_SECONDS;
 
-  publishJson(topicConfig, doc, true);
+  publishJson(mqttClient, topicConfig, doc, true);
 }
 
 void publishHealth() {
@@ -172,8 +175,19 @@ void publishHealth() {
   message["online"] = true;
   message["lastReadingAt"] = lastReadingTimestamp;
   message["heartbeatIntervalSeconds"] = heartbeatIntervalSeconds;
+  message["mqttConnectMs"] = lastMqttConnectMs();
+  message["mqttConnectCount"] = mqttConnectCount();
+  message["lcdUpdateMicros"] = lcdLastUpdateMicros;
+  message["lcdUpdateI2cBytes"] = lcdLastUpdateI2cBytes;
+  if (DEEP_SLEEP_MODE) {
+    message["wakeCount"] = rtcState.wakeCount;
+    message["wakeToPublishMs"] = wakeToPublishMs;
+    message["lastAwakeMs"] = rtcState.lastAwakeMs;
+    message["chargePerReportUah"] =
+        chargePerReportUah(heartbeatIntervalSeconds, rtcState.lastAwakeMs);
+  }
 
-  publishJson(topicHealth, doc, true);
+  publishJson(mqttClient, topicHealth, doc, true);
 }
 
 void publishStatus(bool retain = false) {
@@ -189,19 +203,47 @@ void publishStatus(bool retain = false) {
   message["humidity"] = lastHumidity;
   message["heartbeatIntervalSeconds"] = heartbeatIntervalSeconds;
 
-  publishJson(topicStatus, doc, retain);
+  publishJson(mqttClient, topicStatus, doc, retain);
+}
+
+void invalidateLcdFrame() {
+  memset(lcdFrame, 0, sizeof(lcdFrame));
+}
+
+void renderLcdRow(uint8_t row, const char* text, unsigned long& i2cWrites) {
+  char padded[LCD_COLUMNS + 1];
+  snprintf(padded, sizeof(padded), "%-16.16s", text);
+
+  uint8_t column = 0;
+  while (column < LCD_COLUMNS) {
+    if (lcdFrame[row][column] == padded[column]) {
+      ++column;
+      continue;
+    }
+
+    // One cursor move per dirty run; the HD44780 auto-increments.
+    lcd.setCursor(column, row);
+    ++i2cWrites;
+    while (column < LCD_COLUMNS && lcdFrame[row][column] != padded[column]) {
+      lcd.write(padded[column]);
+      lcdFrame[row][column] = padded[column];
+      ++i2cWrites;
+      ++column;
+    }
+  }
 }
 
 void updateLcd(const char* line1, const char* line2) {
-  char paddedLine1[17];
-  char paddedLine2[17];
-  snprintf(paddedLine1, sizeof(paddedLine1), "%-16.16s", line1);
-  snprintf(paddedLine2, sizeof(paddedLine2), "%-16.16s", line2);
-
-  lcd.setCursor(0, 0);
-  lcd.print(paddedLine1);
-  lcd.setCursor(0, 1);
-  lcd.print(paddedLine2);
+  const unsigned long startedAt = micros();
+  unsigned long i2cWrites = 0;
+
+  renderLcdRow(0, line1, i2cWrites);
+  renderLcdRow(1, line2, i2cWrites);
+
+  if (i2cWrites > 0) {
+    lcdLastUpdateMicros = micros() - startedAt;
+    lcdLastUpdateI2cBytes = i2cWrites * LCD_I2C_BYTES_PER_WRITE;
+  }
 }
 
 void updateLcdWithReading() {
@@ -225,14 +267,14 @@ bool readSensor() {
 
   if (isnan(temperatureEvent.temperature) ||
       isnan(humidityEvent.relative_humidity)) {
-    Serial.println("AHT10 read failed");
+    LOG_WARN("AHT10 read failed");
     updateLcdWithReading();
     return false;
   }
 
   lastTemperature = temperatureEvent.temperature;
   lastHumidity = humidityEvent.relative_humidity;
-  lastReadingTimestamp = getCurrentTimestamp();
+  formatCurrentTimestamp(lastReadingTimestamp, sizeof(lastReadingTimestamp));
   updateLcdWithReading();
   return true;
 }
@@ -242,45 +284,30 @@ void publishCurrentReading(bool refreshSensor) {
     return;
   }
 
+  wakeToPublishMs = millis();
   publishStatus(false);
   publishHealth();
 }
 
-void connectWiFi() {
-  Serial.print("Connecting to WiFi...");
-  updateLcd("WiFi connecting", "Please wait...");
-  WiFi.begin(ssid, password);
-
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(1000);
-    Serial.print(".");
-  }
+void showWiFiRetry() {
+  updateLcd("WiFi connecting", "Still trying...");
+}
 
-  Serial.println("\nWiFi connected!");
-  Serial.print("IP Address: ");
-  Serial.println(WiFi.localIP());
+void reconnectWiFi() {
+  updateLcd("WiFi connecting", "Please wait...");
+  connectWiFi(ssid, password, DEEP_SLEEP_MODE ? &rtcState.wifi : nullptr,
+              showWiFiRetry);
   updateLcd("WiFi connected", WiFi.localIP().toString().c_str());
 }
 
-void syncTime() {
-  configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, "pool.ntp.org");
-  struct tm timeInfo;
-  while (!getLocalTime(&timeInfo)) {
-    Serial.println("Waiting for NTP time");
-    delay(500);
-  }
-  Serial.println("Time synchronized:");
-  Serial.println(&timeInfo, "%Y-%m-%d %H:%M:%S");
+void syncClock() {
+  syncTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC);
+  rtcState.lastTimeSyncEpoch = time(nullptr);
 }
 
-void testDNS() {
-  Serial.println("\nTesting DNS resolution for MQTT server...");
-  IPAddress resolvedIP;
-  if (WiFi.hostByName(mqttServer, resolvedIP)) {
-    Serial.print("DNS resolved: ");
-    Serial.println(resolvedIP);
-  } else {
-    Serial.println("DNS resolution failed!");
+void syncTimeIfStale() {
+  if (rtcTimeSyncDue(rtcState, warmWake, time(nullptr))) {
+    syncClock();
   }
 }
 
@@ -308,78 +335,81 @@ void onConfigMessage(const JsonDocument& doc) {
 }
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  Serial.print("Message RECEIVED [");
-  Serial.print(topic);
-  Serial.print("]: ");
-
   if (strcmp(topic, topicConfigGet) == 0) {
-    Serial.println("(config get request)");
+    LOG_DEBUG("Message RECEIVED [%s]: (config get request)", topic);
     publishConfig();
     return;
   }
 
   if (strcmp(topic, topicStatusGet) == 0) {
-    Serial.println("(status get request)");
+    LOG_DEBUG("Message RECEIVED [%s]: (status get request)", topic);
     publishCurrentReading(true);
     return;
   }
 
-  String message;
-  message.reserve(length);
-  for (unsigned int i = 0; i < length; ++i) {
-    message += static_cast<char>(payload[i]);
-  }
-  Serial.println(message);
+  LOG_DEBUG("Message RECEIVED [%s]: %.*s", topic, (int)length,
+            (const char*)payload);
 
   JsonDocument doc;
-  const DeserializationError error = deserializeJson(doc, message);
+  const DeserializationError error = deserializeJson(doc, payload, length);
   if (error) {
-    Serial.print("deserializeJson() failed: ");
-    Serial.println(error.c_str());
+    LOG_WARN("deserializeJson() failed: %s", error.c_str());
     return;
   }
 
   if (strcmp(topic, topicConfigSet) == 0) {
     onConfigMessage(doc);
+  } else if (strcmp(topic, topicOta) == 0) {
+    otaHandleMessage(mqttClient, topicOtaState, doc["message"], otaCaCert);
   }
 }
 
-void connectMQTT() {
-  while (!mqttClient.connected()) {
-    Serial.println("Attempting MQTT connection...");
-    updateLcd("MQTT connecting", deviceId);
-    if (mqttClient.connect(deviceId, mqttUser, mqttPassword)) {
-      mqttClient.subscribe(topicConfigSet);
-      Serial.print("MQTT subscribed to ");
-      Serial.println(topicConfigSet);
-      mqttClient.subscribe(topicConfigGet);
-      Serial.print("MQTT subscribed to ");
-      Serial.println(topicConfigGet);
-      mqttClient.subscribe(topicStatusGet);
-      Serial.print("MQTT subscribed to ");
-      Serial.println(topicStatusGet);
-      Serial.println("MQTT connected!");
-      updateLcd("MQTT connected", "Syncing state...");
-      publishConfig();
-      publishHealth();
-      if (!isnan(lastTemperature) && !isnan(lastHumidity)) {
-        publishStatus(false);
-      }
-      return;
-    }
+void showMqttRetry() {
+  updateLcd("MQTT failed", "Retrying...");
+}
 
-    Serial.print("failed. mqttClientState = ");
-    Serial.println(mqttClient.state());
-    updateLcd("MQTT failed", "Retrying...");
-    delay(1000);
+void reconnectMQTT() {
+  updateLcd("MQTT connecting", deviceId);
+  // In deep-sleep mode the session is persistent: the broker queues QoS 1
+  // config messages while the node sleeps and delivers them on the next wake.
+  connectMQTT(mqttClient, {deviceId, mqttUser, mqttPassword, !DEEP_SLEEP_MODE},
+              showMqttRetry);
+  // Failover state does not survive deep sleep, so a sleeping node never
+  // sees a switch; it tries the primary first on every wake instead.
+  const bool brokerSwitched = mqttBrokerSwitched();
+  if (brokerSwitched) {
+    publishConfig();
+  }
+
+  const uint8_t subscribeQos = DEEP_SLEEP_MODE ? 1 : 0;
+  // The ota request is retained, so a sleeping node picks it up within the
+  // drain window of its next wake.
+  const char* topics[] = {topicConfigSet, topicConfigGet, topicStatusGet,
+                          topicOta};
+  for (const char* topic : topics) {
+    mqttClient.subscribe(topic, subscribeQos);
+    LOG_DEBUG("MQTT subscribed to %s", topic);
+  }
+  updateLcd("MQTT connected", "Syncing state...");
+  if (warmWake) {
+    return;
+  }
+  otaPublishRunning(mqttClient, topicOtaState);
+  if (!brokerSwitched) {
+    publishConfig();
+  }
+  publishHealth();
+  if (!isnan(lastTemperature) && !isnan(lastHumidity)) {
+    publishStatus(false);
   }
 }
 
 void setupSensor() {
   if (!aht.begin(&Wire)) {
-    Serial.println("Failed to initialize AHT10 sensor");
+    LOG_ERROR("Failed to initialize AHT10 sensor");
     lcd.init();
     lcd.backlight();
+    invalidateLcdFrame();
     updateLcd("AHT10 init fail", "Check wiring");
     while (true) {
       delay(1000);
@@ -389,37 +419,92 @@ void setupSensor() {
 
 void setupLcd() {
   lcd.init();
-  lcd.backlight();
+  if (DEEP_SLEEP_MODE) {
+    lcd.noBacklight();
+  } else {
+    lcd.backlight();
+  }
+  invalidateLcdFrame();
   updateLcd("ESP32 climate", "Starting...");
 }
 
 void setupI2c() {
   Wire.begin(AHT10_SDA_PIN, AHT10_SCL_PIN);
-  Serial.print("I2C initialized. SDA=");
-  Serial.print(AHT10_SDA_PIN);
-  Serial.print(" SCL=");
-  Serial.println(AHT10_SCL_PIN);
+  Wire.setClock(I2C_CLOCK_HZ);
+  LOG_INFO("I2C initialized. SDA=%u SCL=%u clock=%lu", AHT10_SDA_PIN,
+           AHT10_SCL_PIN, (unsigned long)I2C_CLOCK_HZ);
+}
+
+void enterDeepSleep() {
+  // Let the broker deliver anything queued for the persistent session.
+  const unsigned long drainStartedAt = millis();
+  while (millis() - drainStartedAt < MQTT_DRAIN_WINDOW_MS) {
+    mqttClient.loop();
+    delay(10);
+  }
+  mqttClient.disconnect();
+
+  rtcStateSave(rtcState, heartbeatIntervalSeconds, millis());
+  const uint64_t sleepUs =
+      sleepDurationUs(heartbeatIntervalSeconds, rtcState.lastAwakeMs);
+
+  LOG_INFO("Sleeping for %lums after %lums awake",
+           static_cast<unsigned long>(sleepUs / 1000), rtcState.lastAwakeMs);
+  logFlush();
+  WiFi.disconnect(true);
+  esp_sleep_enable_timer_wakeup(sleepUs);
+  esp_deep_sleep_start();
+}
+
+void runDutyCycle() {
+  reconnectWiFi();
+  syncTimeIfStale();
+
+  mqttClient.setServer(mqttServer, mqttPort);
+  mqttClient.setCallback(mqttCallback);
+  mqttClient.setBufferSize(MQTT_PACKET_BUFFER_SIZE);
+#if MQTT_LAN_FAILOVER
+  mqttFailoverBegin(mqttClient, wifiClient, mqttServer, mqttPort,
+                    {mqttLanCaCert, mqttLanUser, mqttLanPassword});
+#endif
+  reconnectMQTT();
+
+  publishCurrentReading(true);
+  enterDeepSleep();
 }
 
 void setup() {
   Serial.begin(115200);
+  logBegin();
 
+  restoreRtcState();
   setDeviceId();
   buildTopics();
   setupI2c();
   setupLcd();
   setupSensor();
 
-  wifiClient.setInsecure();
+  configureTls(wifiClient, mqttCaCert);
+
+  if (DEEP_SLEEP_MODE) {
+    WiFi.persistent(false);
+    runDutyCycle();
+    return;
+  }
 
   updateLcd("Starting WiFi", deviceId);
-  connectWiFi();
+  reconnectWiFi();
   updateLcd("Syncing time", "Please wait...");
-  syncTime();
+  syncClock();
 
   mqttClient.setServer(mqttServer, mqttPort);
   mqttClient.setCallback(mqttCallback);
-  mqttClient.setBufferSize(512);
+  mqttClient.setBufferSize(MQTT_PACKET_BUFFER_SIZE);
+#if MQTT_LAN_FAILOVER
+  mqttFailoverBegin(mqttClient, wifiClient, mqttServer, mqttPort,
+                    {mqttLanCaCert, mqttLanUser, mqttLanPassword});
+  mqttDiscoverLanBroker();
+#endif
 
   publishCurrentReading(true);
   lastHeartbeatPublishAtMs = millis();
@@ -427,16 +512,19 @@ void setup() {
 
 void loop() {
   if (WiFi.status() != WL_CONNECTED) {
-    connectWiFi();
-    syncTime();
+    reconnectWiFi();
+    syncClock();
   }
 
   if (!mqttClient.connected()) {
-    testDNS();
-    connectMQTT();
+    testDNS(mqttServer);
+    reconnectMQTT();
   }
 
   mqttClient.loop();
+#if MQTT_LAN_FAILOVER
+  mqttFailbackDue();
+#endif
 
   const unsigned long now = millis();
   const unsigned long heartbeatIntervalMs = heartbeatIntervalSeconds * 1000UL;
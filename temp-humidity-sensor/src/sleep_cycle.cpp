@@ -0,0 +1,54 @@
+#include "sleep_cycle.h"
+
+#include <string.h>
+
+namespace {
+constexpr uint32_t RTC_STATE_MAGIC = 0x54485331;  // "THS1"
+// The RTC timer keeps wall time through deep sleep but drifts; resync
+// with NTP once the last sync is older than this.
+constexpr time_t TIME_RESYNC_INTERVAL_SECONDS = 6 * 3600;
+constexpr unsigned long MIN_SLEEP_MS = 1000;
+// Rough ESP32 DevKit figures used for the per-report charge estimate.
+constexpr float ACTIVE_CURRENT_MA = 120.0f;
+constexpr float DEEP_SLEEP_CURRENT_UA = 150.0f;
+}  // namespace
+
+bool rtcStateRestore(RtcState& state, bool timerWake) {
+  if (!timerWake || state.magic != RTC_STATE_MAGIC) {
+    memset(&state, 0, sizeof(state));
+    return false;
+  }
+  ++state.wakeCount;
+  return true;
+}
+
+void rtcStateSave(RtcState& state, unsigned long heartbeatIntervalSeconds,
+                  unsigned long awakeMs) {
+  state.magic = RTC_STATE_MAGIC;
+  state.heartbeatIntervalSeconds = heartbeatIntervalSeconds;
+  state.lastAwakeMs = awakeMs;
+}
+
+bool rtcTimeSyncDue(const RtcState& state, bool warmWake, time_t now) {
+  return !warmWake || state.lastTimeSyncEpoch <= 0 ||
+         now - state.lastTimeSyncEpoch >= TIME_RESYNC_INTERVAL_SECONDS;
+}
+
+uint64_t sleepDurationUs(unsigned long heartbeatIntervalSeconds,
+                         unsigned long awakeMs) {
+  const uint64_t intervalMs =
+      static_cast<uint64_t>(heartbeatIntervalSeconds) * 1000ULL;
+  const uint64_t shortestMs = static_cast<uint64_t>(awakeMs) + MIN_SLEEP_MS;
+  const uint64_t sleepMs =
+      intervalMs > shortestMs ? intervalMs - awakeMs : MIN_SLEEP_MS;
+  return sleepMs * 1000ULL;
+}
+
+float chargePerReportUah(unsigned long heartbeatIntervalSeconds,
+                         unsigned long awakeMs) {
+  const float awakeUah = ACTIVE_CURRENT_MA * awakeMs / 3600.0f;
+  const float sleepUah =
+      DEEP_SLEEP_CURRENT_UA *
+      (sleepDurationUs(heartbeatIntervalSeconds, awakeMs) / 1e6f) / 3600.0f;
+  return awakeUah + sleepUah;
+}
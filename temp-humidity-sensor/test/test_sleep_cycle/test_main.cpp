@@ -0,0 +1,165 @@
+#include <unity.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sleep_cycle.h"
+
+// A battery node on a simulated clock. Each boot restores the RTC block
+// the previous one left, publishes `publishAfterMs` after reset, and sleeps
+// `awakeMs` after reset for sleepDurationUs(); wall time moves by nothing
+// else.
+const unsigned long INTERVAL_SECONDS = 300;
+const time_t FIRST_BOOT_EPOCH = 1704110400;  // 2024-01-01T12:00:00Z
+// A cold boot scans, takes a DHCP lease and syncs NTP; a warm one reuses
+// the cached association and lease.
+const unsigned long COLD_PUBLISH_MS = 4200;
+const unsigned long COLD_AWAKE_MS = 4600;
+const unsigned long WARM_PUBLISH_MS = 650;
+const unsigned long WARM_AWAKE_MS = 1000;
+
+RtcState rtc;  // RTC slow memory
+uint64_t wallMs = 0;
+
+struct Boot {
+  bool warm;
+  bool synced;
+  uint64_t wokeAtMs;
+  uint64_t publishedAtMs;
+};
+
+Boot boot(bool timerWake, unsigned long publishAfterMs,
+          unsigned long awakeMs) {
+  Boot result = {};
+  result.wokeAtMs = wallMs;
+  result.warm = rtcStateRestore(rtc, timerWake);
+  const time_t now = FIRST_BOOT_EPOCH + static_cast<time_t>(wallMs / 1000);
+  result.synced = rtcTimeSyncDue(rtc, result.warm, now);
+  if (result.synced) {
+    rtc.lastTimeSyncEpoch = now;
+  }
+  if (!result.warm) {
+    rtc.deviceSuffix = 0x82A3;
+    rtc.wifi.channel = 6;
+  }
+  result.publishedAtMs = wallMs + publishAfterMs;
+  rtcStateSave(rtc, INTERVAL_SECONDS, awakeMs);
+  wallMs += awakeMs + sleepDurationUs(INTERVAL_SECONDS, awakeMs) / 1000;
+  return result;
+}
+
+Boot coldBoot() {
+  return boot(false, COLD_PUBLISH_MS, COLD_AWAKE_MS);
+}
+
+Boot timerWake() {
+  return boot(true, WARM_PUBLISH_MS, WARM_AWAKE_MS);
+}
+
+void setUp() {
+  // RTC memory holds garbage after power-on.
+  memset(&rtc, 0xA5, sizeof(rtc));
+  wallMs = 0;
+}
+
+void tearDown() {}
+
+void test_power_on_clears_the_state() {
+  TEST_ASSERT_FALSE(rtcStateRestore(rtc, false));
+  const RtcState cleared = {};
+  TEST_ASSERT_EQUAL_MEMORY(&cleared, &rtc, sizeof(rtc));
+}
+
+void test_garbage_is_not_taken_for_a_warm_wake() {
+  // A timer wake cause with a block that was never saved.
+  TEST_ASSERT_FALSE(rtcStateRestore(rtc, true));
+  TEST_ASSERT_EQUAL_UINT32(0, rtc.wakeCount);
+}
+
+void test_warm_wakes_keep_and_count_the_state() {
+  TEST_ASSERT_FALSE(coldBoot().warm);
+  for (int i = 0; i < 5; i++) {
+    const Boot wake = timerWake();
+    TEST_ASSERT_TRUE(wake.warm);
+    TEST_ASSERT_FALSE(wake.synced);
+  }
+  TEST_ASSERT_EQUAL_UINT32(5, rtc.wakeCount);
+  TEST_ASSERT_EQUAL_HEX16(0x82A3, rtc.deviceSuffix);
+  TEST_ASSERT_EQUAL_INT32(6, rtc.wifi.channel);
+  TEST_ASSERT_EQUAL_UINT32(INTERVAL_SECONDS, rtc.heartbeatIntervalSeconds);
+  TEST_ASSERT_EQUAL_UINT32(WARM_AWAKE_MS, rtc.lastAwakeMs);
+
+  // A reset that is not a timer wake starts over.
+  const Boot reset = boot(false, COLD_PUBLISH_MS, COLD_AWAKE_MS);
+  TEST_ASSERT_FALSE(reset.warm);
+  TEST_ASSERT_TRUE(reset.synced);
+  TEST_ASSERT_EQUAL_UINT32(0, rtc.wakeCount);
+}
+
+void test_wakes_stay_one_interval_apart() {
+  // The slow cold boot does not push the warm wakes after it off schedule.
+  Boot previous = coldBoot();
+  uint64_t latencyMs = 0;
+  const int wakes = 24;
+  for (int i = 1; i <= wakes; i++) {
+    const Boot wake = timerWake();
+    TEST_ASSERT_EQUAL_UINT64(INTERVAL_SECONDS * 1000ULL,
+                             wake.wokeAtMs - previous.wokeAtMs);
+    latencyMs += wake.publishedAtMs - wake.wokeAtMs;
+    previous = wake;
+  }
+  TEST_ASSERT_EQUAL_UINT64(WARM_PUBLISH_MS, latencyMs / wakes);
+
+  char line[96];
+  snprintf(line, sizeof(line),
+           "wake-to-publish %lu ms, %.1f uAh per report (cold %.1f uAh)",
+           static_cast<unsigned long>(latencyMs / wakes),
+           chargePerReportUah(INTERVAL_SECONDS, WARM_AWAKE_MS),
+           chargePerReportUah(INTERVAL_SECONDS, COLD_AWAKE_MS));
+  TEST_MESSAGE(line);
+}
+
+void test_clock_resyncs_every_six_hours() {
+  TEST_ASSERT_TRUE(coldBoot().synced);
+  int syncs = 0;
+  // One day of five-minute wakes.
+  for (int i = 1; i <= 24 * 12; i++) {
+    const Boot wake = timerWake();
+    if (wake.synced) {
+      syncs++;
+      TEST_ASSERT_EQUAL_UINT64(0, wake.wokeAtMs % (6 * 3600 * 1000ULL));
+    }
+  }
+  TEST_ASSERT_EQUAL(4, syncs);
+}
+
+void test_a_wake_longer_than_the_interval_still_sleeps() {
+  TEST_ASSERT_EQUAL_UINT64(299000000ULL, sleepDurationUs(300, 1000));
+  TEST_ASSERT_EQUAL_UINT64(1000000ULL, sleepDurationUs(1, 2500));
+  TEST_ASSERT_EQUAL_UINT64(1000000ULL, sleepDurationUs(5, 4500));
+  // The longest interval does not overflow on the way to microseconds.
+  TEST_ASSERT_EQUAL_UINT64(5999000000ULL, sleepDurationUs(6000, 1000));
+}
+
+void test_charge_per_report() {
+  // 1 s at 120 mA plus 299 s at 150 uA.
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 33.33f + 12.46f,
+                           chargePerReportUah(300, 1000));
+  // Longer intervals cost more sleep but the same wake.
+  TEST_ASSERT_TRUE(chargePerReportUah(3600, 1000) >
+                   chargePerReportUah(300, 1000));
+  TEST_ASSERT_TRUE(chargePerReportUah(300, COLD_AWAKE_MS) >
+                   chargePerReportUah(300, WARM_AWAKE_MS));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_power_on_clears_the_state);
+  RUN_TEST(test_garbage_is_not_taken_for_a_warm_wake);
+  RUN_TEST(test_warm_wakes_keep_and_count_the_state);
+  RUN_TEST(test_wakes_stay_one_interval_apart);
+  RUN_TEST(test_clock_resyncs_every_six_hours);
+  RUN_TEST(test_a_wake_longer_than_the_interval_still_sleeps);
+  RUN_TEST(test_charge_per_report);
+  return UNITY_END();
+}